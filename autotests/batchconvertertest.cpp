@@ -0,0 +1,102 @@
+#include "batchconverter.h"
+
+#include <QFile>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+
+namespace {
+
+bool writeFile(const QString &path, const QByteArray &data) {
+  QFile file(path);
+  return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+QByteArray readFile(const QString &path) {
+  QFile file(path);
+  return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+} // namespace
+
+class BatchConverterTest : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void convertRtfToText();
+  void reportsFailures();
+  void convertsInParallel();
+};
+
+void BatchConverterTest::convertRtfToText() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  BatchConverter::Job job;
+  job.input = dir.filePath(QStringLiteral("note.rtf"));
+  job.output = dir.filePath(QStringLiteral("out/sub/note.txt"));
+  QVERIFY(writeFile(job.input, "{\\rtf1\\ansi Hello {\\b world}\\par Bye}"));
+
+  const BatchConverter::Result result =
+      BatchConverter::convert(job, DocumentIO::Format::PlainText);
+  QVERIFY2(result.ok, qPrintable(result.error));
+  QCOMPARE(readFile(job.output), QByteArray("Hello world\nBye"));
+  QCOMPARE(result.outputBytes, qint64(15));
+  QVERIFY(result.inputBytes > 0);
+}
+
+void BatchConverterTest::reportsFailures() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+
+  BatchConverter::Job missing;
+  missing.input = dir.filePath(QStringLiteral("missing.rtf"));
+  missing.output = dir.filePath(QStringLiteral("missing.html"));
+  BatchConverter::Result result =
+      BatchConverter::convert(missing, DocumentIO::Format::Html);
+  QVERIFY(!result.ok);
+  QVERIFY(!result.error.isEmpty());
+
+  BatchConverter::Job malformed;
+  malformed.input = dir.filePath(QStringLiteral("deep.rtf"));
+  malformed.output = dir.filePath(QStringLiteral("deep.html"));
+  QVERIFY(writeFile(malformed.input, QByteArray("{\\rtf1 ") +
+                                         QByteArray(5000, '{')));
+  result = BatchConverter::convert(malformed, DocumentIO::Format::Html);
+  QVERIFY(!result.ok);
+  QVERIFY(!result.error.isEmpty());
+  QVERIFY(!QFile::exists(malformed.output));
+}
+
+void BatchConverterTest::convertsInParallel() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+
+  QVector<BatchConverter::Job> jobs;
+  for (int i = 0; i < 12; ++i) {
+    BatchConverter::Job job;
+    job.input = dir.filePath(QStringLiteral("in%1.txt").arg(i));
+    job.output = dir.filePath(QStringLiteral("out/in%1.rtf").arg(i));
+    QVERIFY(writeFile(job.input, QByteArray::number(i)));
+    jobs.append(job);
+  }
+
+  BatchConverter converter(DocumentIO::Format::Rtf);
+  converter.setThreadCount(3);
+  QSignalSpy converted(&converter, &BatchConverter::converted);
+  QSignalSpy finished(&converter, &BatchConverter::finished);
+  converter.enqueue(jobs);
+  QVERIFY(finished.wait(10000));
+  QCOMPARE(converted.count(), jobs.size());
+  QCOMPARE(converter.pendingCount(), 0);
+
+  for (const BatchConverter::Job &job : std::as_const(jobs)) {
+    QVERIFY(readFile(job.output).startsWith("{\\rtf1"));
+  }
+}
+
+int runBatchConverterTest(int argc, char *argv[]) {
+  BatchConverterTest test;
+  return QTest::qExec(&test, argc, argv);
+}
+
+#include "batchconvertertest.moc"
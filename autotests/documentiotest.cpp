@@ -0,0 +1,64 @@
+#include "documentio.h"
+
+#include <QTest>
+#include <QTextDocument>
+
+class DocumentIOTest : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void detectFormat_data();
+  void detectFormat();
+  void formatForPath();
+  void plainTextRoundTrip();
+};
+
+void DocumentIOTest::detectFormat_data() {
+  QTest::addColumn<QByteArray>("data");
+  QTest::addColumn<int>("format");
+
+  QTest::newRow("rtf") << QByteArray("{\\rtf1\\ansi hello}")
+                       << int(DocumentIO::Format::Rtf);
+  QTest::newRow("rtf after whitespace")
+      << QByteArray("\r\n  {\\rtf1 hello}") << int(DocumentIO::Format::Rtf);
+  QTest::newRow("doctype") << QByteArray("<!DOCTYPE HTML><p>hi</p>")
+                           << int(DocumentIO::Format::Html);
+  QTest::newRow("html tag") << QByteArray("\n<Html><body>hi</body></Html>")
+                            << int(DocumentIO::Format::Html);
+  QTest::newRow("plain") << QByteArray("just some text")
+                         << int(DocumentIO::Format::PlainText);
+  QTest::newRow("brace only") << QByteArray("{ not rtf }")
+                              << int(DocumentIO::Format::PlainText);
+  QTest::newRow("empty") << QByteArray()
+                         << int(DocumentIO::Format::PlainText);
+}
+
+void DocumentIOTest::detectFormat() {
+  QFETCH(QByteArray, data);
+  QFETCH(int, format);
+  QCOMPARE(int(DocumentIO::detectFormat(data)), format);
+}
+
+void DocumentIOTest::formatForPath() {
+  QCOMPARE(int(DocumentIO::formatForPath(QStringLiteral("/tmp/a.txt"))),
+           int(DocumentIO::Format::PlainText));
+  QCOMPARE(int(DocumentIO::formatForPath(QStringLiteral("/tmp/a.RTF"))),
+           int(DocumentIO::Format::Rtf));
+  QCOMPARE(int(DocumentIO::formatForPath(QStringLiteral("/tmp/a.html"))),
+           int(DocumentIO::Format::Html));
+}
+
+void DocumentIOTest::plainTextRoundTrip() {
+  const QByteArray text("first line\nsecond line \xc3\xa9");
+  QTextDocument doc;
+  QVERIFY(DocumentIO::read(text, DocumentIO::Format::PlainText, &doc));
+  QCOMPARE(doc.blockCount(), 2);
+  QCOMPARE(DocumentIO::write(&doc, DocumentIO::Format::PlainText), text);
+}
+
+int runDocumentIOTest(int argc, char *argv[]) {
+  DocumentIOTest test;
+  return QTest::qExec(&test, argc, argv);
+}
+
+#include "documentiotest.moc"
@@ -0,0 +1,115 @@
+#include "filesearch.h"
+
+#include <QTest>
+
+class FileSearchTest : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void findsAtEveryOffset();
+  void findsInLastSixteenBytes();
+  void findsOneByteNeedle();
+  void foldsAsciiCase();
+  void fallsBackToMemchr();
+};
+
+namespace {
+
+qint64 find(const LiteralMatcher &matcher, const QByteArray &data,
+            qint64 from = 0) {
+  return matcher.find(data.constData(), data.size(), from);
+}
+
+// The needle at position in filler, in a buffer of exactly size bytes
+QByteArray placed(const QByteArray &needle, int position, int size) {
+  QByteArray data(size, 'x');
+  data.replace(position, needle.size(), needle);
+  return data;
+}
+
+} // namespace
+
+void FileSearchTest::findsAtEveryOffset() {
+  // Offsets on both sides of each 16-byte step, for both matching paths
+  const QByteArray needle("needle");
+  const LiteralMatcher sensitive(needle, true);
+  const LiteralMatcher insensitive(needle, false);
+  for (int size = needle.size(); size <= 70; ++size) {
+    for (int position = 0; position + needle.size() <= size; ++position) {
+      const QByteArray data = placed(needle, position, size);
+      QCOMPARE(find(sensitive, data), qint64(position));
+      QCOMPARE(find(insensitive, data), qint64(position));
+    }
+  }
+}
+
+void FileSearchTest::findsInLastSixteenBytes() {
+  // The vector loop stops 16 starts short of the end; the rest is scalar
+  const QByteArray needle("abc");
+  const LiteralMatcher matcher(needle, true);
+  const int size = 100;
+  const int lastStart = size - needle.size();
+  for (int position = lastStart - 16; position <= lastStart; ++position) {
+    QCOMPARE(find(matcher, placed(needle, position, size)), qint64(position));
+  }
+
+  // A first byte near the end without room for the rest is no match
+  QByteArray truncated(size, 'x');
+  truncated[size - 2] = 'a';
+  truncated[size - 1] = 'b';
+  QCOMPARE(find(matcher, truncated), qint64(-1));
+}
+
+void FileSearchTest::findsOneByteNeedle() {
+  const LiteralMatcher sensitive(QByteArray("q"), true);
+  const LiteralMatcher insensitive(QByteArray("q"), false);
+  for (int position = 0; position < 40; ++position) {
+    const QByteArray data = placed(QByteArray("Q"), position, 40);
+    QCOMPARE(find(sensitive, data), qint64(-1));
+    QCOMPARE(find(insensitive, data), qint64(position));
+  }
+
+  const QByteArray repeated(40, 'q');
+  QCOMPARE(find(sensitive, repeated, 17), qint64(17));
+  QCOMPARE(find(sensitive, repeated, 39), qint64(39));
+  QCOMPARE(find(sensitive, repeated, 40), qint64(-1));
+}
+
+void FileSearchTest::foldsAsciiCase() {
+  const LiteralMatcher insensitive(QByteArray("HeLLo"), false);
+  const LiteralMatcher sensitive(QByteArray("HeLLo"), true);
+  const QByteArray data = QByteArray(32, '-') + "say hello, HELLO and HeLLo";
+
+  QCOMPARE(find(insensitive, data), qint64(36));
+  QCOMPARE(find(insensitive, data, 37), qint64(43));
+  QCOMPARE(find(sensitive, data), qint64(53));
+
+  // First and last bytes match, the middle does not
+  QCOMPARE(find(insensitive, QByteArray(32, '-') + "hxllo"), qint64(-1));
+
+  // Only ASCII is folded; other bytes must match exactly
+  const LiteralMatcher accented(QByteArray("\xc3\xa9t\xc3\xa9"), false);
+  QCOMPARE(find(accented, QByteArray(20, '-') + "\xc3\x89T\xc3\x89"),
+           qint64(-1));
+  QCOMPARE(find(accented, QByteArray(20, '-') + "\xc3\xa9T\xc3\xa9"),
+           qint64(20));
+}
+
+void FileSearchTest::fallsBackToMemchr() {
+  // Shorter than one vector step: only the memchr loop runs
+  const LiteralMatcher matcher(QByteArray("needle"), true);
+  const QByteArray data("nnneedneedle");
+  QVERIFY(data.size() < 16 + 6);
+  QCOMPARE(find(matcher, data), qint64(6));
+  QCOMPARE(find(matcher, data, 7), qint64(-1));
+  QCOMPARE(find(matcher, QByteArray("needl")), qint64(-1));
+  QCOMPARE(find(matcher, QByteArray("nnnnnnnnnnn")), qint64(-1));
+  QCOMPARE(find(matcher, data, -1), qint64(-1));
+}
+
+int runFileSearchTest(int argc, char *argv[]) {
+  FileSearchTest test;
+  return QTest::qExec(&test, argc, argv);
+}
+
+#include "filesearchtest.moc"
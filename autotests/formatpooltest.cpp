@@ -0,0 +1,99 @@
+#include "formatpool.h"
+#include "rtfhandler.h"
+
+#include <QTest>
+#include <QTextBlock>
+#include <QTextDocument>
+
+class FormatPoolTest : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void init();
+  void cleanup();
+  void internsFamilies();
+  void internsFormats();
+  void disabledPassesThrough();
+  void documentsShareFamilies();
+};
+
+namespace {
+
+// Built at run time, so that equal names do not share literal data
+QTextCharFormat boldFormat(const char *family) {
+  QTextCharFormat format;
+  format.setFontWeight(QFont::Bold);
+  format.setFontFamilies({QString::fromLatin1(family)});
+  format.setForeground(QColor(200, 0, 0));
+  return format;
+}
+
+const QChar *familyData(const QTextFormat &format) {
+  return format.property(QTextFormat::FontFamilies)
+      .toStringList()
+      .value(0)
+      .constData();
+}
+
+} // namespace
+
+// Other tests fill the pool as well
+void FormatPoolTest::init() { FormatPool::instance().clear(); }
+
+void FormatPoolTest::cleanup() { FormatPool::setEnabled(true); }
+
+void FormatPoolTest::internsFamilies() {
+  FormatPool &pool = FormatPool::instance();
+  const QString first = pool.family(QString::fromLatin1("Arial"));
+  const QString second = pool.family(QString::fromLatin1("Arial"));
+  QCOMPARE(first, second);
+  QCOMPARE(first.constData(), second.constData());
+  QCOMPARE(pool.stats().families, 1);
+}
+
+void FormatPoolTest::internsFormats() {
+  FormatPool &pool = FormatPool::instance();
+  const QTextCharFormat first = pool.charFormat(boldFormat("Arial"));
+  const QTextCharFormat second = pool.charFormat(boldFormat("Arial"));
+  QCOMPARE(first, second);
+  QCOMPARE(familyData(first), familyData(second));
+  QVERIFY(pool.charFormat(boldFormat("Courier")) != first);
+
+  const FormatPool::Stats stats = pool.stats();
+  QCOMPARE(stats.formats, 2);
+  QCOMPARE(stats.lookups, quint64(3));
+  QCOMPARE(stats.hits, quint64(1));
+}
+
+void FormatPoolTest::disabledPassesThrough() {
+  FormatPool::setEnabled(false);
+  const QTextCharFormat first =
+      FormatPool::instance().charFormat(boldFormat("Arial"));
+  const QTextCharFormat second =
+      FormatPool::instance().charFormat(boldFormat("Arial"));
+  QCOMPARE(first, second);
+  QVERIFY(familyData(first) != familyData(second));
+  QCOMPARE(FormatPool::instance().stats().lookups, quint64(0));
+}
+
+void FormatPoolTest::documentsShareFamilies() {
+  const QByteArray rtf("{\\rtf1\\ansi{\\fonttbl{\\f0 Georgia;}}"
+                       "\\f0\\b Shared\\b0  family\\par}");
+  QTextDocument first;
+  QTextDocument second;
+  QVERIFY(RtfHandler::readRtf(rtf, &first));
+  QVERIFY(RtfHandler::readRtf(rtf, &second));
+
+  const QTextCharFormat a = first.begin().begin().fragment().charFormat();
+  const QTextCharFormat b = second.begin().begin().fragment().charFormat();
+  QCOMPARE(a.fontFamilies().toStringList(),
+           QStringList() << QStringLiteral("Georgia"));
+  QCOMPARE(familyData(a), familyData(b));
+}
+
+int runFormatPoolTest(int argc, char *argv[]) {
+  FormatPoolTest test;
+  return QTest::qExec(&test, argc, argv);
+}
+
+#include "formatpooltest.moc"
@@ -0,0 +1,32 @@
+#include <QApplication>
+
+int runBatchConverterTest(int argc, char *argv[]);
+int runDocumentIOTest(int argc, char *argv[]);
+int runFileSearchTest(int argc, char *argv[]);
+int runFormatPoolTest(int argc, char *argv[]);
+int runRtfHandlerTest(int argc, char *argv[]);
+int runSessionStoreTest(int argc, char *argv[]);
+int runStallWatchdogTest(int argc, char *argv[]);
+int runTraceTest(int argc, char *argv[]);
+int runUndoManagerTest(int argc, char *argv[]);
+
+// One executable for all test classes; DocumentTab needs a QApplication,
+// which QTest::qExec cannot create more than once
+int main(int argc, char *argv[]) {
+  if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+  QApplication app(argc, argv);
+
+  int failures = 0;
+  failures += runBatchConverterTest(argc, argv);
+  failures += runDocumentIOTest(argc, argv);
+  failures += runFileSearchTest(argc, argv);
+  failures += runFormatPoolTest(argc, argv);
+  failures += runRtfHandlerTest(argc, argv);
+  failures += runSessionStoreTest(argc, argv);
+  failures += runStallWatchdogTest(argc, argv);
+  failures += runTraceTest(argc, argv);
+  failures += runUndoManagerTest(argc, argv);
+  return failures;
+}
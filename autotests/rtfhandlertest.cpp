@@ -0,0 +1,300 @@
+#include "codepagedecoder.h"
+#include "rtfhandler.h"
+
+#include <QTest>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextList>
+
+namespace {
+
+// Format of the character at position, not the one before it
+QTextCharFormat formatAt(QTextDocument &doc, int position) {
+  QTextCursor cursor(&doc);
+  cursor.setPosition(position + 1);
+  return cursor.charFormat();
+}
+
+} // namespace
+
+class RtfHandlerTest : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void readFormatting();
+  void readEscapes();
+  void readSkipsDestinations();
+  void readCodePages();
+  void readDoubleByte();
+  void rejectsNonRtf();
+  void roundTrip();
+  void readLegacyList();
+  void readListTable();
+  void roundTripLists();
+  void limits_data();
+  void limits();
+};
+
+void RtfHandlerTest::readFormatting() {
+  const QByteArray rtf("{\\rtf1\\ansi{\\fonttbl{\\f0 Arial;}}"
+                       "{\\colortbl;\\red255\\green0\\blue0;}"
+                       "\\f0\\fs24 plain \\b bold\\b0  \\i italic\\i0\\par "
+                       "\\cf1 red}");
+  QTextDocument doc;
+  QVERIFY(RtfHandler::readRtf(rtf, &doc));
+  QCOMPARE(doc.toPlainText(), QStringLiteral("plain bold italic\nred"));
+
+  QCOMPARE(formatAt(doc, 0).fontWeight(), int(QFont::Normal));
+  QCOMPARE(formatAt(doc, 6).fontWeight(), int(QFont::Bold));
+  QVERIFY(formatAt(doc, 10).fontWeight() != int(QFont::Bold));
+  QVERIFY(!formatAt(doc, 10).fontItalic());
+  QVERIFY(formatAt(doc, 11).fontItalic());
+  QCOMPARE(formatAt(doc, 0).fontPointSize(), 12.0);
+  QCOMPARE(formatAt(doc, 0).fontFamilies().toStringList().value(0),
+           QStringLiteral("Arial"));
+  QCOMPARE(formatAt(doc, 18).foreground().color(), QColor(255, 0, 0));
+}
+
+void RtfHandlerTest::readEscapes() {
+  const QByteArray rtf("{\\rtf1\\ansi caf\\u233?\\par na\\'efve\\~x "
+                       "\\{braces\\} back\\\\slash}");
+  QTextDocument doc;
+  QVERIFY(RtfHandler::readRtf(rtf, &doc));
+  QCOMPARE(doc.toPlainText(),
+           QString(QStringLiteral("caf") + QChar(0xE9) +
+                   QStringLiteral("\nna") + QChar(0xEF) +
+                   QStringLiteral("ve") + QChar(0xA0) +
+                   QStringLiteral("x {braces} back\\slash")));
+}
+
+void RtfHandlerTest::readSkipsDestinations() {
+  const QByteArray rtf("{\\rtf1\\ansi{\\info{\\title Hidden}}"
+                       "{\\*\\generator Writer;}"
+                       "{\\pict\\pngblip 89504e47}visible}");
+  QTextDocument doc;
+  QVERIFY(RtfHandler::readRtf(rtf, &doc));
+  QCOMPARE(doc.toPlainText(), QStringLiteral("visible"));
+}
+
+void RtfHandlerTest::readCodePages() {
+  // Cyrillic document, a Greek font, and \uc replacements
+  const QByteArray rtf(
+      "{\\rtf1\\ansi\\ansicpg1251"
+      "{\\fonttbl{\\f0 Arial;}{\\f1\\fcharset161 Greek;}}"
+      "\\f0\\'cf\\'f0\\'e8\\'e2\\'e5\\'f2 \\f1\\'e1\\'e2\\f0  "
+      "\\u233?x{\\uc2\\u12354\\'82\\'a0}\\u8364 ?\\'88}");
+  QTextDocument doc;
+  QVERIFY(RtfHandler::readRtf(rtf, &doc));
+  QCOMPARE(doc.toPlainText(),
+           QStringLiteral("\u041f\u0440\u0438\u0432\u0435\u0442 "
+                          "\u03b1\u03b2 \u00e9x\u3042\u20ac\u20ac"));
+}
+
+void RtfHandlerTest::readDoubleByte() {
+  if (!CodePageDecoder(932).isValid())
+    QSKIP("No Shift-JIS codec");
+
+  // A trail byte may follow its lead byte unescaped
+  const QByteArray rtf("{\\rtf1\\ansi\\ansicpg1252"
+                       "{\\fonttbl{\\f0 Arial;}"
+                       "{\\f1\\fcharset128 \\'82\\'6c\\'82\\'72 Mincho;}}"
+                       "\\f1\\'82\\'a0\\'83A\\f0  ok}");
+  QTextDocument doc;
+  QVERIFY(RtfHandler::readRtf(rtf, &doc));
+  QCOMPARE(doc.toPlainText(), QStringLiteral("\u3042\u30a2 ok"));
+
+  QTextCursor cursor(&doc);
+  cursor.setPosition(1);
+  QCOMPARE(cursor.charFormat().fontFamilies().toStringList().value(0),
+           QStringLiteral("\uff2d\uff33 Mincho"));
+}
+
+void RtfHandlerTest::rejectsNonRtf() {
+  QTextDocument doc;
+  QVERIFY(!RtfHandler::readRtf(QByteArray("plain text"), &doc));
+  QVERIFY(!RtfHandler::readRtf(QByteArray(), &doc));
+}
+
+void RtfHandlerTest::roundTrip() {
+  QTextDocument source;
+  QTextCursor cursor(&source);
+  cursor.insertText(QStringLiteral("Hello "));
+  QTextCharFormat bold;
+  bold.setFontWeight(QFont::Bold);
+  cursor.insertText(QStringLiteral("World"), bold);
+  cursor.insertBlock();
+  cursor.insertText(QString(QStringLiteral("{x} \\ caf") + QChar(0xE9)),
+                    QTextCharFormat());
+  QTextCharFormat italic;
+  italic.setFontItalic(true);
+  cursor.insertBlock();
+  cursor.insertText(QStringLiteral("last"), italic);
+
+  const QByteArray rtf = RtfHandler::writeRtf(&source);
+  QVERIFY(rtf.startsWith("{\\rtf1"));
+
+  QTextDocument copy;
+  QVERIFY(RtfHandler::readRtf(rtf, &copy));
+  QCOMPARE(copy.toPlainText(), source.toPlainText());
+  QCOMPARE(copy.blockCount(), 3);
+  QVERIFY(formatAt(copy, 0).fontWeight() != int(QFont::Bold));
+  QCOMPARE(formatAt(copy, 6).fontWeight(), int(QFont::Bold));
+  QVERIFY(formatAt(copy, copy.characterCount() - 2).fontItalic());
+}
+
+void RtfHandlerTest::readLegacyList() {
+  // WordPad style: list properties once, kept until \pard
+  QByteArray rtf("{\\rtf1\\ansi{\\fonttbl{\\f0 Arial;}}");
+  for (int i = 0; i < 500; ++i) {
+    rtf.append("{\\pntext\\f0\\'B7\\tab}");
+    if (i == 0) {
+      rtf.append("{\\*\\pn\\pnlvlblt\\pnf0{\\pntxtb\\'B7}}");
+    }
+    rtf.append("item\\par\n");
+  }
+  rtf.append("\\pard plain}");
+
+  QTextDocument doc;
+  QVERIFY(RtfHandler::readRtf(rtf, &doc));
+  QCOMPARE(doc.blockCount(), 501);
+  QTextList *list = doc.begin().textList();
+  QVERIFY(list);
+  QCOMPARE(list->count(), 500);
+  QCOMPARE(list->format().style(), QTextListFormat::ListDisc);
+  QCOMPARE(doc.findBlockByNumber(499).textList(), list);
+  QVERIFY(!doc.lastBlock().textList());
+  QCOMPARE(doc.begin().text(), QStringLiteral("item"));
+}
+
+void RtfHandlerTest::readListTable() {
+  const QByteArray rtf(
+      "{\\rtf1\\ansi"
+      "{\\*\\listtable{\\list\\listtemplateid7"
+      "{\\listlevel\\levelnfc0{\\leveltext\\'02\\'00.;}{\\levelnumbers\\'01;}}"
+      "{\\listlevel\\levelnfc23{\\leveltext\\'01\\u9702 ?;}"
+      "{\\levelnumbers;}}"
+      "{\\listname ;}\\listid7}}"
+      "{\\*\\listoverridetable{\\listoverride\\listid7\\ls1}}"
+      "\\pard\\ls1\\ilvl0{\\listtext 1.\\tab}one\\par"
+      "\\pard\\ls1\\ilvl1{\\listtext o\\tab}nested\\par"
+      "\\pard\\ls1\\ilvl0{\\listtext 2.\\tab}two\\par"
+      "\\pard\\ls1\\ilvl1{\\listtext o\\tab}again\\par"
+      "\\pard after\\par"
+      "\\pard\\ls1\\ilvl0{\\listtext 3.\\tab}three}");
+  QTextDocument doc;
+  QVERIFY(RtfHandler::readRtf(rtf, &doc));
+  QCOMPARE(doc.toPlainText(),
+           QStringLiteral("one\nnested\ntwo\nagain\nafter\nthree"));
+
+  QTextList *top = doc.findBlockByNumber(0).textList();
+  QVERIFY(top);
+  QCOMPARE(top->format().style(), QTextListFormat::ListDecimal);
+  QCOMPARE(top->format().indent(), 1);
+  // Numbering goes on past the nested items and other paragraphs
+  QCOMPARE(doc.findBlockByNumber(2).textList(), top);
+  QCOMPARE(doc.findBlockByNumber(5).textList(), top);
+  QCOMPARE(top->count(), 3);
+
+  QTextList *nested = doc.findBlockByNumber(1).textList();
+  QVERIFY(nested);
+  QCOMPARE(nested->format().style(), QTextListFormat::ListCircle);
+  QCOMPARE(nested->format().indent(), 2);
+  // A top level item restarts the level below
+  QVERIFY(doc.findBlockByNumber(3).textList() != nested);
+  QVERIFY(!doc.findBlockByNumber(4).textList());
+}
+
+void RtfHandlerTest::roundTripLists() {
+  QTextDocument source;
+  QTextCursor cursor(&source);
+  QTextListFormat numbered;
+  numbered.setStyle(QTextListFormat::ListLowerAlpha);
+  numbered.setIndent(1);
+  QTextListFormat bullets;
+  bullets.setStyle(QTextListFormat::ListSquare);
+  bullets.setIndent(2);
+
+  cursor.insertText(QStringLiteral("first"));
+  cursor.createList(numbered);
+  cursor.insertBlock();
+  cursor.insertText(QStringLiteral("second"));
+  cursor.insertBlock();
+  cursor.createList(bullets);
+  cursor.insertText(QStringLiteral("inner"));
+  cursor.insertBlock(QTextBlockFormat());
+  cursor.insertText(QStringLiteral("plain"));
+
+  const QByteArray rtf = RtfHandler::writeRtf(&source);
+  QVERIFY(rtf.contains("\\listtable"));
+  QVERIFY(!rtf.contains("\\pntext"));
+  QCOMPARE(rtf.count("\\listoverride\\"), 2);
+
+  QTextDocument copy;
+  QVERIFY(RtfHandler::readRtf(rtf, &copy));
+  QCOMPARE(copy.toPlainText(), source.toPlainText());
+  QTextList *outer = copy.findBlockByNumber(0).textList();
+  QVERIFY(outer);
+  QCOMPARE(outer->count(), 2);
+  QCOMPARE(outer->format().style(), QTextListFormat::ListLowerAlpha);
+  QTextList *inner = copy.findBlockByNumber(2).textList();
+  QVERIFY(inner);
+  QCOMPARE(inner->format().style(), QTextListFormat::ListSquare);
+  QCOMPARE(inner->format().indent(), 2);
+  QVERIFY(!copy.lastBlock().textList());
+}
+
+void RtfHandlerTest::limits_data() {
+  QTest::addColumn<QByteArray>("rtf");
+  QTest::addColumn<int>("error");
+
+  const QByteArray deep = QByteArray("{\\rtf1 ") + QByteArray(5000, '{') +
+                          QByteArray("x") + QByteArray(5000, '}') +
+                          QByteArray("}");
+  const QByteArray colors = QByteArray("{\\rtf1{\\colortbl;") +
+                            QByteArray(40000, ';') + QByteArray("}x}");
+  const QByteArray text =
+      QByteArray("{\\rtf1 ") + QByteArray(2000, 'a') + QByteArray("}");
+  const QByteArray words = QByteArray("{\\rtf1 ") +
+                           QByteArray(3000, 'a').replace("a", "\\b ") +
+                           QByteArray("}");
+
+  QTest::newRow("deep nesting") << deep << int(RtfHandler::Error::TooDeep);
+  QTest::newRow("huge font id")
+      << QByteArray("{\\rtf1{\\fonttbl{\\f2000000000 Arial;}}x}")
+      << int(RtfHandler::Error::TableIndexOutOfRange);
+  QTest::newRow("negative font id")
+      << QByteArray("{\\rtf1{\\fonttbl{\\f-3 Arial;}}x}")
+      << int(RtfHandler::Error::TableIndexOutOfRange);
+  QTest::newRow("color flood")
+      << colors << int(RtfHandler::Error::TableIndexOutOfRange);
+  QTest::newRow("too long") << text
+                            << int(RtfHandler::Error::TooManyCharacters);
+  QTest::newRow("too many tokens")
+      << words << int(RtfHandler::Error::TooManyTokens);
+  QTest::newRow("within limits")
+      << QByteArray("{\\rtf1{\\fonttbl{\\f1 Arial;}}{{{\\b x}}}}")
+      << int(RtfHandler::Error::None);
+}
+
+void RtfHandlerTest::limits() {
+  QFETCH(QByteArray, rtf);
+  QFETCH(int, error);
+
+  RtfHandler::Limits limits;
+  limits.maxDepth = 100;
+  limits.maxTokens = 2000;
+  limits.maxCharacters = 1000;
+
+  QTextDocument doc;
+  RtfHandler::Error result = RtfHandler::Error::NotRtf;
+  QCOMPARE(RtfHandler::readRtf(rtf, &doc, limits, &result),
+           error == int(RtfHandler::Error::None));
+  QCOMPARE(int(result), error);
+}
+
+int runRtfHandlerTest(int argc, char *argv[]) {
+  RtfHandlerTest test;
+  return QTest::qExec(&test, argc, argv);
+}
+
+#include "rtfhandlertest.moc"
@@ -0,0 +1,138 @@
+#include "sessionstore.h"
+
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+
+class SessionStoreTest : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void tabRoundTrip();
+  void legacyBackup();
+  void tabData();
+  void diskUsage();
+  void indexRemovesOrphans();
+};
+
+void SessionStoreTest::tabRoundTrip() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  SessionStore store(dir.path());
+
+  SessionStore::TabMeta meta;
+  meta.filePath = QStringLiteral("/home/user/notes.txt");
+  meta.tabTitle = QStringLiteral("notes.txt");
+  meta.modified = true;
+  const QString html = QStringLiteral("<p>Hello <b>world</b></p>");
+  QVERIFY(store.writeTab(QStringLiteral("a"), html,
+                         SessionStore::encodeMeta(meta)));
+
+  QString readHtml;
+  QVERIFY(store.readTabContent(QStringLiteral("a"), readHtml));
+  QCOMPARE(readHtml, html);
+
+  SessionStore::TabMeta readMeta;
+  QVERIFY(store.readTabMeta(QStringLiteral("a"), readMeta));
+  QCOMPARE(readMeta.filePath, meta.filePath);
+  QCOMPARE(readMeta.tabTitle, meta.tabTitle);
+  QCOMPARE(readMeta.modified, true);
+
+  store.removeTab(QStringLiteral("a"));
+  QVERIFY(!store.readTabContent(QStringLiteral("a"), readHtml));
+  QVERIFY(!store.readTabMeta(QStringLiteral("a"), readMeta));
+}
+
+void SessionStoreTest::legacyBackup() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  SessionStore store(dir.path());
+
+  QFile legacy(dir.filePath(QStringLiteral("old.html")));
+  QVERIFY(legacy.open(QIODevice::WriteOnly));
+  legacy.write("<p>from an older version</p>");
+  legacy.close();
+
+  QString html;
+  QVERIFY(store.readTabContent(QStringLiteral("old"), html));
+  QCOMPARE(html, QStringLiteral("<p>from an older version</p>"));
+
+  // Writing the tab again replaces the uncompressed file
+  QVERIFY(store.writeTab(QStringLiteral("old"), html, QByteArray("{}")));
+  QVERIFY(!QFile::exists(legacy.fileName()));
+  QVERIFY(store.readTabContent(QStringLiteral("old"), html));
+  QCOMPARE(html, QStringLiteral("<p>from an older version</p>"));
+}
+
+void SessionStoreTest::tabData() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  SessionStore store(dir.path());
+
+  for (const QString &suffix : SessionStore::tabDataSuffixes()) {
+    const QByteArray data = suffix.toUtf8() + QByteArray("\0payload", 8);
+    QVERIFY(store.writeTabData(QStringLiteral("t"), suffix, data));
+    QCOMPARE(store.readTabData(QStringLiteral("t"), suffix), data);
+  }
+  QVERIFY(store.readTabData(QStringLiteral("missing"),
+                            SessionStore::tabDataSuffixes().first())
+              .isEmpty());
+}
+
+void SessionStoreTest::diskUsage() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  SessionStore store(dir.path());
+  QCOMPARE(store.tabDiskUsage(QStringLiteral("t")), qint64(0));
+
+  QVERIFY(store.writeTab(QStringLiteral("t"), QStringLiteral("<p>x</p>"),
+                         QByteArray("{}")));
+  const qint64 backup = store.tabDiskUsage(QStringLiteral("t"));
+  QVERIFY(backup > 0);
+
+  QVERIFY(store.writeTabData(QStringLiteral("t"), QStringLiteral("undo"),
+                             QByteArray(100, 'u')));
+  QCOMPARE(store.tabDiskUsage(QStringLiteral("t")), backup + 100);
+
+  store.removeTab(QStringLiteral("t"));
+  QCOMPARE(store.tabDiskUsage(QStringLiteral("t")), qint64(0));
+}
+
+void SessionStoreTest::indexRemovesOrphans() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  SessionStore store(dir.path());
+
+  const QStringList ids = QStringList()
+                          << QStringLiteral("one") << QStringLiteral("two")
+                          << QStringLiteral("gone");
+  for (const QString &id : ids) {
+    QVERIFY(store.writeTab(id, QStringLiteral("<p>x</p>"), QByteArray("{}")));
+    QVERIFY(store.writeTabData(id, QStringLiteral("undo"), QByteArray("u")));
+  }
+
+  const QStringList kept = ids.mid(0, 2);
+  QVERIFY(store.writeIndex(SessionStore::encodeIndex(kept, 1), kept));
+
+  int activeIndex = -1;
+  QCOMPARE(store.readIndex(activeIndex), kept);
+  QCOMPARE(activeIndex, 1);
+
+  const QStringList left = QDir(dir.path()).entryList(QDir::Files);
+  for (const QString &fileName : left) {
+    QVERIFY2(!fileName.startsWith(QLatin1String("gone.")),
+             qPrintable(fileName));
+  }
+  QString html;
+  QVERIFY(store.readTabContent(QStringLiteral("two"), html));
+  QCOMPARE(store.readTabData(QStringLiteral("one"), QStringLiteral("undo")),
+           QByteArray("u"));
+}
+
+int runSessionStoreTest(int argc, char *argv[]) {
+  SessionStoreTest test;
+  return QTest::qExec(&test, argc, argv);
+}
+
+#include "sessionstoretest.moc"
@@ -0,0 +1,81 @@
+#include "stallwatchdog.h"
+
+#include <QFile>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QThread>
+
+class StallWatchdogTest : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void reportsStall();
+  void rotatesLog();
+};
+
+namespace {
+
+void stall(int milliseconds) {
+  const StallWatchdog::Operation operation("Busy", 42);
+  QThread::msleep(milliseconds);
+}
+
+} // namespace
+
+void StallWatchdogTest::reportsStall() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  const QString logPath = dir.filePath(QStringLiteral("stalls.log"));
+
+  StallWatchdog watchdog;
+  watchdog.setThreshold(20);
+  watchdog.setLogPath(logPath);
+  QSignalSpy spy(&watchdog, &StallWatchdog::stallDetected);
+  watchdog.start();
+
+  stall(200);
+  QTRY_VERIFY(spy.count() >= 1);
+  watchdog.stop();
+
+  const auto reported = spy.first().first().value<StallWatchdog::Stall>();
+  QCOMPARE(reported.operation, QStringLiteral("Busy"));
+  QCOMPARE(reported.documentSize, qint64(42));
+  QVERIFY(reported.milliseconds >= 20);
+
+  QFile log(logPath);
+  QVERIFY(log.open(QIODevice::ReadOnly));
+  QVERIFY(log.readAll().contains("\tBusy\t42\n"));
+}
+
+void StallWatchdogTest::rotatesLog() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  const QString logPath = dir.filePath(QStringLiteral("stalls.log"));
+  {
+    QFile full(logPath);
+    QVERIFY(full.open(QIODevice::WriteOnly));
+    full.write(QByteArray(StallWatchdog::kMaxLogBytes + 1, 'x'));
+  }
+
+  StallWatchdog watchdog;
+  watchdog.setThreshold(20);
+  watchdog.setLogPath(logPath);
+  QSignalSpy spy(&watchdog, &StallWatchdog::stallDetected);
+  watchdog.start();
+
+  stall(200);
+  QTRY_VERIFY(spy.count() >= 1);
+  watchdog.stop();
+
+  QFile rotated(logPath + QStringLiteral(".1"));
+  QCOMPARE(rotated.size(), StallWatchdog::kMaxLogBytes + 1);
+  QVERIFY(QFile(logPath).size() < StallWatchdog::kMaxLogBytes);
+}
+
+int runStallWatchdogTest(int argc, char *argv[]) {
+  StallWatchdogTest test;
+  return QTest::qExec(&test, argc, argv);
+}
+
+#include "stallwatchdogtest.moc"
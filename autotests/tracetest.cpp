@@ -0,0 +1,129 @@
+#include "trace.h"
+
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTest>
+#include <QThread>
+
+#include <thread>
+
+class TraceTest : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void cleanup();
+  void disabledRecordsNothing();
+  void exportsSpansPerThread();
+  void ringKeepsLatest();
+  void finishedThreadsShareRings();
+};
+
+namespace {
+
+// Complete events by name; thread name metadata is skipped
+QHash<QString, int> spanCounts(const QByteArray &json) {
+  QHash<QString, int> counts;
+  const QJsonArray events = QJsonDocument::fromJson(json)
+                                .object()
+                                .value(QStringLiteral("traceEvents"))
+                                .toArray();
+  for (const QJsonValue &value : events) {
+    const QJsonObject event = value.toObject();
+    if (event.value(QStringLiteral("ph")).toString() == QLatin1String("X")) {
+      ++counts[event.value(QStringLiteral("name")).toString()];
+    }
+  }
+  return counts;
+}
+
+} // namespace
+
+void TraceTest::cleanup() {
+  Trace::setEnabled(false);
+  Trace::clear();
+}
+
+void TraceTest::disabledRecordsNothing() {
+  Trace::clear();
+  { KNOTEPAD_TRACE_SCOPE("off"); }
+  QCOMPARE(Trace::eventCount(), 0);
+}
+
+void TraceTest::exportsSpansPerThread() {
+  Trace::clear();
+  Trace::setEnabled(true);
+  {
+    KNOTEPAD_TRACE_SCOPE("outer");
+    KNOTEPAD_TRACE_SCOPE("inner");
+  }
+  QThread *worker = QThread::create([] {
+    for (int i = 0; i < 3; ++i) {
+      KNOTEPAD_TRACE_SCOPE("worker");
+    }
+  });
+  worker->start();
+  QVERIFY(worker->wait());
+  delete worker;
+
+  QCOMPARE(Trace::eventCount(), 5);
+  const QByteArray json = Trace::toChromeJson();
+  const QHash<QString, int> counts = spanCounts(json);
+  QCOMPARE(counts.value(QStringLiteral("outer")), 1);
+  QCOMPARE(counts.value(QStringLiteral("inner")), 1);
+  QCOMPARE(counts.value(QStringLiteral("worker")), 3);
+
+  // The inner span lies within the outer one
+  const QJsonArray events = QJsonDocument::fromJson(json)
+                                .object()
+                                .value(QStringLiteral("traceEvents"))
+                                .toArray();
+  QJsonObject outer;
+  QJsonObject inner;
+  for (const QJsonValue &value : events) {
+    const QString name =
+        value.toObject().value(QStringLiteral("name")).toString();
+    if (name == QLatin1String("outer"))
+      outer = value.toObject();
+    else if (name == QLatin1String("inner"))
+      inner = value.toObject();
+  }
+  const double outerStart = outer.value(QStringLiteral("ts")).toDouble();
+  const double innerStart = inner.value(QStringLiteral("ts")).toDouble();
+  QVERIFY(innerStart >= outerStart);
+  QVERIFY(innerStart + inner.value(QStringLiteral("dur")).toDouble() <=
+          outerStart + outer.value(QStringLiteral("dur")).toDouble());
+}
+
+void TraceTest::ringKeepsLatest() {
+  Trace::clear();
+  Trace::setEnabled(true);
+  for (int i = 0; i < Trace::kRingSize + 100; ++i) {
+    KNOTEPAD_TRACE_SCOPE("wrap");
+  }
+  QCOMPARE(Trace::eventCount(), int(Trace::kRingSize));
+  QCOMPARE(spanCounts(Trace::toChromeJson()).value(QStringLiteral("wrap")),
+           int(Trace::kRingSize));
+}
+
+void TraceTest::finishedThreadsShareRings() {
+  Trace::clear();
+  Trace::setEnabled(true);
+  // One after another, so that each finds the ring of the one before free;
+  // join() returns once thread-local destructors have run
+  const int threads = 20;
+  for (int i = 0; i < threads; ++i) {
+    std::thread([] { KNOTEPAD_TRACE_SCOPE("short-lived"); }).join();
+  }
+  // A ring taken over starts empty, so fewer spans than threads remain
+  QVERIFY(spanCounts(Trace::toChromeJson())
+              .value(QStringLiteral("short-lived")) < threads);
+}
+
+int runTraceTest(int argc, char *argv[]) {
+  TraceTest test;
+  return QTest::qExec(&test, argc, argv);
+}
+
+#include "tracetest.moc"
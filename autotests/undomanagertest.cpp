@@ -0,0 +1,255 @@
+#include "documenttab.h"
+#include "findbar.h"
+
+#include <KConfigGroup>
+#include <KSharedConfig>
+#include <QLineEdit>
+#include <QRandomGenerator>
+#include <QStandardPaths>
+#include <QTest>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextEdit>
+#include <QTextTable>
+
+class UndoManagerTest : public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void initTestCase();
+  void coalescesTyping();
+  void undoesPreparedRemoval();
+  void undoesInsertionOutsideWindow();
+  void keepsHistoryBeforeUnpreparedRemoval();
+  void undoesTableCellEdits();
+  void evictsOldestOverBudget();
+  void undoesRemovalLargerThanBudget();
+  void undoesReplaceAllLargerThanBudget();
+  void windowStaysSmall();
+};
+
+namespace {
+
+QByteArray lines(int count) {
+  QByteArray text;
+  for (int i = 0; i < count; ++i) {
+    text += "line " + QByteArray::number(i) + " of a long document\n";
+  }
+  return text;
+}
+
+// Puts the editor's cursor where typing goes, as a click would
+void moveCursor(DocumentTab &tab, int position) {
+  QTextCursor cursor = tab.editor()->textCursor();
+  cursor.setPosition(position);
+  tab.editor()->setTextCursor(cursor);
+}
+
+// The find bar's line edit with the given placeholder
+QLineEdit *findBarEdit(DocumentTab &tab, const QString &placeholder) {
+  const QList<QLineEdit *> edits =
+      tab.findChild<FindBar *>()->findChildren<QLineEdit *>();
+  for (QLineEdit *edit : edits) {
+    if (edit->placeholderText() == placeholder)
+      return edit;
+  }
+  return nullptr;
+}
+
+// Undoes everything there is and returns the number of steps
+int undoAll(DocumentTab &tab) {
+  int steps = 0;
+  while (tab.canUndo()) {
+    tab.undo();
+    ++steps;
+  }
+  return steps;
+}
+
+} // namespace
+
+void UndoManagerTest::initTestCase() {
+  // The tabs below read their undo budget from here
+  QStandardPaths::setTestModeEnabled(true);
+  KConfigGroup group(KSharedConfig::openConfig(), QStringLiteral("Memory"));
+  group.writeEntry("UndoBudgetMB", 1);
+}
+
+void UndoManagerTest::coalescesTyping() {
+  DocumentTab tab;
+  tab.loadData(QStringLiteral("x.txt"), "first\nsecond");
+
+  moveCursor(tab, tab.editor()->document()->characterCount() - 1);
+  QTest::keyClicks(tab.editor(), QStringLiteral(" line"));
+  QCOMPARE(tab.editor()->toPlainText(), QStringLiteral("first\nsecond line"));
+
+  tab.undo();
+  QCOMPARE(tab.editor()->toPlainText(), QStringLiteral("first\nsecond"));
+  QVERIFY(!tab.canUndo());
+  tab.redo();
+  QCOMPARE(tab.editor()->toPlainText(), QStringLiteral("first\nsecond line"));
+}
+
+void UndoManagerTest::undoesPreparedRemoval() {
+  DocumentTab tab;
+  tab.loadData(QStringLiteral("x.txt"), "one\ntwo\nthree");
+
+  // Backspace at the start of "three" joins it with "two"
+  moveCursor(tab, tab.editor()->document()->findBlockByNumber(2).position());
+  QTest::keyClick(tab.editor(), Qt::Key_Backspace);
+  QCOMPARE(tab.editor()->toPlainText(), QStringLiteral("one\ntwothree"));
+
+  tab.undo();
+  QCOMPARE(tab.editor()->toPlainText(), QStringLiteral("one\ntwo\nthree"));
+}
+
+void UndoManagerTest::undoesInsertionOutsideWindow() {
+  DocumentTab tab;
+  tab.loadData(QStringLiteral("x.txt"), "alpha\nbeta\ngamma\ndelta");
+  moveCursor(tab, 0);
+
+  // The last block was never captured; the insertion alone is enough
+  QTextCursor cursor(tab.editor()->document()->findBlockByNumber(3));
+  cursor.movePosition(QTextCursor::EndOfBlock);
+  cursor.insertText(QStringLiteral(" and\nepsilon"));
+  QCOMPARE(tab.editor()->document()->blockCount(), 5);
+
+  tab.undo();
+  QCOMPARE(tab.editor()->toPlainText(),
+           QStringLiteral("alpha\nbeta\ngamma\ndelta"));
+}
+
+void UndoManagerTest::keepsHistoryBeforeUnpreparedRemoval() {
+  DocumentTab tab;
+  tab.loadData(QStringLiteral("x.txt"), "alpha\nbeta\ngamma\ndelta");
+  moveCursor(tab, 0);
+  QTest::keyClicks(tab.editor(), QStringLiteral("x"));
+
+  // A removal far from the window cannot be undone, but the typing it does
+  // not touch still can
+  QTextCursor far(tab.editor()->document()->findBlockByNumber(3));
+  far.deleteChar();
+  QVERIFY(tab.canUndo());
+  tab.undo();
+  QCOMPARE(tab.editor()->toPlainText(),
+           QStringLiteral("alpha\nbeta\ngamma\nelta"));
+  QVERIFY(!tab.canUndo());
+}
+
+void UndoManagerTest::undoesTableCellEdits() {
+  DocumentTab tab;
+  tab.loadData(QStringLiteral("x.txt"), "alpha\nbeta");
+  moveCursor(tab, 0);
+  QTest::keyClicks(tab.editor(), QStringLiteral("x"));
+
+  QTextCursor end(tab.editor()->document());
+  end.movePosition(QTextCursor::End);
+  QTextTable *table = end.insertTable(2, 2);
+
+  moveCursor(tab, table->cellAt(0, 0).firstCursorPosition().position());
+  QTest::keyClicks(tab.editor(), QStringLiteral("ab"));
+  QTextCursor cell = table->cellAt(0, 0).firstCursorPosition();
+  cell.setPosition(table->cellAt(0, 0).lastCursorPosition().position(),
+                   QTextCursor::KeepAnchor);
+  QCOMPARE(cell.selectedText(), QStringLiteral("ab"));
+
+  // The cell edit is undone within the cell; the table insertion itself is
+  // skipped, and the typing before it stays undoable
+  tab.undo();
+  QCOMPARE(table->rows(), 2);
+  QCOMPARE(table->cellAt(0, 0).firstCursorPosition().position(),
+           table->cellAt(0, 0).lastCursorPosition().position());
+  tab.undo();
+  QCOMPARE(tab.editor()->document()->firstBlock().text(),
+           QStringLiteral("alpha"));
+  QVERIFY(!tab.canUndo());
+}
+
+void UndoManagerTest::evictsOldestOverBudget() {
+  DocumentTab tab;
+  tab.loadData(QStringLiteral("x.txt"), "start");
+
+  // Random text compresses badly, so ten of these exceed the 1 MB budget
+  // even compressed
+  QRandomGenerator random(42);
+  const int edits = 10;
+  for (int i = 0; i < edits; ++i) {
+    QString text;
+    for (int j = 0; j < 300000; ++j) {
+      text += j % 60 == 0 ? QChar(u'\n')
+                          : QChar(u'a' + random.bounded(26));
+    }
+    moveCursor(tab, tab.editor()->document()->characterCount() - 1);
+    tab.editor()->insertPlainText(text);
+    QVERIFY(tab.memoryUsage().undoBytes <= 1024 * 1024);
+  }
+
+  // The oldest commands were dropped rather than the whole history
+  const int steps = undoAll(tab);
+  QVERIFY(steps > 0);
+  QVERIFY(steps < edits);
+  QVERIFY(tab.editor()->document()->characterCount() > 300000);
+}
+
+void UndoManagerTest::undoesRemovalLargerThanBudget() {
+  DocumentTab tab;
+  const QByteArray text = lines(40000);
+  tab.loadData(QStringLiteral("x.txt"), text);
+  moveCursor(tab, 0);
+  QTest::keyClicks(tab.editor(), QStringLiteral("x"));
+
+  // Select all and delete takes far more than the budget before compression
+  tab.editor()->selectAll();
+  QTest::keyClick(tab.editor(), Qt::Key_Delete);
+  QCOMPARE(tab.editor()->document()->characterCount(), 1);
+  QVERIFY(tab.memoryUsage().undoBytes <= 1024 * 1024);
+
+  tab.undo();
+  QCOMPARE(tab.editor()->toPlainText(),
+           QStringLiteral("x") + QString::fromUtf8(text));
+  QVERIFY(tab.canUndo());
+  tab.undo();
+  QCOMPARE(tab.editor()->toPlainText(), QString::fromUtf8(text));
+}
+
+void UndoManagerTest::undoesReplaceAllLargerThanBudget() {
+  DocumentTab tab;
+  const QByteArray text = lines(40000);
+  tab.loadData(QStringLiteral("x.txt"), text);
+
+  QLineEdit *find = findBarEdit(tab, QStringLiteral("Find"));
+  QLineEdit *replace = findBarEdit(tab, QStringLiteral("Replace"));
+  QVERIFY(find && replace);
+  find->setText(QStringLiteral("line"));
+  replace->setText(QStringLiteral("row"));
+
+  // Replace All waits for the search, then replaces every line in one edit
+  tab.findChild<FindBar *>()->replaceAll();
+  QTRY_VERIFY_WITH_TIMEOUT(
+      tab.editor()->document()->lastBlock().previous().text().startsWith(
+          QStringLiteral("row ")),
+      10000);
+  QVERIFY(tab.memoryUsage().undoBytes <= 1024 * 1024);
+
+  tab.undo();
+  QCOMPARE(tab.editor()->toPlainText(), QString::fromUtf8(text));
+  QVERIFY(!tab.canUndo());
+}
+
+void UndoManagerTest::windowStaysSmall() {
+  DocumentTab tab;
+  tab.loadData(QStringLiteral("x.txt"), lines(5000));
+
+  moveCursor(tab, tab.editor()->document()->findBlockByNumber(2500).position());
+  QTest::keyClicks(tab.editor(), QStringLiteral("x"));
+  QVERIFY(tab.canUndo());
+  QVERIFY(tab.memoryUsage().undoBytes < 4096);
+}
+
+int runUndoManagerTest(int argc, char *argv[]) {
+  UndoManagerTest test;
+  return QTest::qExec(&test, argc, argv);
+}
+
+#include "undomanagertest.moc"
@@ -0,0 +1,526 @@
+#include "formatpool.h"
+#include "resourceusage.h"
+#include "rtfgenerator.h"
+#include "rtfhandler.h"
+
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextDocument>
+#include <QVector>
+
+#include <cstdio>
+#include <memory>
+
+namespace {
+
+struct Profile {
+  const char *name;
+  double formattingDensity;
+  double unicodeRatio;
+  double pictShare;
+  double listDensity;
+  int nestingDepth;
+};
+
+const Profile kProfiles[] = {
+    {"plain", 0.0, 0.0, 0.0, 0.0, 1},
+    {"formatted", 0.5, 0.0, 0.0, 0.0, 1},
+    {"unicode", 0.1, 0.5, 0.0, 0.0, 1},
+    {"pictures", 0.1, 0.0, 0.6, 0.0, 1},
+    {"lists", 0.1, 0.0, 0.0, 0.6, 4},
+    {"mixed", 0.2, 0.1, 0.2, 0.2, 3},
+};
+
+// The full sweep; --max-size cuts it short
+const char *const kSizes[] = {"1K", "16K", "256K", "1M", "16M", "100M", "500M"};
+const char *const kQuickSizes[] = {"1K", "64K"};
+
+// Size of each note of the session measurement
+const qint64 kSessionDocumentSize = 4 * 1024;
+
+struct Case {
+  QString name;
+  QJsonObject parameters;
+  QByteArray data;
+};
+
+struct PhaseResult {
+  qint64 bytes = 0;
+  qint64 tokens = 0;
+  qint64 nsecs = -1; // best run
+  qint64 allocations = -1;
+  qint64 allocatedBytes = -1;
+  qint64 peakRss = -1;
+};
+
+double perSecond(double amount, qint64 nsecs) {
+  return nsecs > 0 ? amount / (double(nsecs) / 1e9) : 0.0;
+}
+
+double megabytes(qint64 bytes) { return double(bytes) / (1024.0 * 1024.0); }
+
+QJsonObject toJson(const PhaseResult &result) {
+  QJsonObject object;
+  object[QStringLiteral("bytes")] = result.bytes;
+  object[QStringLiteral("tokens")] = result.tokens;
+  object[QStringLiteral("nsecs")] = result.nsecs;
+  object[QStringLiteral("mbPerSecond")] =
+      perSecond(megabytes(result.bytes), result.nsecs);
+  object[QStringLiteral("tokensPerSecond")] =
+      perSecond(double(result.tokens), result.nsecs);
+  object[QStringLiteral("peakRss")] = result.peakRss;
+  if (result.allocations >= 0) {
+    object[QStringLiteral("allocations")] = result.allocations;
+    object[QStringLiteral("allocatedBytes")] = result.allocatedBytes;
+  } else {
+    object[QStringLiteral("allocations")] = QJsonValue();
+    object[QStringLiteral("allocatedBytes")] = QJsonValue();
+  }
+  return object;
+}
+
+// Time the best of several runs of one phase. Allocations and peak memory
+// come from the first run, which is the one that starts cold.
+template <typename Run> PhaseResult measure(int runs, Run run) {
+  PhaseResult result;
+  for (int i = 0; i < runs; ++i) {
+    const bool first = i == 0;
+    if (first) {
+      ResourceUsage::resetPeakRss();
+    }
+    const quint64 allocations = ResourceUsage::allocationCount();
+    const quint64 allocated = ResourceUsage::allocatedBytes();
+
+    QElapsedTimer timer;
+    timer.start();
+    run();
+    const qint64 nsecs = timer.nsecsElapsed();
+
+    if (first) {
+      result.peakRss = ResourceUsage::peakRss();
+      if (ResourceUsage::countsAllocations()) {
+        result.allocations =
+            qint64(ResourceUsage::allocationCount() - allocations);
+        result.allocatedBytes =
+            qint64(ResourceUsage::allocatedBytes() - allocated);
+      }
+    }
+    result.nsecs = result.nsecs < 0 ? nsecs : qMin(result.nsecs, nsecs);
+  }
+  return result;
+}
+
+QJsonObject runCase(const Case &benchCase, int runs) {
+  PhaseResult tokenize;
+  int tokens = 0;
+  tokenize = measure(runs, [&]() {
+    tokens = RtfHandler::countTokens(benchCase.data);
+  });
+  tokenize.bytes = benchCase.data.size();
+  tokenize.tokens = tokens;
+
+  std::unique_ptr<QTextDocument> doc;
+  bool readOk = true;
+  PhaseResult read = measure(runs, [&]() {
+    doc.reset(new QTextDocument);
+    readOk = RtfHandler::readRtf(benchCase.data, doc.get()) && readOk;
+  });
+  read.bytes = benchCase.data.size();
+  read.tokens = tokens;
+
+  QByteArray written;
+  PhaseResult write = measure(runs, [&]() {
+    written = RtfHandler::writeRtf(doc.get());
+  });
+  write.bytes = written.size();
+  write.tokens = RtfHandler::countTokens(written);
+
+  QJsonObject phases;
+  phases[QStringLiteral("tokenize")] = toJson(tokenize);
+  phases[QStringLiteral("read")] = toJson(read);
+  phases[QStringLiteral("write")] = toJson(write);
+
+  QJsonObject result;
+  result[QStringLiteral("case")] = benchCase.name;
+  result[QStringLiteral("parameters")] = benchCase.parameters;
+  result[QStringLiteral("inputBytes")] = qint64(benchCase.data.size());
+  result[QStringLiteral("blocks")] = doc->blockCount();
+  result[QStringLiteral("readOk")] = readOk;
+  result[QStringLiteral("phases")] = phases;
+  return result;
+}
+
+// Many similarly styled notes open at once, as in a large session; read
+// with the shared format pool or without it
+QJsonObject runSession(int tabs, bool pooled) {
+  FormatPool::setEnabled(pooled);
+  FormatPool::instance().clear();
+
+  // Same fonts and colors in every note, different text
+  QVector<QByteArray> inputs;
+  qint64 inputBytes = 0;
+  for (int i = 0; i < tabs; ++i) {
+    RtfGenerator::Parameters parameters;
+    parameters.size = kSessionDocumentSize;
+    parameters.formattingDensity = 0.5;
+    parameters.seed = quint32(i + 1);
+    inputs.append(RtfGenerator::generate(parameters));
+    inputBytes += inputs.last().size();
+  }
+
+  std::vector<std::unique_ptr<QTextDocument>> docs;
+  docs.reserve(size_t(tabs));
+  bool readOk = true;
+  qint64 formats = 0;
+  const qint64 liveBefore = ResourceUsage::liveBytes();
+  const quint64 allocationsBefore = ResourceUsage::allocationCount();
+  QElapsedTimer timer;
+  timer.start();
+  for (const QByteArray &input : std::as_const(inputs)) {
+    docs.emplace_back(new QTextDocument);
+    readOk = RtfHandler::readRtf(input, docs.back().get()) && readOk;
+    formats += docs.back()->allFormats().size();
+  }
+  const qint64 nsecs = timer.nsecsElapsed();
+
+  QJsonObject result;
+  result[QStringLiteral("case")] = pooled ? QStringLiteral("session/pooled")
+                                          : QStringLiteral("session/unpooled");
+  result[QStringLiteral("tabs")] = tabs;
+  result[QStringLiteral("inputBytes")] = inputBytes;
+  result[QStringLiteral("nsecs")] = nsecs;
+  result[QStringLiteral("formats")] = formats;
+  if (ResourceUsage::countsAllocations()) {
+    result[QStringLiteral("retainedBytes")] =
+        ResourceUsage::liveBytes() - liveBefore;
+    result[QStringLiteral("allocations")] =
+        qint64(ResourceUsage::allocationCount() - allocationsBefore);
+  } else {
+    result[QStringLiteral("retainedBytes")] = QJsonValue();
+    result[QStringLiteral("allocations")] = QJsonValue();
+  }
+  result[QStringLiteral("readOk")] = readOk;
+
+  FormatPool::setEnabled(true);
+  return result;
+}
+
+QString formatBytes(qint64 bytes) {
+  if (bytes < 0)
+    return QStringLiteral("-");
+  if (bytes >= 1024 * 1024)
+    return QString::number(megabytes(bytes), 'f', 1) + QStringLiteral("M");
+  return QString::number(double(bytes) / 1024.0, 'f', 1) +
+         QStringLiteral("K");
+}
+
+void printResult(const QJsonObject &result) {
+  static const char *const phaseNames[] = {"tokenize", "read", "write"};
+  const QJsonObject phases = result[QStringLiteral("phases")].toObject();
+  for (const char *phaseName : phaseNames) {
+    const QJsonObject phase =
+        phases[QLatin1String(phaseName)].toObject();
+    const QJsonValue allocations = phase[QStringLiteral("allocations")];
+    std::printf(
+        "%-28s %-8s %9s %9.2f MB/s %7.2f Mtok/s %9s RSS %11s allocs\n",
+        qPrintable(result[QStringLiteral("case")].toString()), phaseName,
+        qPrintable(formatBytes(phase[QStringLiteral("bytes")].toInteger())),
+        phase[QStringLiteral("mbPerSecond")].toDouble(),
+        phase[QStringLiteral("tokensPerSecond")].toDouble() / 1e6,
+        qPrintable(formatBytes(phase[QStringLiteral("peakRss")].toInteger())),
+        allocations.isNull()
+            ? "-"
+            : qPrintable(QString::number(allocations.toInteger())));
+  }
+  if (!result[QStringLiteral("readOk")].toBool()) {
+    std::printf("%-28s readRtf returned false\n",
+                qPrintable(result[QStringLiteral("case")].toString()));
+  }
+  std::fflush(stdout);
+}
+
+void printSession(const QJsonObject &session) {
+  const qint64 inputBytes = session[QStringLiteral("inputBytes")].toInteger();
+  const QJsonValue retained = session[QStringLiteral("retainedBytes")];
+  const QJsonValue allocations = session[QStringLiteral("allocations")];
+  std::printf(
+      "%-28s %5d tabs %9s %9.1f ms %9s retained %11s allocs\n",
+      qPrintable(session[QStringLiteral("case")].toString()),
+      session[QStringLiteral("tabs")].toInt(),
+      qPrintable(formatBytes(inputBytes)),
+      double(session[QStringLiteral("nsecs")].toInteger()) / 1e6,
+      qPrintable(formatBytes(retained.isNull() ? -1 : retained.toInteger())),
+      allocations.isNull()
+          ? "-"
+          : qPrintable(QString::number(allocations.toInteger())));
+  std::fflush(stdout);
+}
+
+// Throughput change per case and phase against an earlier JSON report;
+// returns false if anything got slower than the threshold allows
+bool compareWithBaseline(const QJsonArray &results, const QString &path,
+                         double threshold) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    std::fprintf(stderr, "cannot read baseline %s\n", qPrintable(path));
+    return false;
+  }
+  const QJsonArray baseline = QJsonDocument::fromJson(file.readAll())
+                                  .object()
+                                  .value(QStringLiteral("results"))
+                                  .toArray();
+  QHash<QString, QJsonObject> baselinePhases;
+  for (const QJsonValue &value : baseline) {
+    const QJsonObject result = value.toObject();
+    baselinePhases.insert(result[QStringLiteral("case")].toString(),
+                          result[QStringLiteral("phases")].toObject());
+  }
+
+  bool ok = true;
+  std::printf("\nagainst %s:\n", qPrintable(path));
+  for (const QJsonValue &value : results) {
+    const QJsonObject result = value.toObject();
+    const QString name = result[QStringLiteral("case")].toString();
+    auto before = baselinePhases.constFind(name);
+    if (before == baselinePhases.constEnd())
+      continue;
+
+    const QJsonObject phases = result[QStringLiteral("phases")].toObject();
+    for (auto it = phases.constBegin(); it != phases.constEnd(); ++it) {
+      const double now =
+          it.value().toObject()[QStringLiteral("mbPerSecond")].toDouble();
+      const double then = before->value(it.key())
+                              .toObject()[QStringLiteral("mbPerSecond")]
+                              .toDouble();
+      if (then <= 0.0)
+        continue;
+      const double change = (now - then) / then * 100.0;
+      const bool regressed = threshold > 0.0 && change < -threshold;
+      ok = ok && !regressed;
+      std::printf("%-28s %-8s %+7.1f%%%s\n", qPrintable(name),
+                  qPrintable(it.key()), change,
+                  regressed ? "  REGRESSION" : "");
+    }
+  }
+  return ok;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+  QGuiApplication app(argc, argv);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+      QStringLiteral("Throughput of the RTF tokenizer, reader and writer"));
+  parser.addHelpOption();
+  QCommandLineOption quickOption(
+      QStringLiteral("quick"),
+      QStringLiteral("Small documents and one run, as a smoke test"));
+  QCommandLineOption sizesOption(
+      QStringLiteral("sizes"),
+      QStringLiteral("Comma-separated synthetic sizes, e.g. 1K,16M"),
+      QStringLiteral("list"));
+  QCommandLineOption maxSizeOption(
+      QStringLiteral("max-size"),
+      QStringLiteral("Largest size of the default sweep (default 16M, the "
+                     "sweep goes up to 500M)"),
+      QStringLiteral("size"), QStringLiteral("16M"));
+  QCommandLineOption profilesOption(
+      QStringLiteral("profiles"),
+      QStringLiteral("Comma-separated synthetic profiles: plain, formatted, "
+                     "unicode, pictures, lists, mixed; \"none\" for the "
+                     "corpus only"),
+      QStringLiteral("list"));
+  QCommandLineOption corpusOption(
+      QStringLiteral("corpus"),
+      QStringLiteral("Directory of real-world .rtf samples"),
+      QStringLiteral("dir"), QStringLiteral(KNOTEPAD_BENCH_CORPUS));
+  QCommandLineOption runsOption(QStringLiteral("runs"),
+                                QStringLiteral("Runs per phase (default 3)"),
+                                QStringLiteral("count"), QStringLiteral("3"));
+  QCommandLineOption jsonOption(
+      QStringLiteral("json"),
+      QStringLiteral("Write the results as JSON to a file, - for stdout"),
+      QStringLiteral("file"));
+  QCommandLineOption labelOption(
+      QStringLiteral("label"),
+      QStringLiteral("Free-form label for the JSON report, e.g. a commit"),
+      QStringLiteral("text"));
+  QCommandLineOption baselineOption(
+      QStringLiteral("baseline"),
+      QStringLiteral("Earlier JSON report to compare throughput with"),
+      QStringLiteral("file"));
+  QCommandLineOption thresholdOption(
+      QStringLiteral("threshold"),
+      QStringLiteral("Fail when a phase is this many percent slower than "
+                     "the baseline"),
+      QStringLiteral("percent"), QStringLiteral("0"));
+  QCommandLineOption sessionTabsOption(
+      QStringLiteral("session-tabs"),
+      QStringLiteral("Notes read at once to measure the format pool "
+                     "(default 200, 0 to skip)"),
+      QStringLiteral("count"), QStringLiteral("200"));
+  parser.addOptions({quickOption, sizesOption, maxSizeOption, profilesOption,
+                     corpusOption, runsOption, jsonOption, labelOption,
+                     baselineOption, thresholdOption, sessionTabsOption});
+  parser.process(app);
+
+  const bool quick = parser.isSet(quickOption);
+  const int runs =
+      quick ? 1 : qMax(1, parser.value(runsOption).toInt());
+  const bool jsonToStdout = parser.value(jsonOption) == QStringLiteral("-");
+
+  QVector<qint64> sizes;
+  if (parser.isSet(sizesOption)) {
+    const QStringList list =
+        parser.value(sizesOption).split(QLatin1Char(','), Qt::SkipEmptyParts);
+    for (const QString &text : list) {
+      const qint64 size = RtfGenerator::parseSize(text);
+      if (size < 0) {
+        std::fprintf(stderr, "invalid size %s\n", qPrintable(text));
+        return 2;
+      }
+      sizes.append(size);
+    }
+  } else if (quick) {
+    for (const char *text : kQuickSizes) {
+      sizes.append(RtfGenerator::parseSize(QLatin1String(text)));
+    }
+  } else {
+    const qint64 maxSize =
+        RtfGenerator::parseSize(parser.value(maxSizeOption));
+    for (const char *text : kSizes) {
+      const qint64 size = RtfGenerator::parseSize(QLatin1String(text));
+      if (size <= maxSize) {
+        sizes.append(size);
+      }
+    }
+  }
+
+  QVector<const Profile *> profiles;
+  const QStringList profileNames =
+      parser.value(profilesOption).split(QLatin1Char(','), Qt::SkipEmptyParts);
+  for (const Profile &profile : kProfiles) {
+    if (profileNames.isEmpty() ||
+        profileNames.contains(QLatin1String(profile.name))) {
+      profiles.append(&profile);
+    }
+  }
+
+  // Generate lazily: the large documents should not all be in memory at
+  // once
+  QJsonArray results;
+  auto run = [&](const Case &benchCase) {
+    const QJsonObject result = runCase(benchCase, runs);
+    if (!jsonToStdout) {
+      printResult(result);
+    }
+    results.append(result);
+  };
+
+  for (const Profile *profile : std::as_const(profiles)) {
+    for (qint64 size : std::as_const(sizes)) {
+      RtfGenerator::Parameters parameters;
+      parameters.size = size;
+      parameters.formattingDensity = profile->formattingDensity;
+      parameters.unicodeRatio = profile->unicodeRatio;
+      parameters.pictShare = profile->pictShare;
+      parameters.listDensity = profile->listDensity;
+      parameters.nestingDepth = profile->nestingDepth;
+
+      Case benchCase;
+      benchCase.name = QLatin1String(profile->name) + QStringLiteral("/") +
+                       RtfGenerator::formatSize(size);
+      benchCase.parameters[QStringLiteral("size")] = size;
+      benchCase.parameters[QStringLiteral("formattingDensity")] =
+          parameters.formattingDensity;
+      benchCase.parameters[QStringLiteral("unicodeRatio")] =
+          parameters.unicodeRatio;
+      benchCase.parameters[QStringLiteral("pictShare")] =
+          parameters.pictShare;
+      benchCase.parameters[QStringLiteral("listDensity")] =
+          parameters.listDensity;
+      benchCase.parameters[QStringLiteral("nestingDepth")] =
+          parameters.nestingDepth;
+      benchCase.data = RtfGenerator::generate(parameters);
+      run(benchCase);
+    }
+  }
+
+  const QDir corpus(parser.value(corpusOption));
+  const QStringList samples = corpus.entryList(
+      QStringList() << QStringLiteral("*.rtf"), QDir::Files, QDir::Name);
+  for (const QString &fileName : samples) {
+    QFile file(corpus.filePath(fileName));
+    if (!file.open(QIODevice::ReadOnly)) {
+      std::fprintf(stderr, "cannot read %s\n", qPrintable(file.fileName()));
+      return 1;
+    }
+    Case benchCase;
+    benchCase.name = QStringLiteral("corpus/") + fileName;
+    benchCase.data = file.readAll();
+    run(benchCase);
+  }
+
+  QJsonArray sessions;
+  const int sessionTabs =
+      quick ? 20 : qMax(0, parser.value(sessionTabsOption).toInt());
+  if (sessionTabs > 0) {
+    for (bool pooled : {false, true}) {
+      const QJsonObject session = runSession(sessionTabs, pooled);
+      if (!jsonToStdout) {
+        printSession(session);
+      }
+      sessions.append(session);
+    }
+  }
+
+  QJsonObject report;
+  report[QStringLiteral("label")] = parser.value(labelOption);
+  report[QStringLiteral("date")] =
+      QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+  report[QStringLiteral("qtVersion")] = QLatin1String(qVersion());
+  report[QStringLiteral("runs")] = runs;
+  report[QStringLiteral("countsAllocations")] =
+      ResourceUsage::countsAllocations();
+  report[QStringLiteral("results")] = results;
+  report[QStringLiteral("sessions")] = sessions;
+  const QByteArray json = QJsonDocument(report).toJson();
+
+  if (jsonToStdout) {
+    std::fwrite(json.constData(), 1, size_t(json.size()), stdout);
+  } else if (parser.isSet(jsonOption)) {
+    QFile file(parser.value(jsonOption));
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+      std::fprintf(stderr, "cannot write %s\n", qPrintable(file.fileName()));
+      return 1;
+    }
+  }
+
+  bool ok = true;
+  for (const QJsonValue &value : std::as_const(results)) {
+    ok = ok && value.toObject()[QStringLiteral("readOk")].toBool();
+  }
+  for (const QJsonValue &value : std::as_const(sessions)) {
+    ok = ok && value.toObject()[QStringLiteral("readOk")].toBool();
+  }
+  if (parser.isSet(baselineOption) && !jsonToStdout) {
+    ok = compareWithBaseline(results, parser.value(baselineOption),
+                             parser.value(thresholdOption).toDouble()) &&
+         ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+#include "resourceusage.h"
+#include "processmemory.h"
+
+#include <QFile>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+
+namespace {
+
+std::atomic<quint64> allocations{0};
+std::atomic<quint64> allocated{0};
+std::atomic<qint64> live{0};
+
+void countAllocation(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocated.fetch_add(size, std::memory_order_relaxed);
+}
+
+} // namespace
+
+// Sanitizers bring their own malloc
+#if defined(__SANITIZE_ADDRESS__)
+#define KNOTEPAD_SANITIZED_MALLOC
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer)
+#define KNOTEPAD_SANITIZED_MALLOC
+#endif
+#endif
+
+#if defined(__GLIBC__) && !defined(KNOTEPAD_SANITIZED_MALLOC)
+
+#include <malloc.h>
+
+namespace {
+
+void addLive(void *pointer, int sign) {
+  if (pointer) {
+    live.fetch_add(sign * qint64(malloc_usable_size(pointer)),
+                   std::memory_order_relaxed);
+  }
+}
+
+} // namespace
+
+// Every allocation in the process goes through these; glibc exports the
+// real implementations under __libc_ names. The aligned ones are wrapped
+// too, since free() takes their blocks off the live count.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+void *__libc_pvalloc(size_t size);
+void __libc_free(void *pointer);
+
+void *malloc(size_t size) __THROW {
+  countAllocation(size);
+  void *result = __libc_malloc(size);
+  addLive(result, 1);
+  return result;
+}
+
+void *calloc(size_t count, size_t size) __THROW {
+  countAllocation(count * size);
+  void *result = __libc_calloc(count, size);
+  addLive(result, 1);
+  return result;
+}
+
+void *realloc(void *pointer, size_t size) __THROW {
+  countAllocation(size);
+  const qint64 before = pointer ? qint64(malloc_usable_size(pointer)) : 0;
+  void *result = __libc_realloc(pointer, size);
+  // A failed realloc keeps the old block; realloc(p, 0) frees it
+  if (result || size == 0) {
+    live.fetch_sub(before, std::memory_order_relaxed);
+    addLive(result, 1);
+  }
+  return result;
+}
+
+void *memalign(size_t alignment, size_t size) __THROW {
+  countAllocation(size);
+  void *result = __libc_memalign(alignment, size);
+  addLive(result, 1);
+  return result;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) __THROW {
+  return memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, size_t alignment, size_t size) __THROW {
+  if (alignment % sizeof(void *) != 0 ||
+      (alignment & (alignment - 1)) != 0 || alignment == 0) {
+    return EINVAL;
+  }
+  void *result = memalign(alignment, size);
+  if (!result)
+    return ENOMEM;
+  *pointer = result;
+  return 0;
+}
+
+void *valloc(size_t size) __THROW {
+  countAllocation(size);
+  void *result = __libc_valloc(size);
+  addLive(result, 1);
+  return result;
+}
+
+void *pvalloc(size_t size) __THROW {
+  countAllocation(size);
+  void *result = __libc_pvalloc(size);
+  addLive(result, 1);
+  return result;
+}
+
+void free(void *pointer) __THROW {
+  addLive(pointer, -1);
+  __libc_free(pointer);
+}
+}
+
+bool ResourceUsage::countsAllocations() { return true; }
+
+#else
+
+bool ResourceUsage::countsAllocations() { return false; }
+
+#endif
+
+quint64 ResourceUsage::allocationCount() {
+  return allocations.load(std::memory_order_relaxed);
+}
+
+quint64 ResourceUsage::allocatedBytes() {
+  return allocated.load(std::memory_order_relaxed);
+}
+
+qint64 ResourceUsage::liveBytes() {
+  return live.load(std::memory_order_relaxed);
+}
+
+bool ResourceUsage::resetPeakRss() {
+#if defined(Q_OS_LINUX)
+  // "5" resets VmHWM to the current RSS (Linux 4.0 and later)
+  QFile file(QStringLiteral("/proc/self/clear_refs"));
+  return file.open(QIODevice::WriteOnly) && file.write("5") == 1;
+#else
+  return false;
+#endif
+}
+
+qint64 ResourceUsage::peakRss() { return ProcessMemory::peakResidentBytes(); }
@@ -0,0 +1,30 @@
+#ifndef RESOURCEUSAGE_H
+#define RESOURCEUSAGE_H
+
+#include <QtGlobal>
+
+/**
+ * Process-wide allocation counters and peak memory, for the benchmarks.
+ *
+ * Allocations are counted by wrapping malloc, which Qt's containers and
+ * operator new both end up in; that only works with glibc. Peak RSS can be
+ * reset between phases only on Linux.
+ */
+class ResourceUsage {
+public:
+  static bool countsAllocations();
+  static quint64 allocationCount();
+  static quint64 allocatedBytes();
+  // Bytes allocated and not yet freed, as usable sizes; aligned
+  // allocations are not wrapped, so only differences are meaningful
+  static qint64 liveBytes();
+
+  // Start measuring the peak from the current RSS; false if the peak
+  // cannot be reset and covers the whole process lifetime instead
+  static bool resetPeakRss();
+
+  // Bytes, or -1 when the platform does not tell
+  static qint64 peakRss();
+};
+
+#endif // RESOURCEUSAGE_H
@@ -0,0 +1,200 @@
+#include "rtfgenerator.h"
+
+#include <QtGlobal>
+
+#include <iterator>
+#include <random>
+
+namespace {
+
+const char *const kWords[] = {
+    "the",       "quarterly", "report",   "shows",    "a",
+    "steady",    "increase",  "in",       "revenue",  "across",
+    "all",       "regions",   "while",    "costs",    "remained",
+    "flat",      "compared",  "to",       "last",     "year",
+    "customers", "asked",     "for",      "better",   "support",
+    "of",        "document",  "formats",  "and",      "faster",
+    "loading",   "times",     "on",       "older",    "machines",
+};
+
+// Latin-1 letters come out as \'xx, the rest as \uN
+const char16_t *const kUnicodeWords[] = {
+    u"caf\u00e9",          u"na\u00efve",        u"Gr\u00f6\u00dfe",
+    u"\u00e9t\u00e9",      u"\u0395\u03bb\u03bb\u03ac\u03b4\u03b1",
+    u"\u041c\u043e\u0441\u043a\u0432\u0430",     u"\u65e5\u672c\u8a9e",
+    u"\u20ac100",          u"\u0141\u00f3d\u017a",
+};
+
+const char *const kFormats[] = {
+    "\\b ",     "\\i ",    "\\ul ",      "\\b\\i ",
+    "\\cf2 ",   "\\fs28 ", "\\f1 ",      "\\strike ",
+    "\\b\\cf3 ", "\\i\\fs20 ",
+};
+
+const int kWordCount = int(std::size(kWords));
+const int kUnicodeWordCount = int(std::size(kUnicodeWords));
+const int kFormatCount = int(std::size(kFormats));
+
+const int kPictLineLength = 128;
+// Smaller payloads are not worth a picture of their own
+const qint64 kMinPict = 4 * 1024;
+
+void appendText(QByteArray &out, const QString &text) {
+  for (const QChar ch : text) {
+    const ushort code = ch.unicode();
+    if (code == '\\' || code == '{' || code == '}') {
+      out.append('\\');
+      out.append(char(code));
+    } else if (code < 0x80) {
+      out.append(char(code));
+    } else if (code <= 0xFF) {
+      out.append("\\'");
+      out.append(QByteArray::number(code, 16).rightJustified(2, '0'));
+    } else {
+      // \uN takes a signed 16-bit value
+      out.append("\\u");
+      out.append(QByteArray::number(code > 32767 ? int(code) - 65536
+                                                 : int(code)));
+      out.append('?');
+    }
+  }
+}
+
+void appendListTable(QByteArray &out, int depth) {
+  out.append("{\\*\\listtable{\\list\\listtemplateid1\\listhybrid");
+  for (int level = 0; level < depth; ++level) {
+    out.append("{\\listlevel\\levelnfc23\\levelstartat1\\levelfollow0"
+               "{\\leveltext\\'01\\'b7;}{\\levelnumbers;}\\fi-360\\li");
+    out.append(QByteArray::number(720 * (level + 1)));
+    out.append('}');
+  }
+  out.append("\\listid1}}\n{\\*\\listoverridetable{\\listoverride\\listid1"
+             "\\listoverridecount0\\ls1}}\n");
+}
+
+} // namespace
+
+QByteArray RtfGenerator::generate(const Parameters &parameters) {
+  std::mt19937 rng(parameters.seed);
+  auto chance = [&rng](double probability) {
+    return probability > 0.0 &&
+           std::uniform_real_distribution<double>(0.0, 1.0)(rng) <
+               probability;
+  };
+  auto pick = [&rng](int count) {
+    return std::uniform_int_distribution<int>(0, count - 1)(rng);
+  };
+
+  const qint64 size = qMax<qint64>(parameters.size, 256);
+  const int depth = qBound(1, parameters.nestingDepth, 9);
+  // A document made only of pictures would never reach its size in text
+  const double pictShare = qBound(0.0, parameters.pictShare, 0.95);
+
+  QByteArray out;
+  out.reserve(size + 64 * 1024);
+  out.append("{\\rtf1\\ansi\\ansicpg1252\\deff0\\uc1\n"
+             "{\\fonttbl{\\f0\\fswiss\\fcharset0 Arial;}"
+             "{\\f1\\froman\\fcharset0 Times New Roman;}"
+             "{\\f2\\fnil\\fcharset2 Symbol;}}\n"
+             "{\\colortbl;\\red0\\green0\\blue0;\\red192\\green0\\blue0;"
+             "\\red0\\green64\\blue160;}\n"
+             "{\\*\\generator knotepad_bench;}\n");
+  if (parameters.listDensity > 0.0) {
+    appendListTable(out, depth);
+  }
+
+  qint64 pictBytes = 0;
+  while (out.size() < size - 1) {
+    if (chance(parameters.listDensity)) {
+      const int level = pick(depth);
+      out.append("\\pard\\plain\\ls1\\ilvl");
+      out.append(QByteArray::number(level));
+      out.append("\\fi-360\\li");
+      out.append(QByteArray::number(720 * (level + 1)));
+      out.append("{\\listtext\\f2 \\'b7\\tab}\\f0\\fs24 ");
+    } else {
+      out.append("\\pard\\plain\\f0\\fs24 ");
+    }
+
+    const int words = 8 + pick(32);
+    for (int w = 0; w < words; ++w) {
+      if (w > 0) {
+        out.append(' ');
+      }
+      QString word;
+      if (chance(parameters.unicodeRatio)) {
+        word = QString::fromUtf16(kUnicodeWords[pick(kUnicodeWordCount)]);
+      } else {
+        word = QString::fromLatin1(kWords[pick(kWordCount)]);
+      }
+
+      if (chance(parameters.formattingDensity)) {
+        out.append('{');
+        out.append(kFormats[pick(kFormatCount)]);
+        appendText(out, word);
+        out.append('}');
+      } else {
+        appendText(out, word);
+      }
+    }
+    out.append(".\\par\n");
+
+    // Keep the picture payload at its share of what was written so far
+    const double text = double(out.size() - pictBytes);
+    const qint64 wanted =
+        qint64(pictShare * text / (1.0 - pictShare)) - pictBytes;
+    if (wanted >= kMinPict && out.size() < size - 1) {
+      const qint64 payload =
+          qMin(wanted, qMax<qint64>(size - out.size(), kMinPict));
+      const qint64 before = out.size();
+      out.append("{\\pict\\pngblip\\picw320\\pich200\\picwgoal4800"
+                 "\\pichgoal3000\n");
+      static const char hex[] = "0123456789abcdef";
+      for (qint64 i = 0; i < payload; ++i) {
+        out.append(hex[rng() & 0xF]);
+        if ((i + 1) % kPictLineLength == 0) {
+          out.append('\n');
+        }
+      }
+      out.append("}\n");
+      pictBytes += out.size() - before;
+    }
+  }
+
+  out.append("}\n");
+  return out;
+}
+
+qint64 RtfGenerator::parseSize(const QString &text) {
+  QString number = text.trimmed().toUpper();
+  if (number.endsWith(QLatin1Char('B'))) {
+    number.chop(1);
+  }
+
+  qint64 multiplier = 1;
+  if (number.endsWith(QLatin1Char('K'))) {
+    multiplier = 1024;
+  } else if (number.endsWith(QLatin1Char('M'))) {
+    multiplier = 1024 * 1024;
+  } else if (number.endsWith(QLatin1Char('G'))) {
+    multiplier = 1024 * 1024 * 1024;
+  }
+  if (multiplier > 1) {
+    number.chop(1);
+  }
+
+  bool ok = false;
+  const qint64 value = number.toLongLong(&ok);
+  return ok && value > 0 ? value * multiplier : -1;
+}
+
+QString RtfGenerator::formatSize(qint64 bytes) {
+  if (bytes >= 1024 * 1024 * 1024 && bytes % (1024 * 1024 * 1024) == 0)
+    return QString::number(bytes / (1024 * 1024 * 1024)) +
+           QStringLiteral("G");
+  if (bytes >= 1024 * 1024 && bytes % (1024 * 1024) == 0)
+    return QString::number(bytes / (1024 * 1024)) + QStringLiteral("M");
+  if (bytes >= 1024 && bytes % 1024 == 0)
+    return QString::number(bytes / 1024) + QStringLiteral("K");
+  return QString::number(bytes);
+}
@@ -0,0 +1,32 @@
+#ifndef RTFGENERATOR_H
+#define RTFGENERATOR_H
+
+#include <QByteArray>
+#include <QString>
+
+/**
+ * Synthetic RTF documents for the benchmarks.
+ *
+ * Output is deterministic for a given set of parameters, so numbers from
+ * different commits measure the same input.
+ */
+class RtfGenerator {
+public:
+  struct Parameters {
+    qint64 size = 64 * 1024; // approximate output size in bytes
+    double formattingDensity = 0.1; // share of words with their own format
+    double unicodeRatio = 0.0;      // share of words with non-ASCII letters
+    double pictShare = 0.0;         // share of the output in \pict payloads
+    double listDensity = 0.0;       // share of paragraphs in lists
+    int nestingDepth = 1;           // deepest list level used
+    quint32 seed = 1;
+  };
+
+  static QByteArray generate(const Parameters &parameters);
+
+  // "1K", "16M", "2G" or plain bytes; -1 when not a size
+  static qint64 parseSize(const QString &text);
+  static QString formatSize(qint64 bytes);
+};
+
+#endif // RTFGENERATOR_H
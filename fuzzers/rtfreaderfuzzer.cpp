@@ -0,0 +1,60 @@
+#include "rtfhandler.h"
+
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QTextDocument>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+// Inputs that take longer count as failures, so slow cases are kept like
+// crashes. Fuzzing inputs are small; anything near this is pathological.
+const int kSlowInputMs = 1000;
+
+RtfHandler::Limits fuzzLimits() {
+  RtfHandler::Limits limits;
+  limits.maxDepth = 256;
+  limits.maxTokens = 1000000;
+  limits.maxTableIndex = 4096;
+  limits.maxCharacters = 1000000;
+  limits.maxMilliseconds = kSlowInputMs;
+  return limits;
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv) {
+  // QTextDocument needs a QGuiApplication for fonts
+  qputenv("QT_QPA_PLATFORM", "offscreen");
+  static QGuiApplication app(*argc, *argv);
+  return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  const QByteArray input = QByteArray::fromRawData(
+      reinterpret_cast<const char *>(data), qsizetype(size));
+
+  QElapsedTimer timer;
+  timer.start();
+
+  QTextDocument doc;
+  RtfHandler::Error error = RtfHandler::Error::None;
+  const bool ok = RtfHandler::readRtf(input, &doc, fuzzLimits(), &error);
+
+  // Whatever was read must survive the writer and be readable again
+  if (ok) {
+    QTextDocument copy;
+    RtfHandler::readRtf(RtfHandler::writeRtf(&doc), &copy, fuzzLimits());
+  }
+
+  const qint64 elapsed = timer.elapsed();
+  if (error == RtfHandler::Error::TimedOut || elapsed > kSlowInputMs) {
+    std::fprintf(stderr, "slow input: %lld ms for %zu bytes\n",
+                 static_cast<long long>(elapsed), size);
+    std::abort();
+  }
+  return 0;
+}
@@ -0,0 +1,65 @@
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+
+#include <cstdint>
+#include <cstdio>
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv);
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+namespace {
+
+void runOne(const QString &name, const QByteArray &data) {
+  QElapsedTimer timer;
+  timer.start();
+  LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(data.constData()),
+                         size_t(data.size()));
+  std::printf("%s: %lld bytes, %.3f ms\n", qPrintable(name),
+              static_cast<long long>(data.size()),
+              double(timer.nsecsElapsed()) / 1e6);
+  std::fflush(stdout);
+}
+
+} // namespace
+
+// Runs the target on each file or directory given, or on stdin, and
+// reports the time every input took
+int main(int argc, char *argv[]) {
+  LLVMFuzzerInitialize(&argc, &argv);
+
+  if (argc < 2) {
+    QFile in;
+    if (!in.open(stdin, QIODevice::ReadOnly)) {
+      return 1;
+    }
+    runOne(QStringLiteral("stdin"), in.readAll());
+    return 0;
+  }
+
+  for (int i = 1; i < argc; ++i) {
+    const QString path = QFile::decodeName(argv[i]);
+    QStringList files;
+    if (QFileInfo(path).isDir()) {
+      QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+      while (it.hasNext()) {
+        files.append(it.next());
+      }
+      files.sort();
+    } else {
+      files.append(path);
+    }
+
+    for (const QString &file : std::as_const(files)) {
+      QFile input(file);
+      if (!input.open(QIODevice::ReadOnly)) {
+        std::fprintf(stderr, "cannot read %s\n", qPrintable(file));
+        return 1;
+      }
+      runOne(file, input.readAll());
+    }
+  }
+  return 0;
+}
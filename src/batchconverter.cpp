@@ -0,0 +1,102 @@
+#include "batchconverter.h"
+#include "trace.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTextDocument>
+#include <QThread>
+
+BatchConverter::BatchConverter(DocumentIO::Format target, QObject *parent)
+    : QObject(parent), m_target(target) {
+  m_pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+BatchConverter::~BatchConverter() {
+  m_queue.clear();
+  m_pool.waitForDone();
+}
+
+void BatchConverter::setThreadCount(int count) {
+  m_pool.setMaxThreadCount(qMax(1, count));
+  startJobs();
+}
+
+void BatchConverter::enqueue(const QVector<Job> &jobs) {
+  for (const Job &job : jobs) {
+    m_queue.enqueue(job);
+  }
+  startJobs();
+}
+
+void BatchConverter::startJobs() {
+  // Two per thread, so no worker waits for the next file to be handed out
+  const int maxInFlight = m_pool.maxThreadCount() * 2;
+  while (m_inFlight < maxInFlight && !m_queue.isEmpty()) {
+    const Job job = m_queue.dequeue();
+    ++m_inFlight;
+
+    const DocumentIO::Format target = m_target;
+    m_pool.start([this, job, target]() {
+      const Result result = convert(job, target);
+      QMetaObject::invokeMethod(
+          this, [this, result]() { onJobDone(result); },
+          Qt::QueuedConnection);
+    });
+  }
+}
+
+void BatchConverter::onJobDone(const Result &result) {
+  --m_inFlight;
+  Q_EMIT converted(result);
+
+  startJobs();
+  if (pendingCount() == 0) {
+    Q_EMIT finished();
+  }
+}
+
+BatchConverter::Result BatchConverter::convert(const Job &job,
+                                               DocumentIO::Format target) {
+  KNOTEPAD_TRACE_SCOPE("BatchConverter::convert");
+  Result result;
+  result.job = job;
+
+  QElapsedTimer timer;
+  timer.start();
+
+  QFile in(job.input);
+  if (!in.open(QIODevice::ReadOnly)) {
+    result.error = in.errorString();
+    return result;
+  }
+  const QByteArray data = in.readAll();
+  in.close();
+  result.inputBytes = data.size();
+
+  // Sniffed like DocumentTab does when opening a file
+  QTextDocument doc;
+  QString error;
+  if (!DocumentIO::read(data, DocumentIO::detectFormat(data), &doc, &error)) {
+    result.error =
+        error.isEmpty() ? QStringLiteral("Unreadable document") : error;
+    return result;
+  }
+  result.readNsecs = timer.nsecsElapsed();
+
+  timer.restart();
+  const QByteArray output = DocumentIO::write(&doc, target);
+  QDir().mkpath(QFileInfo(job.output).path());
+  QSaveFile out(job.output);
+  if (!out.open(QIODevice::WriteOnly) || out.write(output) != output.size() ||
+      !out.commit()) {
+    result.error = out.errorString();
+    return result;
+  }
+  result.writeNsecs = timer.nsecsElapsed();
+  result.outputBytes = output.size();
+  result.ok = true;
+  return result;
+}
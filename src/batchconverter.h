@@ -0,0 +1,70 @@
+#ifndef BATCHCONVERTER_H
+#define BATCHCONVERTER_H
+
+#include "documentio.h"
+
+#include <QObject>
+#include <QQueue>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+/**
+ * Converts files between the formats DocumentIO knows, several at a time.
+ *
+ * Every file is read, converted and written on a worker thread with a
+ * QTextDocument of its own; results come back on the owner's thread in
+ * completion order. Like FileLoadQueue, only a few files per thread are
+ * queued at once, so a batch of thousands does not pile up in memory.
+ */
+class BatchConverter : public QObject {
+  Q_OBJECT
+
+public:
+  struct Job {
+    QString input;
+    QString output;
+  };
+
+  struct Result {
+    Job job;
+    bool ok = false;
+    QString error;
+    qint64 inputBytes = 0;
+    qint64 outputBytes = 0;
+    qint64 readNsecs = 0;  // reading and parsing
+    qint64 writeNsecs = 0; // serializing and writing
+  };
+
+  explicit BatchConverter(DocumentIO::Format target,
+                          QObject *parent = nullptr);
+  ~BatchConverter() override;
+
+  void setThreadCount(int count);
+  int threadCount() const { return m_pool.maxThreadCount(); }
+
+  void enqueue(const QVector<Job> &jobs);
+
+  // Jobs queued or being converted
+  int pendingCount() const { return m_queue.size() + m_inFlight; }
+
+  // One conversion on the calling thread
+  static Result convert(const Job &job, DocumentIO::Format target);
+
+Q_SIGNALS:
+  void converted(const BatchConverter::Result &result);
+  void finished();
+
+private:
+  void startJobs();
+  void onJobDone(const Result &result);
+
+  DocumentIO::Format m_target;
+  QThreadPool m_pool;
+  QQueue<Job> m_queue;
+  int m_inFlight = 0;
+};
+
+Q_DECLARE_METATYPE(BatchConverter::Result)
+
+#endif // BATCHCONVERTER_H
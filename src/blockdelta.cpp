@@ -0,0 +1,23 @@
+#include "blockdelta.h"
+
+#include <QTextBlock>
+#include <QTextDocument>
+
+BlockDelta BlockDelta::fromContentsChange(const QTextDocument *doc,
+                                          int position, int charsAdded,
+                                          int previousBlockCount) {
+  // The changed range after the edit, and how the block count moved
+  QTextBlock first = doc->findBlock(position);
+  QTextBlock last = doc->findBlock(position + charsAdded);
+  if (!first.isValid())
+    first = doc->lastBlock();
+  if (!last.isValid())
+    last = doc->lastBlock();
+
+  BlockDelta delta;
+  delta.firstBlock = first.blockNumber();
+  delta.addedBlocks = last.blockNumber() - first.blockNumber() + 1;
+  delta.removedBlocks =
+      delta.addedBlocks - (doc->blockCount() - previousBlockCount);
+  return delta;
+}
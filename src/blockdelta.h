@@ -0,0 +1,51 @@
+#ifndef BLOCKDELTA_H
+#define BLOCKDELTA_H
+
+#include <QVector>
+
+class QTextDocument;
+
+/**
+ * One edit of a document at block level: blocks [firstBlock, firstBlock +
+ * addedBlocks) replaced the removedBlocks blocks that started at firstBlock
+ * before the edit.
+ *
+ * Caches that keep one entry per block follow the document through
+ * splice(). A delta that does not fit the cache, or a cache that no longer
+ * has one entry per block afterwards, means a change was missed; the
+ * caller then starts over from the whole document.
+ */
+struct BlockDelta {
+  int firstBlock = 0;
+  int removedBlocks = 0;
+  int addedBlocks = 0;
+
+  // The delta of a QTextDocument::contentsChange(), given the block count
+  // before it
+  static BlockDelta fromContentsChange(const QTextDocument *doc, int position,
+                                       int charsAdded, int previousBlockCount);
+
+  int blockCountChange() const { return addedBlocks - removedBlocks; }
+
+  // Whether the removed blocks lie within blockCount blocks
+  bool fits(qsizetype blockCount) const {
+    return firstBlock >= 0 && removedBlocks >= 0 && addedBlocks >= 0 &&
+           firstBlock + removedBlocks <= blockCount;
+  }
+
+  // Replace the removed entries with default ones for the added blocks.
+  // False if the cache does not end up with blockCount entries.
+  template <typename T>
+  bool splice(QVector<T> &blocks, int blockCount) const {
+    if (!fits(blocks.size()))
+      return false;
+    // Typing inside a line keeps the block count; no need to move anything
+    if (removedBlocks != addedBlocks) {
+      blocks.remove(firstBlock, removedBlocks);
+      blocks.insert(firstBlock, addedBlocks, T());
+    }
+    return blocks.size() == blockCount;
+  }
+};
+
+#endif // BLOCKDELTA_H
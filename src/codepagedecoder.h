@@ -0,0 +1,58 @@
+#ifndef CODEPAGEDECODER_H
+#define CODEPAGEDECODER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringDecoder>
+
+/**
+ * Decodes text in the Windows code pages that RTF names with \ansicpg,
+ * \cpg and \fcharset.
+ *
+ * Single-byte code pages go through a 256-entry table. The double-byte
+ * ones (932 Shift-JIS, 936 GBK, 949 Korean, 950 Big5) are split into
+ * characters here and decoded by QStringDecoder, whose codecs come from
+ * ICU; without them every double-byte character becomes U+FFFD. A lead
+ * byte at the end of the data waits for its trail byte in the next call, so
+ * callers may pass the bytes of one run in pieces.
+ */
+class CodePageDecoder {
+public:
+  // Unsupported code pages decode as 1252
+  explicit CodePageDecoder(int codePage = 1252);
+
+  int codePage() const { return m_codePage; }
+  bool isDoubleByte() const { return m_doubleByte; }
+
+  // Whether double-byte characters decode to more than U+FFFD
+  bool isValid() const { return !m_doubleByte || m_decoder.isValid(); }
+
+  // Appends the decoded data to text
+  void decode(const char *data, qsizetype size, QString &text);
+  void decode(const QByteArray &data, QString &text) {
+    decode(data.constData(), data.size(), text);
+  }
+
+  // Whether a lead byte waits for its trail byte
+  bool hasPendingByte() const { return m_pending >= 0; }
+
+  // Ends the run, appending U+FFFD for a lead byte without its trail byte
+  void finish(QString &text);
+
+  static bool isSupported(int codePage);
+
+  // Code page of an \fcharset, or 0 for the document's own
+  static int codePageForCharset(int charset);
+
+private:
+  bool isLeadByte(uchar byte) const;
+  void decodeCharacters(const char *data, qsizetype size, QString &text);
+
+  int m_codePage;
+  bool m_doubleByte = false;
+  char16_t m_table[256]; // single-byte code pages
+  QStringDecoder m_decoder;
+  int m_pending = -1; // lead byte waiting for its trail byte
+};
+
+#endif // CODEPAGEDECODER_H
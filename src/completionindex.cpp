@@ -0,0 +1,182 @@
+#include "completionindex.h"
+#include "blockdelta.h"
+#include "wordtokenizer.h"
+
+#include <QTextBlock>
+#include <QTextDocument>
+
+namespace {
+
+// Shorter words are faster to type than to pick; longer runs are rarely
+// words
+const int kMinWordLength = 3;
+const int kMaxWordLength = 64;
+
+} // namespace
+
+CompletionIndex::CompletionIndex(QObject *parent)
+    : QObject(parent), m_state(std::make_shared<State>()) {
+  m_pool.setMaxThreadCount(1);
+}
+
+CompletionIndex::~CompletionIndex() {
+  // The worker reports back to this object
+  ++m_generation;
+  m_pool.waitForDone();
+}
+
+qint64 CompletionIndex::memoryUsage() const {
+  qint64 bytes = m_state->trie.memoryUsage();
+  for (const QVector<QVector<quint32>> &blocks : std::as_const(m_state->docs)) {
+    bytes += qint64(blocks.capacity()) * sizeof(QVector<quint32>);
+    for (const QVector<quint32> &ids : blocks) {
+      bytes += qint64(ids.capacity()) * sizeof(quint32);
+    }
+  }
+  return bytes;
+}
+
+void CompletionIndex::indexBlock(RadixTrie &trie, const QString &text,
+                                 QVector<quint32> &ids) {
+  ids.clear();
+  WordTokenizer::forEachWord(text, [&](int start, int length) {
+    if (length >= kMinWordLength && length <= kMaxWordLength) {
+      ids.append(trie.insert(QStringView(text).mid(start, length)));
+    }
+  });
+}
+
+void CompletionIndex::unindexBlock(RadixTrie &trie,
+                                   const QVector<quint32> &ids) {
+  for (quint32 id : ids) {
+    trie.remove(id);
+  }
+}
+
+void CompletionIndex::touch(const QString &docId) {
+  if (m_rebuilding) {
+    m_touched.insert(docId);
+  }
+}
+
+void CompletionIndex::addDocument(const QString &docId,
+                                  const QTextDocument *doc) {
+  removeDocument(docId);
+  if (!doc)
+    return;
+
+  touch(docId);
+  QVector<QVector<quint32>> &blocks = m_state->docs[docId];
+  blocks.resize(doc->blockCount());
+  int i = 0;
+  for (QTextBlock block = doc->begin(); block.isValid() && i < blocks.size();
+       block = block.next(), ++i) {
+    indexBlock(m_state->trie, block.text(), blocks[i]);
+  }
+}
+
+void CompletionIndex::removeDocument(const QString &docId) {
+  auto it = m_state->docs.find(docId);
+  if (it == m_state->docs.end())
+    return;
+
+  touch(docId);
+  for (const QVector<quint32> &ids : std::as_const(*it)) {
+    unindexBlock(m_state->trie, ids);
+  }
+  m_state->docs.erase(it);
+}
+
+void CompletionIndex::updateBlocks(const QString &docId,
+                                   const QTextDocument *doc, int firstBlock,
+                                   int removedBlocks, int addedBlocks) {
+  auto it = m_state->docs.find(docId);
+  const BlockDelta delta{firstBlock, removedBlocks, addedBlocks};
+  if (it == m_state->docs.end() || !doc || !delta.fits(it->size())) {
+    addDocument(docId, doc);
+    return;
+  }
+
+  touch(docId);
+  QVector<QVector<quint32>> &blocks = *it;
+  for (int i = firstBlock; i < firstBlock + removedBlocks; ++i) {
+    unindexBlock(m_state->trie, blocks[i]);
+  }
+  if (!delta.splice(blocks, doc->blockCount())) {
+    addDocument(docId, doc);
+    return;
+  }
+
+  QTextBlock block = doc->findBlockByNumber(firstBlock);
+  for (int i = firstBlock; i < firstBlock + addedBlocks && block.isValid();
+       ++i, block = block.next()) {
+    indexBlock(m_state->trie, block.text(), blocks[i]);
+  }
+}
+
+QStringList CompletionIndex::complete(const QString &prefix,
+                                      int maxResults) const {
+  // One extra in case the prefix itself is a word
+  QStringList words = m_state->trie.complete(prefix, maxResults + 1);
+  words.removeOne(prefix);
+  while (words.size() > maxResults)
+    words.removeLast();
+  return words;
+}
+
+void CompletionIndex::rebuild(
+    const QVector<QPair<QString, QStringList>> &documents) {
+  const quint64 generation = ++m_generation;
+  m_rebuilding = true;
+  m_touched.clear();
+
+  m_pool.start([this, documents, generation]() {
+    auto rebuilt = std::make_shared<State>();
+    for (const auto &document : documents) {
+      QVector<QVector<quint32>> &blocks = rebuilt->docs[document.first];
+      blocks.resize(document.second.size());
+      for (int i = 0; i < document.second.size(); ++i) {
+        indexBlock(rebuilt->trie, document.second[i], blocks[i]);
+      }
+    }
+    QMetaObject::invokeMethod(
+        this, [this, rebuilt, generation]() {
+          adoptRebuilt(rebuilt, generation);
+        },
+        Qt::QueuedConnection);
+  });
+}
+
+void CompletionIndex::adoptRebuilt(std::shared_ptr<State> rebuilt,
+                                   quint64 generation) {
+  if (generation != m_generation)
+    return;
+
+  // Documents edited, added or closed meanwhile are taken over from the
+  // live index, which saw every change
+  for (const QString &docId : std::as_const(m_touched)) {
+    auto stale = rebuilt->docs.find(docId);
+    if (stale != rebuilt->docs.end()) {
+      for (const QVector<quint32> &ids : std::as_const(*stale)) {
+        unindexBlock(rebuilt->trie, ids);
+      }
+      rebuilt->docs.erase(stale);
+    }
+
+    auto live = m_state->docs.constFind(docId);
+    if (live == m_state->docs.constEnd())
+      continue;
+    QVector<QVector<quint32>> &blocks = rebuilt->docs[docId];
+    blocks.resize(live->size());
+    for (int i = 0; i < live->size(); ++i) {
+      blocks[i].reserve(live->at(i).size());
+      for (quint32 id : live->at(i)) {
+        blocks[i].append(rebuilt->trie.insert(m_state->trie.word(id)));
+      }
+    }
+  }
+
+  m_state = rebuilt;
+  m_touched.clear();
+  m_rebuilding = false;
+}
@@ -0,0 +1,68 @@
+#ifndef COMPLETIONINDEX_H
+#define COMPLETIONINDEX_H
+
+#include "radixtrie.h"
+
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+
+#include <memory>
+
+class QTextDocument;
+
+/**
+ * Words of all open documents for completion, with their frequencies.
+ *
+ * Documents are kept as per-block lists of word ids into one shared
+ * RadixTrie, so an edit only re-counts the blocks it touched. A full
+ * rebuild, as after restoring a session, runs on a worker thread while the
+ * old index keeps answering.
+ */
+class CompletionIndex : public QObject {
+  Q_OBJECT
+
+public:
+  explicit CompletionIndex(QObject *parent = nullptr);
+  ~CompletionIndex() override;
+
+  void addDocument(const QString &docId, const QTextDocument *doc);
+  void removeDocument(const QString &docId);
+  void updateBlocks(const QString &docId, const QTextDocument *doc,
+                    int firstBlock, int removedBlocks, int addedBlocks);
+
+  // Replace the index with one built in the background from the block
+  // texts of each document
+  void rebuild(const QVector<QPair<QString, QStringList>> &documents);
+  bool isRebuilding() const { return m_rebuilding; }
+
+  QStringList complete(const QString &prefix, int maxResults) const;
+
+  int wordCount() const { return m_state->trie.wordCount(); }
+  qint64 memoryUsage() const;
+
+private:
+  struct State {
+    RadixTrie trie;
+    QHash<QString, QVector<QVector<quint32>>> docs; // doc -> block -> ids
+  };
+
+  static void indexBlock(RadixTrie &trie, const QString &text,
+                         QVector<quint32> &ids);
+  static void unindexBlock(RadixTrie &trie, const QVector<quint32> &ids);
+  void touch(const QString &docId);
+  void adoptRebuilt(std::shared_ptr<State> rebuilt, quint64 generation);
+
+  std::shared_ptr<State> m_state;
+  QThreadPool m_pool;
+  quint64 m_generation = 0;
+  bool m_rebuilding = false;
+  // Documents changed while a rebuild was running
+  QSet<QString> m_touched;
+};
+
+#endif // COMPLETIONINDEX_H
@@ -0,0 +1,242 @@
+#include "converttool.h"
+#include "batchconverter.h"
+#include "trace.h"
+
+#include <QCommandLineParser>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QSet>
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char *const kDocumentPatterns[] = {"*.rtf", "*.html", "*.htm",
+                                         "*.txt"};
+
+double milliseconds(qint64 nsecs) { return double(nsecs) / 1e6; }
+
+// Below outDir at the same path relative to base, or next to the input
+// without an output directory
+QString outputPath(const QFileInfo &input, const QDir &base,
+                   const QString &outDir, const QString &suffix) {
+  const QString name =
+      input.completeBaseName() + QLatin1Char('.') + suffix;
+  if (outDir.isEmpty())
+    return input.dir().filePath(name);
+
+  const QString relativeDir = base.relativeFilePath(input.absolutePath());
+  return QDir::cleanPath(QDir(outDir).filePath(relativeDir) +
+                         QLatin1Char('/') + name);
+}
+
+} // namespace
+
+bool ConvertTool::isRequested(int argc, char *argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--convert") == 0)
+      return true;
+  }
+  return false;
+}
+
+int ConvertTool::run(QGuiApplication &app) {
+  QCoreApplication::setApplicationName(QStringLiteral("knotepad"));
+  QCoreApplication::setApplicationVersion(QStringLiteral("1.0"));
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+      QStringLiteral("Converts documents without opening the editor."));
+  parser.addHelpOption();
+  parser.addVersionOption();
+  QCommandLineOption convertOption(QStringLiteral("convert"),
+                                   QStringLiteral("Convert and exit."));
+  QCommandLineOption toOption(QStringLiteral("to"),
+                              QStringLiteral("Target format: html, rtf or "
+                                             "txt."),
+                              QStringLiteral("format"));
+  QCommandLineOption outputOption(
+      QStringList() << QStringLiteral("o") << QStringLiteral("output"),
+      QStringLiteral("Output directory; next to each input by default."),
+      QStringLiteral("dir"));
+  QCommandLineOption jobsOption(
+      QStringList() << QStringLiteral("j") << QStringLiteral("jobs"),
+      QStringLiteral("Files converted in parallel; one per core by "
+                     "default."),
+      QStringLiteral("count"));
+  QCommandLineOption quietOption(
+      QStringList() << QStringLiteral("q") << QStringLiteral("quiet"),
+      QStringLiteral("Report only failures and the summary."));
+  QCommandLineOption traceOption(
+      QStringLiteral("trace"),
+      QStringLiteral("Save timing spans as Chrome trace JSON to <file>."),
+      QStringLiteral("file"));
+  parser.addOptions({convertOption, toOption, outputOption, jobsOption,
+                     quietOption, traceOption});
+  parser.addPositionalArgument(QStringLiteral("inputs"),
+                               QStringLiteral("Files or directories."),
+                               QStringLiteral("inputs..."));
+  parser.process(app);
+
+  const QString tracePath = parser.value(traceOption);
+  if (!tracePath.isEmpty()) {
+    Trace::setEnabled(true);
+  }
+
+  DocumentIO::Format target = DocumentIO::Format::Html;
+  const QString to = parser.value(toOption).toLower();
+  bool knownFormat = false;
+  for (DocumentIO::Format format :
+       {DocumentIO::Format::Html, DocumentIO::Format::Rtf,
+        DocumentIO::Format::PlainText}) {
+    if (to == DocumentIO::suffix(format)) {
+      target = format;
+      knownFormat = true;
+    }
+  }
+  if (!knownFormat) {
+    std::fprintf(stderr, "--to must be html, rtf or txt\n");
+    return 2;
+  }
+
+  int threads = 0;
+  if (parser.isSet(jobsOption)) {
+    bool ok = false;
+    threads = parser.value(jobsOption).toInt(&ok);
+    if (!ok || threads < 1) {
+      std::fprintf(stderr, "-j needs a positive number\n");
+      return 2;
+    }
+  }
+
+  const QStringList inputs = parser.positionalArguments();
+  if (inputs.isEmpty()) {
+    std::fprintf(stderr, "no inputs given\n");
+    return 2;
+  }
+
+  QString outDir;
+  if (parser.isSet(outputOption)) {
+    outDir = QFileInfo(parser.value(outputOption)).absoluteFilePath();
+  }
+  const QString suffix = DocumentIO::suffix(target);
+  QStringList patterns;
+  for (const char *pattern : kDocumentPatterns) {
+    patterns.append(QLatin1String(pattern));
+  }
+
+  // Gather every job up front, so that outputs written by this run are not
+  // picked up as inputs
+  QVector<BatchConverter::Job> jobs;
+  QSet<QString> outputs;
+  int failures = 0;
+  auto addJob = [&](const QFileInfo &input, const QDir &base) {
+    BatchConverter::Job job;
+    job.input = input.absoluteFilePath();
+    job.output = outputPath(input, base, outDir, suffix);
+    if (job.output == job.input) {
+      std::fprintf(stderr, "skipped %s: already %s\n", qPrintable(job.input),
+                   qPrintable(suffix));
+      ++failures;
+      return;
+    }
+    if (outputs.contains(job.output)) {
+      std::fprintf(stderr, "skipped %s: %s is written by another input\n",
+                   qPrintable(job.input), qPrintable(job.output));
+      ++failures;
+      return;
+    }
+    outputs.insert(job.output);
+    jobs.append(job);
+  };
+
+  for (const QString &path : inputs) {
+    const QFileInfo info(path);
+    if (info.isDir()) {
+      const QDir base(info.absoluteFilePath());
+      QStringList files;
+      QDirIterator it(base.path(), patterns, QDir::Files,
+                      QDirIterator::Subdirectories);
+      while (it.hasNext()) {
+        const QString file = it.next();
+        // Results of an earlier run into a directory below this one
+        if (!outDir.isEmpty() &&
+            file.startsWith(QString(outDir + QLatin1Char('/')))) {
+          continue;
+        }
+        files.append(file);
+      }
+      // Same order on every run, for comparable timings
+      files.sort();
+      for (const QString &file : std::as_const(files)) {
+        addJob(QFileInfo(file), base);
+      }
+    } else if (info.isFile()) {
+      addJob(info, info.absoluteDir());
+    } else {
+      std::fprintf(stderr, "no such file or directory: %s\n",
+                   qPrintable(path));
+      ++failures;
+    }
+  }
+
+  BatchConverter converter(target);
+  if (threads > 0) {
+    converter.setThreadCount(threads);
+  }
+
+  const bool quiet = parser.isSet(quietOption);
+  int converted = 0;
+  qint64 inputBytes = 0;
+  qint64 outputBytes = 0;
+  QObject::connect(
+      &converter, &BatchConverter::converted,
+      [&](const BatchConverter::Result &result) {
+        if (!result.ok) {
+          ++failures;
+          std::fprintf(stderr, "failed %s: %s\n",
+                       qPrintable(result.job.input),
+                       qPrintable(result.error));
+          return;
+        }
+        ++converted;
+        inputBytes += result.inputBytes;
+        outputBytes += result.outputBytes;
+        if (!quiet) {
+          std::printf("%9.1f ms (read %.1f, write %.1f)  %s -> %s\n",
+                      milliseconds(result.readNsecs + result.writeNsecs),
+                      milliseconds(result.readNsecs),
+                      milliseconds(result.writeNsecs),
+                      qPrintable(result.job.input),
+                      qPrintable(result.job.output));
+        }
+      });
+  QObject::connect(&converter, &BatchConverter::finished, &app,
+                   &QCoreApplication::quit);
+
+  QElapsedTimer timer;
+  timer.start();
+  if (!jobs.isEmpty()) {
+    converter.enqueue(jobs);
+    app.exec();
+  }
+  const double seconds = double(qMax<qint64>(timer.elapsed(), 1)) / 1000.0;
+
+  std::printf("%d of %d files converted in %.2f s on %d threads: "
+              "%.1f files/s, %.1f MB/s read, %.1f MB written\n",
+              converted, int(jobs.size()), seconds, converter.threadCount(),
+              double(converted) / seconds,
+              double(inputBytes) / (1024.0 * 1024.0) / seconds,
+              double(outputBytes) / (1024.0 * 1024.0));
+
+  if (!tracePath.isEmpty() && !Trace::writeChromeJson(tracePath)) {
+    std::fprintf(stderr, "could not write trace to %s\n",
+                 qPrintable(tracePath));
+    return 1;
+  }
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,25 @@
+#ifndef CONVERTTOOL_H
+#define CONVERTTOOL_H
+
+class QGuiApplication;
+
+/**
+ * The headless "knotepad --convert" mode.
+ *
+ *   knotepad --convert [-j N] --to html|rtf|txt [-o DIR] INPUT...
+ *
+ * Inputs are files or directories, which are searched recursively for
+ * documents. Each output is named after its input with the suffix of the
+ * target format, in DIR or next to the input; the relative layout below an
+ * input directory is kept. One line per file reports its timing, and a
+ * summary follows at the end.
+ */
+class ConvertTool {
+public:
+  // Whether the command line asks for conversion rather than the editor
+  static bool isRequested(int argc, char *argv[]);
+
+  static int run(QGuiApplication &app);
+};
+
+#endif // CONVERTTOOL_H
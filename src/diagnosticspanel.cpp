@@ -0,0 +1,250 @@
+#include "diagnosticspanel.h"
+#include "completionindex.h"
+#include "documenttab.h"
+#include "formatpool.h"
+#include "processmemory.h"
+#include "sessionmanager.h"
+
+#include <QFormLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLocale>
+#include <QSpinBox>
+#include <QTabWidget>
+#include <QTimer>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+#include <KConfigGroup>
+#include <KLocalizedString>
+#include <KSharedConfig>
+
+namespace {
+
+enum MemoryColumn {
+  TabColumn,
+  CharactersColumn,
+  BlocksColumn,
+  FragmentsColumn,
+  FormatsColumn,
+  DocumentColumn,
+  LayoutColumn,
+  UndoColumn,
+  BackupColumn,
+  MemoryColumnCount
+};
+
+QString byteSize(qint64 bytes) {
+  return bytes < 0 ? i18n("Unknown") : QLocale().formattedDataSize(bytes);
+}
+
+} // namespace
+
+DiagnosticsPanel::DiagnosticsPanel(StallWatchdog *watchdog, QTabWidget *tabs,
+                                   const SessionManager *sessions,
+                                   const CompletionIndex *completion,
+                                   QWidget *parent)
+    : QWidget(parent), m_watchdog(watchdog), m_tabs(tabs),
+      m_sessions(sessions), m_completion(completion) {
+  QVBoxLayout *layout = new QVBoxLayout(this);
+  layout->setContentsMargins(0, 0, 0, 0);
+
+  m_pages = new QTabWidget(this);
+  m_pages->setDocumentMode(true);
+  layout->addWidget(m_pages);
+
+  // --- Stalls ---
+  QWidget *stallPage = new QWidget(m_pages);
+  QVBoxLayout *stallLayout = new QVBoxLayout(stallPage);
+
+  m_thresholdSpin = new QSpinBox(stallPage);
+  m_thresholdSpin->setRange(10, 10000);
+  m_thresholdSpin->setSingleStep(10);
+  m_thresholdSpin->setSuffix(i18n(" ms"));
+  m_thresholdSpin->setValue(m_watchdog->threshold());
+  QFormLayout *form = new QFormLayout;
+  form->addRow(i18n("Report stalls over:"), m_thresholdSpin);
+  stallLayout->addLayout(form);
+
+  m_stalls = new QTreeWidget(stallPage);
+  m_stalls->setColumnCount(4);
+  m_stalls->setHeaderLabels(QStringList() << i18n("Time") << i18n("Duration")
+                                          << i18n("Operation")
+                                          << i18n("Size"));
+  m_stalls->setRootIsDecorated(false);
+  m_stalls->setUniformRowHeights(true);
+  m_stalls->header()->setStretchLastSection(true);
+  stallLayout->addWidget(m_stalls);
+
+  m_stallSummary = new QLabel(stallPage);
+  m_stallSummary->setWordWrap(true);
+  stallLayout->addWidget(m_stallSummary);
+
+  m_pages->addTab(stallPage, i18n("Stalls"));
+
+  // --- Memory ---
+  m_memoryPage = new QWidget(m_pages);
+  QVBoxLayout *memoryLayout = new QVBoxLayout(m_memoryPage);
+
+  m_memory = new QTreeWidget(m_memoryPage);
+  m_memory->setColumnCount(MemoryColumnCount);
+  m_memory->setHeaderLabels(QStringList()
+                            << i18n("Tab") << i18n("Characters")
+                            << i18n("Blocks") << i18n("Fragments")
+                            << i18n("Formats") << i18n("Document")
+                            << i18n("Layout") << i18n("Undo")
+                            << i18n("Backup on Disk"));
+  m_memory->setRootIsDecorated(false);
+  m_memory->setUniformRowHeights(true);
+  memoryLayout->addWidget(m_memory);
+
+  m_memorySummary = new QLabel(m_memoryPage);
+  m_memorySummary->setWordWrap(true);
+  memoryLayout->addWidget(m_memorySummary);
+
+  m_pages->addTab(m_memoryPage, i18n("Memory"));
+
+  // Every figure comes from a counter, so a refresh per second is cheap
+  m_memoryTimer = new QTimer(this);
+  m_memoryTimer->setInterval(1000);
+  connect(m_memoryTimer, &QTimer::timeout, this,
+          &DiagnosticsPanel::refreshMemory);
+  connect(m_pages, &QTabWidget::currentChanged, this,
+          &DiagnosticsPanel::refreshMemory);
+
+  // Applied when editing stops, not on every step of the spin box
+  connect(m_thresholdSpin, &QSpinBox::editingFinished, this,
+          [this]() { setThreshold(m_thresholdSpin->value()); });
+  connect(m_watchdog, &StallWatchdog::stallDetected, this,
+          &DiagnosticsPanel::addStall);
+  updateSummary();
+}
+
+void DiagnosticsPanel::addStall(const StallWatchdog::Stall &stall) {
+  ++m_stallCount;
+  m_longestStall = qMax(m_longestStall, stall.milliseconds);
+
+  QTreeWidgetItem *item = new QTreeWidgetItem;
+  item->setText(0, stall.when.time().toString(QStringLiteral("HH:mm:ss.zzz")));
+  item->setText(1, i18n("%1 ms", stall.milliseconds));
+  item->setTextAlignment(1, Qt::AlignRight | Qt::AlignVCenter);
+  item->setText(2, stall.operation.isEmpty() ? i18n("Unknown")
+                                             : stall.operation);
+  item->setText(3, stall.documentSize > 0
+                       ? QLocale().toString(stall.documentSize)
+                       : QString());
+  item->setTextAlignment(3, Qt::AlignRight | Qt::AlignVCenter);
+  m_stalls->insertTopLevelItem(0, item);
+
+  while (m_stalls->topLevelItemCount() > kMaxStallRows) {
+    delete m_stalls->takeTopLevelItem(m_stalls->topLevelItemCount() - 1);
+  }
+  updateSummary();
+}
+
+void DiagnosticsPanel::setThreshold(int milliseconds) {
+  if (milliseconds == m_watchdog->threshold())
+    return;
+
+  KConfigGroup group(KSharedConfig::openConfig(),
+                     QStringLiteral("Diagnostics"));
+  group.writeEntry("StallThresholdMs", milliseconds);
+
+  m_watchdog->stop();
+  m_watchdog->setThreshold(milliseconds);
+  m_watchdog->start();
+}
+
+void DiagnosticsPanel::showEvent(QShowEvent *event) {
+  QWidget::showEvent(event);
+  refreshMemory();
+  m_memoryTimer->start();
+}
+
+void DiagnosticsPanel::hideEvent(QHideEvent *event) {
+  QWidget::hideEvent(event);
+  m_memoryTimer->stop();
+}
+
+void DiagnosticsPanel::refreshMemory() {
+  if (!isVisible() || m_pages->currentWidget() != m_memoryPage)
+    return;
+
+  const QLocale locale;
+  const int count = m_tabs->count();
+  while (m_memory->topLevelItemCount() > count) {
+    delete m_memory->takeTopLevelItem(m_memory->topLevelItemCount() - 1);
+  }
+  while (m_memory->topLevelItemCount() < count) {
+    QTreeWidgetItem *item = new QTreeWidgetItem(m_memory);
+    for (int column = CharactersColumn; column < MemoryColumnCount;
+         ++column) {
+      item->setTextAlignment(column, Qt::AlignRight | Qt::AlignVCenter);
+    }
+  }
+
+  DocumentTab::MemoryUsage total;
+  qint64 backupTotal = 0;
+  int hibernated = 0;
+  for (int i = 0; i < count; ++i) {
+    DocumentTab *tab = qobject_cast<DocumentTab *>(m_tabs->widget(i));
+    QTreeWidgetItem *item = m_memory->topLevelItem(i);
+    if (!tab)
+      continue;
+
+    const DocumentTab::MemoryUsage usage = tab->memoryUsage();
+    const qint64 backup = m_sessions->backupSize(tab->sessionId());
+    if (tab->isHibernated()) {
+      ++hibernated;
+      item->setText(TabColumn, i18n("%1 (hibernated)", tab->tabTitle()));
+    } else {
+      item->setText(TabColumn, tab->tabTitle());
+    }
+    item->setText(CharactersColumn, locale.toString(usage.characters));
+    item->setText(BlocksColumn, locale.toString(usage.blocks));
+    item->setText(FragmentsColumn, locale.toString(usage.fragments));
+    item->setText(FormatsColumn, locale.toString(usage.formats));
+    item->setText(DocumentColumn, byteSize(usage.documentBytes));
+    item->setText(LayoutColumn, byteSize(usage.layoutBytes));
+    item->setText(UndoColumn, byteSize(usage.undoBytes));
+    item->setText(BackupColumn, byteSize(backup));
+
+    total.characters += usage.characters;
+    total.documentBytes += usage.documentBytes;
+    total.layoutBytes += usage.layoutBytes;
+    total.undoBytes += usage.undoBytes;
+    backupTotal += backup;
+  }
+
+  const QString tabs =
+      i18n("%1 tabs, %2 hibernated, %3 characters. Estimated: documents %4, "
+           "layout %5, undo %6, completion index %7.",
+           count, hibernated, locale.toString(total.characters),
+           byteSize(total.documentBytes), byteSize(total.layoutBytes),
+           byteSize(total.undoBytes), byteSize(m_completion->memoryUsage()));
+  const QString process =
+      i18n("Backups on disk: %1. Process resident: %2, peak %3.",
+           byteSize(backupTotal), byteSize(ProcessMemory::residentBytes()),
+           byteSize(ProcessMemory::peakResidentBytes()));
+  const FormatPool::Stats pool = FormatPool::instance().stats();
+  const QString formats =
+      i18n("Format pool: %1 formats, %2 font families, %3 of %4 lookups "
+           "shared.",
+           pool.formats, pool.families, locale.toString(pool.hits),
+           locale.toString(pool.lookups));
+  m_memorySummary->setText(tabs + QLatin1Char('\n') + process +
+                           QLatin1Char('\n') + formats);
+}
+
+void DiagnosticsPanel::updateSummary() {
+  if (m_stallCount == 0) {
+    m_stallSummary->setText(
+        i18n("No stalls so far. Stalls are also written to %1.",
+             m_watchdog->logPath()));
+    return;
+  }
+  m_stallSummary->setText(
+      i18np("1 stall, longest %2 ms. Stalls are also written to %3.",
+            "%1 stalls, longest %2 ms. Stalls are also written to %3.",
+            m_stallCount, m_longestStall, m_watchdog->logPath()));
+}
@@ -0,0 +1,60 @@
+#ifndef DIAGNOSTICSPANEL_H
+#define DIAGNOSTICSPANEL_H
+
+#include "stallwatchdog.h"
+
+#include <QWidget>
+
+class CompletionIndex;
+class QLabel;
+class QSpinBox;
+class QTabWidget;
+class QTimer;
+class QTreeWidget;
+class SessionManager;
+
+// Stalls of the GUI event loop reported by the watchdog, newest first, and
+// the memory held by each tab, refreshed while it is shown
+class DiagnosticsPanel : public QWidget {
+  Q_OBJECT
+
+public:
+  // Rows kept in the stall list; the log on disk keeps more
+  static constexpr int kMaxStallRows = 500;
+
+  DiagnosticsPanel(StallWatchdog *watchdog, QTabWidget *tabs,
+                   const SessionManager *sessions,
+                   const CompletionIndex *completion,
+                   QWidget *parent = nullptr);
+
+protected:
+  void showEvent(QShowEvent *event) override;
+  void hideEvent(QHideEvent *event) override;
+
+private Q_SLOTS:
+  void addStall(const StallWatchdog::Stall &stall);
+  void setThreshold(int milliseconds);
+  void refreshMemory();
+
+private:
+  void updateSummary();
+
+  StallWatchdog *m_watchdog;
+  QTabWidget *m_tabs;
+  const SessionManager *m_sessions;
+  const CompletionIndex *m_completion;
+  int m_stallCount = 0;
+  qint64 m_longestStall = 0;
+
+  QTabWidget *m_pages;
+  QSpinBox *m_thresholdSpin;
+  QTreeWidget *m_stalls;
+  QLabel *m_stallSummary;
+
+  QWidget *m_memoryPage;
+  QTreeWidget *m_memory;
+  QLabel *m_memorySummary;
+  QTimer *m_memoryTimer;
+};
+
+#endif // DIAGNOSTICSPANEL_H
@@ -0,0 +1,95 @@
+#include "documentio.h"
+#include "rtfhandler.h"
+
+#include <QTextDocument>
+
+#include <cstring>
+
+namespace {
+
+bool startsWithNoCase(const char *data, qsizetype size, const char *prefix) {
+  const qsizetype length = qsizetype(std::strlen(prefix));
+  return size >= length && qstrnicmp(data, prefix, uint(length)) == 0;
+}
+
+} // namespace
+
+DocumentIO::Format DocumentIO::detectFormat(const QByteArray &data) {
+  // Only the opening matters, so skip leading whitespace in place instead
+  // of decoding the whole file
+  const char *p = data.constData();
+  qsizetype size = data.size();
+  while (size > 0 && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' ||
+                      *p == '\f' || *p == '\v')) {
+    ++p;
+    --size;
+  }
+
+  if (size >= 5 && std::memcmp(p, "{\\rtf", 5) == 0)
+    return Format::Rtf;
+  if (startsWithNoCase(p, size, "<!DOCTYPE html") ||
+      startsWithNoCase(p, size, "<html")) {
+    return Format::Html;
+  }
+  return Format::PlainText;
+}
+
+DocumentIO::Format DocumentIO::formatForPath(const QString &path) {
+  if (path.endsWith(QLatin1String(".txt"), Qt::CaseInsensitive))
+    return Format::PlainText;
+  if (path.endsWith(QLatin1String(".rtf"), Qt::CaseInsensitive))
+    return Format::Rtf;
+  return Format::Html;
+}
+
+QString DocumentIO::suffix(Format format) {
+  switch (format) {
+  case Format::PlainText:
+    return QStringLiteral("txt");
+  case Format::Html:
+    return QStringLiteral("html");
+  case Format::Rtf:
+    return QStringLiteral("rtf");
+  }
+  return QString();
+}
+
+bool DocumentIO::read(const QByteArray &data, Format format,
+                      QTextDocument *doc, QString *errorString) {
+  if (!doc)
+    return false;
+
+  switch (format) {
+  case Format::Rtf: {
+    RtfHandler::Error error = RtfHandler::Error::None;
+    if (RtfHandler::readRtf(data, doc, RtfHandler::Limits(), &error))
+      return true;
+    if (errorString) {
+      *errorString = RtfHandler::errorString(error);
+    }
+    return false;
+  }
+  case Format::Html:
+    doc->setHtml(QString::fromUtf8(data));
+    return true;
+  case Format::PlainText:
+    doc->setPlainText(QString::fromUtf8(data));
+    return true;
+  }
+  return false;
+}
+
+QByteArray DocumentIO::write(const QTextDocument *doc, Format format) {
+  if (!doc)
+    return QByteArray();
+
+  switch (format) {
+  case Format::Rtf:
+    return RtfHandler::writeRtf(doc);
+  case Format::Html:
+    return doc->toHtml().toUtf8();
+  case Format::PlainText:
+    return doc->toPlainText().toUtf8();
+  }
+  return QByteArray();
+}
@@ -0,0 +1,35 @@
+#ifndef DOCUMENTIO_H
+#define DOCUMENTIO_H
+
+#include <QByteArray>
+#include <QString>
+
+class QTextDocument;
+
+/**
+ * File formats knotepad reads and writes, without any editor attached.
+ *
+ * Loading sniffs the content rather than trusting the extension; saving
+ * picks the format from the extension.
+ */
+class DocumentIO {
+public:
+  enum class Format { PlainText, Html, Rtf };
+
+  // RTF and HTML are recognized by how they open, anything else is text
+  static Format detectFormat(const QByteArray &data);
+
+  // .txt and .rtf by extension, HTML for everything else
+  static Format formatForPath(const QString &path);
+
+  // Extension files of the format are saved with, without the dot
+  static QString suffix(Format format);
+
+  // False if the content could not be read in full; errorString then says
+  // why, and doc holds what was read up to that point
+  static bool read(const QByteArray &data, Format format, QTextDocument *doc,
+                   QString *errorString = nullptr);
+  static QByteArray write(const QTextDocument *doc, Format format);
+};
+
+#endif // DOCUMENTIO_H
@@ -0,0 +1,122 @@
+#include "documentstats.h"
+#include "blockdelta.h"
+#include "wordtokenizer.h"
+
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+
+DocumentStats::BlockCounts DocumentStats::countBlock(const QString &text) {
+  BlockCounts counts;
+  counts.words = WordTokenizer::countWords(text);
+  counts.characters = int(text.size());
+  return counts;
+}
+
+DocumentStats::BlockCounts DocumentStats::countBlock(const QTextBlock &block) {
+  BlockCounts counts = countBlock(block.text());
+  for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+    ++counts.fragments;
+  }
+  return counts;
+}
+
+void DocumentStats::add(const BlockCounts &counts, int sign) {
+  m_totals.words += sign * counts.words;
+  m_totals.characters += sign * counts.characters;
+  m_totals.fragments += sign * counts.fragments;
+  m_totals.lines += sign;
+  if (counts.characters > 0)
+    m_totals.paragraphs += sign;
+}
+
+void DocumentStats::reset(const QTextDocument *doc) {
+  m_blocks.clear();
+  m_totals = Counts();
+  if (!doc)
+    return;
+
+  m_blocks.reserve(doc->blockCount());
+  for (QTextBlock block = doc->begin(); block.isValid(); block = block.next()) {
+    const BlockCounts counts = countBlock(block);
+    m_blocks.append(counts);
+    add(counts, 1);
+  }
+}
+
+void DocumentStats::update(const QTextDocument *doc, int firstBlock,
+                           int removedBlocks, int addedBlocks) {
+  const BlockDelta delta{firstBlock, removedBlocks, addedBlocks};
+  if (!doc || !delta.fits(m_blocks.size())) {
+    reset(doc);
+    return;
+  }
+
+  for (int i = firstBlock; i < firstBlock + removedBlocks; ++i) {
+    add(m_blocks[i], -1);
+  }
+  if (!delta.splice(m_blocks, doc->blockCount())) {
+    reset(doc);
+    return;
+  }
+
+  QTextBlock block = doc->findBlockByNumber(firstBlock);
+  for (int i = firstBlock; i < firstBlock + addedBlocks && block.isValid();
+       ++i, block = block.next()) {
+    m_blocks[i] = countBlock(block);
+    add(m_blocks[i], 1);
+  }
+}
+
+void DocumentStats::releaseBlocks() {
+  m_blocks.clear();
+  m_blocks.squeeze();
+}
+
+DocumentStats::Counts DocumentStats::selection(const QTextCursor &cursor) const {
+  Counts counts;
+  if (!cursor.hasSelection() || !cursor.document())
+    return counts;
+
+  const QTextDocument *doc = cursor.document();
+  const int start = cursor.selectionStart();
+  const int end = cursor.selectionEnd();
+  const QTextBlock first = doc->findBlock(start);
+  const QTextBlock last = doc->findBlock(end);
+
+  auto addPartial = [&counts](const QString &text) {
+    counts.words += WordTokenizer::countWords(text);
+    counts.characters += text.size();
+    counts.lines += 1;
+    if (!text.isEmpty())
+      counts.paragraphs += 1;
+  };
+
+  if (first == last) {
+    addPartial(first.text().mid(start - first.position(), end - start));
+    return counts;
+  }
+
+  addPartial(first.text().mid(start - first.position()));
+  const int lastNumber = last.blockNumber();
+  const bool cached = m_blocks.size() == doc->blockCount();
+  QTextBlock block = first.next();
+  for (int i = first.blockNumber() + 1; i < lastNumber; ++i) {
+    if (cached) {
+      const BlockCounts &b = m_blocks[i];
+      counts.words += b.words;
+      counts.characters += b.characters;
+      counts.lines += 1;
+      if (b.characters > 0)
+        counts.paragraphs += 1;
+    } else {
+      addPartial(block.text());
+      block = block.next();
+    }
+  }
+  // A selection ending at the start of a line does not include that line
+  if (end > last.position()) {
+    addPartial(last.text().left(end - last.position()));
+  }
+  return counts;
+}
@@ -0,0 +1,58 @@
+#ifndef DOCUMENTSTATS_H
+#define DOCUMENTSTATS_H
+
+#include <QVector>
+
+class QTextBlock;
+class QTextCursor;
+class QTextDocument;
+
+/**
+ * Word, character, line, paragraph and fragment counts of a document.
+ *
+ * Counts are cached per block and only the blocks touched by an edit are
+ * recounted, so keeping them current costs time proportional to the edit
+ * rather than to the document.
+ */
+class DocumentStats {
+public:
+  struct Counts {
+    qint64 words = 0;
+    qint64 characters = 0; // without line breaks
+    qint64 lines = 0;
+    qint64 paragraphs = 0; // non-empty lines
+    qint64 fragments = 0;  // runs of one format; not kept for selections
+  };
+
+  // Count every block from scratch
+  void reset(const QTextDocument *doc);
+
+  // Recount after blocks [firstBlock, firstBlock + addedBlocks) replaced
+  // removedBlocks blocks, as reported by DocumentTab::blocksChanged()
+  void update(const QTextDocument *doc, int firstBlock, int removedBlocks,
+              int addedBlocks);
+
+  // Drop the per-block cache but keep the totals, for hibernated tabs
+  void releaseBlocks();
+
+  const Counts &totals() const { return m_totals; }
+
+  // Counts of the selected text; whole blocks come from the cache
+  Counts selection(const QTextCursor &cursor) const;
+
+private:
+  struct BlockCounts {
+    int words = 0;
+    int characters = 0;
+    int fragments = 0;
+  };
+
+  static BlockCounts countBlock(const QString &text);
+  static BlockCounts countBlock(const QTextBlock &block);
+  void add(const BlockCounts &counts, int sign);
+
+  QVector<BlockCounts> m_blocks;
+  Counts m_totals;
+};
+
+#endif // DOCUMENTSTATS_H
@@ -1,22 +1,68 @@
 #include "documenttab.h"
-#include "rtfhandler.h"
+#include "blockdelta.h"
+#include "documentio.h"
+#include "findbar.h"
+#include "formatpool.h"
+#include "stallwatchdog.h"
+#include "syntaxhighlighter.h"
+#include "trace.h"
 
+#include <QContextMenuEvent>
+#include <QDragEnterEvent>
+#include <QDropEvent>
 #include <QFile>
 #include <QFileInfo>
+#include <QKeyEvent>
+#include <QMenu>
+#include <QMimeData>
+#include <QScrollBar>
+#include <QTextBlock>
 #include <QTextCursor>
+#include <QTextDocumentFragment>
 #include <QTextList>
 #include <QTextListFormat>
-#include <QTextStream>
+#include <QTimer>
 #include <QVBoxLayout>
 
+#include <KConfigGroup>
+#include <KSharedConfig>
+
 DocumentTab::DocumentTab(QWidget *parent)
-    : QWidget(parent), m_editor(new QTextEdit(this)),
+    : QWidget(parent),
       m_sessionId(QUuid::createUuid().toString(QUuid::WithoutBraces)) {
   QVBoxLayout *layout = new QVBoxLayout(this);
   layout->setContentsMargins(0, 0, 0, 0);
-  layout->addWidget(m_editor);
+
+  m_highlighter = new SyntaxHighlighter(this);
+
+  KConfigGroup group(KSharedConfig::openConfig(), QStringLiteral("Memory"));
+  m_undo.setBudget(group.readEntry("UndoBudgetMB", 4) * qint64(1024 * 1024));
+
+  createEditor();
+
+  m_findBar = new FindBar(this);
+  layout->addWidget(m_findBar);
+  connect(m_findBar, &FindBar::highlightsChanged, this,
+          [this](const QList<QTextEdit::ExtraSelection> &selections) {
+            setExtraSelections(FindLayer, selections);
+          });
+}
+
+DocumentTab::~DocumentTab() = default;
+
+void DocumentTab::createEditor() {
+  m_editor = new TextEditor(this);
+  // Above the find bar, which outlives hibernation
+  static_cast<QVBoxLayout *>(layout())->insertWidget(0, m_editor);
 
   m_editor->setAcceptRichText(true);
+  // History is kept by m_undo instead
+  m_editor->document()->setUndoRedoEnabled(false);
+  // A paste inserted in slices is undone in one step
+  connect(m_editor, &TextEditor::pasteStarted, this,
+          [this]() { m_undo.beginGroup(); });
+  connect(m_editor, &TextEditor::pasteFinished, this,
+          [this]() { m_undo.endGroup(); });
   m_editor->setTabStopDistance(40);
 
   // Set a sensible default font
@@ -25,67 +71,163 @@ DocumentTab::DocumentTab(QWidget *parent)
 
   connect(m_editor->document(), &QTextDocument::contentsChanged, this,
           &DocumentTab::onContentsChanged);
+  connect(m_editor->document(), &QTextDocument::contentsChange, this,
+          &DocumentTab::onContentsChange);
   connect(m_editor, &QTextEdit::cursorPositionChanged, this,
           &DocumentTab::onCursorPositionChanged);
+  connect(m_editor, &QTextEdit::selectionChanged, this,
+          &DocumentTab::prepareUndo);
+
+  // Dropped files are opened rather than inserted as text
+  m_editor->viewport()->installEventFilter(this);
+  // Undo and redo keys and menu entries go to m_undo
+  m_editor->installEventFilter(this);
 }
 
-DocumentTab::~DocumentTab() = default;
+QStringList DocumentTab::droppedFiles(const QMimeData *mimeData) {
+  QStringList paths;
+  if (!mimeData || !mimeData->hasUrls())
+    return paths;
+
+  const QList<QUrl> urls = mimeData->urls();
+  for (const QUrl &url : urls) {
+    if (!url.isLocalFile())
+      return QStringList();
+    paths.append(url.toLocalFile());
+  }
+  return paths;
+}
+
+bool DocumentTab::eventFilter(QObject *watched, QEvent *event) {
+  if (m_editor && watched == m_editor &&
+      (event->type() == QEvent::ShortcutOverride ||
+       event->type() == QEvent::KeyPress)) {
+    QKeyEvent *key = static_cast<QKeyEvent *>(event);
+    const bool isUndo = key->matches(QKeySequence::Undo);
+    const bool isRedo = key->matches(QKeySequence::Redo);
+    if (isUndo || isRedo) {
+      if (event->type() == QEvent::KeyPress && isUndo) {
+        undo();
+      } else if (event->type() == QEvent::KeyPress) {
+        redo();
+      }
+      event->accept();
+      return true;
+    }
+  }
+
+  if (m_editor && event->type() == QEvent::ContextMenu &&
+      (watched == m_editor || watched == m_editor->viewport())) {
+    QContextMenuEvent *menu = static_cast<QContextMenuEvent *>(event);
+    QPoint pos = menu->pos();
+    if (watched == m_editor) {
+      pos = m_editor->viewport()->mapFrom(m_editor, pos);
+    }
+    showContextMenu(pos, menu->globalPos());
+    return true;
+  }
+
+  if (m_editor && watched == m_editor->viewport()) {
+    switch (event->type()) {
+    case QEvent::DragEnter:
+    case QEvent::DragMove: {
+      QDragMoveEvent *drag = static_cast<QDragMoveEvent *>(event);
+      if (!droppedFiles(drag->mimeData()).isEmpty()) {
+        drag->acceptProposedAction();
+        return true;
+      }
+      break;
+    }
+    case QEvent::Drop: {
+      QDropEvent *drop = static_cast<QDropEvent *>(event);
+      const QStringList paths = droppedFiles(drop->mimeData());
+      if (!paths.isEmpty()) {
+        drop->acceptProposedAction();
+        Q_EMIT filesDropped(paths);
+        return true;
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+  return QWidget::eventFilter(watched, event);
+}
 
 bool DocumentTab::loadFile(const QString &path) {
+  KNOTEPAD_TRACE_SCOPE("DocumentTab::loadFile");
   QFile file(path);
   if (!file.open(QIODevice::ReadOnly)) {
     return false;
   }
 
-  m_loading = true;
-
   QByteArray data = file.readAll();
   file.close();
 
-  // Detect content type
-  QByteArray trimmed = data.trimmed();
-  if (trimmed.startsWith("{\\rtf")) {
-    // RTF content — use our RTF parser
-    RtfHandler::readRtf(data, m_editor->document());
-  } else {
-    QString text = QString::fromUtf8(data);
-    if (text.trimmed().startsWith(QLatin1String("<!DOCTYPE html"),
-                                  Qt::CaseInsensitive) ||
-        text.trimmed().startsWith(QLatin1String("<html"), Qt::CaseInsensitive)) {
-      m_editor->setHtml(text);
-    } else {
-      m_editor->setPlainText(text);
-    }
+  return loadData(path, data);
+}
+
+bool DocumentTab::loadData(const QString &path, const QByteArray &data,
+                           QString *errorString) {
+  KNOTEPAD_TRACE_SCOPE("DocumentTab::loadData");
+  if (!m_editor)
+    createEditor();
+
+  m_editor->cancelPaste();
+  m_loading = true;
+  m_highlighter->detach();
+
+  // The editor's own setters also reset its cursor and view
+  bool ok = true;
+  switch (DocumentIO::detectFormat(data)) {
+  case DocumentIO::Format::Rtf: {
+    const StallWatchdog::Operation operation("Load RTF", data.size());
+    ok = DocumentIO::read(data, DocumentIO::Format::Rtf, m_editor->document(),
+                          errorString);
+    break;
+  }
+  case DocumentIO::Format::Html: {
+    const StallWatchdog::Operation operation("Load HTML", data.size());
+    m_editor->setHtml(QString::fromUtf8(data));
+    break;
+  }
+  case DocumentIO::Format::PlainText: {
+    const StallWatchdog::Operation operation("Load text", data.size());
+    m_editor->setPlainText(QString::fromUtf8(data));
+    break;
+  }
   }
 
-  m_filePath = path;
+  m_filePath = ok ? path : QString();
   m_tabTitle = QFileInfo(path).fileName();
-  m_modified = false;
+  m_modified = !ok;
   m_loading = false;
 
-  return true;
+  resetContents();
+  return ok;
 }
 
 bool DocumentTab::saveFile(const QString &path) {
+  KNOTEPAD_TRACE_SCOPE("DocumentTab::saveFile");
+  if (!m_editor)
+    return false;
+
   QFile file(path);
   if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
     return false;
   }
 
-  if (path.endsWith(QLatin1String(".txt"), Qt::CaseInsensitive)) {
-    // Plain text
-    QTextStream stream(&file);
-    stream << m_editor->toPlainText();
-  } else if (path.endsWith(QLatin1String(".rtf"), Qt::CaseInsensitive)) {
-    // Real RTF format
-    QByteArray rtfData = RtfHandler::writeRtf(m_editor->document());
-    file.write(rtfData);
-  } else {
-    // HTML (default for .html and other extensions)
-    QTextStream stream(&file);
-    stream << m_editor->toHtml();
+  const DocumentIO::Format format = DocumentIO::formatForPath(path);
+  const char *name = "Save text";
+  if (format == DocumentIO::Format::Rtf) {
+    name = "Save RTF";
+  } else if (format == DocumentIO::Format::Html) {
+    name = "Save HTML";
   }
-
+  const StallWatchdog::Operation operation(
+      name, m_editor->document()->characterCount());
+  file.write(DocumentIO::write(m_editor->document(), format));
   file.close();
 
   m_filePath = path;
@@ -102,28 +244,235 @@ void DocumentTab::setModified(bool modified) {
   }
 }
 
-QString DocumentTab::toHtml() const { return m_editor->toHtml(); }
+QString DocumentTab::toHtml() const {
+  return m_editor ? m_editor->toHtml() : QString();
+}
 
 void DocumentTab::setFromHtml(const QString &html) {
+  if (!m_editor)
+    createEditor();
+
+  m_editor->cancelPaste();
+  m_loading = true;
+  m_highlighter->detach();
+  m_editor->setHtml(html);
+  m_loading = false;
+
+  resetContents();
+}
+
+void DocumentTab::replaceContent(const QString &html) {
+  if (!m_editor)
+    return;
+
+  prepareEdit(0, m_editor->document()->characterCount());
+  QTextCursor cursor(m_editor->document());
+  cursor.beginEditBlock();
+  cursor.select(QTextCursor::Document);
+  cursor.insertFragment(QTextDocumentFragment::fromHtml(html));
+  cursor.endEditBlock();
+}
+
+void DocumentTab::undo() {
+  int position = 0;
+  if (m_editor && !m_editor->isPasting() &&
+      m_undo.undo(m_editor->document(), position)) {
+    QTextCursor cursor = m_editor->textCursor();
+    cursor.setPosition(position);
+    m_editor->setTextCursor(cursor);
+    m_editor->ensureCursorVisible();
+  }
+  Q_EMIT undoStateChanged();
+}
+
+void DocumentTab::redo() {
+  int position = 0;
+  if (m_editor && !m_editor->isPasting() &&
+      m_undo.redo(m_editor->document(), position)) {
+    QTextCursor cursor = m_editor->textCursor();
+    cursor.setPosition(position);
+    m_editor->setTextCursor(cursor);
+    m_editor->ensureCursorVisible();
+  }
+  Q_EMIT undoStateChanged();
+}
+
+bool DocumentTab::restoreUndoHistory(const QByteArray &data) {
+  const bool restored = m_editor && m_undo.restore(m_editor->document(), data);
+  Q_EMIT undoStateChanged();
+  return restored;
+}
+
+void DocumentTab::prepareEdit(int from, int to) {
+  if (!m_editor)
+    return;
+
+  const QTextDocument *doc = m_editor->document();
+  const QTextBlock first = doc->findBlock(from);
+  const QTextBlock last = doc->findBlock(to);
+  m_undo.prepare(doc, first.isValid() ? first.blockNumber() : 0,
+                 last.isValid() ? last.blockNumber() : doc->blockCount() - 1);
+}
+
+void DocumentTab::prepareUndo() {
+  if (!m_editor)
+    return;
+
+  // The selection plus the blocks a keystroke can join it with
+  const QTextCursor cursor = m_editor->textCursor();
+  const QTextDocument *doc = m_editor->document();
+  m_undo.prepare(doc, doc->findBlock(cursor.selectionStart()).blockNumber() - 1,
+                 doc->findBlock(cursor.selectionEnd()).blockNumber() + 1);
+}
+
+void DocumentTab::showContextMenu(const QPoint &pos, const QPoint &globalPos) {
+  // The standard entries act on the disabled QTextDocument stack
+  const QPoint contentsPos(pos.x() + m_editor->horizontalScrollBar()->value(),
+                           pos.y() + m_editor->verticalScrollBar()->value());
+  QMenu *menu = m_editor->createStandardContextMenu(contentsPos);
+  const QList<QAction *> actions = menu->actions();
+  for (QAction *action : actions) {
+    const QString name = action->objectName();
+    if (name == QLatin1String("edit-undo")) {
+      disconnect(action, &QAction::triggered, nullptr, nullptr);
+      action->setEnabled(canUndo());
+      connect(action, &QAction::triggered, this, &DocumentTab::undo);
+    } else if (name == QLatin1String("edit-redo")) {
+      disconnect(action, &QAction::triggered, nullptr, nullptr);
+      action->setEnabled(canRedo());
+      connect(action, &QAction::triggered, this, &DocumentTab::redo);
+    }
+  }
+  menu->exec(globalPos);
+  delete menu;
+}
+
+void DocumentTab::hibernate() {
+  if (!canHibernate())
+    return;
+
+  QTextCursor cursor = m_editor->textCursor();
+  m_savedCursorPosition = cursor.position();
+  m_savedAnchor = cursor.anchor();
+  m_savedVerticalScroll = m_editor->verticalScrollBar()->value();
+  m_savedHorizontalScroll = m_editor->horizontalScrollBar()->value();
+
+  // Deleting the editor also releases its document and layout
+  m_highlighter->detach();
+  delete m_editor;
+  m_editor = nullptr;
+  m_stats.releaseBlocks();
+  m_undo.release();
+  for (QList<QTextEdit::ExtraSelection> &selections : m_extraSelections) {
+    selections.clear();
+  }
+
+  Q_EMIT hibernated();
+}
+
+void DocumentTab::rehydrate(const QString &html) {
+  if (m_editor)
+    return;
+
+  // As setFromHtml(), but the content is the one the tab had, so the undo
+  // history and everything built from contentsReset() stay as they are
+  createEditor();
   m_loading = true;
   m_editor->setHtml(html);
   m_loading = false;
+  attachContents(true);
+
+  // Restore the selection, clamped in case the backup was shorter
+  int last = m_editor->document()->characterCount() - 1;
+  QTextCursor cursor(m_editor->document());
+  cursor.setPosition(qBound(0, m_savedAnchor, last));
+  cursor.setPosition(qBound(0, m_savedCursorPosition, last),
+                     QTextCursor::KeepAnchor);
+  m_editor->setTextCursor(cursor);
+
+  // Scroll once the document has been laid out
+  QTimer::singleShot(0, m_editor, [this]() {
+    m_editor->verticalScrollBar()->setValue(m_savedVerticalScroll);
+    m_editor->horizontalScrollBar()->setValue(m_savedHorizontalScroll);
+  });
+
+  Q_EMIT rehydrated();
+}
+
+DocumentTab::MemoryUsage DocumentTab::memoryUsage() const {
+  MemoryUsage usage;
+  usage.undoBytes = m_undo.memoryUsage();
+  usage.fragments = m_stats.totals().fragments;
+  if (!m_editor) {
+    usage.characters = m_stats.totals().characters;
+    usage.blocks = m_stats.totals().lines;
+    return usage;
+  }
+
+  const QTextDocument *doc = m_editor->document();
+  usage.characters = doc->characterCount();
+  usage.blocks = doc->blockCount();
+  // A shared copy of the format list, not a walk over the document
+  usage.formats = doc->allFormats().size();
+
+  // UTF-16 text plus a fragment map node per run and the properties of
+  // each format; glyph layout costs several bytes per character, and every
+  // block carries a layout and format bookkeeping
+  usage.documentBytes =
+      usage.characters * 2 + usage.fragments * 40 + usage.formats * 64;
+  usage.layoutBytes = usage.characters * 10 + usage.blocks * 256;
+  return usage;
+}
+
+qint64 DocumentTab::estimatedMemory() const {
+  if (!m_editor)
+    return m_undo.memoryUsage();
+
+  const MemoryUsage usage = memoryUsage();
+  return usage.documentBytes + usage.layoutBytes + usage.undoBytes;
+}
+
+void DocumentTab::showFindBar(bool replace) {
+  if (m_editor) {
+    m_findBar->activate(replace);
+  }
+}
+
+void DocumentTab::setExtraSelections(
+    SelectionLayer layer, const QList<QTextEdit::ExtraSelection> &selections) {
+  m_extraSelections[layer] = selections;
+  if (!m_editor)
+    return;
+
+  QList<QTextEdit::ExtraSelection> merged;
+  for (const QList<QTextEdit::ExtraSelection> &list : m_extraSelections) {
+    merged += list;
+  }
+  m_editor->setExtraSelections(merged);
 }
 
 void DocumentTab::mergeFormat(const QTextCharFormat &fmt) {
+  if (!m_editor)
+    return;
+
+  // Family names and brushes of the result are shared with other tabs
+  const QTextCharFormat pooled = FormatPool::instance().charFormat(fmt);
   QTextCursor cursor = m_editor->textCursor();
   if (!cursor.hasSelection()) {
     cursor.select(QTextCursor::WordUnderCursor);
   }
-  cursor.mergeCharFormat(fmt);
-  m_editor->mergeCurrentCharFormat(fmt);
+  cursor.mergeCharFormat(pooled);
+  m_editor->mergeCurrentCharFormat(pooled);
 }
 
 QTextCharFormat DocumentTab::currentCharFormat() const {
-  return m_editor->currentCharFormat();
+  return m_editor ? m_editor->currentCharFormat() : QTextCharFormat();
 }
 
 void DocumentTab::toggleBulletList(bool enable) {
+  if (!m_editor)
+    return;
+
   QTextCursor cursor = m_editor->textCursor();
 
   if (enable) {
@@ -146,6 +495,9 @@ void DocumentTab::toggleBulletList(bool enable) {
 }
 
 bool DocumentTab::isInBulletList() const {
+  if (!m_editor)
+    return false;
+
   QTextCursor cursor = m_editor->textCursor();
   return cursor.currentList() != nullptr;
 }
@@ -153,7 +505,66 @@ bool DocumentTab::isInBulletList() const {
 void DocumentTab::onContentsChanged() {
   if (!m_loading) {
     setModified(true);
+    m_needsSnapshot = true;
   }
 }
 
-void DocumentTab::onCursorPositionChanged() { Q_EMIT cursorFormatChanged(); }
+void DocumentTab::onContentsChange(int position, int charsRemoved,
+                                   int charsAdded) {
+  if (m_loading)
+    return;
+
+  QTextDocument *doc = m_editor->document();
+  const BlockDelta delta =
+      BlockDelta::fromContentsChange(doc, position, charsAdded, m_blockCount);
+  m_blockCount = doc->blockCount();
+
+  m_stats.update(doc, delta.firstBlock, delta.removedBlocks,
+                 delta.addedBlocks);
+  m_undo.record(doc, delta.firstBlock, delta.removedBlocks, delta.addedBlocks,
+                position, charsRemoved, charsAdded);
+  m_editEnd = position + charsAdded;
+  Q_EMIT blocksChanged(delta.firstBlock, delta.removedBlocks,
+                       delta.addedBlocks);
+  Q_EMIT undoStateChanged();
+}
+
+void DocumentTab::resetContents() {
+  attachContents(false);
+  Q_EMIT contentsReset();
+}
+
+void DocumentTab::attachContents(bool keepHistory) {
+  m_blockCount = m_editor->document()->blockCount();
+  m_stats.reset(m_editor->document());
+  if (keepHistory) {
+    m_undo.reattach(m_editor->document());
+  } else {
+    m_undo.reset(m_editor->document());
+  }
+  prepareUndo();
+  updateHighlighter();
+  Q_EMIT undoStateChanged();
+}
+
+void DocumentTab::updateHighlighter() {
+  // Content sniffing looks at the first lines only
+  QStringList firstLines;
+  QTextBlock block = m_editor->document()->begin();
+  for (int i = 0; i < 50 && block.isValid(); ++i, block = block.next()) {
+    firstLines.append(block.text());
+  }
+  m_highlighter->attach(m_editor,
+                        HighlightRules::forFile(m_filePath, firstLines));
+}
+
+void DocumentTab::onCursorPositionChanged() {
+  // Typing continues where the last edit ended; anywhere else starts a new
+  // undo step
+  if (m_editor->textCursor().position() != m_editEnd) {
+    m_undo.breakCoalescing();
+  }
+  m_editEnd = -1;
+  prepareUndo();
+  Q_EMIT cursorFormatChanged();
+}
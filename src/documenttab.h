@@ -1,11 +1,19 @@
 #ifndef DOCUMENTTAB_H
 #define DOCUMENTTAB_H
 
+#include "documentstats.h"
+#include "texteditor.h"
+#include "undomanager.h"
+
 #include <QTextCharFormat>
 #include <QTextEdit>
 #include <QUuid>
 #include <QWidget>
 
+class FindBar;
+class SyntaxHighlighter;
+class QMimeData;
+
 class DocumentTab : public QWidget {
   Q_OBJECT
 
@@ -15,8 +23,17 @@ public:
 
   // File operations
   bool loadFile(const QString &path);
+  // False if the content is malformed beyond what the readers accept;
+  // errorString then says why. What was read up to that point stays in the
+  // tab, unsaved and not tied to the file, so that saving it cannot
+  // truncate the original.
+  bool loadData(const QString &path, const QByteArray &data,
+                QString *errorString = nullptr);
   bool saveFile(const QString &path);
 
+  // Local files carried by a drag, or an empty list if there are none
+  static QStringList droppedFiles(const QMimeData *mimeData);
+
   // Properties
   QString filePath() const { return m_filePath; }
   QString tabTitle() const { return m_tabTitle; }
@@ -30,30 +47,131 @@ public:
   QString toHtml() const;
   void setFromHtml(const QString &html);
 
+  // Replace the whole content as a single undoable edit
+  void replaceContent(const QString &html);
+
+  // Undo history, bounded by a memory budget; it is kept across hibernation
+  // and saved with the session
+  void undo();
+  void redo();
+  bool canUndo() const { return m_undo.canUndo(); }
+  bool canRedo() const { return m_undo.canRedo(); }
+  QByteArray saveUndoHistory() const { return m_undo.save(); }
+  bool restoreUndoHistory(const QByteArray &data);
+
+  // Make the next edit of [from, to] undoable; edits reaching past the
+  // cursor and selection need this beforehand
+  void prepareEdit(int from, int to);
+
+  // Version history: whether the content changed since the last snapshot
+  bool needsSnapshot() const { return m_needsSnapshot; }
+  void clearNeedsSnapshot() { m_needsSnapshot = false; }
+
+  // Counts kept current from block-level deltas; the totals survive
+  // hibernation
+  const DocumentStats &stats() const { return m_stats; }
+
+  // Find/replace bar below the editor
+  void showFindBar(bool replace);
+
+  // Extra selections are kept per layer so that independent features can
+  // highlight text without overwriting each other
+  enum SelectionLayer { FindLayer, SpellLayer, SelectionLayerCount };
+  void setExtraSelections(SelectionLayer layer,
+                          const QList<QTextEdit::ExtraSelection> &selections);
+
   // Formatting
   void mergeFormat(const QTextCharFormat &fmt);
   QTextCharFormat currentCharFormat() const;
   void toggleBulletList(bool enable);
   bool isInBulletList() const;
 
-  // Access to editor
+  // Access to editor and document (nullptr while the tab is hibernated)
   QTextEdit *editor() const { return m_editor; }
+  QTextDocument *document() const {
+    return m_editor ? m_editor->document() : nullptr;
+  }
+
+  // Hibernation: release the editor and document of an inactive tab. The
+  // caller is responsible for backing up the content beforehand. A tab in
+  // the middle of a paste cannot be hibernated.
+  bool isHibernated() const { return m_editor == nullptr; }
+  bool canHibernate() const { return m_editor && !m_editor->isPasting(); }
+  void hibernate();
+  void rehydrate(const QString &html);
+
+  // What the tab holds, from counters kept current by edits, so that it is
+  // cheap enough to poll. Byte figures are estimates; a hibernated tab
+  // reports its last counts but holds only its undo history.
+  struct MemoryUsage {
+    qint64 characters = 0;
+    qint64 blocks = 0;
+    qint64 fragments = 0;
+    qint64 formats = 0;
+    qint64 documentBytes = 0; // text, fragment map and formats
+    qint64 layoutBytes = 0;
+    qint64 undoBytes = 0;
+  };
+  MemoryUsage memoryUsage() const;
+
+  // Rough estimate of the memory held by the document, layout and undo
+  // stack; only the undo history for a hibernated tab
+  qint64 estimatedMemory() const;
 
 Q_SIGNALS:
   void modifiedChanged(bool modified);
   void cursorFormatChanged();
+  void undoStateChanged();
+  void hibernated();
+  // The editor is back with the content it had; unlike contentsReset(),
+  // state built from that content is still valid
+  void rehydrated();
+  void filesDropped(const QStringList &paths);
+
+  // Edits as block ranges: blocks [firstBlock, firstBlock + addedBlocks)
+  // replace the removedBlocks blocks that started at firstBlock before the
+  // edit. Not emitted while a file or backup is loaded; contentsReset() is
+  // emitted once the whole document has been replaced instead.
+  void blocksChanged(int firstBlock, int removedBlocks, int addedBlocks);
+  void contentsReset();
+
+protected:
+  bool eventFilter(QObject *watched, QEvent *event) override;
 
 private Q_SLOTS:
   void onContentsChanged();
+  void onContentsChange(int position, int charsRemoved, int charsAdded);
   void onCursorPositionChanged();
 
 private:
-  QTextEdit *m_editor;
+  void createEditor();
+  void resetContents();
+  // Follow a new editor document; no signal about the content itself
+  void attachContents(bool keepHistory);
+  void prepareUndo();
+  void showContextMenu(const QPoint &pos, const QPoint &globalPos);
+  void updateHighlighter();
+
+  TextEditor *m_editor = nullptr;
+  FindBar *m_findBar = nullptr;
+  SyntaxHighlighter *m_highlighter = nullptr;
+  QList<QTextEdit::ExtraSelection> m_extraSelections[SelectionLayerCount];
   QString m_filePath;
   QString m_tabTitle;
   QString m_sessionId;
   bool m_modified = false;
   bool m_loading = false;
+  bool m_needsSnapshot = false;
+  int m_blockCount = 1;
+  int m_editEnd = -1; // cursor position the last edit left behind
+  DocumentStats m_stats;
+  UndoManager m_undo;
+
+  // View state kept across hibernation
+  int m_savedCursorPosition = 0;
+  int m_savedAnchor = 0;
+  int m_savedVerticalScroll = 0;
+  int m_savedHorizontalScroll = 0;
 };
 
 #endif // DOCUMENTTAB_H
@@ -0,0 +1,60 @@
+#include "fileloadqueue.h"
+
+#include <QFile>
+#include <QThread>
+
+FileLoadQueue::FileLoadQueue(QObject *parent) : QObject(parent) {
+  m_pool.setMaxThreadCount(qBound(2, QThread::idealThreadCount(), 8));
+  // Read a little ahead so the GUI thread always has a file to process
+  m_maxInFlight = m_pool.maxThreadCount() * 2;
+}
+
+FileLoadQueue::~FileLoadQueue() {
+  m_queue.clear();
+  m_pool.waitForDone();
+}
+
+void FileLoadQueue::enqueue(const QStringList &paths) {
+  for (const QString &path : paths) {
+    m_queue.enqueue(path);
+  }
+  startReads();
+}
+
+void FileLoadQueue::startReads() {
+  while (m_inFlight < m_maxInFlight && !m_queue.isEmpty()) {
+    const QString path = m_queue.dequeue();
+    ++m_inFlight;
+
+    m_pool.start([this, path]() {
+      QByteArray data;
+      QFile file(path);
+      bool ok = file.open(QIODevice::ReadOnly);
+      if (ok) {
+        data = file.readAll();
+        ok = file.error() == QFileDevice::NoError;
+      }
+
+      // Queued calls to a destroyed receiver are dropped
+      QMetaObject::invokeMethod(
+          this, [this, path, data, ok]() { onReadDone(path, data, ok); },
+          Qt::QueuedConnection);
+    });
+  }
+}
+
+void FileLoadQueue::onReadDone(const QString &path, const QByteArray &data,
+                               bool ok) {
+  --m_inFlight;
+
+  if (ok) {
+    Q_EMIT fileLoaded(path, data);
+  } else {
+    Q_EMIT loadFailed(path);
+  }
+
+  startReads();
+  if (pendingCount() == 0) {
+    Q_EMIT finished();
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef FILELOADQUEUE_H
+#define FILELOADQUEUE_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QQueue>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+
+/**
+ * Reads files on a small thread pool and hands their contents back to the
+ * GUI thread in completion order.
+ *
+ * The number of reads in flight is bounded, so a large batch neither floods
+ * the disk with requests nor buffers every file in memory before the GUI
+ * thread has turned them into tabs.
+ */
+class FileLoadQueue : public QObject {
+  Q_OBJECT
+
+public:
+  explicit FileLoadQueue(QObject *parent = nullptr);
+  ~FileLoadQueue() override;
+
+  void enqueue(const QStringList &paths);
+
+  // Files queued or being read
+  int pendingCount() const { return m_queue.size() + m_inFlight; }
+
+Q_SIGNALS:
+  void fileLoaded(const QString &path, const QByteArray &data);
+  void loadFailed(const QString &path);
+  void finished();
+
+private:
+  void startReads();
+  void onReadDone(const QString &path, const QByteArray &data, bool ok);
+
+  QThreadPool m_pool;
+  QQueue<QString> m_queue;
+  int m_inFlight = 0;
+  int m_maxInFlight = 0;
+};
+
+#endif // FILELOADQUEUE_H
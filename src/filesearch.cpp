@@ -0,0 +1,427 @@
+#include "filesearch.h"
+
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QQueue>
+#include <QRegularExpression>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define KNOTEPAD_HAVE_SSE2
+#endif
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+// Hits are handed to the GUI thread in batches of this size or age
+const int kHitBatchSize = 256;
+const int kHitBatchMillis = 50;
+// Searching stops once this many hits have been reported
+const int kMaxHits = 50000;
+// Characters of line text kept per hit
+const int kMaxLineText = 200;
+// Files containing a NUL byte here are treated as binary and skipped
+const int kBinaryProbe = 4096;
+// Paths handed over by the walker per lock
+const int kWalkBatch = 64;
+
+uchar asciiLower(uchar c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; }
+uchar asciiUpper(uchar c) { return c >= 'a' && c <= 'z' ? c - 32 : c; }
+
+bool isAscii(const QString &text) {
+  for (QChar ch : text) {
+    if (ch.unicode() >= 0x80)
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+LiteralMatcher::LiteralMatcher(const QByteArray &needle, bool caseSensitive)
+    : m_needle(needle), m_caseSensitive(caseSensitive) {
+  const uchar first = needle.isEmpty() ? 0 : uchar(needle.front());
+  const uchar last = needle.isEmpty() ? 0 : uchar(needle.back());
+  m_firstLower = caseSensitive ? first : asciiLower(first);
+  m_firstUpper = caseSensitive ? first : asciiUpper(first);
+  m_lastLower = caseSensitive ? last : asciiLower(last);
+  m_lastUpper = caseSensitive ? last : asciiUpper(last);
+}
+
+bool LiteralMatcher::matchesAt(const char *p) const {
+  if (m_caseSensitive)
+    return std::memcmp(p, m_needle.constData(), m_needle.size()) == 0;
+  return qstrnicmp(p, m_needle.constData(), size_t(m_needle.size())) == 0;
+}
+
+qint64 LiteralMatcher::find(const char *data, qint64 size, qint64 from) const {
+  const qint64 n = m_needle.size();
+  if (n == 0 || from < 0 || size - from < n)
+    return -1;
+
+  // Last offset at which a match can start
+  const qint64 end = size - n;
+  qint64 i = from;
+
+#ifdef KNOTEPAD_HAVE_SSE2
+  // Compare 16 candidate starts at once against the first byte of the
+  // needle and the 16 matching ends against its last byte
+  const __m128i firstLower = _mm_set1_epi8(char(m_firstLower));
+  const __m128i firstUpper = _mm_set1_epi8(char(m_firstUpper));
+  const __m128i lastLower = _mm_set1_epi8(char(m_lastLower));
+  const __m128i lastUpper = _mm_set1_epi8(char(m_lastUpper));
+  for (; i + 15 <= end; i += 16) {
+    const __m128i head =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    const __m128i tail =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + n - 1));
+    const __m128i headHit = _mm_or_si128(_mm_cmpeq_epi8(head, firstLower),
+                                         _mm_cmpeq_epi8(head, firstUpper));
+    const __m128i tailHit = _mm_or_si128(_mm_cmpeq_epi8(tail, lastLower),
+                                         _mm_cmpeq_epi8(tail, lastUpper));
+    uint mask = uint(_mm_movemask_epi8(_mm_and_si128(headHit, tailHit)));
+    while (mask) {
+      const int bit = qCountTrailingZeroBits(mask);
+      if (matchesAt(data + i + bit))
+        return i + bit;
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  if (m_caseSensitive) {
+    while (i <= end) {
+      const void *found = std::memchr(data + i, m_firstLower, size_t(end - i + 1));
+      if (!found)
+        return -1;
+      i = static_cast<const char *>(found) - data;
+      if (matchesAt(data + i))
+        return i;
+      ++i;
+    }
+    return -1;
+  }
+
+  for (; i <= end; ++i) {
+    const uchar c = uchar(data[i]);
+    if ((c == m_firstLower || c == m_firstUpper) && matchesAt(data + i))
+      return i;
+  }
+  return -1;
+}
+
+struct FileSearch::Job {
+  Options options;
+  quint64 generation = 0;
+
+  // Case-insensitive non-ASCII patterns need Unicode case folding, which
+  // only the regular expression path provides
+  std::unique_ptr<LiteralMatcher> literal;
+  QRegularExpression re;
+  int patternLength = 0;
+
+  QMutex mutex;
+  QWaitCondition available;
+  QQueue<QString> paths;
+  bool walkDone = false;
+
+  std::atomic<bool> cancelled{false};
+  std::atomic<int> hitCount{0};
+  std::atomic<int> filesSearched{0};
+  std::atomic<qint64> bytesSearched{0};
+  std::atomic<int> activeTasks{0};
+};
+
+FileSearch::FileSearch(QObject *parent) : QObject(parent) {
+  // Mapped files are mostly waiting on I/O, so oversubscribe a little
+  m_pool.setMaxThreadCount(qMax(2, QThread::idealThreadCount()) + 1);
+}
+
+FileSearch::~FileSearch() {
+  cancel();
+  m_pool.waitForDone();
+}
+
+bool FileSearch::start(const Options &options) {
+  cancel();
+  if (options.pattern.isEmpty())
+    return false;
+
+  auto job = std::make_shared<Job>();
+  job->options = options;
+  job->generation = ++m_generation;
+  job->patternLength = int(options.pattern.size());
+
+  if (!options.regex && (options.caseSensitive || isAscii(options.pattern))) {
+    job->literal.reset(
+        new LiteralMatcher(options.pattern.toUtf8(), options.caseSensitive));
+  } else {
+    QRegularExpression::PatternOptions patternOptions =
+        QRegularExpression::MultilineOption |
+        QRegularExpression::UseUnicodePropertiesOption;
+    if (!options.caseSensitive)
+      patternOptions |= QRegularExpression::CaseInsensitiveOption;
+    const QString pattern = options.regex
+                                ? options.pattern
+                                : QRegularExpression::escape(options.pattern);
+    job->re = QRegularExpression(pattern, patternOptions);
+    if (!job->re.isValid())
+      return false;
+    job->re.optimize();
+  }
+
+  m_job = job;
+  m_running = true;
+
+  const int workers = m_pool.maxThreadCount() - 1;
+  job->activeTasks = workers + 1;
+  m_pool.start([this, job]() { runWalker(job); });
+  for (int i = 0; i < workers; ++i) {
+    m_pool.start([this, job]() { runWorker(job); });
+  }
+  return true;
+}
+
+void FileSearch::cancel() {
+  if (!m_job)
+    return;
+
+  {
+    QMutexLocker locker(&m_job->mutex);
+    m_job->cancelled = true;
+    m_job->available.wakeAll();
+  }
+  m_job.reset();
+  m_running = false;
+  // Results still queued for the old search are dropped by generation
+  ++m_generation;
+}
+
+void FileSearch::runWalker(const std::shared_ptr<Job> &job) {
+  QDirIterator it(job->options.rootDir, job->options.nameFilters,
+                  QDir::Files | QDir::Readable, QDirIterator::Subdirectories);
+  QStringList batch;
+  auto handOver = [&]() {
+    QMutexLocker locker(&job->mutex);
+    for (const QString &path : std::as_const(batch)) {
+      job->paths.enqueue(path);
+    }
+    job->available.wakeAll();
+    batch.clear();
+  };
+
+  while (it.hasNext() && !job->cancelled.load(std::memory_order_relaxed)) {
+    batch.append(it.next());
+    if (batch.size() >= kWalkBatch)
+      handOver();
+  }
+  handOver();
+
+  {
+    QMutexLocker locker(&job->mutex);
+    job->walkDone = true;
+    job->available.wakeAll();
+  }
+
+  // Help with the remaining files once the tree is walked
+  runWorker(job);
+}
+
+void FileSearch::runWorker(const std::shared_ptr<Job> &job) {
+  QVector<Hit> hits;
+  QElapsedTimer sinceFlush;
+  sinceFlush.start();
+
+  while (true) {
+    QString path;
+    {
+      QMutexLocker locker(&job->mutex);
+      while (job->paths.isEmpty() && !job->walkDone &&
+             !job->cancelled.load()) {
+        job->available.wait(&job->mutex);
+      }
+      if (job->cancelled.load() || job->paths.isEmpty())
+        break;
+      path = job->paths.dequeue();
+    }
+
+    searchFile(job, path, hits);
+    if (hits.size() >= kHitBatchSize ||
+        (!hits.isEmpty() && sinceFlush.elapsed() >= kHitBatchMillis)) {
+      flushHits(job, hits);
+      sinceFlush.restart();
+    }
+  }
+  flushHits(job, hits);
+
+  // The last task to leave reports completion
+  if (job->activeTasks.fetch_sub(1) != 1)
+    return;
+  const quint64 generation = job->generation;
+  const int files = job->filesSearched.load();
+  const qint64 bytes = job->bytesSearched.load();
+  const bool truncated = job->hitCount.load() >= kMaxHits;
+  QMetaObject::invokeMethod(
+      this, [this, generation, files, bytes, truncated]() {
+        if (generation != m_generation)
+          return;
+        m_job.reset();
+        m_running = false;
+        Q_EMIT finished(files, bytes, truncated);
+      },
+      Qt::QueuedConnection);
+}
+
+void FileSearch::flushHits(const std::shared_ptr<Job> &job,
+                           QVector<Hit> &hits) {
+  if (hits.isEmpty())
+    return;
+
+  const quint64 generation = job->generation;
+  const QVector<Hit> batch = hits;
+  hits.clear();
+  QMetaObject::invokeMethod(
+      this, [this, generation, batch]() {
+        if (generation == m_generation)
+          Q_EMIT hitsFound(batch);
+      },
+      Qt::QueuedConnection);
+}
+
+void FileSearch::searchFile(const std::shared_ptr<Job> &job,
+                            const QString &path, QVector<Hit> &hits) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly))
+    return;
+  const qint64 size = file.size();
+  if (size <= 0)
+    return;
+
+  // Map the file; special files and some file systems only support reads
+  QByteArray buffer;
+  qint64 length = size;
+  const char *data = reinterpret_cast<const char *>(file.map(0, size));
+  if (data) {
+#ifdef Q_OS_UNIX
+    madvise(const_cast<char *>(data), size_t(size), MADV_SEQUENTIAL);
+#endif
+  } else {
+    buffer = file.readAll();
+    data = buffer.constData();
+    length = buffer.size();
+  }
+
+  job->filesSearched.fetch_add(1, std::memory_order_relaxed);
+  job->bytesSearched.fetch_add(length, std::memory_order_relaxed);
+
+  if (std::memchr(data, 0, size_t(qMin<qint64>(length, kBinaryProbe))))
+    return;
+
+  auto addHit = [&](int line, const char *lineStart, const char *lineEnd,
+                    int column, int matchLength) {
+    Hit hit;
+    hit.path = path;
+    hit.line = line;
+    hit.column = column;
+    hit.length = matchLength;
+    hit.lineText = QString::fromUtf8(
+        lineStart, qMin<qint64>(lineEnd - lineStart, kMaxLineText * 4));
+    if (hit.lineText.endsWith(QLatin1Char('\r')))
+      hit.lineText.chop(1);
+    if (hit.lineText.size() > kMaxLineText)
+      hit.lineText.truncate(kMaxLineText);
+    hits.append(hit);
+    return job->hitCount.fetch_add(1) + 1 < kMaxHits;
+  };
+
+  const char *end = data + length;
+  if (job->literal) {
+    const LiteralMatcher &matcher = *job->literal;
+    int line = 0;
+    const char *counted = data; // newlines before this point are in line
+    qint64 from = 0;
+    while (!job->cancelled.load(std::memory_order_relaxed)) {
+      const qint64 found = matcher.find(data, length, from);
+      if (found < 0)
+        break;
+
+      const char *match = data + found;
+      for (const char *p = counted;
+           (p = static_cast<const char *>(
+                std::memchr(p, '\n', size_t(match - p))));
+           ++p) {
+        ++line;
+      }
+      const char *lineStart = match;
+      while (lineStart > data && lineStart[-1] != '\n')
+        --lineStart;
+      const char *lineEnd =
+          static_cast<const char *>(std::memchr(match, '\n', size_t(end - match)));
+      if (!lineEnd)
+        lineEnd = end;
+
+      const int column = int(QString::fromUtf8(lineStart, match - lineStart).size());
+      if (!addHit(line, lineStart, lineEnd, column, job->patternLength)) {
+        job->cancelled = true;
+        break;
+      }
+
+      // One hit per line
+      counted = lineEnd;
+      from = lineEnd - data;
+    }
+    return;
+  }
+
+  // Regular expressions run on the decoded text
+  const QString text = QString::fromUtf8(data, length);
+  QRegularExpressionMatchIterator it = job->re.globalMatch(text);
+  int line = 0;
+  qsizetype counted = 0;
+  int lastHitLine = -1;
+  while (it.hasNext() && !job->cancelled.load(std::memory_order_relaxed)) {
+    const QRegularExpressionMatch match = it.next();
+    if (match.capturedLength() == 0)
+      continue;
+
+    const qsizetype position = match.capturedStart();
+    for (qsizetype p = counted; p < position; ++p) {
+      if (text.at(p) == QLatin1Char('\n'))
+        ++line;
+    }
+    counted = position;
+    if (line == lastHitLine)
+      continue;
+    lastHitLine = line;
+
+    const qsizetype lineStart =
+        position == 0 ? 0 : text.lastIndexOf(QLatin1Char('\n'), position - 1) + 1;
+    qsizetype lineEnd = text.indexOf(QLatin1Char('\n'), position);
+    if (lineEnd < 0)
+      lineEnd = text.size();
+
+    Hit hit;
+    hit.path = path;
+    hit.line = line;
+    hit.column = int(position - lineStart);
+    hit.length = int(match.capturedLength());
+    hit.lineText = text.mid(lineStart, qMin<qsizetype>(lineEnd - lineStart, kMaxLineText));
+    if (hit.lineText.endsWith(QLatin1Char('\r')))
+      hit.lineText.chop(1);
+    hits.append(hit);
+    if (job->hitCount.fetch_add(1) + 1 >= kMaxHits) {
+      job->cancelled = true;
+      break;
+    }
+  }
+}
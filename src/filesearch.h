@@ -0,0 +1,92 @@
+#ifndef FILESEARCH_H
+#define FILESEARCH_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+
+#include <memory>
+
+/**
+ * Byte-level literal matcher for UTF-8 data.
+ *
+ * Candidate positions are found 16 bytes at a time by comparing the first
+ * and last byte of the needle (SSE2 where available, memchr otherwise) and
+ * only then verified in full. Case-insensitive matching folds ASCII only.
+ */
+class LiteralMatcher {
+public:
+  LiteralMatcher(const QByteArray &needle, bool caseSensitive);
+
+  // Offset of the first match starting at or after from, or -1
+  qint64 find(const char *data, qint64 size, qint64 from) const;
+
+  int size() const { return int(m_needle.size()); }
+
+private:
+  bool matchesAt(const char *p) const;
+
+  QByteArray m_needle;
+  bool m_caseSensitive;
+  uchar m_firstLower, m_firstUpper;
+  uchar m_lastLower, m_lastUpper;
+};
+
+/**
+ * Searches every file below a directory on a thread pool.
+ *
+ * One task walks the tree and feeds a shared queue that the other tasks
+ * drain; files are memory-mapped and matched in place. Hits are reported
+ * in batches as they are found, one per line.
+ */
+class FileSearch : public QObject {
+  Q_OBJECT
+
+public:
+  struct Options {
+    QString rootDir;
+    QStringList nameFilters; // empty matches every file
+    QString pattern;
+    bool regex = false;
+    bool caseSensitive = false;
+  };
+
+  struct Hit {
+    QString path;
+    int line = 0;   // 0-based
+    int column = 0; // in UTF-16 units, like QTextCursor positions
+    int length = 0;
+    QString lineText;
+  };
+
+  explicit FileSearch(QObject *parent = nullptr);
+  ~FileSearch() override;
+
+  // Cancels a running search first. Returns false for an invalid pattern.
+  bool start(const Options &options);
+  void cancel();
+  bool isRunning() const { return m_running; }
+
+Q_SIGNALS:
+  void hitsFound(const QVector<FileSearch::Hit> &hits);
+  void finished(int filesSearched, qint64 bytesSearched, bool truncated);
+
+private:
+  struct Job;
+
+  void runWalker(const std::shared_ptr<Job> &job);
+  void runWorker(const std::shared_ptr<Job> &job);
+  void searchFile(const std::shared_ptr<Job> &job, const QString &path,
+                  QVector<Hit> &hits);
+  void flushHits(const std::shared_ptr<Job> &job, QVector<Hit> &hits);
+
+  QThreadPool m_pool;
+  std::shared_ptr<Job> m_job;
+  quint64 m_generation = 0;
+  bool m_running = false;
+};
+
+#endif // FILESEARCH_H
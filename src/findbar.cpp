@@ -0,0 +1,538 @@
+#include "findbar.h"
+#include "documenttab.h"
+
+#include <KLocalizedString>
+
+#include <QApplication>
+#include <QCheckBox>
+#include <QColor>
+#include <QEvent>
+#include <QHBoxLayout>
+#include <QIcon>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QScrollBar>
+#include <QShortcut>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTimer>
+#include <QToolButton>
+#include <QVBoxLayout>
+
+#include <algorithm>
+
+namespace {
+
+// Typing in the find field restarts the search after this pause
+const int kSearchDelayMillis = 150;
+// Edits to the document re-run the search after a longer pause
+const int kEditSearchDelayMillis = 400;
+// Upper bound on extra selections for one viewport
+const int kMaxVisibleHighlights = 2000;
+
+} // namespace
+
+FindBar::FindBar(DocumentTab *tab) : QWidget(tab), m_tab(tab) {
+  m_pool.setMaxThreadCount(1);
+
+  m_findEdit = new QLineEdit(this);
+  m_findEdit->setPlaceholderText(i18n("Find"));
+  m_findEdit->setClearButtonEnabled(true);
+  m_replaceEdit = new QLineEdit(this);
+  m_replaceEdit->setPlaceholderText(i18n("Replace"));
+  m_regexBox = new QCheckBox(i18n("Regular expression"), this);
+  m_caseBox = new QCheckBox(i18n("Match case"), this);
+  m_statusLabel = new QLabel(this);
+
+  QPushButton *nextButton = new QPushButton(i18n("Next"), this);
+  QPushButton *previousButton = new QPushButton(i18n("Previous"), this);
+  QPushButton *replaceButton = new QPushButton(i18n("Replace"), this);
+  QPushButton *replaceAllButton = new QPushButton(i18n("Replace All"), this);
+  QToolButton *closeButton = new QToolButton(this);
+  closeButton->setIcon(QIcon::fromTheme(QStringLiteral("dialog-close")));
+  closeButton->setAutoRaise(true);
+  closeButton->setToolTip(i18n("Close"));
+
+  QHBoxLayout *findRow = new QHBoxLayout;
+  findRow->addWidget(m_findEdit, 1);
+  findRow->addWidget(previousButton);
+  findRow->addWidget(nextButton);
+  findRow->addWidget(m_regexBox);
+  findRow->addWidget(m_caseBox);
+  findRow->addWidget(m_statusLabel);
+  findRow->addWidget(closeButton);
+
+  m_replaceRow = new QWidget(this);
+  QHBoxLayout *replaceRow = new QHBoxLayout(m_replaceRow);
+  replaceRow->setContentsMargins(0, 0, 0, 0);
+  replaceRow->addWidget(m_replaceEdit, 1);
+  replaceRow->addWidget(replaceButton);
+  replaceRow->addWidget(replaceAllButton);
+
+  QVBoxLayout *layout = new QVBoxLayout(this);
+  layout->setContentsMargins(4, 2, 4, 2);
+  layout->addLayout(findRow);
+  layout->addWidget(m_replaceRow);
+
+  m_searchTimer = new QTimer(this);
+  m_searchTimer->setSingleShot(true);
+  connect(m_searchTimer, &QTimer::timeout, this, &FindBar::startSearch);
+
+  // Scrolling and resizing only move the visible window over the matches
+  m_highlightTimer = new QTimer(this);
+  m_highlightTimer->setSingleShot(true);
+  m_highlightTimer->setInterval(0);
+  connect(m_highlightTimer, &QTimer::timeout, this, &FindBar::updateHighlights);
+
+  connect(m_findEdit, &QLineEdit::textChanged, this, &FindBar::scheduleSearch);
+  connect(m_regexBox, &QCheckBox::toggled, this, &FindBar::scheduleSearch);
+  connect(m_caseBox, &QCheckBox::toggled, this, &FindBar::scheduleSearch);
+  connect(m_findEdit, &QLineEdit::returnPressed, this, [this]() {
+    if (QApplication::keyboardModifiers() & Qt::ShiftModifier) {
+      findPrevious();
+    } else {
+      findNext();
+    }
+  });
+  connect(m_replaceEdit, &QLineEdit::returnPressed, this, &FindBar::replaceOne);
+  connect(nextButton, &QPushButton::clicked, this, &FindBar::findNext);
+  connect(previousButton, &QPushButton::clicked, this, &FindBar::findPrevious);
+  connect(replaceButton, &QPushButton::clicked, this, &FindBar::replaceOne);
+  connect(replaceAllButton, &QPushButton::clicked, this, &FindBar::replaceAll);
+  connect(closeButton, &QToolButton::clicked, this, &FindBar::closeBar);
+
+  QShortcut *escape = new QShortcut(QKeySequence(Qt::Key_Escape), this);
+  escape->setContext(Qt::WidgetWithChildrenShortcut);
+  connect(escape, &QShortcut::activated, this, &FindBar::closeBar);
+
+  connect(m_tab, &DocumentTab::blocksChanged, this,
+          &FindBar::onDocumentChanged);
+  connect(m_tab, &DocumentTab::contentsReset, this, [this]() {
+    attachEditor();
+    onDocumentChanged();
+  });
+  connect(m_tab, &DocumentTab::rehydrated, this, [this]() {
+    attachEditor();
+    onDocumentChanged();
+  });
+  connect(m_tab, &DocumentTab::hibernated, this, [this]() {
+    cancelSearch();
+    m_snapshot.clear();
+    m_matches.clear();
+    ++m_editRevision;
+  });
+
+  attachEditor();
+  hide();
+}
+
+FindBar::~FindBar() {
+  // The worker reports back to this object; let it finish first
+  cancelSearch();
+  m_pool.waitForDone();
+}
+
+void FindBar::attachEditor() {
+  QTextEdit *editor = m_tab->editor();
+  if (!editor)
+    return;
+
+  // Connections are unique, so attaching the same editor twice is harmless
+  connect(editor->verticalScrollBar(), &QScrollBar::valueChanged, this,
+          &FindBar::scheduleHighlights, Qt::UniqueConnection);
+  connect(editor->horizontalScrollBar(), &QScrollBar::valueChanged, this,
+          &FindBar::scheduleHighlights, Qt::UniqueConnection);
+  editor->viewport()->removeEventFilter(this);
+  editor->viewport()->installEventFilter(this);
+}
+
+bool FindBar::eventFilter(QObject *watched, QEvent *event) {
+  if (event->type() == QEvent::Resize && m_tab->editor() &&
+      watched == m_tab->editor()->viewport()) {
+    scheduleHighlights();
+  }
+  return QWidget::eventFilter(watched, event);
+}
+
+void FindBar::activate(bool replace) {
+  m_replaceRow->setVisible(replace);
+  show();
+
+  // Seed the query with a single-line selection
+  if (QTextEdit *editor = m_tab->editor()) {
+    const QString selected = editor->textCursor().selectedText();
+    if (!selected.isEmpty() && !selected.contains(QChar::ParagraphSeparator)) {
+      m_findEdit->setText(m_regexBox->isChecked()
+                              ? QRegularExpression::escape(selected)
+                              : selected);
+    }
+  }
+
+  m_findEdit->setFocus();
+  m_findEdit->selectAll();
+  if (!matchesAreCurrent()) {
+    startSearch();
+  } else {
+    scheduleHighlights();
+  }
+}
+
+void FindBar::closeBar() {
+  cancelSearch();
+  m_searchTimer->stop();
+  m_replaceAllPending = false;
+  hide();
+  Q_EMIT highlightsChanged(QList<QTextEdit::ExtraSelection>());
+  if (QTextEdit *editor = m_tab->editor()) {
+    editor->setFocus();
+  }
+}
+
+TextSearch::Options FindBar::options() const {
+  TextSearch::Options opts;
+  opts.pattern = m_findEdit->text();
+  opts.regex = m_regexBox->isChecked();
+  opts.caseSensitive = m_caseBox->isChecked();
+  return opts;
+}
+
+bool FindBar::matchesAreCurrent() const {
+  return m_searchDone && m_matchesRevision == m_editRevision;
+}
+
+void FindBar::scheduleSearch() {
+  // Old matches no longer describe the query
+  cancelSearch();
+  m_matches.clear();
+  m_searchDone = false;
+  m_searchTimer->start(kSearchDelayMillis);
+}
+
+void FindBar::onDocumentChanged() {
+  ++m_editRevision;
+  if (isHidden() || m_findEdit->text().isEmpty())
+    return;
+
+  // Offsets after the edit are unreliable; hide them until the re-run
+  cancelSearch();
+  m_matches.clear();
+  m_searchDone = false;
+  Q_EMIT highlightsChanged(QList<QTextEdit::ExtraSelection>());
+  m_searchTimer->start(kEditSearchDelayMillis);
+}
+
+void FindBar::cancelSearch() {
+  if (m_cancelled) {
+    m_cancelled->store(true);
+    m_cancelled.reset();
+  }
+  // Batches still queued for the old search are dropped by generation
+  ++m_generation;
+}
+
+void FindBar::startSearch() {
+  m_searchTimer->stop();
+  cancelSearch();
+  m_matches.clear();
+  m_searchDone = false;
+  m_searchFailed = false;
+
+  QTextEdit *editor = m_tab->editor();
+  const TextSearch::Options opts = options();
+  if (!editor || opts.pattern.isEmpty()) {
+    m_replaceAllPending = false;
+    updateStatus();
+    Q_EMIT highlightsChanged(QList<QTextEdit::ExtraSelection>());
+    return;
+  }
+
+  if (m_snapshotRevision != m_editRevision) {
+    m_snapshot = editor->document()->toPlainText();
+    m_snapshotRevision = m_editRevision;
+  }
+
+  const quint64 generation = m_generation;
+  const quint64 revision = m_editRevision;
+  auto cancelled = std::make_shared<std::atomic<bool>>(false);
+  m_cancelled = cancelled;
+  const QString text = m_snapshot;
+  updateStatus();
+
+  m_pool.start([this, text, opts, cancelled, generation, revision]() {
+    const bool ok = TextSearch::run(
+        text, opts, *cancelled,
+        [this, generation](const QVector<TextSearch::Match> &batch) {
+          QMetaObject::invokeMethod(
+              this, [this, generation, batch]() {
+                appendMatches(generation, batch);
+              },
+              Qt::QueuedConnection);
+        });
+    if (cancelled->load())
+      return;
+    QMetaObject::invokeMethod(
+        this, [this, generation, revision, ok]() {
+          if (generation == m_generation) {
+            m_matchesRevision = revision;
+          }
+          searchFinished(generation, ok);
+        },
+        Qt::QueuedConnection);
+  });
+}
+
+void FindBar::appendMatches(quint64 generation,
+                            const QVector<TextSearch::Match> &batch) {
+  if (generation != m_generation)
+    return;
+
+  // Batches arrive in document order
+  m_matches += batch;
+  updateStatus();
+  scheduleHighlights();
+}
+
+void FindBar::searchFinished(quint64 generation, bool ok) {
+  if (generation != m_generation)
+    return;
+
+  m_cancelled.reset();
+  m_searchDone = true;
+  m_searchFailed = !ok;
+  updateStatus();
+  scheduleHighlights();
+
+  if (m_replaceAllPending) {
+    m_replaceAllPending = false;
+    if (ok) {
+      doReplaceAll();
+    }
+  }
+}
+
+void FindBar::updateStatus() {
+  if (m_findEdit->text().isEmpty()) {
+    m_statusLabel->clear();
+  } else if (m_searchFailed) {
+    m_statusLabel->setText(i18n("Invalid expression"));
+  } else if (!m_searchDone) {
+    m_statusLabel->setText(i18n("Searching… %1", m_matches.size()));
+  } else if (m_matches.isEmpty()) {
+    m_statusLabel->setText(i18n("No matches"));
+  } else {
+    m_statusLabel->setText(
+        i18np("1 match", "%1 matches", m_matches.size()));
+  }
+}
+
+void FindBar::scheduleHighlights() {
+  if (!isHidden()) {
+    m_highlightTimer->start();
+  }
+}
+
+void FindBar::updateHighlights() {
+  QList<QTextEdit::ExtraSelection> selections;
+  QTextEdit *editor = m_tab->editor();
+  if (!editor || isHidden() || m_matches.isEmpty() ||
+      m_snapshotRevision != m_editRevision) {
+    Q_EMIT highlightsChanged(selections);
+    return;
+  }
+
+  // The character range currently on screen, widened to whole blocks
+  QTextDocument *doc = editor->document();
+  const QRect rect = editor->viewport()->rect();
+  const QTextBlock firstBlock =
+      doc->findBlock(editor->cursorForPosition(rect.topLeft()).position());
+  const QTextBlock lastBlock =
+      doc->findBlock(editor->cursorForPosition(rect.bottomRight()).position());
+  const int first = firstBlock.position();
+  const int last = lastBlock.position() + lastBlock.length();
+
+  auto it = std::lower_bound(m_matches.cbegin(), m_matches.cend(), first,
+                             [](const TextSearch::Match &m, int position) {
+                               return m.position + m.length <= position;
+                             });
+
+  QTextCharFormat format;
+  format.setBackground(QColor(255, 225, 80));
+  format.setForeground(Qt::black);
+  for (; it != m_matches.cend() && it->position < last &&
+         selections.size() < kMaxVisibleHighlights;
+       ++it) {
+    QTextEdit::ExtraSelection selection;
+    selection.cursor = QTextCursor(doc);
+    selection.cursor.setPosition(it->position);
+    selection.cursor.setPosition(it->position + it->length,
+                                 QTextCursor::KeepAnchor);
+    selection.format = format;
+    selections.append(selection);
+  }
+  Q_EMIT highlightsChanged(selections);
+}
+
+void FindBar::selectMatch(const TextSearch::Match &match) {
+  QTextEdit *editor = m_tab->editor();
+  QTextCursor cursor(editor->document());
+  cursor.setPosition(match.position);
+  cursor.setPosition(match.position + match.length, QTextCursor::KeepAnchor);
+  editor->setTextCursor(cursor);
+  editor->ensureCursorVisible();
+}
+
+void FindBar::findNext() {
+  QTextEdit *editor = m_tab->editor();
+  const TextSearch::Options opts = options();
+  if (!editor || opts.pattern.isEmpty())
+    return;
+
+  const int from = editor->textCursor().selectionEnd();
+  if (matchesAreCurrent() && !m_matches.isEmpty()) {
+    auto it = std::lower_bound(m_matches.cbegin(), m_matches.cend(), from,
+                               [](const TextSearch::Match &m, int position) {
+                                 return m.position < position;
+                               });
+    selectMatch(it == m_matches.cend() ? m_matches.first() : *it);
+    return;
+  }
+
+  // The match list is still being built; ask the document directly
+  QTextDocument *doc = editor->document();
+  QTextDocument::FindFlags flags;
+  if (opts.caseSensitive)
+    flags |= QTextDocument::FindCaseSensitively;
+  auto find = [&](int position) {
+    return opts.regex ? doc->find(TextSearch::regularExpression(opts),
+                                  position, flags)
+                      : doc->find(opts.pattern, position, flags);
+  };
+  QTextCursor found = find(from);
+  if (found.isNull())
+    found = find(0);
+  if (!found.isNull()) {
+    editor->setTextCursor(found);
+    editor->ensureCursorVisible();
+  }
+}
+
+void FindBar::findPrevious() {
+  QTextEdit *editor = m_tab->editor();
+  const TextSearch::Options opts = options();
+  if (!editor || opts.pattern.isEmpty())
+    return;
+
+  const int from = editor->textCursor().selectionStart();
+  if (matchesAreCurrent() && !m_matches.isEmpty()) {
+    auto it = std::lower_bound(m_matches.cbegin(), m_matches.cend(), from,
+                               [](const TextSearch::Match &m, int position) {
+                                 return m.position < position;
+                               });
+    selectMatch(it == m_matches.cbegin() ? m_matches.last() : *(it - 1));
+    return;
+  }
+
+  QTextDocument *doc = editor->document();
+  QTextDocument::FindFlags flags = QTextDocument::FindBackward;
+  if (opts.caseSensitive)
+    flags |= QTextDocument::FindCaseSensitively;
+  auto find = [&](int position) {
+    return opts.regex ? doc->find(TextSearch::regularExpression(opts),
+                                  position, flags)
+                      : doc->find(opts.pattern, position, flags);
+  };
+  QTextCursor found = find(from);
+  if (found.isNull())
+    found = find(doc->characterCount() - 1);
+  if (!found.isNull()) {
+    editor->setTextCursor(found);
+    editor->ensureCursorVisible();
+  }
+}
+
+void FindBar::replaceOne() {
+  QTextEdit *editor = m_tab->editor();
+  const TextSearch::Options opts = options();
+  if (!editor || opts.pattern.isEmpty())
+    return;
+
+  // Replace the selection only if it is a match of the current query
+  QTextCursor cursor = editor->textCursor();
+  if (cursor.hasSelection()) {
+    const QString selected =
+        cursor.selectedText().replace(QChar::ParagraphSeparator,
+                                      QLatin1Char('\n'));
+    QString replacement = m_replaceEdit->text();
+    bool isMatch = false;
+    if (opts.regex) {
+      TextSearch::Options anchored = opts;
+      anchored.pattern = QRegularExpression::anchoredPattern(opts.pattern);
+      const QRegularExpression re = TextSearch::regularExpression(anchored);
+      isMatch = re.match(selected).hasMatch();
+      if (isMatch) {
+        replacement = TextSearch::replacementFor(
+            selected, TextSearch::Match{0, int(selected.size())}, &re,
+            replacement);
+      }
+    } else {
+      isMatch = selected.compare(opts.pattern, opts.caseSensitive
+                                                   ? Qt::CaseSensitive
+                                                   : Qt::CaseInsensitive) == 0;
+    }
+    if (isMatch) {
+      cursor.insertText(replacement);
+      editor->setTextCursor(cursor);
+    }
+  }
+
+  findNext();
+}
+
+void FindBar::replaceAll() {
+  if (!m_tab->editor() || m_findEdit->text().isEmpty())
+    return;
+
+  if (matchesAreCurrent()) {
+    doReplaceAll();
+    return;
+  }
+
+  // Replace once the running (or a fresh) search has completed
+  m_replaceAllPending = true;
+  if (m_searchTimer->isActive() || !m_cancelled) {
+    startSearch();
+  }
+}
+
+void FindBar::doReplaceAll() {
+  QTextEdit *editor = m_tab->editor();
+  if (!editor || m_matches.isEmpty())
+    return;
+
+  // The edit below invalidates the members once it is committed
+  const QVector<TextSearch::Match> matches = m_matches;
+  const QString text = m_snapshot;
+  const TextSearch::Options opts = options();
+  QRegularExpression re;
+  if (opts.regex) {
+    re = TextSearch::regularExpression(opts);
+  }
+  const QString replacement = m_replaceEdit->text();
+
+  // One edit block makes the whole replacement a single undo step; going
+  // backwards keeps the offsets of the remaining matches valid
+  m_tab->prepareEdit(matches.first().position,
+                     matches.last().position + matches.last().length);
+  QTextCursor cursor(editor->document());
+  cursor.beginEditBlock();
+  for (int i = matches.size() - 1; i >= 0; --i) {
+    const TextSearch::Match &match = matches[i];
+    cursor.setPosition(match.position);
+    cursor.setPosition(match.position + match.length, QTextCursor::KeepAnchor);
+    cursor.insertText(TextSearch::replacementFor(
+        text, match, opts.regex ? &re : nullptr, replacement));
+  }
+  cursor.endEditBlock();
+}
@@ -0,0 +1,98 @@
+#ifndef FINDBAR_H
+#define FINDBAR_H
+
+#include "textsearch.h"
+
+#include <QList>
+#include <QTextEdit>
+#include <QThreadPool>
+#include <QWidget>
+
+#include <atomic>
+#include <memory>
+
+class DocumentTab;
+class QCheckBox;
+class QLabel;
+class QLineEdit;
+class QTimer;
+
+/**
+ * Find/replace bar of a DocumentTab.
+ *
+ * Matching runs on a worker thread over a plain-text snapshot of the
+ * document and streams match offsets back in batches; a newer query
+ * cancels the running one. Only matches inside the viewport are turned
+ * into extra selections, so huge match counts cost nothing to display.
+ */
+class FindBar : public QWidget {
+  Q_OBJECT
+
+public:
+  explicit FindBar(DocumentTab *tab);
+  ~FindBar() override;
+
+  void activate(bool replace);
+
+Q_SIGNALS:
+  void highlightsChanged(const QList<QTextEdit::ExtraSelection> &selections);
+
+public Q_SLOTS:
+  void findNext();
+  void findPrevious();
+  void replaceOne();
+  void replaceAll();
+  void closeBar();
+
+protected:
+  bool eventFilter(QObject *watched, QEvent *event) override;
+
+private Q_SLOTS:
+  void scheduleSearch();
+  void startSearch();
+  void scheduleHighlights();
+  void updateHighlights();
+  void onDocumentChanged();
+  void attachEditor();
+
+private:
+  TextSearch::Options options() const;
+  void cancelSearch();
+  void appendMatches(quint64 generation,
+                     const QVector<TextSearch::Match> &batch);
+  void searchFinished(quint64 generation, bool ok);
+  bool matchesAreCurrent() const;
+  void selectMatch(const TextSearch::Match &match);
+  void doReplaceAll();
+  void updateStatus();
+
+  DocumentTab *m_tab;
+
+  QLineEdit *m_findEdit;
+  QLineEdit *m_replaceEdit;
+  QWidget *m_replaceRow;
+  QCheckBox *m_regexBox;
+  QCheckBox *m_caseBox;
+  QLabel *m_statusLabel;
+
+  QTimer *m_searchTimer;
+  QTimer *m_highlightTimer;
+
+  // Snapshot of the document text, taken again only after edits
+  QString m_snapshot;
+  quint64 m_editRevision = 0;
+  quint64 m_snapshotRevision = quint64(-1);
+
+  // Matches of the latest search, sorted by position
+  QVector<TextSearch::Match> m_matches;
+  quint64 m_matchesRevision = quint64(-1);
+  bool m_searchDone = false;
+  bool m_searchFailed = false;
+  bool m_replaceAllPending = false;
+
+  QThreadPool m_pool;
+  quint64 m_generation = 0;
+  std::shared_ptr<std::atomic<bool>> m_cancelled;
+};
+
+#endif // FINDBAR_H
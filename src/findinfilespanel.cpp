@@ -0,0 +1,186 @@
+#include "findinfilespanel.h"
+
+#include <QCheckBox>
+#include <QDir>
+#include <QFileDialog>
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QIcon>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QToolButton>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+#include <KLocalizedString>
+
+FindInFilesPanel::FindInFilesPanel(QWidget *parent) : QWidget(parent) {
+  m_search = new FileSearch(this);
+
+  QVBoxLayout *layout = new QVBoxLayout(this);
+  layout->setContentsMargins(0, 0, 0, 0);
+
+  m_dirEdit = new QLineEdit(QDir::homePath(), this);
+  QToolButton *browseButton = new QToolButton(this);
+  browseButton->setIcon(QIcon::fromTheme(QStringLiteral("document-open-folder")));
+  browseButton->setToolTip(i18n("Choose Folder"));
+  QHBoxLayout *dirRow = new QHBoxLayout;
+  dirRow->addWidget(m_dirEdit, 1);
+  dirRow->addWidget(browseButton);
+
+  m_patternEdit = new QLineEdit(this);
+  m_patternEdit->setClearButtonEnabled(true);
+  m_filterEdit = new QLineEdit(this);
+  m_filterEdit->setPlaceholderText(i18n("All files, or e.g. *.txt *.md *.log"));
+
+  QFormLayout *form = new QFormLayout;
+  form->addRow(i18n("Find:"), m_patternEdit);
+  form->addRow(i18n("Folder:"), dirRow);
+  form->addRow(i18n("Files:"), m_filterEdit);
+  layout->addLayout(form);
+
+  m_regexBox = new QCheckBox(i18n("Regular expression"), this);
+  m_caseBox = new QCheckBox(i18n("Match case"), this);
+  m_searchButton = new QPushButton(i18n("Search"), this);
+  QHBoxLayout *optionsRow = new QHBoxLayout;
+  optionsRow->addWidget(m_regexBox);
+  optionsRow->addWidget(m_caseBox);
+  optionsRow->addStretch();
+  optionsRow->addWidget(m_searchButton);
+  layout->addLayout(optionsRow);
+
+  m_results = new QTreeWidget(this);
+  m_results->setColumnCount(2);
+  m_results->setHeaderLabels(QStringList() << i18n("Line") << i18n("Text"));
+  m_results->setUniformRowHeights(true);
+  m_results->header()->setStretchLastSection(true);
+  layout->addWidget(m_results);
+
+  m_statusLabel = new QLabel(this);
+  layout->addWidget(m_statusLabel);
+
+  connect(browseButton, &QToolButton::clicked, this, &FindInFilesPanel::browse);
+  connect(m_searchButton, &QPushButton::clicked, this,
+          &FindInFilesPanel::startOrStop);
+  connect(m_patternEdit, &QLineEdit::returnPressed, this,
+          &FindInFilesPanel::startOrStop);
+  connect(m_results, &QTreeWidget::itemActivated, this,
+          &FindInFilesPanel::onItemActivated);
+  connect(m_search, &FileSearch::hitsFound, this,
+          &FindInFilesPanel::onHitsFound);
+  connect(m_search, &FileSearch::finished, this, &FindInFilesPanel::onFinished);
+}
+
+void FindInFilesPanel::focusQuery() {
+  m_patternEdit->setFocus();
+  m_patternEdit->selectAll();
+}
+
+void FindInFilesPanel::browse() {
+  const QString dir = QFileDialog::getExistingDirectory(
+      this, i18n("Choose Folder"), m_dirEdit->text());
+  if (!dir.isEmpty()) {
+    m_dirEdit->setText(dir);
+  }
+}
+
+void FindInFilesPanel::startOrStop() {
+  if (m_search->isRunning()) {
+    m_search->cancel();
+    m_searchButton->setText(i18n("Search"));
+    m_statusLabel->setText(i18n("Stopped after %1 matches", m_hitCount));
+    return;
+  }
+
+  m_results->clear();
+  m_fileItems.clear();
+  m_hitCount = 0;
+
+  FileSearch::Options options;
+  options.rootDir = m_dirEdit->text();
+  options.nameFilters =
+      m_filterEdit->text().split(QLatin1Char(' '), Qt::SkipEmptyParts);
+  options.pattern = m_patternEdit->text();
+  options.regex = m_regexBox->isChecked();
+  options.caseSensitive = m_caseBox->isChecked();
+  if (options.pattern.isEmpty() || !QDir(options.rootDir).exists()) {
+    m_statusLabel->clear();
+    return;
+  }
+
+  m_rootDir = QDir(options.rootDir).absolutePath();
+  if (!m_search->start(options)) {
+    m_statusLabel->setText(i18n("Invalid expression"));
+    return;
+  }
+  m_elapsed.start();
+  m_searchButton->setText(i18n("Stop"));
+  m_statusLabel->setText(i18n("Searching…"));
+}
+
+void FindInFilesPanel::onHitsFound(const QVector<FileSearch::Hit> &hits) {
+  const QDir root(m_rootDir);
+  m_results->setUpdatesEnabled(false);
+  for (const FileSearch::Hit &hit : hits) {
+    QTreeWidgetItem *fileItem = m_fileItems.value(hit.path);
+    if (!fileItem) {
+      fileItem = new QTreeWidgetItem(m_results);
+      fileItem->setText(0, root.relativeFilePath(hit.path));
+      fileItem->setFirstColumnSpanned(true);
+      fileItem->setData(0, Qt::UserRole, hit.path);
+      fileItem->setData(0, Qt::UserRole + 1, -1);
+      m_fileItems.insert(hit.path, fileItem);
+    }
+
+    QTreeWidgetItem *item = new QTreeWidgetItem(fileItem);
+    item->setText(0, QString::number(hit.line + 1));
+    item->setText(1, hit.lineText.trimmed());
+    item->setData(0, Qt::UserRole, hit.path);
+    item->setData(0, Qt::UserRole + 1, hit.line);
+    item->setData(0, Qt::UserRole + 2, hit.column);
+    item->setData(0, Qt::UserRole + 3, hit.length);
+  }
+  m_results->setUpdatesEnabled(true);
+
+  m_hitCount += hits.size();
+  m_statusLabel->setText(i18np("Searching… 1 match", "Searching… %1 matches",
+                               m_hitCount));
+}
+
+void FindInFilesPanel::onFinished(int filesSearched, qint64 bytesSearched,
+                                  bool truncated) {
+  m_searchButton->setText(i18n("Search"));
+
+  const double seconds = qMax<qint64>(1, m_elapsed.elapsed()) / 1000.0;
+  const double megabytes = bytesSearched / (1024.0 * 1024.0);
+  QString status = i18np("1 match", "%1 matches", m_hitCount) +
+                   QStringLiteral(" — ") +
+                   i18np("1 file, %2 MB in %3 s (%4 MB/s)",
+                         "%1 files, %2 MB in %3 s (%4 MB/s)", filesSearched,
+                         QString::number(megabytes, 'f', 1),
+                         QString::number(seconds, 'f', 2),
+                         QString::number(megabytes / seconds, 'f', 0));
+  if (truncated) {
+    status += QStringLiteral(" — ") + i18n("results truncated");
+  }
+  m_statusLabel->setText(status);
+}
+
+void FindInFilesPanel::onItemActivated(QTreeWidgetItem *item) {
+  if (!item)
+    return;
+
+  const int line = item->data(0, Qt::UserRole + 1).toInt();
+  if (line < 0) {
+    // File rows open the file at its first hit
+    if (item->childCount() > 0)
+      onItemActivated(item->child(0));
+    return;
+  }
+
+  Q_EMIT hitActivated(item->data(0, Qt::UserRole).toString(), line,
+                      item->data(0, Qt::UserRole + 2).toInt(),
+                      item->data(0, Qt::UserRole + 3).toInt());
+}
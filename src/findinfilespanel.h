@@ -0,0 +1,55 @@
+#ifndef FINDINFILESPANEL_H
+#define FINDINFILESPANEL_H
+
+#include "filesearch.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QWidget>
+
+class QCheckBox;
+class QLabel;
+class QLineEdit;
+class QPushButton;
+class QTreeWidget;
+class QTreeWidgetItem;
+
+// Directory, pattern and streaming results of a search through files on disk
+class FindInFilesPanel : public QWidget {
+  Q_OBJECT
+
+public:
+  explicit FindInFilesPanel(QWidget *parent = nullptr);
+
+  void focusQuery();
+
+Q_SIGNALS:
+  void hitActivated(const QString &path, int line, int column, int length);
+
+private Q_SLOTS:
+  void browse();
+  void startOrStop();
+  void onHitsFound(const QVector<FileSearch::Hit> &hits);
+  void onFinished(int filesSearched, qint64 bytesSearched, bool truncated);
+  void onItemActivated(QTreeWidgetItem *item);
+
+private:
+  FileSearch *m_search;
+  QElapsedTimer m_elapsed;
+  QString m_rootDir;
+  int m_hitCount = 0;
+
+  QLineEdit *m_dirEdit;
+  QLineEdit *m_patternEdit;
+  QLineEdit *m_filterEdit;
+  QCheckBox *m_regexBox;
+  QCheckBox *m_caseBox;
+  QPushButton *m_searchButton;
+  QTreeWidget *m_results;
+  QLabel *m_statusLabel;
+
+  // File path -> its top-level result item
+  QHash<QString, QTreeWidgetItem *> m_fileItems;
+};
+
+#endif // FINDINFILESPANEL_H
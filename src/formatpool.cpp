@@ -0,0 +1,107 @@
+#include "formatpool.h"
+
+#include <QDataStream>
+#include <QIODevice>
+
+std::atomic<bool> FormatPool::s_enabled{true};
+
+FormatPool &FormatPool::instance() {
+  static FormatPool pool;
+  return pool;
+}
+
+void FormatPool::setEnabled(bool enabled) {
+  s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+QString FormatPool::familyLocked(const QString &name) {
+  auto it = m_families.constFind(name);
+  if (it != m_families.constEnd())
+    return *it;
+  m_families.insert(name, name);
+  return name;
+}
+
+QStringList FormatPool::familiesLocked(const QStringList &names) {
+  if (names.size() == 1) {
+    auto it = m_singleFamilies.constFind(names.first());
+    if (it != m_singleFamilies.constEnd())
+      return *it;
+    const QStringList list{familyLocked(names.first())};
+    m_singleFamilies.insert(list.first(), list);
+    return list;
+  }
+
+  QStringList list;
+  list.reserve(names.size());
+  for (const QString &name : names) {
+    list.append(familyLocked(name));
+  }
+  return list;
+}
+
+QString FormatPool::family(const QString &name) {
+  if (!isEnabled() || name.isEmpty())
+    return name;
+  QMutexLocker locker(&m_mutex);
+  return familyLocked(name);
+}
+
+QStringList FormatPool::families(const QStringList &names) {
+  if (!isEnabled() || names.isEmpty())
+    return names;
+  QMutexLocker locker(&m_mutex);
+  return familiesLocked(names);
+}
+
+QTextFormat FormatPool::intern(const QTextFormat &format) {
+  // The serialized properties identify a format; there is no public hash
+  QByteArray key;
+  {
+    QDataStream stream(&key, QIODevice::WriteOnly);
+    stream << format;
+  }
+
+  QMutexLocker locker(&m_mutex);
+  ++m_stats.lookups;
+  auto it = m_formats.constFind(key);
+  if (it != m_formats.constEnd()) {
+    ++m_stats.hits;
+    return *it;
+  }
+
+  if (m_formats.size() >= kMaxFormats) {
+    m_formats.clear();
+  }
+  QTextFormat pooled = format;
+  if (pooled.hasProperty(QTextFormat::FontFamilies)) {
+    pooled.setProperty(
+        QTextFormat::FontFamilies,
+        familiesLocked(
+            pooled.property(QTextFormat::FontFamilies).toStringList()));
+  }
+  m_formats.insert(key, pooled);
+  return pooled;
+}
+
+QTextCharFormat FormatPool::charFormat(const QTextCharFormat &format) {
+  if (!isEnabled())
+    return format;
+  return intern(format).toCharFormat();
+}
+
+FormatPool::Stats FormatPool::stats() const {
+  QMutexLocker locker(&m_mutex);
+  Stats stats = m_stats;
+  stats.formats = int(m_formats.size());
+  stats.families = int(m_families.size());
+  return stats;
+}
+
+void FormatPool::clear() {
+  QMutexLocker locker(&m_mutex);
+  m_formats.clear();
+  m_families.clear();
+  m_singleFamilies.clear();
+  m_stats = Stats();
+}
@@ -0,0 +1,70 @@
+#ifndef FORMATPOOL_H
+#define FORMATPOOL_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QTextCharFormat>
+
+#include <atomic>
+
+/**
+ * Application-wide pool of character formats and font family names, so
+ * that equal formats built by different loaders and documents share their
+ * data. Block formats hold only numbers and are left out.
+ *
+ * QTextDocument keeps a private copy of every format it stores, so the
+ * documents cannot share one format object. What they do share through the
+ * pool are the values inside: family names, family lists and brushes,
+ * which each document would otherwise allocate again for every distinct
+ * format. Loaders that go through the pool also stop building a fresh
+ * format for every run of text.
+ *
+ * All calls are thread-safe. While the pool is disabled every call returns
+ * its argument, for measuring what the pool saves.
+ */
+class FormatPool {
+public:
+  // Formats kept before the pool starts over; documents keep what they use
+  static constexpr int kMaxFormats = 4096;
+
+  static FormatPool &instance();
+
+  static bool isEnabled() {
+    return s_enabled.load(std::memory_order_relaxed);
+  }
+  static void setEnabled(bool enabled);
+
+  QString family(const QString &name);
+  QStringList families(const QStringList &names);
+  QTextCharFormat charFormat(const QTextCharFormat &format);
+
+  struct Stats {
+    int formats = 0;
+    int families = 0;
+    quint64 lookups = 0;
+    quint64 hits = 0;
+  };
+  Stats stats() const;
+  void clear();
+
+private:
+  FormatPool() = default;
+
+  QTextFormat intern(const QTextFormat &format);
+  // Callers hold m_mutex
+  QString familyLocked(const QString &name);
+  QStringList familiesLocked(const QStringList &names);
+
+  mutable QMutex m_mutex;
+  QHash<QByteArray, QTextFormat> m_formats; // serialized format -> format
+  QHash<QString, QString> m_families;
+  QHash<QString, QStringList> m_singleFamilies; // the usual one-name lists
+  Stats m_stats;
+
+  static std::atomic<bool> s_enabled;
+};
+
+#endif // FORMATPOOL_H
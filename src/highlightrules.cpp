@@ -0,0 +1,424 @@
+#include "highlightrules.h"
+
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSet>
+
+namespace {
+
+enum MarkdownState { MarkdownNormal = 0, MarkdownBacktickFence, MarkdownTildeFence };
+enum CFamilyState { CNormal = 0, CBlockComment };
+
+// Level tokens are matched near the start of a line only
+const int kLevelSearchLength = 120;
+
+const QSet<QString> &cKeywords() {
+  static const QSet<QString> keywords = []() {
+    const char *words[] = {
+        "alignas",   "alignof",  "async",     "auto",      "await",
+        "break",     "case",     "catch",     "class",     "const",
+        "constexpr", "continue", "def",       "default",   "delete",
+        "do",        "else",     "enum",      "explicit",  "export",
+        "extends",   "extern",   "false",     "final",     "fn",
+        "for",       "friend",   "func",      "function",  "goto",
+        "if",        "implements", "import",  "in",        "inline",
+        "instanceof", "interface", "let",     "mutable",   "namespace",
+        "new",       "noexcept", "nullptr",   "NULL",      "operator",
+        "override",  "package",  "private",   "protected", "public",
+        "return",    "sizeof",   "static",    "struct",    "switch",
+        "template",  "this",     "throw",     "true",      "try",
+        "typedef",   "typename", "union",     "using",     "var",
+        "virtual",   "volatile", "while",     "yield"};
+    QSet<QString> set;
+    for (const char *word : words) {
+      set.insert(QLatin1String(word));
+    }
+    return set;
+  }();
+  return keywords;
+}
+
+const QSet<QString> &cTypes() {
+  static const QSet<QString> types = []() {
+    const char *words[] = {
+        "bool",     "char",     "char16_t", "char32_t", "double",  "float",
+        "int",      "int8_t",   "int16_t",  "int32_t",  "int64_t", "long",
+        "qint64",   "quint64",  "QString",  "short",    "signed",  "size_t",
+        "ssize_t",  "std",      "string",   "String",   "uint8_t", "uint16_t",
+        "uint32_t", "uint64_t", "unsigned", "void",     "wchar_t"};
+    QSet<QString> set;
+    for (const char *word : words) {
+      set.insert(QLatin1String(word));
+    }
+    return set;
+  }();
+  return types;
+}
+
+bool isIdentifierStart(QChar ch) {
+  return ch.isLetter() || ch == QLatin1Char('_');
+}
+
+bool isIdentifierChar(QChar ch) {
+  return ch.isLetterOrNumber() || ch == QLatin1Char('_');
+}
+
+// Index of the closing quote of a string starting at from, or -1
+int stringEnd(const QString &text, int from, QChar quote) {
+  for (int i = from + 1; i < text.size(); ++i) {
+    if (text[i] == QLatin1Char('\\')) {
+      ++i;
+    } else if (text[i] == quote) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+} // namespace
+
+int MarkdownRules::highlightLine(const QString &text, int state,
+                                 QVector<Span> &spans) const {
+  const int n = text.size();
+  const QString trimmed = text.trimmed();
+
+  // Fenced code is taken verbatim until the matching fence
+  if (state == MarkdownBacktickFence || state == MarkdownTildeFence) {
+    if (n > 0)
+      spans.append(Span{0, n, Code});
+    const QLatin1String fence(state == MarkdownBacktickFence ? "```" : "~~~");
+    return trimmed.startsWith(fence) ? MarkdownNormal : state;
+  }
+  if (trimmed.startsWith(QLatin1String("```"))) {
+    spans.append(Span{0, n, Code});
+    return MarkdownBacktickFence;
+  }
+  if (trimmed.startsWith(QLatin1String("~~~"))) {
+    spans.append(Span{0, n, Code});
+    return MarkdownTildeFence;
+  }
+
+  // Up to three spaces of indentation before block markers
+  int i = 0;
+  while (i < n && i < 3 && text[i] == QLatin1Char(' '))
+    ++i;
+
+  if (i < n && text[i] == QLatin1Char('#')) {
+    int level = 0;
+    while (i + level < n && text[i + level] == QLatin1Char('#'))
+      ++level;
+    if (level <= 6 && (i + level == n || text[i + level] == QLatin1Char(' '))) {
+      spans.append(Span{0, n, Heading});
+      return MarkdownNormal;
+    }
+  }
+
+  if (i < n && text[i] == QLatin1Char('>')) {
+    spans.append(Span{0, n, Quote});
+    return MarkdownNormal;
+  }
+
+  int from = i;
+  if (i + 1 < n &&
+      (text[i] == QLatin1Char('-') || text[i] == QLatin1Char('*') ||
+       text[i] == QLatin1Char('+')) &&
+      text[i + 1] == QLatin1Char(' ')) {
+    spans.append(Span{i, 1, ListMarker});
+    from = i + 2;
+  } else {
+    int j = i;
+    while (j < n && text[j].isDigit())
+      ++j;
+    if (j > i && j + 1 < n &&
+        (text[j] == QLatin1Char('.') || text[j] == QLatin1Char(')')) &&
+        text[j + 1] == QLatin1Char(' ')) {
+      spans.append(Span{i, j - i + 1, ListMarker});
+      from = j + 2;
+    }
+  }
+
+  highlightInline(text, from, spans);
+  return MarkdownNormal;
+}
+
+void MarkdownRules::highlightInline(const QString &text, int from,
+                                    QVector<Span> &spans) const {
+  const int n = text.size();
+  int i = from;
+  while (i < n) {
+    const QChar ch = text[i];
+
+    if (ch == QLatin1Char('`')) {
+      int ticks = 0;
+      while (i + ticks < n && text[i + ticks] == QLatin1Char('`'))
+        ++ticks;
+      const int close =
+          text.indexOf(QString(ticks, QLatin1Char('`')), i + ticks);
+      if (close > 0) {
+        spans.append(Span{i, close + ticks - i, Code});
+        i = close + ticks;
+        continue;
+      }
+      i += ticks;
+      continue;
+    }
+
+    if ((ch == QLatin1Char('*') || ch == QLatin1Char('_')) && i + 1 < n) {
+      // Underscores inside words are part of identifiers, not emphasis
+      const bool wordBefore = i > 0 && text[i - 1].isLetterOrNumber();
+      if (ch == QLatin1Char('_') && wordBefore) {
+        ++i;
+        continue;
+      }
+      const bool strong = text[i + 1] == ch;
+      const int markerLength = strong ? 2 : 1;
+      const QString marker(markerLength, ch);
+      const int start = i + markerLength;
+      if (start < n && !text[start].isSpace()) {
+        const int close = text.indexOf(marker, start + 1);
+        if (close > start) {
+          spans.append(
+              Span{i, close + markerLength - i, strong ? Strong : Emphasis});
+          i = close + markerLength;
+          continue;
+        }
+      }
+      i += markerLength;
+      continue;
+    }
+
+    if (ch == QLatin1Char('[')) {
+      const int textEnd = text.indexOf(QLatin1String("]("), i + 1);
+      const int close = textEnd < 0 ? -1 : text.indexOf(QLatin1Char(')'), textEnd);
+      if (close > 0) {
+        spans.append(Span{i, close + 1 - i, Link});
+        i = close + 1;
+        continue;
+      }
+    }
+
+    if (ch == QLatin1Char('h') &&
+        (text.mid(i, 7) == QLatin1String("http://") ||
+         text.mid(i, 8) == QLatin1String("https://"))) {
+      int end = i;
+      while (end < n && !text[end].isSpace() && text[end] != QLatin1Char('>') &&
+             text[end] != QLatin1Char(')'))
+        ++end;
+      spans.append(Span{i, end - i, Link});
+      i = end;
+      continue;
+    }
+
+    ++i;
+  }
+}
+
+int CFamilyRules::highlightLine(const QString &text, int state,
+                                QVector<Span> &spans) const {
+  const int n = text.size();
+  int i = 0;
+
+  if (state == CBlockComment) {
+    const int close = text.indexOf(QLatin1String("*/"));
+    if (close < 0) {
+      if (n > 0)
+        spans.append(Span{0, n, Comment});
+      return CBlockComment;
+    }
+    spans.append(Span{0, close + 2, Comment});
+    i = close + 2;
+  }
+
+  // Preprocessor directive name
+  int first = i;
+  while (first < n && text[first].isSpace())
+    ++first;
+  if (state == CNormal && first < n && text[first] == QLatin1Char('#')) {
+    int end = first + 1;
+    while (end < n && text[end].isSpace())
+      ++end;
+    while (end < n && isIdentifierChar(text[end]))
+      ++end;
+    spans.append(Span{first, end - first, Preprocessor});
+    i = end;
+  }
+
+  while (i < n) {
+    const QChar ch = text[i];
+
+    if (ch == QLatin1Char('/') && i + 1 < n) {
+      if (text[i + 1] == QLatin1Char('/')) {
+        spans.append(Span{i, n - i, Comment});
+        return CNormal;
+      }
+      if (text[i + 1] == QLatin1Char('*')) {
+        const int close = text.indexOf(QLatin1String("*/"), i + 2);
+        if (close < 0) {
+          spans.append(Span{i, n - i, Comment});
+          return CBlockComment;
+        }
+        spans.append(Span{i, close + 2 - i, Comment});
+        i = close + 2;
+        continue;
+      }
+    }
+
+    if (ch == QLatin1Char('"') || ch == QLatin1Char('\'') ||
+        ch == QLatin1Char('`')) {
+      const int close = stringEnd(text, i, ch);
+      const int end = close < 0 ? n : close + 1;
+      spans.append(Span{i, end - i, String});
+      i = end;
+      continue;
+    }
+
+    if (ch.isDigit() ||
+        (ch == QLatin1Char('.') && i + 1 < n && text[i + 1].isDigit())) {
+      int end = i + 1;
+      while (end < n && (isIdentifierChar(text[end]) ||
+                         text[end] == QLatin1Char('.') ||
+                         text[end] == QLatin1Char('\'')))
+        ++end;
+      spans.append(Span{i, end - i, Number});
+      i = end;
+      continue;
+    }
+
+    if (isIdentifierStart(ch)) {
+      int end = i + 1;
+      while (end < n && isIdentifierChar(text[end]))
+        ++end;
+      const QString word = text.mid(i, end - i);
+      if (cKeywords().contains(word)) {
+        spans.append(Span{i, end - i, Keyword});
+      } else if (cTypes().contains(word)) {
+        spans.append(Span{i, end - i, Type});
+      }
+      i = end;
+      continue;
+    }
+
+    ++i;
+  }
+  return CNormal;
+}
+
+int LogRules::timestampLength(const QString &line) {
+  // ISO 8601, syslog ("Mar  7 12:00:01") or a bare time of day, optionally
+  // in brackets
+  static const QRegularExpression timestamp(QStringLiteral(
+      "^\\[?(?:\\d{4}-\\d{2}-\\d{2}[ T]\\d{2}:\\d{2}:\\d{2}(?:[.,]\\d+)?"
+      "(?:Z|[+-]\\d{2}:?\\d{2})?"
+      "|[A-Z][a-z]{2} [ \\d]\\d \\d{2}:\\d{2}:\\d{2}"
+      "|\\d{2}:\\d{2}:\\d{2}(?:[.,]\\d+)?)\\]?"));
+  const QRegularExpressionMatch match = timestamp.match(line);
+  return match.hasMatch() ? int(match.capturedLength()) : 0;
+}
+
+HighlightRules::Style LogRules::levelOf(const QString &line) {
+  static const QRegularExpression level(QStringLiteral(
+      "\\b(FATAL|CRITICAL|CRIT|SEVERE|ERROR|ERR|Error|WARNING|WARN|Warning|"
+      "NOTICE|INFO|Info|DEBUG|Debug|TRACE|VERBOSE)\\b"));
+  const QRegularExpressionMatch match =
+      level.match(line.left(kLevelSearchLength));
+  if (!match.hasMatch())
+    return StyleCount;
+
+  switch (match.capturedView(1).front().toUpper().unicode()) {
+  case 'F':
+  case 'C':
+  case 'S':
+  case 'E':
+    return LogError;
+  case 'W':
+    return LogWarning;
+  case 'N':
+  case 'I':
+    return LogInfo;
+  default:
+    return LogDebug;
+  }
+}
+
+int LogRules::highlightLine(const QString &text, int state,
+                            QVector<Span> &spans) const {
+  Q_UNUSED(state);
+  const int stamp = timestampLength(text);
+  if (stamp > 0)
+    spans.append(Span{0, stamp, Timestamp});
+
+  const Style level = levelOf(text);
+  if (level != StyleCount && stamp < text.size())
+    spans.append(Span{stamp, int(text.size()) - stamp, level});
+
+  // Log lines are independent of each other
+  return 0;
+}
+
+std::unique_ptr<HighlightRules>
+HighlightRules::forFile(const QString &path, const QStringList &firstLines) {
+  const QString suffix = QFileInfo(path).suffix().toLower();
+  static const QSet<QString> markdownSuffixes = {
+      QStringLiteral("md"), QStringLiteral("markdown"), QStringLiteral("mdown"),
+      QStringLiteral("mkd")};
+  static const QSet<QString> cSuffixes = {
+      QStringLiteral("c"),    QStringLiteral("cc"),   QStringLiteral("cpp"),
+      QStringLiteral("cxx"),  QStringLiteral("h"),    QStringLiteral("hh"),
+      QStringLiteral("hpp"),  QStringLiteral("hxx"),  QStringLiteral("cs"),
+      QStringLiteral("java"), QStringLiteral("js"),   QStringLiteral("ts"),
+      QStringLiteral("go"),   QStringLiteral("rs"),   QStringLiteral("kt"),
+      QStringLiteral("swift"), QStringLiteral("m"),   QStringLiteral("mm")};
+
+  if (markdownSuffixes.contains(suffix))
+    return std::make_unique<MarkdownRules>();
+  if (cSuffixes.contains(suffix))
+    return std::make_unique<CFamilyRules>();
+  if (suffix == QLatin1String("log"))
+    return std::make_unique<LogRules>();
+  if (!suffix.isEmpty() && suffix != QLatin1String("txt"))
+    return nullptr;
+
+  // Sniff the content of text files
+  static const QRegularExpression heading(QStringLiteral("^#{1,6} "));
+  int lines = 0;
+  int logLines = 0;
+  int markdownLines = 0;
+  int codeLines = 0;
+  for (const QString &line : firstLines) {
+    const QString trimmed = line.trimmed();
+    if (trimmed.isEmpty())
+      continue;
+    ++lines;
+
+    if (LogRules::timestampLength(line) > 0 ||
+        LogRules::levelOf(line.left(40)) != StyleCount) {
+      ++logLines;
+    }
+    if (heading.match(trimmed).hasMatch() ||
+        trimmed.startsWith(QLatin1String("```")) ||
+        trimmed.startsWith(QLatin1String("- ")) ||
+        trimmed.startsWith(QLatin1String("* ")) ||
+        trimmed.startsWith(QLatin1String("> ")) ||
+        trimmed.contains(QLatin1String("](")) ||
+        trimmed.contains(QLatin1String("**"))) {
+      ++markdownLines;
+    }
+    if (trimmed.endsWith(QLatin1Char(';')) || trimmed.endsWith(QLatin1Char('{')) ||
+        trimmed == QLatin1String("}") ||
+        trimmed.startsWith(QLatin1String("#include")) ||
+        trimmed.startsWith(QLatin1String("//")) ||
+        trimmed.startsWith(QLatin1String("/*"))) {
+      ++codeLines;
+    }
+  }
+
+  if (lines == 0)
+    return nullptr;
+  if (logLines * 2 >= lines)
+    return std::make_unique<LogRules>();
+  if (markdownLines >= 2 && markdownLines * 4 >= lines)
+    return std::make_unique<MarkdownRules>();
+  if (codeLines >= 2 && codeLines * 3 >= lines)
+    return std::make_unique<CFamilyRules>();
+  return nullptr;
+}
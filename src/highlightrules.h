@@ -0,0 +1,93 @@
+#ifndef HIGHLIGHTRULES_H
+#define HIGHLIGHTRULES_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <memory>
+
+/**
+ * Line-by-line syntax rules for SyntaxHighlighter.
+ *
+ * A rule set sees one line at a time together with the state the previous
+ * line ended in (0 at the start of the document) and returns the state
+ * this line ends in, so constructs spanning lines such as block comments
+ * or fenced code can be carried forward without looking at other lines.
+ */
+class HighlightRules {
+public:
+  enum Style {
+    Keyword,
+    Type,
+    String,
+    Number,
+    Comment,
+    Preprocessor,
+    Heading,
+    Strong,
+    Emphasis,
+    Code,
+    Link,
+    Quote,
+    ListMarker,
+    Timestamp,
+    LogError,
+    LogWarning,
+    LogInfo,
+    LogDebug,
+    StyleCount
+  };
+
+  struct Span {
+    int start;
+    int length;
+    Style style;
+  };
+
+  virtual ~HighlightRules() = default;
+
+  virtual QString name() const = 0;
+
+  // Appends the spans of text and returns the state at its end. States
+  // are non-negative.
+  virtual int highlightLine(const QString &text, int state,
+                            QVector<Span> &spans) const = 0;
+
+  // Rules for a file, chosen by extension or, for .txt and files without
+  // an extension, by the first lines of its content. Null if none apply.
+  static std::unique_ptr<HighlightRules>
+  forFile(const QString &path, const QStringList &firstLines);
+};
+
+class MarkdownRules : public HighlightRules {
+public:
+  QString name() const override { return QStringLiteral("Markdown"); }
+  int highlightLine(const QString &text, int state,
+                    QVector<Span> &spans) const override;
+
+private:
+  void highlightInline(const QString &text, int from,
+                       QVector<Span> &spans) const;
+};
+
+class CFamilyRules : public HighlightRules {
+public:
+  QString name() const override { return QStringLiteral("C"); }
+  int highlightLine(const QString &text, int state,
+                    QVector<Span> &spans) const override;
+};
+
+class LogRules : public HighlightRules {
+public:
+  QString name() const override { return QStringLiteral("Log"); }
+  int highlightLine(const QString &text, int state,
+                    QVector<Span> &spans) const override;
+
+  // Length of a timestamp at the start of line, or 0
+  static int timestampLength(const QString &line);
+  // Severity style of a line, or StyleCount if it has no level
+  static Style levelOf(const QString &line);
+};
+
+#endif // HIGHLIGHTRULES_H
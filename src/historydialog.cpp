@@ -0,0 +1,136 @@
+#include "historydialog.h"
+
+#include <QComboBox>
+#include <QDateTime>
+#include <QDialogButtonBox>
+#include <QListWidget>
+#include <QLocale>
+#include <QPushButton>
+#include <QSplitter>
+#include <QTextEdit>
+#include <QVBoxLayout>
+
+#include <KLocalizedString>
+
+#include <algorithm>
+
+HistoryDialog::HistoryDialog(const HistoryStore &store, const QString &docKey,
+                             const QStringList &openKeys, QWidget *parent)
+    : QDialog(parent), m_store(store), m_docKey(docKey) {
+  setWindowTitle(i18n("Version History"));
+  resize(800, 500);
+
+  QVBoxLayout *layout = new QVBoxLayout(this);
+
+  // The current document, then closed ones, most recently changed first
+  QLocale locale;
+  m_documents = new QComboBox(this);
+  m_documents->addItem(i18n("Current document"), docKey);
+  QVector<HistoryStore::Document> closed = store.documents();
+  closed.erase(std::remove_if(closed.begin(), closed.end(),
+                              [&](const HistoryStore::Document &document) {
+                                return document.key == docKey ||
+                                       openKeys.contains(document.key);
+                              }),
+               closed.end());
+  std::sort(closed.begin(), closed.end(),
+            [](const HistoryStore::Document &a,
+               const HistoryStore::Document &b) {
+              return a.timestamp > b.timestamp;
+            });
+  for (const HistoryStore::Document &document : std::as_const(closed)) {
+    const QString title =
+        document.title.isEmpty() ? i18n("Untitled") : document.title;
+    m_documents->addItem(
+        i18n("%1 (closed, %2)", title,
+             locale.toString(QDateTime::fromMSecsSinceEpoch(document.timestamp),
+                             QLocale::ShortFormat)),
+        document.key);
+    m_documents->setItemData(m_documents->count() - 1, title, Qt::ToolTipRole);
+  }
+  m_documents->setVisible(m_documents->count() > 1);
+  layout->addWidget(m_documents);
+
+  QSplitter *splitter = new QSplitter(this);
+  m_list = new QListWidget(splitter);
+  m_preview = new QTextEdit(splitter);
+  m_preview->setReadOnly(true);
+  splitter->setStretchFactor(1, 1);
+  layout->addWidget(splitter);
+
+  QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Close, this);
+  m_restoreButton =
+      buttons->addButton(i18n("Restore"), QDialogButtonBox::AcceptRole);
+  m_restoreButton->setEnabled(false);
+  layout->addWidget(buttons);
+
+  connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+  connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+  connect(m_list, &QListWidget::currentRowChanged, this,
+          &HistoryDialog::onSelectionChanged);
+  connect(m_documents, &QComboBox::currentIndexChanged, this,
+          &HistoryDialog::onDocumentChanged);
+
+  onDocumentChanged();
+}
+
+QString HistoryDialog::selectedTitle() const {
+  return m_documents->currentData(Qt::ToolTipRole).toString();
+}
+
+void HistoryDialog::onDocumentChanged() {
+  m_docKey = m_documents->currentData().toString();
+  m_snapshots = m_store.snapshots(m_docKey);
+  m_selectedHtml.clear();
+  m_list->clear();
+  m_restoreButton->setEnabled(false);
+
+  // Newest first
+  QLocale locale;
+  for (int i = m_snapshots.size() - 1; i >= 0; --i) {
+    const HistoryStore::Snapshot &snap = m_snapshots[i];
+    QString reason;
+    if (snap.reason == QStringLiteral("save")) {
+      reason = i18n("Saved");
+    } else if (snap.reason == QStringLiteral("restore")) {
+      reason = i18n("Before restore");
+    } else {
+      reason = i18n("Automatic");
+    }
+    QListWidgetItem *item = new QListWidgetItem(
+        i18n("%1 — %2 (%3)",
+             locale.toString(QDateTime::fromMSecsSinceEpoch(snap.timestamp),
+                             QLocale::ShortFormat),
+             reason, locale.formattedDataSize(snap.size)),
+        m_list);
+    item->setData(Qt::UserRole, i);
+  }
+
+  if (m_snapshots.isEmpty()) {
+    m_preview->setPlainText(i18n("No snapshots have been taken yet."));
+  } else {
+    m_list->setCurrentRow(0);
+  }
+}
+
+void HistoryDialog::onSelectionChanged() {
+  QListWidgetItem *item = m_list->currentItem();
+  if (!item) {
+    m_restoreButton->setEnabled(false);
+    return;
+  }
+
+  const HistoryStore::Snapshot &snap =
+      m_snapshots[item->data(Qt::UserRole).toInt()];
+  QByteArray content = m_store.snapshotContent(m_docKey, snap.id);
+  if (content.isEmpty() && snap.size > 0) {
+    m_selectedHtml.clear();
+    m_preview->setPlainText(i18n("This snapshot could not be read."));
+    m_restoreButton->setEnabled(false);
+    return;
+  }
+
+  m_selectedHtml = QString::fromUtf8(content);
+  m_preview->setHtml(m_selectedHtml);
+  m_restoreButton->setEnabled(true);
+}
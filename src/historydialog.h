@@ -0,0 +1,47 @@
+#ifndef HISTORYDIALOG_H
+#define HISTORYDIALOG_H
+
+#include <QDialog>
+#include <QStringList>
+#include <QVector>
+
+#include "historystore.h"
+
+class QComboBox;
+class QListWidget;
+class QPushButton;
+class QTextEdit;
+
+// Lists the snapshots of a document and lets the user restore one. Closed
+// documents, whose history no open tab reaches, can be picked too.
+class HistoryDialog : public QDialog {
+  Q_OBJECT
+
+public:
+  HistoryDialog(const HistoryStore &store, const QString &docKey,
+                const QStringList &openKeys, QWidget *parent = nullptr);
+
+  // Content of the snapshot chosen for restoring
+  QString selectedHtml() const { return m_selectedHtml; }
+
+  // Document the snapshot belongs to: docKey, or a closed document
+  QString selectedKey() const { return m_docKey; }
+  QString selectedTitle() const;
+
+private Q_SLOTS:
+  void onDocumentChanged();
+  void onSelectionChanged();
+
+private:
+  const HistoryStore &m_store;
+  QString m_docKey;
+  QVector<HistoryStore::Snapshot> m_snapshots;
+  QString m_selectedHtml;
+
+  QComboBox *m_documents;
+  QListWidget *m_list;
+  QTextEdit *m_preview;
+  QPushButton *m_restoreButton;
+};
+
+#endif // HISTORYDIALOG_H
@@ -0,0 +1,348 @@
+#include "historystore.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+
+#include <array>
+
+namespace {
+
+// Chunk size limits. The average is large enough that a recipe (20 bytes
+// per chunk) stays small next to the content it describes.
+const int kMinChunk = 4 * 1024;
+const int kAvgChunk = 16 * 1024;
+const int kMaxChunk = 64 * 1024;
+
+// Normalized chunking: a stricter mask before the average size and a looser
+// one after it keeps chunk sizes close to the average. The gear hash shifts
+// left, so its top bits depend on the most recent 64 bytes.
+const quint64 kMaskSmall = ~quint64(0) << (64 - 16);
+const quint64 kMaskLarge = ~quint64(0) << (64 - 12);
+
+const quint32 kRecipeMagic = 0x4B4E534E; // "KNSN"
+const quint32 kRecipeVersion = 1;
+const int kHashSize = 20; // SHA-1
+
+// Prunes between two garbage collections. Each prune of a full history
+// drops one snapshot, whose few unique chunks can wait.
+const int kPrunesPerCollection = 50;
+
+const std::array<quint64, 256> &gearTable() {
+  static const std::array<quint64, 256> table = []() {
+    // splitmix64 with a fixed seed: boundaries must be stable across runs
+    std::array<quint64, 256> t{};
+    quint64 state = 0x6b6e6f7465706164ULL;
+    for (quint64 &value : t) {
+      state += 0x9e3779b97f4a7c15ULL;
+      quint64 z = state;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      value = z ^ (z >> 31);
+    }
+    return t;
+  }();
+  return table;
+}
+
+} // namespace
+
+HistoryStore::HistoryStore(const QString &rootDir) : m_rootDir(rootDir) {}
+
+QString HistoryStore::docDir(const QString &docKey) const {
+  return m_rootDir + QStringLiteral("/") + docKey;
+}
+
+QString HistoryStore::chunkPath(const QByteArray &hash) const {
+  const QString hex = QString::fromLatin1(hash.toHex());
+  return m_rootDir + QStringLiteral("/chunks/") + hex.left(2) +
+         QStringLiteral("/") + hex.mid(2);
+}
+
+QVector<int> HistoryStore::chunkBoundaries(const QByteArray &data) {
+  QVector<int> ends;
+  const std::array<quint64, 256> &gear = gearTable();
+  const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+  const int len = data.size();
+
+  int start = 0;
+  while (start < len) {
+    const int remaining = len - start;
+    if (remaining <= kMinChunk) {
+      ends.append(len);
+      break;
+    }
+
+    const int normal = start + qMin(kAvgChunk, remaining);
+    const int limit = start + qMin(kMaxChunk, remaining);
+    int end = limit;
+    quint64 hash = 0;
+    int i = start + kMinChunk;
+    for (; i < normal; ++i) {
+      hash = (hash << 1) + gear[p[i]];
+      if (!(hash & kMaskSmall)) {
+        end = i + 1;
+        break;
+      }
+    }
+    if (i == normal) {
+      for (; i < limit; ++i) {
+        hash = (hash << 1) + gear[p[i]];
+        if (!(hash & kMaskLarge)) {
+          end = i + 1;
+          break;
+        }
+      }
+    }
+
+    ends.append(end);
+    start = end;
+  }
+
+  return ends;
+}
+
+bool HistoryStore::readRecipe(const QString &path, Recipe &recipe,
+                              bool withChunks) const {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+
+  QDataStream in(&file);
+  quint32 magic = 0;
+  quint32 version = 0;
+  in >> magic >> version;
+  if (magic != kRecipeMagic || version != kRecipeVersion) {
+    return false;
+  }
+
+  quint32 count = 0;
+  recipe.info.id = QFileInfo(path).completeBaseName();
+  in >> recipe.info.timestamp >> recipe.info.reason >> recipe.info.size >>
+      recipe.contentHash >> count;
+
+  recipe.chunks.clear();
+  if (withChunks) {
+    recipe.chunks.reserve(count);
+    for (quint32 i = 0; i < count; ++i) {
+      QByteArray hash(kHashSize, Qt::Uninitialized);
+      if (in.readRawData(hash.data(), kHashSize) != kHashSize) {
+        return false;
+      }
+      recipe.chunks.append(hash);
+    }
+  }
+
+  return in.status() == QDataStream::Ok;
+}
+
+bool HistoryStore::addSnapshot(const QString &docKey,
+                               const QByteArray &content,
+                               const QString &reason) {
+  const QByteArray contentHash =
+      QCryptographicHash::hash(content, QCryptographicHash::Sha1);
+
+  // Skip the snapshot if the latest one has the same content
+  const QStringList existing = recipeNames(docKey);
+  if (!existing.isEmpty()) {
+    Recipe last;
+    if (readRecipe(docDir(docKey) + QStringLiteral("/") + existing.last(),
+                   last, false) &&
+        last.contentHash == contentHash) {
+      return false;
+    }
+  }
+
+  QDir().mkpath(docDir(docKey));
+
+  // Write the chunks the store does not have yet
+  Recipe recipe;
+  int start = 0;
+  const QVector<int> ends = chunkBoundaries(content);
+  for (int end : ends) {
+    const QByteArray chunk =
+        QByteArray::fromRawData(content.constData() + start, end - start);
+    const QByteArray hash =
+        QCryptographicHash::hash(chunk, QCryptographicHash::Sha1);
+    const QString path = chunkPath(hash);
+    if (!QFile::exists(path)) {
+      QDir().mkpath(QFileInfo(path).path());
+      QSaveFile file(path);
+      if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+      }
+      file.write(qCompress(chunk, 1));
+      if (!file.commit()) {
+        return false;
+      }
+    }
+    recipe.chunks.append(hash);
+    start = end;
+  }
+
+  // Recipe names sort by time
+  qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
+  QString recipePath;
+  do {
+    recipePath = docDir(docKey) + QStringLiteral("/") +
+                 QStringLiteral("%1.snap").arg(timestamp, 16, 10,
+                                               QLatin1Char('0'));
+    ++timestamp;
+  } while (QFile::exists(recipePath));
+  --timestamp;
+
+  QSaveFile file(recipePath);
+  if (!file.open(QIODevice::WriteOnly)) {
+    return false;
+  }
+  QDataStream out(&file);
+  out << kRecipeMagic << kRecipeVersion << timestamp << reason
+      << qint64(content.size()) << contentHash
+      << quint32(recipe.chunks.size());
+  for (const QByteArray &hash : std::as_const(recipe.chunks)) {
+    out.writeRawData(hash.constData(), hash.size());
+  }
+  return file.commit();
+}
+
+QStringList HistoryStore::recipeNames(const QString &docKey) const {
+  // Names are zero-padded timestamps, so name order is time order
+  return QDir(docDir(docKey))
+      .entryList(QStringList() << QStringLiteral("*.snap"), QDir::Files,
+                 QDir::Name);
+}
+
+QVector<HistoryStore::Snapshot>
+HistoryStore::snapshots(const QString &docKey) const {
+  QVector<Snapshot> result;
+
+  QDir dir(docDir(docKey));
+  const QStringList files = recipeNames(docKey);
+  for (const QString &fileName : files) {
+    Recipe recipe;
+    if (readRecipe(dir.filePath(fileName), recipe, false)) {
+      result.append(recipe.info);
+    }
+  }
+
+  return result;
+}
+
+QByteArray HistoryStore::snapshotContent(const QString &docKey,
+                                         const QString &snapshotId) const {
+  Recipe recipe;
+  if (!readRecipe(docDir(docKey) + QStringLiteral("/") + snapshotId +
+                      QStringLiteral(".snap"),
+                  recipe)) {
+    return QByteArray();
+  }
+
+  QByteArray content;
+  content.reserve(recipe.info.size);
+  for (const QByteArray &hash : std::as_const(recipe.chunks)) {
+    QFile file(chunkPath(hash));
+    if (!file.open(QIODevice::ReadOnly)) {
+      return QByteArray();
+    }
+    content.append(qUncompress(file.readAll()));
+  }
+
+  if (content.size() != recipe.info.size) {
+    return QByteArray();
+  }
+  return content;
+}
+
+void HistoryStore::setTitle(const QString &docKey, const QString &title) {
+  const QString path = docDir(docKey) + QStringLiteral("/title");
+  const QByteArray data = title.toUtf8();
+  QFile current(path);
+  if (current.open(QIODevice::ReadOnly) && current.readAll() == data)
+    return;
+  current.close();
+
+  QSaveFile file(path);
+  if (file.open(QIODevice::WriteOnly)) {
+    file.write(data);
+    file.commit();
+  }
+}
+
+QVector<HistoryStore::Document> HistoryStore::documents() const {
+  QVector<Document> result;
+
+  const QStringList keys =
+      QDir(m_rootDir).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+  for (const QString &key : keys) {
+    if (key == QStringLiteral("chunks"))
+      continue;
+    const QStringList names = recipeNames(key);
+    if (names.isEmpty())
+      continue;
+
+    Document document;
+    document.key = key;
+    document.timestamp =
+        QFileInfo(names.last()).completeBaseName().toLongLong();
+    QFile title(docDir(key) + QStringLiteral("/title"));
+    if (title.open(QIODevice::ReadOnly)) {
+      document.title = QString::fromUtf8(title.readAll());
+    }
+    result.append(document);
+  }
+
+  return result;
+}
+
+void HistoryStore::prune(const QString &docKey, int maxSnapshots) {
+  const QStringList all = recipeNames(docKey);
+  const int excess = all.size() - maxSnapshots;
+  if (excess <= 0)
+    return;
+
+  for (int i = 0; i < excess; ++i) {
+    QFile::remove(docDir(docKey) + QStringLiteral("/") + all[i]);
+  }
+  if (++m_prunesSinceCollection >= kPrunesPerCollection) {
+    collectGarbage();
+  }
+}
+
+void HistoryStore::collectGarbage() {
+  m_prunesSinceCollection = 0;
+
+  // Mark every chunk referenced by a remaining recipe
+  QSet<QByteArray> referenced;
+  QDirIterator recipes(m_rootDir, QStringList() << QStringLiteral("*.snap"),
+                       QDir::Files, QDirIterator::Subdirectories);
+  while (recipes.hasNext()) {
+    Recipe recipe;
+    if (!readRecipe(recipes.next(), recipe)) {
+      // Never delete chunks while a recipe cannot be read
+      return;
+    }
+    for (const QByteArray &hash : std::as_const(recipe.chunks)) {
+      referenced.insert(hash);
+    }
+  }
+
+  // Sweep the rest
+  QDirIterator chunks(m_rootDir + QStringLiteral("/chunks"), QDir::Files,
+                      QDirIterator::Subdirectories);
+  while (chunks.hasNext()) {
+    const QString path = chunks.next();
+    const QFileInfo info(path);
+    const QByteArray hash = QByteArray::fromHex(
+        (info.dir().dirName() + info.fileName()).toLatin1());
+    if (!referenced.contains(hash)) {
+      QFile::remove(path);
+    }
+  }
+}
@@ -0,0 +1,88 @@
+#ifndef HISTORYSTORE_H
+#define HISTORYSTORE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * Per-document snapshot history backed by a deduplicated chunk store.
+ *
+ * Snapshot content is split at content-defined boundaries (a gear rolling
+ * hash, as in FastCDC), so an edit only changes the chunks around it. Each
+ * chunk is stored once under its SHA-1, compressed; a snapshot is a small
+ * recipe listing the chunks it is made of.
+ *
+ * Layout below the root directory:
+ *   chunks/<2 hex>/<38 hex>    compressed chunk data
+ *   <docKey>/<timestamp>.snap  snapshot recipe
+ *   <docKey>/title             name of the document, UTF-8
+ */
+class HistoryStore {
+public:
+  struct Snapshot {
+    QString id;
+    qint64 timestamp = 0; // msecs since epoch
+    QString reason;
+    qint64 size = 0; // uncompressed content size in bytes
+  };
+
+  struct Document {
+    QString key;
+    QString title;
+    qint64 timestamp = 0; // of the newest snapshot
+  };
+
+  explicit HistoryStore(const QString &rootDir);
+
+  QString rootDir() const { return m_rootDir; }
+
+  // Store content as a new snapshot. Only chunks not yet in the store are
+  // written. Returns false if nothing was stored (unchanged or I/O error).
+  bool addSnapshot(const QString &docKey, const QByteArray &content,
+                   const QString &reason);
+
+  // Snapshots of a document, oldest first
+  QVector<Snapshot> snapshots(const QString &docKey) const;
+
+  // Name shown for a document whose tab is gone
+  void setTitle(const QString &docKey, const QString &title);
+
+  // Every document with snapshots, including those no tab shows any more
+  QVector<Document> documents() const;
+
+  // Reassemble the content of a snapshot; empty on failure
+  QByteArray snapshotContent(const QString &docKey,
+                             const QString &snapshotId) const;
+
+  // Drop the oldest snapshots beyond maxSnapshots. Their chunks stay until
+  // the next collection, which runs every few dozen prunes.
+  void prune(const QString &docKey, int maxSnapshots);
+
+  // Delete chunks no snapshot refers to. Reads every recipe, so it is run
+  // rarely: at startup and from prune().
+  void collectGarbage();
+
+  // Chunk end offsets for the given data
+  static QVector<int> chunkBoundaries(const QByteArray &data);
+
+private:
+  struct Recipe {
+    Snapshot info;
+    QByteArray contentHash;
+    QVector<QByteArray> chunks; // raw SHA-1 digests
+  };
+
+  QString docDir(const QString &docKey) const;
+  QString chunkPath(const QByteArray &hash) const;
+  // Recipe file names of a document, oldest first, without reading them
+  QStringList recipeNames(const QString &docKey) const;
+  bool readRecipe(const QString &path, Recipe &recipe,
+                  bool withChunks = true) const;
+
+  QString m_rootDir;
+  int m_prunesSinceCollection = 0;
+};
+
+#endif // HISTORYSTORE_H
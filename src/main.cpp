@@ -1,10 +1,23 @@
 #include <QApplication>
+#include <QCommandLineParser>
 #include <KAboutData>
 #include <KLocalizedString>
+#include <cstdio>
+#include "converttool.h"
 #include "mainwindow.h"
+#include "trace.h"
 
 int main(int argc, char *argv[])
 {
+    // Batch conversion needs neither widgets nor a display
+    if (ConvertTool::isRequested(argc, argv)) {
+        if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+            qputenv("QT_QPA_PLATFORM", "offscreen");
+        }
+        QGuiApplication app(argc, argv);
+        return ConvertTool::run(app);
+    }
+
     QApplication app(argc, argv);
 
     KAboutData aboutData(
@@ -17,8 +30,30 @@ int main(int argc, char *argv[])
     );
     KAboutData::setApplicationData(aboutData);
 
+    QCommandLineParser parser;
+    aboutData.setupCommandLine(&parser);
+    QCommandLineOption traceOption(
+        QStringLiteral("trace"),
+        i18n("Record timing spans and save them as Chrome trace JSON to "
+             "<file> on exit."),
+        QStringLiteral("file"));
+    parser.addOption(traceOption);
+    parser.process(app);
+    aboutData.processCommandLine(&parser);
+
+    // Enabled before the window exists, so that session restore is covered
+    const QString tracePath = parser.value(traceOption);
+    if (!tracePath.isEmpty()) {
+        Trace::setEnabled(true);
+    }
+
     MainWindow *window = new MainWindow();
     window->show();
 
-    return app.exec();
+    const int result = app.exec();
+    if (!tracePath.isEmpty() && !Trace::writeChromeJson(tracePath)) {
+        std::fprintf(stderr, "could not write trace to %s\n",
+                     qPrintable(tracePath));
+    }
+    return result;
 }
@@ -1,28 +1,51 @@
 #include "mainwindow.h"
+#include "completionindex.h"
+#include "diagnosticspanel.h"
 #include "documenttab.h"
+#include "fileloadqueue.h"
+#include "findinfilespanel.h"
+#include "historydialog.h"
+#include "searchpanel.h"
 #include "sessionmanager.h"
-
+#include "spellchecker.h"
+#include "spellcheckservice.h"
+#include "stallwatchdog.h"
+#include "tabmanager.h"
+#include "trace.h"
+#include "wordcompleter.h"
+
+#include <QAbstractItemModel>
 #include <QAction>
 #include <QApplication>
 #include <QAudioOutput>
 #include <QCloseEvent>
 #include <QColorDialog>
 #include <QComboBox>
+#include <QDockWidget>
+#include <QDragEnterEvent>
+#include <QDropEvent>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QLabel>
 #include <QMediaPlayer>
 #include <QMenu>
 #include <QMenuBar>
 #include <QMessageBox>
 #include <QStatusBar>
+#include <QTextBlock>
 #include <QTextCharFormat>
+#include <QTextCursor>
+#include <QTextDocument>
 #include <QTextList>
 #include <QTimer>
 #include <QToolBar>
 #include <QToolButton>
+#include <QUuid>
 
 #include <KActionCollection>
+#include <KConfigGroup>
 #include <KLocalizedString>
+#include <KSharedConfig>
 
 MainWindow::MainWindow(QWidget *parent) : KXmlGuiWindow(parent) {
   // Tab widget as central widget
@@ -39,14 +62,89 @@ MainWindow::MainWindow(QWidget *parent) : KXmlGuiWindow(parent) {
 
   m_sessionManager = new SessionManager(this);
 
+  // Watching from the start, so that a slow session restore is reported
+  m_stallWatchdog = new StallWatchdog(this);
+  m_stallWatchdog->setThreshold(
+      KConfigGroup(KSharedConfig::openConfig(), QStringLiteral("Diagnostics"))
+          .readEntry("StallThresholdMs", 50));
+  m_stallWatchdog->setLogPath(m_sessionManager->sessionDir() +
+                              QStringLiteral("/stalls.log"));
+  m_stallWatchdog->start();
+
+  // Cursor movement can fire many times per event-loop turn; the toolbar is
+  // refreshed at most once per turn
+  m_formatUpdateTimer = new QTimer(this);
+  m_formatUpdateTimer->setSingleShot(true);
+  m_formatUpdateTimer->setInterval(0);
+  connect(m_formatUpdateTimer, &QTimer::timeout, this,
+          &MainWindow::updateFormatActions);
+  m_tabManager = new TabManager(m_sessionManager, this);
+
+  // Edits and selection changes refresh the counts once per turn
+  m_statsUpdateTimer = new QTimer(this);
+  m_statsUpdateTimer->setSingleShot(true);
+  m_statsUpdateTimer->setInterval(0);
+  connect(m_statsUpdateTimer, &QTimer::timeout, this,
+          &MainWindow::updateStatistics);
+
+  m_completionIndex = new CompletionIndex(this);
+  m_spellCheckService = new SpellCheckService(this);
+
+  m_fileLoadQueue = new FileLoadQueue(this);
+  connect(m_fileLoadQueue, &FileLoadQueue::fileLoaded, this,
+          &MainWindow::onFileLoaded);
+  connect(m_fileLoadQueue, &FileLoadQueue::loadFailed, this,
+          qOverload<const QString &>(&MainWindow::onFileLoadFailed));
+  connect(m_fileLoadQueue, &FileLoadQueue::finished, this,
+          &MainWindow::onFileLoadsFinished);
+  setAcceptDrops(true);
+
+  // Periodic version history snapshots of edited tabs
+  m_snapshotTimer = new QTimer(this);
+  m_snapshotTimer->setInterval(5 * 60 * 1000);
+  connect(m_snapshotTimer, &QTimer::timeout, this,
+          &MainWindow::snapshotModifiedTabs);
+  m_snapshotTimer->start();
+
   setupActions();
   setupFormatToolbar();
 
+  // Cross-tab search panel, hidden until requested
+  m_searchPanel = new SearchPanel(m_searchIndex, m_tabWidget, this);
+  m_searchDock = new QDockWidget(i18n("Search"), this);
+  m_searchDock->setObjectName(QStringLiteral("searchDock"));
+  m_searchDock->setWidget(m_searchPanel);
+  addDockWidget(Qt::RightDockWidgetArea, m_searchDock);
+  m_searchDock->hide();
+  connect(m_searchPanel, &SearchPanel::hitActivated, this,
+          &MainWindow::jumpToSearchHit);
+
+  m_findInFilesPanel = new FindInFilesPanel(this);
+  m_findInFilesDock = new QDockWidget(i18n("Find in Files"), this);
+  m_findInFilesDock->setObjectName(QStringLiteral("findInFilesDock"));
+  m_findInFilesDock->setWidget(m_findInFilesPanel);
+  addDockWidget(Qt::BottomDockWidgetArea, m_findInFilesDock);
+  m_findInFilesDock->hide();
+  connect(m_findInFilesPanel, &FindInFilesPanel::hitActivated, this,
+          &MainWindow::jumpToFileHit);
+
+  m_diagnosticsPanel =
+      new DiagnosticsPanel(m_stallWatchdog, m_tabWidget, m_sessionManager,
+                           m_completionIndex, this);
+  m_diagnosticsDock = new QDockWidget(i18n("Diagnostics"), this);
+  m_diagnosticsDock->setObjectName(QStringLiteral("diagnosticsDock"));
+  m_diagnosticsDock->setWidget(m_diagnosticsPanel);
+  addDockWidget(Qt::BottomDockWidgetArea, m_diagnosticsDock);
+  m_diagnosticsDock->hide();
+
   // Setup window state (shortcuts, statusbar, save/restore size)
   // No Create or ToolBar — menus are built programmatically in setupActions()
   setupGUI(QSize(800, 600), KXmlGuiWindow::Keys | KXmlGuiWindow::StatusBar |
                                 KXmlGuiWindow::Save);
 
+  m_statsLabel = new QLabel(this);
+  statusBar()->addPermanentWidget(m_statsLabel);
+
   // Restore previous session or create a new tab
   restoreSession();
   if (m_tabWidget->count() == 0) {
@@ -96,6 +194,13 @@ void MainWindow::setupActions() {
   connect(saveAsAction, &QAction::triggered, this, &MainWindow::saveFileAs);
   fileMenu->addAction(saveAsAction);
 
+  QAction *historyAction =
+      new QAction(QIcon::fromTheme(QStringLiteral("view-history")),
+                  i18n("Version History..."), this);
+  ac->addAction(QStringLiteral("file_history"), historyAction);
+  connect(historyAction, &QAction::triggered, this, &MainWindow::showHistory);
+  fileMenu->addAction(historyAction);
+
   fileMenu->addSeparator();
 
   QAction *quitAction = new QAction(
@@ -105,6 +210,92 @@ void MainWindow::setupActions() {
   connect(quitAction, &QAction::triggered, this, &MainWindow::close);
   fileMenu->addAction(quitAction);
 
+  // --- Edit menu ---
+  QMenu *editMenu = menuBar()->addMenu(i18n("&Edit"));
+
+  m_undoAction = new QAction(
+      QIcon::fromTheme(QStringLiteral("edit-undo")), i18n("Undo"), this);
+  ac->addAction(QStringLiteral("edit_undo"), m_undoAction);
+  ac->setDefaultShortcut(m_undoAction, QKeySequence::Undo);
+  m_undoAction->setEnabled(false);
+  connect(m_undoAction, &QAction::triggered, this, [this]() {
+    if (DocumentTab *tab = currentTab())
+      tab->undo();
+  });
+  editMenu->addAction(m_undoAction);
+
+  m_redoAction = new QAction(
+      QIcon::fromTheme(QStringLiteral("edit-redo")), i18n("Redo"), this);
+  ac->addAction(QStringLiteral("edit_redo"), m_redoAction);
+  ac->setDefaultShortcut(m_redoAction, QKeySequence::Redo);
+  m_redoAction->setEnabled(false);
+  connect(m_redoAction, &QAction::triggered, this, [this]() {
+    if (DocumentTab *tab = currentTab())
+      tab->redo();
+  });
+  editMenu->addAction(m_redoAction);
+
+  editMenu->addSeparator();
+
+  QAction *findAction = new QAction(
+      QIcon::fromTheme(QStringLiteral("edit-find")), i18n("Find..."), this);
+  ac->addAction(QStringLiteral("edit_find"), findAction);
+  ac->setDefaultShortcut(findAction, QKeySequence::Find);
+  connect(findAction, &QAction::triggered, this, [this]() {
+    if (DocumentTab *tab = currentTab())
+      tab->showFindBar(false);
+  });
+  editMenu->addAction(findAction);
+
+  QAction *replaceAction =
+      new QAction(QIcon::fromTheme(QStringLiteral("edit-find-replace")),
+                  i18n("Replace..."), this);
+  ac->addAction(QStringLiteral("edit_replace"), replaceAction);
+  ac->setDefaultShortcut(replaceAction, QKeySequence::Replace);
+  connect(replaceAction, &QAction::triggered, this, [this]() {
+    if (DocumentTab *tab = currentTab())
+      tab->showFindBar(true);
+  });
+  editMenu->addAction(replaceAction);
+
+  editMenu->addSeparator();
+
+  QAction *searchTabsAction =
+      new QAction(QIcon::fromTheme(QStringLiteral("edit-find")),
+                  i18n("Search All Tabs..."), this);
+  ac->addAction(QStringLiteral("edit_search_tabs"), searchTabsAction);
+  ac->setDefaultShortcut(searchTabsAction,
+                         QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_F));
+  connect(searchTabsAction, &QAction::triggered, this,
+          &MainWindow::showSearchPanel);
+  editMenu->addAction(searchTabsAction);
+
+  QAction *findInFilesAction =
+      new QAction(QIcon::fromTheme(QStringLiteral("edit-find")),
+                  i18n("Find in Files..."), this);
+  ac->addAction(QStringLiteral("edit_find_in_files"), findInFilesAction);
+  ac->setDefaultShortcut(findInFilesAction,
+                         QKeySequence(Qt::CTRL | Qt::ALT | Qt::Key_F));
+  connect(findInFilesAction, &QAction::triggered, this,
+          &MainWindow::showFindInFiles);
+  editMenu->addAction(findInFilesAction);
+
+  editMenu->addSeparator();
+
+  m_spellCheckAction =
+      new QAction(QIcon::fromTheme(QStringLiteral("tools-check-spelling")),
+                  i18n("Automatic Spell Checking"), this);
+  ac->addAction(QStringLiteral("edit_spellcheck"), m_spellCheckAction);
+  m_spellCheckAction->setCheckable(true);
+  m_spellCheckAction->setEnabled(m_spellCheckService->isAvailable());
+  m_spellCheckAction->setChecked(
+      m_spellCheckService->isAvailable() &&
+      KConfigGroup(KSharedConfig::openConfig(), QStringLiteral("Spelling"))
+          .readEntry("Enabled", true));
+  connect(m_spellCheckAction, &QAction::toggled, this,
+          &MainWindow::setSpellCheckEnabled);
+  editMenu->addAction(m_spellCheckAction);
+
   // --- Format menu ---
   QMenu *formatMenu = menuBar()->addMenu(i18n("F&ormat"));
 
@@ -164,6 +355,36 @@ void MainWindow::setupActions() {
   connect(m_colorAction, &QAction::triggered, this,
           &MainWindow::selectTextColor);
   formatMenu->addAction(m_colorAction);
+
+  // --- Diagnostics menu ---
+  QMenu *diagnosticsMenu = menuBar()->addMenu(i18n("&Diagnostics"));
+
+  QAction *diagnosticsAction =
+      new QAction(QIcon::fromTheme(QStringLiteral("view-statistics")),
+                  i18n("Show Diagnostics"), this);
+  ac->addAction(QStringLiteral("diagnostics_show"), diagnosticsAction);
+  connect(diagnosticsAction, &QAction::triggered, this,
+          &MainWindow::showDiagnostics);
+  diagnosticsMenu->addAction(diagnosticsAction);
+
+  diagnosticsMenu->addSeparator();
+
+  m_traceAction =
+      new QAction(QIcon::fromTheme(QStringLiteral("media-record")),
+                  i18n("Record Trace"), this);
+  ac->addAction(QStringLiteral("diagnostics_record_trace"), m_traceAction);
+  m_traceAction->setCheckable(true);
+  m_traceAction->setChecked(Trace::isEnabled());
+  connect(m_traceAction, &QAction::toggled, this,
+          &MainWindow::setTracingEnabled);
+  diagnosticsMenu->addAction(m_traceAction);
+
+  QAction *saveTraceAction =
+      new QAction(QIcon::fromTheme(QStringLiteral("document-save")),
+                  i18n("Save Trace..."), this);
+  ac->addAction(QStringLiteral("diagnostics_save_trace"), saveTraceAction);
+  connect(saveTraceAction, &QAction::triggered, this, &MainWindow::saveTrace);
+  diagnosticsMenu->addAction(saveTraceAction);
 }
 
 void MainWindow::setupFormatToolbar() {
@@ -178,6 +399,13 @@ void MainWindow::setupFormatToolbar() {
   connect(m_fontCombo, &QFontComboBox::currentFontChanged, this,
           &MainWindow::onFontFamilyChanged);
 
+  // The family -> row cache follows the combo's font list
+  QAbstractItemModel *fontModel = m_fontCombo->model();
+  auto clearFontRows = [this]() { m_fontRows.clear(); };
+  connect(fontModel, &QAbstractItemModel::modelReset, this, clearFontRows);
+  connect(fontModel, &QAbstractItemModel::rowsInserted, this, clearFontRows);
+  connect(fontModel, &QAbstractItemModel::rowsRemoved, this, clearFontRows);
+
   // Font size spinner
   m_fontSizeSpinBox = new QSpinBox(formatBar);
   m_fontSizeSpinBox->setRange(6, 72);
@@ -257,14 +485,10 @@ void MainWindow::newTab() {
   m_untitledCounter++;
   DocumentTab *tab = new DocumentTab(this);
   tab->setTabTitle(i18n("Untitled %1", m_untitledCounter));
+  connectTab(tab);
   int idx = m_tabWidget->addTab(tab, tab->tabTitle());
   m_tabWidget->setCurrentIndex(idx);
 
-  connect(tab, &DocumentTab::modifiedChanged, this,
-          &MainWindow::onCurrentDocModified);
-  connect(tab, &DocumentTab::cursorFormatChanged, this,
-          &MainWindow::updateFormatActions);
-
   updateWindowTitle();
 }
 
@@ -274,37 +498,122 @@ void MainWindow::openFile() {
       i18n("All Supported Files (*.html *.rtf *.txt);;Rich Text (*.rtf);;HTML "
            "Files (*.html);;Text Files (*.txt);;All Files (*)"));
 
+  openFiles(filePaths);
+}
+
+// Key of the open-document index: symlinks and relative paths to the same
+// file map to the same key
+static QString canonicalPath(const QString &filePath) {
+  QFileInfo info(filePath);
+  QString canonical = info.canonicalFilePath();
+  return canonical.isEmpty() ? info.absoluteFilePath() : canonical;
+}
+
+void MainWindow::openFiles(const QStringList &filePaths) {
+  DocumentTab *alreadyOpen = nullptr;
+  QStringList toLoad;
+
   for (const QString &filePath : filePaths) {
-    // Check if already open
-    bool alreadyOpen = false;
-    for (int i = 0; i < m_tabWidget->count(); ++i) {
-      DocumentTab *tab = tabAt(i);
-      if (tab && tab->filePath() == filePath) {
-        m_tabWidget->setCurrentIndex(i);
-        alreadyOpen = true;
-        break;
-      }
+    const QString key = canonicalPath(filePath);
+    DocumentTab *tab = m_openPaths.value(key);
+    if (tab) {
+      if (!alreadyOpen)
+        alreadyOpen = tab;
+      continue;
     }
-    if (alreadyOpen)
+    if (m_queuedPaths.contains(key))
       continue;
 
-    DocumentTab *tab = new DocumentTab(this);
-    if (tab->loadFile(filePath)) {
-      int idx = m_tabWidget->addTab(tab, tab->tabTitle());
-      m_tabWidget->setCurrentIndex(idx);
-      connect(tab, &DocumentTab::modifiedChanged, this,
-              &MainWindow::onCurrentDocModified);
-      connect(tab, &DocumentTab::cursorFormatChanged, this,
-              &MainWindow::updateFormatActions);
-    } else {
+    m_queuedPaths.insert(key);
+    toLoad.append(filePath);
+  }
+
+  if (toLoad.isEmpty()) {
+    if (alreadyOpen)
+      m_tabWidget->setCurrentWidget(alreadyOpen);
+    return;
+  }
+
+  m_fileLoadQueue->enqueue(toLoad);
+}
+
+void MainWindow::onFileLoaded(const QString &path, const QByteArray &data) {
+  const QString key = canonicalPath(path);
+  m_queuedPaths.remove(key);
+  if (m_openPaths.contains(key))
+    return;
+
+  DocumentTab *tab = new DocumentTab(this);
+  QString error;
+  if (!tab->loadData(path, data, &error)) {
+    if (tab->document()->isEmpty()) {
       delete tab;
-      QMessageBox::warning(this, i18n("Error"),
-                           i18n("Could not open file: %1", filePath));
+      onFileLoadFailed(path, error);
+      return;
     }
+    // Keep what was read, as an unsaved document of its own
+    m_failedLoads.append(
+        i18n("%1: %2. What could be read was opened as a new document.",
+             path, error));
+    tab->setTabTitle(i18n("%1 (incomplete)", QFileInfo(path).fileName()));
+  }
+  connectTab(tab);
+  int idx = m_tabWidget->addTab(tab, tab->tabTitle());
+
+  // Switching tabs for every file of a batch is wasted work; show the last
+  if (m_fileLoadQueue->pendingCount() == 0) {
+    m_tabWidget->setCurrentIndex(idx);
+  }
+
+  // A find-in-files hit opened this file
+  auto jump = m_pendingJumps.constFind(key);
+  if (jump != m_pendingJumps.constEnd()) {
+    const PendingJump pending = jump.value();
+    m_pendingJumps.erase(jump);
+    m_tabWidget->setCurrentIndex(idx);
+    selectLineRange(tab, pending.line, pending.column, pending.length);
   }
   updateWindowTitle();
 }
 
+void MainWindow::onFileLoadFailed(const QString &path) {
+  onFileLoadFailed(path, QString());
+}
+
+void MainWindow::onFileLoadFailed(const QString &path, const QString &reason) {
+  m_queuedPaths.remove(canonicalPath(path));
+  m_pendingJumps.remove(canonicalPath(path));
+  m_failedLoads.append(reason.isEmpty() ? path
+                                        : i18n("%1: %2", path, reason));
+}
+
+void MainWindow::onFileLoadsFinished() {
+  if (m_failedLoads.isEmpty())
+    return;
+
+  // One message for the whole batch
+  const QStringList failed = m_failedLoads;
+  m_failedLoads.clear();
+  QMessageBox::warning(this, i18n("Error"),
+                       i18np("Could not open file: %2",
+                             "Could not open %1 files:\n%2", failed.size(),
+                             failed.join(QLatin1Char('\n'))));
+}
+
+void MainWindow::dragEnterEvent(QDragEnterEvent *event) {
+  if (!DocumentTab::droppedFiles(event->mimeData()).isEmpty()) {
+    event->acceptProposedAction();
+  }
+}
+
+void MainWindow::dropEvent(QDropEvent *event) {
+  const QStringList paths = DocumentTab::droppedFiles(event->mimeData());
+  if (!paths.isEmpty()) {
+    event->acceptProposedAction();
+    openFiles(paths);
+  }
+}
+
 void MainWindow::saveFile() {
   DocumentTab *tab = currentTab();
   if (!tab)
@@ -315,6 +624,8 @@ void MainWindow::saveFile() {
   } else {
     if (!tab->saveFile(tab->filePath())) {
       QMessageBox::warning(this, i18n("Error"), i18n("Could not save file."));
+    } else {
+      m_sessionManager->snapshotTab(tab, QStringLiteral("save"));
     }
     updateWindowTitle();
   }
@@ -335,11 +646,203 @@ void MainWindow::saveFileAs() {
       QMessageBox::warning(this, i18n("Error"), i18n("Could not save file."));
     } else {
       m_tabWidget->setTabText(m_tabWidget->currentIndex(), tab->tabTitle());
+      indexTab(tab);
+      m_sessionManager->snapshotTab(tab, QStringLiteral("save"));
     }
     updateWindowTitle();
   }
 }
 
+void MainWindow::showHistory() {
+  DocumentTab *tab = currentTab();
+  if (!tab)
+    return;
+
+  // Make sure snapshots queued on the writer thread are visible
+  m_sessionManager->flush();
+
+  const QString key = m_sessionManager->historyKey(tab);
+  QStringList openKeys;
+  for (int i = 0; i < m_tabWidget->count(); ++i) {
+    if (DocumentTab *open = tabAt(i)) {
+      openKeys.append(m_sessionManager->historyKey(open));
+    }
+  }
+
+  HistoryDialog dialog(m_sessionManager->history(), key, openKeys, this);
+  if (dialog.exec() != QDialog::Accepted || dialog.selectedHtml().isEmpty())
+    return;
+
+  if (dialog.selectedKey() != key) {
+    // A closed document comes back in a new tab. An untitled one was
+    // identified by its tab, so the new tab takes over its id and history.
+    newTab();
+    DocumentTab *restored = currentTab();
+    if (QUuid::fromString(dialog.selectedKey()).isNull()) {
+      restored->setTabTitle(i18n("%1 (restored)", dialog.selectedTitle()));
+    } else {
+      restored->setSessionId(dialog.selectedKey());
+      restored->setTabTitle(dialog.selectedTitle());
+    }
+    m_tabWidget->setTabText(m_tabWidget->currentIndex(),
+                            restored->tabTitle());
+    restored->setFromHtml(dialog.selectedHtml());
+    restored->setModified(true);
+    updateWindowTitle();
+    return;
+  }
+
+  // Keep the current state so the restore itself can be undone from history
+  m_sessionManager->snapshotTab(tab, QStringLiteral("restore"));
+  tab->replaceContent(dialog.selectedHtml());
+}
+
+void MainWindow::showSearchPanel() {
+  m_searchDock->show();
+  m_searchDock->raise();
+  m_searchPanel->focusQuery();
+}
+
+void MainWindow::jumpToSearchHit(const QString &docId, int blockNumber,
+                                 const QString &query) {
+  DocumentTab *tab = tabForSessionId(docId);
+  if (!tab)
+    return;
+
+  // Activation rehydrates a hibernated tab
+  m_tabWidget->setCurrentWidget(tab);
+  QTextEdit *editor = tab->editor();
+  if (!editor)
+    return;
+
+  QTextDocument *doc = editor->document();
+  QTextBlock block = doc->findBlockByNumber(blockNumber);
+  if (!block.isValid())
+    return;
+
+  // Select the first query word in the block, or go to its start
+  QTextCursor cursor(block);
+  const QStringList tokens = SearchIndex::tokenize(query);
+  if (!tokens.isEmpty()) {
+    QTextCursor found =
+        doc->find(tokens.first(), block.position(), QTextDocument::FindWholeWords);
+    if (!found.isNull() && found.block() == block) {
+      cursor = found;
+    }
+  }
+  editor->setTextCursor(cursor);
+  editor->ensureCursorVisible();
+  editor->setFocus();
+}
+
+void MainWindow::showFindInFiles() {
+  m_findInFilesDock->show();
+  m_findInFilesDock->raise();
+  m_findInFilesPanel->focusQuery();
+}
+
+void MainWindow::showDiagnostics() {
+  m_diagnosticsDock->show();
+  m_diagnosticsDock->raise();
+}
+
+void MainWindow::setTracingEnabled(bool enabled) {
+  if (enabled && !Trace::isEnabled()) {
+    Trace::clear();
+  }
+  Trace::setEnabled(enabled);
+  statusBar()->showMessage(enabled ? i18n("Recording trace")
+                                   : i18n("Trace recording stopped"));
+}
+
+void MainWindow::saveTrace() {
+  if (Trace::eventCount() == 0) {
+    QMessageBox::information(
+        this, i18n("Save Trace"),
+        i18n("Nothing has been recorded yet. Enable Diagnostics > Record "
+             "Trace, repeat the slow operation and save again."));
+    return;
+  }
+
+  const QString path = QFileDialog::getSaveFileName(
+      this, i18n("Save Trace"), QStringLiteral("knotepad-trace.json"),
+      i18n("Chrome Trace (*.json)"));
+  if (path.isEmpty())
+    return;
+
+  if (!Trace::writeChromeJson(path)) {
+    QMessageBox::warning(this, i18n("Error"),
+                         i18n("Could not save the trace to %1", path));
+    return;
+  }
+  statusBar()->showMessage(i18n("Trace saved to %1", path));
+}
+
+void MainWindow::setSpellCheckEnabled(bool enabled) {
+  KConfigGroup group(KSharedConfig::openConfig(), QStringLiteral("Spelling"));
+  group.writeEntry("Enabled", enabled);
+
+  for (int i = 0; i < m_tabWidget->count(); ++i) {
+    DocumentTab *tab = tabAt(i);
+    if (!tab)
+      continue;
+    if (SpellChecker *checker = tab->findChild<SpellChecker *>()) {
+      checker->setEnabled(enabled);
+    }
+  }
+}
+
+void MainWindow::jumpToFileHit(const QString &path, int line, int column,
+                               int length) {
+  const QString key = canonicalPath(path);
+  DocumentTab *tab = m_openPaths.value(key);
+  if (!tab) {
+    // Jump once the loading queue delivers the file
+    PendingJump jump;
+    jump.line = line;
+    jump.column = column;
+    jump.length = length;
+    m_pendingJumps.insert(key, jump);
+    openFiles(QStringList() << path);
+    return;
+  }
+
+  // Activation rehydrates a hibernated tab
+  m_tabWidget->setCurrentWidget(tab);
+  selectLineRange(tab, line, column, length);
+}
+
+void MainWindow::selectLineRange(DocumentTab *tab, int line, int column,
+                                 int length) {
+  QTextEdit *editor = tab->editor();
+  if (!editor)
+    return;
+
+  // Lines map to blocks for plain text; rich files land near the hit
+  QTextDocument *doc = editor->document();
+  QTextBlock block = doc->findBlockByNumber(line);
+  if (!block.isValid())
+    block = doc->lastBlock();
+
+  const int start = block.position() + qBound(0, column, block.length() - 1);
+  const int end = qMin(start + length, block.position() + block.length() - 1);
+  QTextCursor cursor(doc);
+  cursor.setPosition(start);
+  cursor.setPosition(end, QTextCursor::KeepAnchor);
+  editor->setTextCursor(cursor);
+  editor->ensureCursorVisible();
+  editor->setFocus();
+}
+
+void MainWindow::snapshotModifiedTabs() {
+  for (int i = 0; i < m_tabWidget->count(); ++i) {
+    DocumentTab *tab = tabAt(i);
+    if (tab && tab->needsSnapshot()) {
+      m_sessionManager->snapshotTab(tab, QStringLiteral("auto"));
+    }
+  }
+}
+
 void MainWindow::closeTab(int index) {
   DocumentTab *tab = tabAt(index);
   if (!tab)
@@ -347,6 +850,10 @@ void MainWindow::closeTab(int index) {
 
   // Remove the session backup for this tab
   m_sessionManager->removeTabBackup(tab->sessionId());
+  m_tabManager->removeTab(tab);
+  unindexTab(tab);
+  m_searchIndex.removeDocument(tab->sessionId());
+  m_completionIndex->removeDocument(tab->sessionId());
 
   m_tabWidget->removeTab(index);
   delete tab;
@@ -358,9 +865,19 @@ void MainWindow::closeTab(int index) {
 }
 
 void MainWindow::onTabChanged(int index) {
-  Q_UNUSED(index);
+  // Bring hibernated tabs back before anything touches their editor
+  m_tabManager->activate(tabAt(index));
   updateWindowTitle();
-  updateFormatActions();
+  invalidateFormatState();
+  scheduleFormatUpdate();
+  updateStatistics();
+  updateUndoActions();
+}
+
+void MainWindow::updateUndoActions() {
+  DocumentTab *tab = currentTab();
+  m_undoAction->setEnabled(tab && tab->canUndo());
+  m_redoAction->setEnabled(tab && tab->canRedo());
 }
 
 void MainWindow::onCurrentDocModified() {
@@ -386,6 +903,7 @@ void MainWindow::toggleBold() {
   DocumentTab *tab = currentTab();
   if (!tab)
     return;
+  invalidateFormatState();
 
   QTextCharFormat fmt;
   fmt.setFontWeight(m_boldAction->isChecked() ? QFont::Bold : QFont::Normal);
@@ -396,6 +914,7 @@ void MainWindow::toggleItalic() {
   DocumentTab *tab = currentTab();
   if (!tab)
     return;
+  invalidateFormatState();
 
   QTextCharFormat fmt;
   fmt.setFontItalic(m_italicAction->isChecked());
@@ -406,6 +925,7 @@ void MainWindow::toggleUnderline() {
   DocumentTab *tab = currentTab();
   if (!tab)
     return;
+  invalidateFormatState();
 
   QTextCharFormat fmt;
   fmt.setFontUnderline(m_underlineAction->isChecked());
@@ -416,6 +936,7 @@ void MainWindow::toggleStrikethrough() {
   DocumentTab *tab = currentTab();
   if (!tab)
     return;
+  invalidateFormatState();
 
   QTextCharFormat fmt;
   fmt.setFontStrikeOut(m_strikethroughAction->isChecked());
@@ -426,6 +947,7 @@ void MainWindow::toggleBulletList() {
   DocumentTab *tab = currentTab();
   if (!tab)
     return;
+  invalidateFormatState();
   tab->toggleBulletList(m_bulletAction->isChecked());
 }
 
@@ -446,8 +968,9 @@ void MainWindow::selectTextColor() {
 
 void MainWindow::onFontFamilyChanged(const QFont &font) {
   DocumentTab *tab = currentTab();
-  if (!tab)
+  if (!tab || m_updatingFormat)
     return;
+  invalidateFormatState();
 
   QTextCharFormat fmt;
   fmt.setFontFamilies({font.family()});
@@ -458,52 +981,217 @@ void MainWindow::onFontSizeChanged(int size) {
   DocumentTab *tab = currentTab();
   if (!tab)
     return;
+  invalidateFormatState();
 
   QTextCharFormat fmt;
   fmt.setFontPointSize(size);
   tab->mergeFormat(fmt);
 }
 
+void MainWindow::scheduleFormatUpdate() {
+  if (!m_formatUpdateTimer->isActive()) {
+    m_formatUpdateTimer->start();
+  }
+}
+
+void MainWindow::invalidateFormatState() { m_formatState.valid = false; }
+
 void MainWindow::updateFormatActions() {
+  KNOTEPAD_TRACE_SCOPE("MainWindow::updateFormatActions");
   DocumentTab *tab = currentTab();
   if (!tab)
     return;
 
   QTextCharFormat fmt = tab->currentCharFormat();
 
-  // Block signals to prevent recursive updates
-  m_boldAction->blockSignals(true);
-  m_italicAction->blockSignals(true);
-  m_underlineAction->blockSignals(true);
-  m_strikethroughAction->blockSignals(true);
-  m_fontCombo->blockSignals(true);
-  m_fontSizeSpinBox->blockSignals(true);
-  m_bulletAction->blockSignals(true);
+  FormatState state;
+  state.valid = true;
+  state.bold = fmt.fontWeight() >= QFont::Bold;
+  state.italic = fmt.fontItalic();
+  state.underline = fmt.fontUnderline();
+  state.strikethrough = fmt.fontStrikeOut();
+  state.bullet = tab->isInBulletList();
+  state.fontSize =
+      fmt.fontPointSize() > 0 ? static_cast<int>(fmt.fontPointSize()) : 13;
+  QStringList families = fmt.fontFamilies().toStringList();
+  state.family =
+      families.isEmpty() ? QStringLiteral("Sans Serif") : families.first();
+
+  const FormatState &old = m_formatState;
+  const bool all = !old.valid;
+
+  // Signals are blocked per widget to prevent recursive updates
+  auto setChecked = [](QAction *action, bool checked) {
+    action->blockSignals(true);
+    action->setChecked(checked);
+    action->blockSignals(false);
+  };
+
+  if (all || state.bold != old.bold)
+    setChecked(m_boldAction, state.bold);
+  if (all || state.italic != old.italic)
+    setChecked(m_italicAction, state.italic);
+  if (all || state.underline != old.underline)
+    setChecked(m_underlineAction, state.underline);
+  if (all || state.strikethrough != old.strikethrough)
+    setChecked(m_strikethroughAction, state.strikethrough);
+  if (all || state.bullet != old.bullet)
+    setChecked(m_bulletAction, state.bullet);
+
+  // The combo keeps its signals, as QFontComboBox only updates currentFont()
+  // from its own handler; onFontFamilyChanged ignores what this causes
+  if (all || state.family != old.family) {
+    m_updatingFormat = true;
+    setFontComboFamily(state.family);
+    m_updatingFormat = false;
+  }
 
-  m_boldAction->setChecked(fmt.fontWeight() >= QFont::Bold);
-  m_italicAction->setChecked(fmt.fontItalic());
-  m_underlineAction->setChecked(fmt.fontUnderline());
-  m_strikethroughAction->setChecked(fmt.fontStrikeOut());
+  if (all || state.fontSize != old.fontSize) {
+    m_fontSizeSpinBox->blockSignals(true);
+    m_fontSizeSpinBox->setValue(state.fontSize);
+    m_fontSizeSpinBox->blockSignals(false);
+  }
 
-  QStringList families = fmt.fontFamilies().toStringList();
-  QFont f(families.isEmpty() ? QStringLiteral("Sans Serif") : families.first());
-  m_fontCombo->setCurrentFont(f);
-  m_fontSizeSpinBox->setValue(
-      fmt.fontPointSize() > 0 ? static_cast<int>(fmt.fontPointSize()) : 13);
+  m_formatState = state;
+}
 
-  m_bulletAction->setChecked(tab->isInBulletList());
+void MainWindow::setFontComboFamily(const QString &family) {
+  if (m_fontRows.isEmpty()) {
+    QAbstractItemModel *model = m_fontCombo->model();
+    const int rows = model->rowCount();
+    m_fontRows.reserve(rows);
+    for (int row = 0; row < rows; ++row) {
+      m_fontRows.insert(model->index(row, 0).data().toString(), row);
+    }
+  }
 
-  m_boldAction->blockSignals(false);
-  m_italicAction->blockSignals(false);
-  m_underlineAction->blockSignals(false);
-  m_strikethroughAction->blockSignals(false);
-  m_fontCombo->blockSignals(false);
-  m_fontSizeSpinBox->blockSignals(false);
-  m_bulletAction->blockSignals(false);
+  auto it = m_fontRows.constFind(family);
+  if (it != m_fontRows.constEnd()) {
+    m_fontCombo->setCurrentIndex(it.value());
+    return;
+  }
+
+  // Aliases such as "Sans Serif" need QFontComboBox's own matching; remember
+  // where it lands so the lookup is cheap next time
+  m_fontCombo->setCurrentFont(QFont(family));
+  m_fontRows.insert(family, m_fontCombo->currentIndex());
 }
 
 // --- Helpers ---
 
+void MainWindow::connectTab(DocumentTab *tab) {
+  connect(tab, &DocumentTab::modifiedChanged, this,
+          &MainWindow::onCurrentDocModified);
+  connect(tab, &DocumentTab::cursorFormatChanged, this,
+          &MainWindow::scheduleFormatUpdate);
+  connect(tab, &DocumentTab::filesDropped, this, &MainWindow::openFiles);
+  auto scheduleStatistics = [this, tab]() {
+    if (tab == currentTab())
+      m_statsUpdateTimer->start();
+  };
+  connect(tab, &DocumentTab::blocksChanged, this, scheduleStatistics);
+  connect(tab, &DocumentTab::contentsReset, this, scheduleStatistics);
+  connect(tab, &DocumentTab::rehydrated, this, scheduleStatistics);
+  connect(tab, &DocumentTab::cursorFormatChanged, this, scheduleStatistics);
+  connect(tab, &DocumentTab::undoStateChanged, this, [this, tab]() {
+    if (tab == currentTab())
+      updateUndoActions();
+  });
+  m_tabManager->addTab(tab);
+  indexTab(tab);
+
+  // Keep the search index current from block-level deltas
+  connect(tab, &DocumentTab::blocksChanged, this,
+          [this, tab](int firstBlock, int removedBlocks, int addedBlocks) {
+            m_searchIndex.updateBlocks(tab->sessionId(), tab->document(),
+                                       firstBlock, removedBlocks, addedBlocks);
+          });
+  connect(tab, &DocumentTab::contentsReset, this, [this, tab]() {
+    m_searchIndex.addDocument(tab->sessionId(), tab->document());
+  });
+
+  // Same for completion; a restored session is indexed in one background
+  // rebuild instead
+  new WordCompleter(tab, *m_completionIndex);
+  SpellChecker *spellChecker = new SpellChecker(tab, *m_spellCheckService);
+  spellChecker->setEnabled(m_spellCheckAction->isChecked());
+  connect(tab, &DocumentTab::blocksChanged, this,
+          [this, tab](int firstBlock, int removedBlocks, int addedBlocks) {
+            m_completionIndex->updateBlocks(tab->sessionId(), tab->document(),
+                                            firstBlock, removedBlocks,
+                                            addedBlocks);
+          });
+  connect(tab, &DocumentTab::contentsReset, this, [this, tab]() {
+    m_completionIndex->addDocument(tab->sessionId(), tab->document());
+  });
+  if (!m_restoringSession && !tab->isHibernated()) {
+    m_completionIndex->addDocument(tab->sessionId(), tab->document());
+  }
+
+  // Restored tabs start from the postings saved with the session
+  if (!tab->isHibernated()) {
+    const QString id = tab->sessionId();
+    if (!m_searchIndex.restoreDocument(
+            id, tab->document(),
+            m_sessionManager->readTabData(id, QStringLiteral("idx")))) {
+      m_searchIndex.addDocument(id, tab->document());
+    }
+  }
+}
+
+void MainWindow::updateStatistics() {
+  DocumentTab *tab = currentTab();
+  if (!tab) {
+    m_statsLabel->clear();
+    return;
+  }
+
+  const DocumentStats::Counts total = tab->stats().totals();
+  DocumentStats::Counts selected;
+  if (QTextEdit *editor = tab->editor()) {
+    selected = tab->stats().selection(editor->textCursor());
+  }
+
+  if (selected.characters > 0) {
+    m_statsLabel->setText(
+        i18n("Words: %1/%2  Characters: %3/%4  Lines: %5/%6  Paragraphs: "
+             "%7/%8",
+             selected.words, total.words, selected.characters,
+             total.characters, selected.lines, total.lines,
+             selected.paragraphs, total.paragraphs));
+  } else {
+    m_statsLabel->setText(
+        i18n("Words: %1  Characters: %2  Lines: %3  Paragraphs: %4",
+             total.words, total.characters, total.lines, total.paragraphs));
+  }
+}
+
+DocumentTab *MainWindow::tabForSessionId(const QString &sessionId) {
+  for (int i = 0; i < m_tabWidget->count(); ++i) {
+    DocumentTab *tab = tabAt(i);
+    if (tab && tab->sessionId() == sessionId)
+      return tab;
+  }
+  return nullptr;
+}
+
+void MainWindow::indexTab(DocumentTab *tab) {
+  unindexTab(tab);
+  if (tab->filePath().isEmpty())
+    return;
+
+  const QString key = canonicalPath(tab->filePath());
+  m_openPaths.insert(key, tab);
+  m_tabPaths.insert(tab, key);
+}
+
+void MainWindow::unindexTab(DocumentTab *tab) {
+  const QString key = m_tabPaths.take(tab);
+  if (!key.isEmpty() && m_openPaths.value(key) == tab) {
+    m_openPaths.remove(key);
+  }
+}
+
 DocumentTab *MainWindow::currentTab() {
   return qobject_cast<DocumentTab *>(m_tabWidget->currentWidget());
 }
@@ -531,11 +1219,22 @@ void MainWindow::closeEvent(QCloseEvent *event) {
 }
 
 void MainWindow::saveSession() {
+  KNOTEPAD_TRACE_SCOPE("MainWindow::saveSession");
+  const StallWatchdog::Operation operation("Save session");
   QStringList tabSessionData;
   for (int i = 0; i < m_tabWidget->count(); ++i) {
     DocumentTab *tab = tabAt(i);
     if (tab) {
       m_sessionManager->backupTab(tab);
+      // A hibernated tab has no text to hash; postings saved earlier stay
+      // and are checked against the text when restored
+      if (!tab->isHibernated()) {
+        m_sessionManager->writeTabData(
+            tab->sessionId(), QStringLiteral("idx"),
+            m_searchIndex.saveDocument(tab->sessionId(), tab->document()));
+      }
+      m_sessionManager->writeTabData(tab->sessionId(), QStringLiteral("undo"),
+                                     tab->saveUndoHistory());
       tabSessionData.append(tab->sessionId());
     }
   }
@@ -544,26 +1243,50 @@ void MainWindow::saveSession() {
 }
 
 void MainWindow::restoreSession() {
+  KNOTEPAD_TRACE_SCOPE("MainWindow::restoreSession");
+  const StallWatchdog::Operation operation("Restore session");
   int activeIndex = 0;
   QStringList tabIds = m_sessionManager->loadSessionIndex(activeIndex);
 
+  m_restoringSession = true;
   for (const QString &sessionId : tabIds) {
     DocumentTab *tab = new DocumentTab(this);
     if (m_sessionManager->restoreTab(tab, sessionId)) {
+      tab->restoreUndoHistory(
+          m_sessionManager->readTabData(sessionId, QStringLiteral("undo")));
+      connectTab(tab);
       int idx = m_tabWidget->addTab(tab, tab->tabTitle());
       Q_UNUSED(idx);
-      connect(tab, &DocumentTab::modifiedChanged, this,
-              &MainWindow::onCurrentDocModified);
-      connect(tab, &DocumentTab::cursorFormatChanged, this,
-              &MainWindow::updateFormatActions);
     } else {
       delete tab;
     }
   }
+  m_restoringSession = false;
+
+  // Tokenizing every tab is left to a worker; only the block texts are
+  // collected here
+  QVector<QPair<QString, QStringList>> texts;
+  for (int i = 0; i < m_tabWidget->count(); ++i) {
+    DocumentTab *tab = tabAt(i);
+    if (!tab || !tab->document())
+      continue;
+    QStringList blocks;
+    blocks.reserve(tab->document()->blockCount());
+    for (QTextBlock block = tab->document()->begin(); block.isValid();
+         block = block.next()) {
+      blocks.append(block.text());
+    }
+    texts.append(qMakePair(tab->sessionId(), blocks));
+  }
+  m_completionIndex->rebuild(texts);
 
   if (activeIndex >= 0 && activeIndex < m_tabWidget->count()) {
     m_tabWidget->setCurrentIndex(activeIndex);
   }
+
+  // Large sessions may not fit the memory budget at once
+  m_tabManager->activate(currentTab());
+  m_tabManager->enforceBudget();
 }
 
 // --- Timer slots ---
@@ -1,9 +1,13 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include "searchindex.h"
+
 #include <KXmlGuiWindow>
 #include <QComboBox>
 #include <QFontComboBox>
+#include <QHash>
+#include <QSet>
 #include <QLabel>
 #include <QMediaPlayer>
 #include <QSpinBox>
@@ -12,8 +16,17 @@
 #include <QToolBar>
 #include <QToolButton>
 
+class CompletionIndex;
+class DiagnosticsPanel;
 class DocumentTab;
+class FileLoadQueue;
+class FindInFilesPanel;
+class QDockWidget;
+class SearchPanel;
 class SessionManager;
+class SpellCheckService;
+class StallWatchdog;
+class TabManager;
 class QAudioOutput;
 
 class MainWindow : public KXmlGuiWindow {
@@ -23,17 +36,39 @@ public:
   explicit MainWindow(QWidget *parent = nullptr);
   ~MainWindow() override;
 
+  // Open files through the bounded loading queue, skipping those already
+  // open under any path that resolves to the same file
+  void openFiles(const QStringList &filePaths);
+
 protected:
   void closeEvent(QCloseEvent *event) override;
+  void dragEnterEvent(QDragEnterEvent *event) override;
+  void dropEvent(QDropEvent *event) override;
 
 private Q_SLOTS:
   void newTab();
   void openFile();
   void saveFile();
   void saveFileAs();
+  void onFileLoaded(const QString &path, const QByteArray &data);
+  void onFileLoadFailed(const QString &path);
+  void onFileLoadFailed(const QString &path, const QString &reason);
+  void onFileLoadsFinished();
+  void showHistory();
+  void showSearchPanel();
+  void jumpToSearchHit(const QString &docId, int blockNumber,
+                       const QString &query);
+  void showFindInFiles();
+  void showDiagnostics();
+  void jumpToFileHit(const QString &path, int line, int column, int length);
+  void setSpellCheckEnabled(bool enabled);
+  void setTracingEnabled(bool enabled);
+  void saveTrace();
+  void snapshotModifiedTabs();
   void closeTab(int index);
   void onTabChanged(int index);
   void onCurrentDocModified();
+  void updateUndoActions();
 
   // Formatting
   void toggleBold();
@@ -44,7 +79,9 @@ private Q_SLOTS:
   void selectTextColor();
   void onFontFamilyChanged(const QFont &font);
   void onFontSizeChanged(int size);
+  void scheduleFormatUpdate();
   void updateFormatActions();
+  void updateStatistics();
 
   // Timer
   void startCountdown();
@@ -56,6 +93,13 @@ private:
   void setupActions();
   void setupFormatToolbar();
   void setupTimerWidgets(QToolBar *formatBar);
+  void invalidateFormatState();
+  void setFontComboFamily(const QString &family);
+  void connectTab(DocumentTab *tab);
+  void indexTab(DocumentTab *tab);
+  void unindexTab(DocumentTab *tab);
+  DocumentTab *tabForSessionId(const QString &sessionId);
+  void selectLineRange(DocumentTab *tab, int line, int column, int length);
   DocumentTab *currentTab();
   DocumentTab *tabAt(int index);
   void updateWindowTitle();
@@ -64,6 +108,50 @@ private:
 
   QTabWidget *m_tabWidget;
   SessionManager *m_sessionManager;
+  TabManager *m_tabManager;
+  FileLoadQueue *m_fileLoadQueue;
+
+  // Canonical path -> tab, and the reverse for removal
+  QHash<QString, DocumentTab *> m_openPaths;
+  QHash<DocumentTab *, QString> m_tabPaths;
+  QSet<QString> m_queuedPaths;
+  QStringList m_failedLoads;
+
+  // Full-text index over all tabs
+  SearchIndex m_searchIndex;
+  SearchPanel *m_searchPanel;
+  QDockWidget *m_searchDock;
+
+  // Word completion over all tabs; filled in the background on restore
+  CompletionIndex *m_completionIndex;
+  bool m_restoringSession = false;
+
+  // Spell checking on one worker shared by all tabs
+  SpellCheckService *m_spellCheckService;
+  QAction *m_spellCheckAction;
+
+  // Enabled from the current tab's history
+  QAction *m_undoAction;
+  QAction *m_redoAction;
+
+  // Span recording for Diagnostics > Save Trace
+  QAction *m_traceAction;
+
+  // Event loop stalls, logged to the session directory
+  StallWatchdog *m_stallWatchdog;
+  DiagnosticsPanel *m_diagnosticsPanel;
+  QDockWidget *m_diagnosticsDock;
+
+  // Find in files, and hits waiting for their file to finish loading
+  struct PendingJump {
+    int line = 0;
+    int column = 0;
+    int length = 0;
+  };
+  FindInFilesPanel *m_findInFilesPanel;
+  QDockWidget *m_findInFilesDock;
+  QHash<QString, PendingJump> m_pendingJumps; // canonical path -> hit
+  QTimer *m_snapshotTimer;
 
   // Format toolbar widgets
   QFontComboBox *m_fontCombo;
@@ -77,6 +165,27 @@ private:
   QAction *m_bulletAction;
   QAction *m_colorAction;
 
+  // Toolbar state last applied by updateFormatActions(); widgets are only
+  // touched when their value differs
+  struct FormatState {
+    bool valid = false;
+    bool bold = false;
+    bool italic = false;
+    bool underline = false;
+    bool strikethrough = false;
+    bool bullet = false;
+    int fontSize = 0;
+    QString family;
+  };
+  FormatState m_formatState;
+  bool m_updatingFormat = false; // toolbar follows the cursor, not the user
+  QTimer *m_formatUpdateTimer;
+  QHash<QString, int> m_fontRows; // font family -> font combo row
+
+  // Live document statistics in the status bar
+  QLabel *m_statsLabel;
+  QTimer *m_statsUpdateTimer;
+
   // Timer widgets
   QToolButton *m_timerButton;
   QComboBox *m_timerCombo;
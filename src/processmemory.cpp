@@ -0,0 +1,55 @@
+#include "processmemory.h"
+
+#include <QFile>
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+#if defined(Q_OS_LINUX)
+// A "VmRSS:    123456 kB" line of /proc/self/status, in bytes
+qint64 statusField(const char *field) {
+  QFile file(QStringLiteral("/proc/self/status"));
+  if (!file.open(QIODevice::ReadOnly))
+    return -1;
+  const QList<QByteArray> lines = file.readAll().split('\n');
+  for (const QByteArray &line : lines) {
+    if (line.startsWith(field)) {
+      const QByteArray value = line.mid(int(qstrlen(field))).trimmed();
+      return value.split(' ').value(0).toLongLong() * 1024;
+    }
+  }
+  return -1;
+}
+#endif
+
+} // namespace
+
+qint64 ProcessMemory::residentBytes() {
+#if defined(Q_OS_LINUX)
+  return statusField("VmRSS:");
+#else
+  return -1;
+#endif
+}
+
+qint64 ProcessMemory::peakResidentBytes() {
+#if defined(Q_OS_LINUX)
+  const qint64 peak = statusField("VmHWM:");
+  if (peak >= 0)
+    return peak;
+#endif
+#if defined(Q_OS_UNIX)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(Q_OS_MACOS)
+    return qint64(usage.ru_maxrss);
+#else
+    return qint64(usage.ru_maxrss) * 1024;
+#endif
+  }
+#endif
+  return -1;
+}
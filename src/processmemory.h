@@ -0,0 +1,14 @@
+#ifndef PROCESSMEMORY_H
+#define PROCESSMEMORY_H
+
+#include <QtGlobal>
+
+// Memory of the whole process as the operating system sees it
+class ProcessMemory {
+public:
+  // Bytes, or -1 when the platform does not tell
+  static qint64 residentBytes();
+  static qint64 peakResidentBytes();
+};
+
+#endif // PROCESSMEMORY_H
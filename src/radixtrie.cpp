@@ -0,0 +1,297 @@
+#include "radixtrie.h"
+
+#include <queue>
+#include <vector>
+
+RadixTrie::RadixTrie() { clear(); }
+
+void RadixTrie::clear() {
+  m_nodes.clear();
+  m_freeNodes.clear();
+  m_labels.clear();
+  m_liveLabels = 0;
+  m_nodes.append(Node());
+  m_wordCount = 0;
+}
+
+qint64 RadixTrie::memoryUsage() const {
+  return qint64(m_nodes.capacity()) * sizeof(Node) +
+         qint64(m_freeNodes.capacity()) * sizeof(qint32) +
+         qint64(m_labels.capacity()) * sizeof(QChar);
+}
+
+qint32 RadixTrie::newNode(quint32 labelStart, quint32 labelLength,
+                          qint32 parent) {
+  Node node;
+  node.labelStart = labelStart;
+  node.labelLength = labelLength;
+  node.parent = parent;
+
+  qint32 index;
+  if (!m_freeNodes.isEmpty()) {
+    index = m_freeNodes.takeLast();
+    m_nodes[index] = node;
+  } else {
+    index = m_nodes.size();
+    m_nodes.append(node);
+  }
+
+  // New nodes go to the front of the sibling list
+  m_nodes[index].nextSibling = m_nodes[parent].firstChild;
+  m_nodes[parent].firstChild = index;
+  return index;
+}
+
+qint32 RadixTrie::findChild(qint32 node, QChar first) const {
+  for (qint32 child = m_nodes[node].firstChild; child >= 0;
+       child = m_nodes[child].nextSibling) {
+    if (m_labels.at(m_nodes[child].labelStart) == first)
+      return child;
+  }
+  return -1;
+}
+
+void RadixTrie::replaceChild(qint32 parent, qint32 oldChild, qint32 newChild) {
+  const qint32 next = m_nodes[oldChild].nextSibling;
+  if (newChild >= 0) {
+    m_nodes[newChild].nextSibling = next;
+    m_nodes[newChild].parent = parent;
+  }
+  const qint32 replacement = newChild >= 0 ? newChild : next;
+
+  if (m_nodes[parent].firstChild == oldChild) {
+    m_nodes[parent].firstChild = replacement;
+    return;
+  }
+  for (qint32 child = m_nodes[parent].firstChild; child >= 0;
+       child = m_nodes[child].nextSibling) {
+    if (m_nodes[child].nextSibling == oldChild) {
+      m_nodes[child].nextSibling = replacement;
+      return;
+    }
+  }
+}
+
+qint32 RadixTrie::split(qint32 node, quint32 at) {
+  // The upper part takes the node's place; the node keeps its index so
+  // that word ids stay valid
+  const qint32 parent = m_nodes[node].parent;
+  const qint32 middle = newNode(m_nodes[node].labelStart, at, parent);
+  // newNode() linked middle in front; unlink it again and put it where
+  // node was
+  m_nodes[parent].firstChild = m_nodes[middle].nextSibling;
+  replaceChild(parent, node, middle);
+
+  Node &lower = m_nodes[node];
+  lower.labelStart += at;
+  lower.labelLength -= at;
+  lower.parent = middle;
+  lower.nextSibling = -1;
+  m_nodes[middle].firstChild = node;
+  m_nodes[middle].best = lower.best;
+  return middle;
+}
+
+void RadixTrie::updateBest(qint32 node) {
+  while (node >= 0) {
+    quint32 best = m_nodes[node].count;
+    for (qint32 child = m_nodes[node].firstChild; child >= 0;
+         child = m_nodes[child].nextSibling) {
+      best = qMax(best, m_nodes[child].best);
+    }
+    if (best == m_nodes[node].best)
+      return;
+    m_nodes[node].best = best;
+    node = m_nodes[node].parent;
+  }
+}
+
+quint32 RadixTrie::insert(QStringView word, quint32 occurrences) {
+  qint32 node = 0;
+  qsizetype pos = 0;
+  while (pos < word.size()) {
+    const qint32 child = findChild(node, word[pos]);
+    if (child < 0) {
+      const quint32 start = quint32(m_labels.size());
+      m_labels.append(word.mid(pos));
+      m_liveLabels += word.size() - pos;
+      node = newNode(start, quint32(word.size() - pos), node);
+      break;
+    }
+
+    const QStringView edge = label(m_nodes[child]);
+    qsizetype common = 1;
+    while (common < edge.size() && pos + common < word.size() &&
+           edge[common] == word[pos + common]) {
+      ++common;
+    }
+    node = common < edge.size() ? split(child, quint32(common)) : child;
+    pos += common;
+  }
+
+  if (node == 0)
+    return 0; // empty words are not stored
+
+  if (m_nodes[node].count == 0)
+    ++m_wordCount;
+  m_nodes[node].count += occurrences;
+
+  // Counts only grew, so ancestors need at most a larger maximum
+  const quint32 count = m_nodes[node].count;
+  for (qint32 i = node; i >= 0 && m_nodes[i].best < count;
+       i = m_nodes[i].parent) {
+    m_nodes[i].best = count;
+  }
+  return quint32(node);
+}
+
+void RadixTrie::remove(quint32 id, quint32 occurrences) {
+  qint32 node = qint32(id);
+  if (node <= 0 || node >= m_nodes.size() || m_nodes[node].count == 0)
+    return;
+
+  Node &target = m_nodes[node];
+  target.count -= qMin(occurrences, target.count);
+  if (target.count > 0) {
+    updateBest(node);
+    return;
+  }
+  --m_wordCount;
+
+  // Drop nodes that no longer lead to any word
+  while (node > 0 && m_nodes[node].count == 0 &&
+         m_nodes[node].firstChild < 0) {
+    const qint32 parent = m_nodes[node].parent;
+    replaceChild(parent, node, -1);
+    m_liveLabels -= m_nodes[node].labelLength;
+    m_nodes[node] = Node();
+    m_freeNodes.append(node);
+    node = parent;
+  }
+
+  // A wordless node with a single child is folded into the child, which
+  // keeps its index for the same reason as in split()
+  if (node > 0 && m_nodes[node].count == 0) {
+    const qint32 child = m_nodes[node].firstChild;
+    if (child >= 0 && m_nodes[child].nextSibling < 0) {
+      const Node upper = m_nodes[node];
+      Node &lower = m_nodes[child];
+      if (upper.labelStart + upper.labelLength == lower.labelStart) {
+        lower.labelStart = upper.labelStart;
+      } else {
+        // Both old ranges are dead from here on
+        const QString joined = label(upper).toString() + label(lower);
+        lower.labelStart = quint32(m_labels.size());
+        m_labels.append(joined);
+      }
+      lower.labelLength += upper.labelLength;
+      replaceChild(upper.parent, node, child);
+      m_nodes[node] = Node();
+      m_freeNodes.append(node);
+      node = upper.parent;
+    }
+  }
+
+  updateBest(node);
+
+  if (m_labels.size() - m_liveLabels > m_liveLabels) {
+    compactLabels();
+  }
+}
+
+void RadixTrie::compactLabels() {
+  // Free nodes have empty labels and are skipped with the root
+  QString labels;
+  labels.reserve(m_liveLabels);
+  for (Node &node : m_nodes) {
+    if (node.labelLength == 0)
+      continue;
+    const quint32 start = quint32(labels.size());
+    labels.append(label(node));
+    node.labelStart = start;
+  }
+  m_labels = labels;
+  m_liveLabels = m_labels.size();
+}
+
+quint32 RadixTrie::count(quint32 id) const {
+  return qint32(id) > 0 && qint32(id) < m_nodes.size() ? m_nodes[id].count : 0;
+}
+
+QString RadixTrie::word(quint32 id) const {
+  if (qint32(id) <= 0 || qint32(id) >= m_nodes.size())
+    return QString();
+
+  QVector<QStringView> parts;
+  for (qint32 node = qint32(id); node > 0; node = m_nodes[node].parent) {
+    parts.append(label(m_nodes[node]));
+  }
+  QString result;
+  for (auto it = parts.crbegin(); it != parts.crend(); ++it) {
+    result += *it;
+  }
+  return result;
+}
+
+QStringList RadixTrie::complete(QStringView prefix, int maxResults) const {
+  QStringList results;
+  if (prefix.isEmpty() || maxResults <= 0)
+    return results;
+
+  // Find the node whose subtree holds exactly the words with this prefix
+  qint32 node = 0;
+  QString path;
+  qsizetype pos = 0;
+  while (pos < prefix.size()) {
+    const qint32 child = findChild(node, prefix[pos]);
+    if (child < 0)
+      return results;
+    const QStringView edge = label(m_nodes[child]);
+    qsizetype common = 1;
+    while (common < edge.size() && pos + common < prefix.size() &&
+           edge[common] == prefix[pos + common]) {
+      ++common;
+    }
+    if (common < edge.size() && pos + common < prefix.size())
+      return results;
+    path += edge;
+    pos += common;
+    node = child;
+  }
+
+  // Best-first over subtree maxima: a subtree is expanded only once no
+  // better word is waiting
+  struct Entry {
+    quint32 key;
+    bool isWord;
+    qint32 node;
+    QString text;
+  };
+  auto lower = [](const Entry &a, const Entry &b) {
+    if (a.key != b.key)
+      return a.key < b.key;
+    if (a.isWord != b.isWord)
+      return !a.isWord;
+    return a.text > b.text;
+  };
+  std::priority_queue<Entry, std::vector<Entry>, decltype(lower)> queue(lower);
+  queue.push(Entry{m_nodes[node].best, false, node, path});
+
+  while (!queue.empty() && results.size() < maxResults) {
+    const Entry entry = queue.top();
+    queue.pop();
+    if (entry.isWord) {
+      results.append(entry.text);
+      continue;
+    }
+    const Node &n = m_nodes[entry.node];
+    if (n.count > 0)
+      queue.push(Entry{n.count, true, entry.node, entry.text});
+    for (qint32 child = n.firstChild; child >= 0;
+         child = m_nodes[child].nextSibling) {
+      queue.push(Entry{m_nodes[child].best, false, child,
+                       entry.text + label(m_nodes[child])});
+    }
+  }
+  return results;
+}
@@ -0,0 +1,68 @@
+#ifndef RADIXTRIE_H
+#define RADIXTRIE_H
+
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QVector>
+
+/**
+ * Compressed prefix tree of words with occurrence counts.
+ *
+ * Nodes live in one array and link to their first child and next sibling,
+ * and edge labels are ranges of a shared character pool, so a node costs a
+ * few integers and no allocation of its own. Labels of removed words stay
+ * in the pool until they outnumber the live ones; the pool is rebuilt
+ * then. Every node also records the highest count in its subtree, which
+ * lets complete() visit the most frequent words first and stop after the
+ * requested number.
+ */
+class RadixTrie {
+public:
+  RadixTrie();
+
+  // Adds occurrences of word and returns its id. The id stays valid as long
+  // as the word's count is above zero.
+  quint32 insert(QStringView word, quint32 occurrences = 1);
+  void remove(quint32 id, quint32 occurrences = 1);
+
+  quint32 count(quint32 id) const;
+  QString word(quint32 id) const;
+
+  // Most frequent words starting with prefix, most frequent first
+  QStringList complete(QStringView prefix, int maxResults) const;
+
+  void clear();
+  int wordCount() const { return m_wordCount; }
+  int nodeCount() const { return m_nodes.size() - m_freeNodes.size(); }
+  qint64 memoryUsage() const;
+
+private:
+  struct Node {
+    quint32 labelStart = 0;
+    quint32 labelLength = 0;
+    quint32 count = 0;
+    quint32 best = 0; // highest count in the subtree, this node included
+    qint32 parent = -1;
+    qint32 firstChild = -1;
+    qint32 nextSibling = -1;
+  };
+
+  QStringView label(const Node &node) const {
+    return QStringView(m_labels).mid(node.labelStart, node.labelLength);
+  }
+  qint32 newNode(quint32 labelStart, quint32 labelLength, qint32 parent);
+  qint32 findChild(qint32 node, QChar first) const;
+  void replaceChild(qint32 parent, qint32 oldChild, qint32 newChild);
+  qint32 split(qint32 node, quint32 at);
+  void updateBest(qint32 node);
+  void compactLabels();
+
+  QVector<Node> m_nodes; // m_nodes[0] is the root
+  QVector<qint32> m_freeNodes;
+  QString m_labels;
+  qsizetype m_liveLabels = 0; // characters of m_labels that nodes use
+  int m_wordCount = 0;
+};
+
+#endif // RADIXTRIE_H
@@ -1,6 +1,12 @@
 #include "rtfhandler.h"
+#include "codepagedecoder.h"
+#include "formatpool.h"
+#include "trace.h"
 
+#include <QElapsedTimer>
 #include <QFont>
+#include <QHash>
+#include <QPair>
 #include <QStack>
 #include <QTextBlock>
 #include <QTextBlockFormat>
@@ -11,28 +17,72 @@
 #include <QTextList>
 #include <QTextListFormat>
 
+#include <map>
+
 // ============================================================================
 // Tokenizer
 // ============================================================================
 
-QVector<RtfHandler::Token> RtfHandler::tokenize(const QByteArray &data) {
-  QVector<Token> tokens;
-  int i = 0;
-  int len = data.size();
+// Produces tokens on demand, so memory does not grow with the input. The
+// reader looks at most two tokens ahead.
+class RtfHandler::Tokenizer {
+public:
+  explicit Tokenizer(const QByteArray &data) : m_data(data) {}
+
+  // Next token, or false at the end of the input
+  bool next(Token &token) {
+    if (!m_lookahead.isEmpty()) {
+      token = m_lookahead.takeFirst();
+    } else if (!read(token)) {
+      return false;
+    }
+    ++m_taken;
+    return true;
+  }
+
+  // Token that many places after the last one taken, without taking it
+  const Token *peek(int ahead = 0) {
+    while (m_lookahead.size() <= ahead) {
+      Token token;
+      if (!read(token))
+        return nullptr;
+      m_lookahead.append(token);
+    }
+    return &m_lookahead[ahead];
+  }
+
+  qint64 taken() const { return m_taken; }
+
+  // Drops count characters from the front of the next token, which must
+  // have been peeked at and be text
+  void dropText(int count) { m_lookahead.first().text.remove(0, count); }
+
+private:
+  bool read(Token &t);
+
+  const QByteArray &m_data;
+  int m_pos = 0;
+  QVector<Token> m_lookahead;
+  qint64 m_taken = 0;
+};
+
+bool RtfHandler::Tokenizer::read(Token &t) {
+  const QByteArray &data = m_data;
+  int &i = m_pos;
+  const int len = data.size();
+  t = Token();
 
   while (i < len) {
     char ch = data[i];
 
     if (ch == '{') {
-      Token t;
       t.type = TokenType::GroupStart;
-      tokens.append(t);
       i++;
+      return true;
     } else if (ch == '}') {
-      Token t;
       t.type = TokenType::GroupEnd;
-      tokens.append(t);
       i++;
+      return true;
     } else if (ch == '\\') {
       i++; // skip backslash
       if (i >= len)
@@ -44,13 +94,12 @@ QVector<RtfHandler::Token> RtfHandler::tokenize(const QByteArray &data) {
       if (ch == '\'') {
         i++;
         if (i + 1 < len) {
-          Token t;
           t.type = TokenType::HexChar;
           QByteArray hexStr = data.mid(i, 2);
           bool ok;
           t.hexValue = hexStr.toInt(&ok, 16);
-          tokens.append(t);
           i += 2;
+          return true;
         }
         continue;
       }
@@ -60,30 +109,22 @@ QVector<RtfHandler::Token> RtfHandler::tokenize(const QByteArray &data) {
         // Special: \~ = non-breaking space, \- = optional hyphen, \_ = non-breaking hyphen
         // \n and \r are paragraph breaks like \par
         if (ch == '\n' || ch == '\r') {
-          Token t;
           t.type = TokenType::ControlWord;
           t.word = QStringLiteral("par");
-          tokens.append(t);
         } else if (ch == '~') {
-          Token t;
           t.type = TokenType::Text;
           t.text = QChar(0xA0); // non-breaking space
-          tokens.append(t);
         } else if (ch == '*') {
           // \* marks a "destination" group that can be skipped if unknown
-          Token t;
           t.type = TokenType::ControlWord;
           t.word = QStringLiteral("*");
-          tokens.append(t);
         } else {
           // Other control symbols: output the character itself
-          Token t;
           t.type = TokenType::Text;
           t.text = QChar::fromLatin1(ch);
-          tokens.append(t);
         }
         i++;
-        continue;
+        return true;
       }
 
       // Control word: letters followed by optional digits, terminated by space or non-alpha
@@ -93,7 +134,6 @@ QVector<RtfHandler::Token> RtfHandler::tokenize(const QByteArray &data) {
         i++;
       }
 
-      Token t;
       t.type = TokenType::ControlWord;
       t.word = word;
 
@@ -117,63 +157,259 @@ QVector<RtfHandler::Token> RtfHandler::tokenize(const QByteArray &data) {
         i++;
       }
 
-      tokens.append(t);
+      return true;
     } else if (ch == '\r' || ch == '\n') {
       // Bare CR/LF outside control words are ignored in RTF
       i++;
     } else {
       // Plain text - collect until we hit a special character
-      QString text;
+      const int start = i;
+      bool highBytes = false;
       while (i < len && data[i] != '{' && data[i] != '}' && data[i] != '\\' &&
              data[i] != '\r' && data[i] != '\n') {
-        text += QChar::fromLatin1(data[i]);
+        highBytes |= uchar(data[i]) >= 0x80;
         i++;
       }
-      if (!text.isEmpty()) {
-        Token t;
+      if (i > start) {
         t.type = TokenType::Text;
-        t.text = text;
-        tokens.append(t);
+        t.text = QString::fromLatin1(data.constData() + start, i - start);
+        t.highBytes = highBytes;
+        return true;
       }
     }
   }
 
-  return tokens;
+  return false;
+}
+
+int RtfHandler::countTokens(const QByteArray &rtfData) {
+  KNOTEPAD_TRACE_SCOPE("RtfHandler::tokenize");
+  Tokenizer tokenizer(rtfData);
+  Token token;
+  while (tokenizer.next(token)) {
+  }
+  return int(tokenizer.taken());
 }
 
 // ============================================================================
 // RTF Reader
 // ============================================================================
 
+namespace {
+
+// What a character format is built from; runs in equal states share one
+struct FormatKey {
+  quint8 flags = 0;
+  int fontIndex = -1; // -1 without a font table entry
+  int fontSize = 0;   // half-points, 0 for the default
+  int colorIndex = 0; // 0 without a color table entry
+
+  bool operator==(const FormatKey &other) const {
+    return flags == other.flags && fontIndex == other.fontIndex &&
+           fontSize == other.fontSize && colorIndex == other.colorIndex;
+  }
+};
+
+size_t qHash(const FormatKey &key, size_t seed = 0) {
+  return qHashMulti(seed, key.flags, key.fontIndex, key.fontSize,
+                    key.colorIndex);
+}
+
+// Levels an RTF list may have
+constexpr int kMaxListLevels = 9;
+
+// Bullet characters written for the bullet styles
+constexpr uint kDiscBullet = 0x2022;
+constexpr uint kCircleBullet = 0x25E6;
+constexpr uint kSquareBullet = 0x25AA;
+
+// Style of a \levelnfc number format, with the bullet telling bullets apart
+QTextListFormat::Style listStyle(int numberFormat, uint bullet) {
+  switch (numberFormat) {
+  case 1:
+    return QTextListFormat::ListUpperRoman;
+  case 2:
+    return QTextListFormat::ListLowerRoman;
+  case 3:
+    return QTextListFormat::ListUpperAlpha;
+  case 4:
+    return QTextListFormat::ListLowerAlpha;
+  case 23:
+  case 255: // no number; shown as a bullet
+    if (bullet == kCircleBullet)
+      return QTextListFormat::ListCircle;
+    if (bullet == kSquareBullet || bullet == 0x25A0)
+      return QTextListFormat::ListSquare;
+    return QTextListFormat::ListDisc;
+  default:
+    return QTextListFormat::ListDecimal;
+  }
+}
+
+int numberFormat(QTextListFormat::Style style) {
+  switch (style) {
+  case QTextListFormat::ListUpperRoman:
+    return 1;
+  case QTextListFormat::ListLowerRoman:
+    return 2;
+  case QTextListFormat::ListUpperAlpha:
+    return 3;
+  case QTextListFormat::ListLowerAlpha:
+    return 4;
+  case QTextListFormat::ListDecimal:
+    return 0;
+  default:
+    return 23;
+  }
+}
+
+uint bulletCharacter(QTextListFormat::Style style) {
+  switch (style) {
+  case QTextListFormat::ListCircle:
+    return kCircleBullet;
+  case QTextListFormat::ListSquare:
+    return kSquareBullet;
+  default:
+    return kDiscBullet;
+  }
+}
+
+// \listlevel group for a level of the given style
+QByteArray listLevelRtf(QTextListFormat::Style style, int level) {
+  const int format = numberFormat(style);
+  QByteArray rtf("{\\listlevel\\levelnfc");
+  rtf.append(QByteArray::number(format));
+  rtf.append("\\levelnfcn");
+  rtf.append(QByteArray::number(format));
+  rtf.append("\\leveljc0\\levelstartat1{\\leveltext");
+  if (format == 23) {
+    rtf.append("\\'01\\u");
+    rtf.append(QByteArray::number(bulletCharacter(style)));
+    rtf.append(" ?;}{\\levelnumbers;}");
+  } else {
+    // The level's own number followed by a period
+    rtf.append("\\'02\\'0");
+    rtf.append(QByteArray::number(level));
+    rtf.append(".;}{\\levelnumbers\\'01;}");
+  }
+  rtf.append("\\fi-360\\li");
+  rtf.append(QByteArray::number(720 * (level + 1)));
+  rtf.append("}");
+  return rtf;
+}
+
+} // namespace
+
 bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
+  return readRtf(rtfData, doc, Limits());
+}
+
+QString RtfHandler::errorString(Error error) {
+  switch (error) {
+  case Error::None:
+    return QString();
+  case Error::NotRtf:
+    return QStringLiteral("Not an RTF document");
+  case Error::TooDeep:
+    return QStringLiteral("Groups are nested too deeply");
+  case Error::TooManyTokens:
+    return QStringLiteral("Too many tokens");
+  case Error::TableIndexOutOfRange:
+    return QStringLiteral("Font or color table index out of range");
+  case Error::TooManyCharacters:
+    return QStringLiteral("Document text is too long");
+  case Error::TimedOut:
+    return QStringLiteral("Reading took too long");
+  }
+  return QString();
+}
+
+bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc,
+                         const Limits &limits, Error *error) {
+  KNOTEPAD_TRACE_SCOPE("RtfHandler::readRtf");
+  if (error) {
+    *error = Error::NotRtf;
+  }
   if (!doc)
     return false;
 
-  QVector<Token> tokens = tokenize(rtfData);
-  if (tokens.isEmpty())
+  Tokenizer tokenizer(rtfData);
+  if (!tokenizer.peek())
     return false;
 
+  // The first limit exceeded ends the loop below
+  Error failure = Error::None;
+  qint64 characters = 0;
+  QElapsedTimer timer;
+  timer.start();
+
+  // Whether count more characters stay within the limit
+  auto allowCharacters = [&](qint64 count) {
+    characters += count;
+    if (limits.maxCharacters > 0 && characters > limits.maxCharacters) {
+      failure = Error::TooManyCharacters;
+      return false;
+    }
+    return true;
+  };
+
   // Font table and color table
   QVector<FontEntry> fontTable;
   QVector<ColorEntry> colorTable;
 
+  // Code page of text whose font names none, and a decoder per code page
+  int documentCodePage = 1252;
+  std::map<int, CodePageDecoder> decoders;
+  auto decoderFor = [&](int codePage) -> CodePageDecoder & {
+    return decoders.try_emplace(codePage, codePage).first->second;
+  };
+
+  // Formats built so far, dropped whenever a table changes
+  QHash<FormatKey, QTextCharFormat> formatCache;
+
+  // List table, list overrides and the list of the current paragraph
+  QVector<ListEntry> listTable;
+  QVector<ListOverride> listOverrides;
+  ParaList paraList;
+
+  // List each \ls number and level adds paragraphs to; \pn lists use 0
+  QHash<QPair<int, int>, QTextList *> openLists;
+
   // State stack for group nesting
   QStack<State> stateStack;
   State currentState;
 
   // Parsing modes
-  enum class ParseMode { Normal, FontTable, ColorTable, SkipGroup };
+  enum class ParseMode {
+    Normal,
+    FontTable,
+    ColorTable,
+    ListTable,
+    ListOverrideTable,
+    SkipGroup
+  };
   QStack<ParseMode> modeStack;
   modeStack.push(ParseMode::Normal);
 
-  // For font table parsing
+  // For font table parsing; names are in the font's code page
   FontEntry currentFont;
-  QString fontNameAccum;
+  QByteArray fontNameBytes;
 
   // For color table parsing
   ColorEntry currentColor;
   bool colorHasComponent = false;
 
+  auto addColor = [&]() {
+    if (limits.maxTableIndex > 0 && colorTable.size() > limits.maxTableIndex) {
+      failure = Error::TableIndexOutOfRange;
+      return;
+    }
+    colorTable.append(currentColor);
+    formatCache.clear();
+    currentColor = ColorEntry();
+    colorHasComponent = false;
+  };
+
   // Track group depth for skip mode
   int skipDepth = 0;
 
@@ -187,48 +423,146 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
   // We need to track if this is the first paragraph (to avoid leading empty line)
   bool firstParagraph = true;
 
-  // Track pending list state — will be applied at \par
-  bool pendingListItem = false;
-
   // Track the default font
   int defaultFontIndex = 0;
 
   auto applyCharFormat = [&]() -> QTextCharFormat {
-    QTextCharFormat fmt;
     const CharState &cs = currentState.charState;
+    FormatKey key;
+    key.flags = (cs.bold ? 1 : 0) | (cs.italic ? 2 : 0) |
+                (cs.underline ? 4 : 0) | (cs.strikethrough ? 8 : 0);
+    if (cs.fontIndex >= 0 && cs.fontIndex < fontTable.size()) {
+      key.fontIndex = cs.fontIndex;
+    }
+    key.fontSize = qMax(0, cs.fontSize);
+    if (cs.colorIndex > 0 && cs.colorIndex <= colorTable.size()) {
+      key.colorIndex = cs.colorIndex;
+    }
 
+    auto cached = formatCache.constFind(key);
+    if (cached != formatCache.constEnd())
+      return *cached;
+
+    QTextCharFormat fmt;
     fmt.setFontWeight(cs.bold ? QFont::Bold : QFont::Normal);
     fmt.setFontItalic(cs.italic);
     fmt.setFontUnderline(cs.underline);
     fmt.setFontStrikeOut(cs.strikethrough);
 
     // Font size: RTF uses half-points, Qt uses points
-    if (cs.fontSize > 0) {
-      fmt.setFontPointSize(cs.fontSize / 2.0);
+    if (key.fontSize > 0) {
+      fmt.setFontPointSize(key.fontSize / 2.0);
     }
 
     // Font family
-    if (cs.fontIndex >= 0 && cs.fontIndex < fontTable.size()) {
-      fmt.setFontFamilies({fontTable[cs.fontIndex].name});
+    if (key.fontIndex >= 0) {
+      fmt.setFontFamilies({fontTable[key.fontIndex].name});
     }
 
     // Text color
-    if (cs.colorIndex > 0 && cs.colorIndex <= colorTable.size()) {
-      const ColorEntry &ce = colorTable[cs.colorIndex - 1];
+    if (key.colorIndex > 0) {
+      const ColorEntry &ce = colorTable[key.colorIndex - 1];
       fmt.setForeground(QColor(ce.red, ce.green, ce.blue));
     }
 
+    // Shared with equal formats of other documents
+    fmt = FormatPool::instance().charFormat(fmt);
+    formatCache.insert(key, fmt);
     return fmt;
   };
 
-  for (int ti = 0; ti < tokens.size(); ++ti) {
-    const Token &tok = tokens[ti];
+  auto currentDecoder = [&]() -> CodePageDecoder & {
+    const int fontIndex = currentState.charState.fontIndex;
+    if (fontIndex >= 0 && fontIndex < fontTable.size() &&
+        fontTable[fontIndex].codePage > 0) {
+      return decoderFor(fontTable[fontIndex].codePage);
+    }
+    return decoderFor(documentCodePage);
+  };
+
+  // Decodes bytes in the code page of the current font and inserts them
+  auto insertEncoded = [&](const char *data, qsizetype size) {
+    QString text;
+    currentDecoder().decode(data, size, text);
+    if (text.isEmpty() || !allowCharacters(text.size()))
+      return;
+    cursor.insertText(text, applyCharFormat());
+  };
+
+  auto listFormat = [&]() -> QTextListFormat {
+    QTextListFormat format;
+    format.setIndent(paraList.level + 1);
+    if (paraList.number <= 0) {
+      format.setStyle(paraList.legacyStyle);
+      return format;
+    }
+
+    // Lists missing from the table are shown as bullets
+    format.setStyle(QTextListFormat::ListDisc);
+    for (const ListOverride &entry : listOverrides) {
+      if (entry.number != paraList.number)
+        continue;
+      for (const ListEntry &list : listTable) {
+        if (list.id == entry.listId && paraList.level < list.levels.size()) {
+          const ListLevel &level = list.levels[paraList.level];
+          format.setStyle(listStyle(level.numberFormat, level.bullet));
+          break;
+        }
+      }
+      break;
+    }
+    return format;
+  };
+
+  // Puts the current block into the list of its paragraph, so that the
+  // items of one list share a QTextList
+  auto attachList = [&]() {
+    if (!paraList.isList()) {
+      // Numbering of \pn lists does not go on past other paragraphs
+      for (int level = 0; level < kMaxListLevels; ++level) {
+        openLists.remove({0, level});
+      }
+      return;
+    }
+
+    const QPair<int, int> key(paraList.number, paraList.level);
+    // An item restarts the numbering of the levels below it
+    for (int level = key.second + 1; level < kMaxListLevels; ++level) {
+      openLists.remove({key.first, level});
+    }
+
+    const QTextListFormat format = listFormat();
+    QTextList *list = openLists.value(key);
+    if (list && list->format() == format) {
+      list->add(cursor.block());
+    } else {
+      openLists.insert(key, cursor.createList(format));
+    }
+  };
+
+  Token tok;
+  while (failure == Error::None && tokenizer.next(tok)) {
+    if (limits.maxTokens > 0 && tokenizer.taken() > limits.maxTokens) {
+      failure = Error::TooManyTokens;
+      break;
+    }
+    // The clock is too slow to read for every token
+    if (limits.maxMilliseconds > 0 && (tokenizer.taken() & 0x3ff) == 0 &&
+        timer.elapsed() > limits.maxMilliseconds) {
+      failure = Error::TimedOut;
+      break;
+    }
+
     ParseMode mode = modeStack.top();
 
     // Handle skip mode
     if (mode == ParseMode::SkipGroup) {
       if (tok.type == TokenType::GroupStart) {
         skipDepth++;
+        if (limits.maxDepth > 0 &&
+            stateStack.size() + skipDepth > limits.maxDepth) {
+          failure = Error::TooDeep;
+        }
       } else if (tok.type == TokenType::GroupEnd) {
         skipDepth--;
         if (skipDepth <= 0) {
@@ -243,23 +577,32 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
 
     switch (tok.type) {
     case TokenType::GroupStart: {
+      if (limits.maxDepth > 0 && stateStack.size() >= limits.maxDepth) {
+        failure = Error::TooDeep;
+        continue;
+      }
       stateStack.push(currentState);
 
       // Check if next token is \* (ignorable destination)
-      if (ti + 1 < tokens.size() &&
-          tokens[ti + 1].type == TokenType::ControlWord &&
-          tokens[ti + 1].word == QStringLiteral("*")) {
+      const Token *star = tokenizer.peek(0);
+      if (star && star->type == TokenType::ControlWord &&
+          star->word == QStringLiteral("*")) {
         // Check if the destination after \* is known
-        if (ti + 2 < tokens.size() &&
-            tokens[ti + 2].type == TokenType::ControlWord) {
-          const QString &destWord = tokens[ti + 2].word;
+        const Token *dest = tokenizer.peek(1);
+        if (dest && dest->type == TokenType::ControlWord) {
+          const QString &destWord = dest->word;
           // Known ignorable destinations we want to skip
           if (destWord != QStringLiteral("fonttbl") &&
               destWord != QStringLiteral("colortbl") &&
+              destWord != QStringLiteral("listtable") &&
+              destWord != QStringLiteral("listoverridetable") &&
               destWord != QStringLiteral("pn")) {
             modeStack.push(ParseMode::SkipGroup);
             skipDepth = 1;
-            ti += 2; // skip \* and the destination word
+            // skip \* and the destination word
+            Token skipped;
+            tokenizer.next(skipped);
+            tokenizer.next(skipped);
             continue;
           }
         }
@@ -268,7 +611,7 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
       if (mode == ParseMode::FontTable) {
         // Beginning of a font entry sub-group
         currentFont = FontEntry();
-        fontNameAccum.clear();
+        fontNameBytes.clear();
         modeStack.push(ParseMode::FontTable);
       } else {
         modeStack.push(mode);
@@ -279,26 +622,38 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
     case TokenType::GroupEnd: {
       if (mode == ParseMode::FontTable) {
         // If we have a font name accumulated, save it
-        if (!fontNameAccum.isEmpty()) {
+        if (!fontNameBytes.isEmpty()) {
+          CodePageDecoder &decoder = decoderFor(
+              currentFont.codePage > 0 ? currentFont.codePage
+                                       : documentCodePage);
+          QString fontName;
+          decoder.decode(fontNameBytes, fontName);
+          decoder.finish(fontName);
+
           // Remove trailing semicolons and whitespace
-          fontNameAccum = fontNameAccum.trimmed();
-          if (fontNameAccum.endsWith(QLatin1Char(';'))) {
-            fontNameAccum.chop(1);
+          fontName = fontName.trimmed();
+          if (fontName.endsWith(QLatin1Char(';'))) {
+            fontName.chop(1);
+          }
+          currentFont.name =
+              FormatPool::instance().family(fontName.trimmed());
+          if (currentFont.id < 0 || (limits.maxTableIndex > 0 &&
+                                     currentFont.id > limits.maxTableIndex)) {
+            failure = Error::TableIndexOutOfRange;
+            continue;
           }
-          currentFont.name = fontNameAccum.trimmed();
           // Ensure the font table is large enough
           while (fontTable.size() <= currentFont.id) {
             fontTable.append(FontEntry());
           }
           fontTable[currentFont.id] = currentFont;
-          fontNameAccum.clear();
+          formatCache.clear();
+          fontNameBytes.clear();
         }
       } else if (mode == ParseMode::ColorTable) {
         // Finalize any pending color entry
         if (colorHasComponent) {
-          colorTable.append(currentColor);
-          currentColor = ColorEntry();
-          colorHasComponent = false;
+          addColor();
         }
       }
 
@@ -321,6 +676,30 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
         continue;
       }
 
+      // Character set of the document; \ansicpg refines \ansi
+      if (w == QStringLiteral("ansi")) {
+        documentCodePage = 1252;
+        continue;
+      }
+      if (w == QStringLiteral("mac")) {
+        documentCodePage = 10000;
+        continue;
+      }
+      if (w == QStringLiteral("pc")) {
+        documentCodePage = 437;
+        continue;
+      }
+      if (w == QStringLiteral("pca")) {
+        documentCodePage = 850;
+        continue;
+      }
+      if (w == QStringLiteral("ansicpg") && tok.hasParam) {
+        if (CodePageDecoder::isSupported(tok.parameter)) {
+          documentCodePage = tok.parameter;
+        }
+        continue;
+      }
+
       // Font table
       if (w == QStringLiteral("fonttbl")) {
         modeStack.pop();
@@ -338,6 +717,18 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
         continue;
       }
 
+      // List tables
+      if (w == QStringLiteral("listtable")) {
+        modeStack.pop();
+        modeStack.push(ParseMode::ListTable);
+        continue;
+      }
+      if (w == QStringLiteral("listoverridetable")) {
+        modeStack.pop();
+        modeStack.push(ParseMode::ListOverrideTable);
+        continue;
+      }
+
       // Skip known destinations that we don't handle
       if (w == QStringLiteral("stylesheet") ||
           w == QStringLiteral("info") ||
@@ -354,8 +745,9 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
           w == QStringLiteral("datafield") ||
           w == QStringLiteral("mmathPr") ||
           w == QStringLiteral("generator") ||
-          w == QStringLiteral("listtable") ||
-          w == QStringLiteral("listoverridetable") ||
+          w == QStringLiteral("listname") ||
+          w == QStringLiteral("pntxta") ||
+          w == QStringLiteral("pntxtb") ||
           w == QStringLiteral("rsidtbl") ||
           w == QStringLiteral("pgdsctbl") ||
           w == QStringLiteral("latentstyles")) {
@@ -372,9 +764,17 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
       if (mode == ParseMode::FontTable) {
         if (w == QStringLiteral("f") && tok.hasParam) {
           currentFont.id = tok.parameter;
+        } else if (w == QStringLiteral("fcharset") && tok.hasParam &&
+                   currentFont.codePage == 0) {
+          currentFont.codePage =
+              CodePageDecoder::codePageForCharset(tok.parameter);
+        } else if (w == QStringLiteral("cpg") && tok.hasParam &&
+                   CodePageDecoder::isSupported(tok.parameter)) {
+          // An explicit code page wins over the charset's
+          currentFont.codePage = tok.parameter;
         }
         // Skip font family types (fnil, froman, fswiss, etc.)
-        // Skip fcharset, fprq, etc.
+        // Skip fprq, etc.
         continue;
       }
 
@@ -393,6 +793,53 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
         continue;
       }
 
+      // List table mode: list definitions and the style of their levels
+      if (mode == ParseMode::ListTable) {
+        if (w == QStringLiteral("list")) {
+          if (limits.maxTableIndex > 0 &&
+              listTable.size() > limits.maxTableIndex) {
+            failure = Error::TableIndexOutOfRange;
+            continue;
+          }
+          listTable.append(ListEntry());
+        } else if (listTable.isEmpty()) {
+          continue;
+        } else if (w == QStringLiteral("listid") && tok.hasParam) {
+          listTable.last().id = tok.parameter;
+        } else if (w == QStringLiteral("listlevel")) {
+          listTable.last().levels.append(ListLevel());
+        } else if (listTable.last().levels.isEmpty()) {
+          continue;
+        } else if ((w == QStringLiteral("levelnfc") ||
+                    w == QStringLiteral("levelnfcn")) &&
+                   tok.hasParam) {
+          listTable.last().levels.last().numberFormat = tok.parameter;
+        } else if (w == QStringLiteral("u") && tok.hasParam) {
+          // Only the level text has characters of its own
+          listTable.last().levels.last().bullet =
+              uint(tok.parameter < 0 ? tok.parameter + 65536 : tok.parameter);
+        }
+        continue;
+      }
+
+      if (mode == ParseMode::ListOverrideTable) {
+        if (w == QStringLiteral("listoverride")) {
+          if (limits.maxTableIndex > 0 &&
+              listOverrides.size() > limits.maxTableIndex) {
+            failure = Error::TableIndexOutOfRange;
+            continue;
+          }
+          listOverrides.append(ListOverride());
+        } else if (listOverrides.isEmpty() || !tok.hasParam) {
+          continue;
+        } else if (w == QStringLiteral("listid")) {
+          listOverrides.last().listId = tok.parameter;
+        } else if (w == QStringLiteral("ls")) {
+          listOverrides.last().number = tok.parameter;
+        }
+        continue;
+      }
+
       // Normal mode: handle formatting control words
 
       // Default font
@@ -454,20 +901,12 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
           firstParagraph = false;
         }
 
-        // Check if current paragraph should be a list item
-        if (pendingListItem) {
-          QTextBlockFormat bfmt;
-          bfmt.setIndent(1);
-          cursor.setBlockFormat(bfmt);
-
-          QTextListFormat listFmt;
-          listFmt.setStyle(QTextListFormat::ListDisc);
-          listFmt.setIndent(1);
-          cursor.createList(listFmt);
-          pendingListItem = false;
-        }
+        attachList();
 
-        cursor.insertBlock();
+        if (!allowCharacters(1))
+          continue;
+        // The next block starts outside any list, not in this one
+        cursor.insertBlock(QTextBlockFormat());
         continue;
       }
 
@@ -476,25 +915,59 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
         currentState.charState = CharState();
         currentState.charState.fontIndex = defaultFontIndex;
         currentState.paraState = ParaState();
-        pendingListItem = false;
+        paraList = ParaList();
         continue;
       }
 
       // Line break
       if (w == QStringLiteral("line")) {
+        if (!allowCharacters(1))
+          continue;
         cursor.insertText(QStringLiteral("\n"));
         continue;
       }
 
       // Tab
       if (w == QStringLiteral("tab")) {
+        if (!allowCharacters(1))
+          continue;
         cursor.insertText(QStringLiteral("\t"));
         continue;
       }
 
-      // List-related: detect bullets
+      // Lists of older writers: \pn properties on each paragraph
       if (w == QStringLiteral("pnlvlblt")) {
-        pendingListItem = true;
+        paraList.legacy = true;
+        paraList.level = 0;
+        paraList.legacyStyle = QTextListFormat::ListDisc;
+        continue;
+      }
+      if (w == QStringLiteral("pnlvlbody") ||
+          (w == QStringLiteral("pnlvl") && tok.hasParam)) {
+        paraList.legacy = true;
+        paraList.level =
+            tok.hasParam ? qBound(0, tok.parameter - 1, kMaxListLevels - 1) : 0;
+        paraList.legacyStyle = QTextListFormat::ListDecimal;
+        continue;
+      }
+      if (w == QStringLiteral("pndec")) {
+        paraList.legacyStyle = QTextListFormat::ListDecimal;
+        continue;
+      }
+      if (w == QStringLiteral("pnucltr")) {
+        paraList.legacyStyle = QTextListFormat::ListUpperAlpha;
+        continue;
+      }
+      if (w == QStringLiteral("pnlcltr")) {
+        paraList.legacyStyle = QTextListFormat::ListLowerAlpha;
+        continue;
+      }
+      if (w == QStringLiteral("pnucrm")) {
+        paraList.legacyStyle = QTextListFormat::ListUpperRoman;
+        continue;
+      }
+      if (w == QStringLiteral("pnlcrm")) {
+        paraList.legacyStyle = QTextListFormat::ListLowerRoman;
         continue;
       }
 
@@ -510,15 +983,18 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
         continue;
       }
 
-      // Paragraph-level list number bullets from LibreOffice
-      // \ls and \ilvl indicate list override and level
+      // List override and level of the paragraph, from the list tables
       if (w == QStringLiteral("ls") && tok.hasParam) {
-        pendingListItem = true;
+        paraList.number = qMax(0, tok.parameter);
+        continue;
+      }
+      if (w == QStringLiteral("ilvl") && tok.hasParam) {
+        paraList.level = qBound(0, tok.parameter, kMaxListLevels - 1);
         continue;
       }
 
-      // \pntext group — bullet text representation, skip it
-      if (w == QStringLiteral("pntext")) {
+      // \pntext and \listtext groups — the item's number as text, skip them
+      if (w == QStringLiteral("pntext") || w == QStringLiteral("listtext")) {
         if (!stateStack.isEmpty()) {
           modeStack.pop();
           modeStack.push(ParseMode::SkipGroup);
@@ -540,20 +1016,37 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
         if (codepoint < 0) {
           codepoint += 65536;
         }
+        if (!allowCharacters(1))
+          continue;
         QTextCharFormat fmt = applyCharFormat();
         cursor.insertText(QString(QChar(codepoint)), fmt);
 
-        // Skip the ANSI replacement character (usually next text char)
-        if (ti + 1 < tokens.size() &&
-            tokens[ti + 1].type == TokenType::Text &&
-            tokens[ti + 1].text.size() == 1) {
-          ti++;
+        // Skip the \uc characters that stand in for it in older readers;
+        // an escape counts as one
+        for (int skip = currentState.unicodeSkip; skip > 0;) {
+          const Token *replacement = tokenizer.peek();
+          if (!replacement || (replacement->type != TokenType::Text &&
+                               replacement->type != TokenType::HexChar))
+            break;
+          if (replacement->type == TokenType::Text &&
+              replacement->text.size() > skip) {
+            tokenizer.dropText(skip);
+            break;
+          }
+          skip -= replacement->type == TokenType::Text
+                      ? int(replacement->text.size())
+                      : 1;
+          Token skipped;
+          tokenizer.next(skipped);
         }
         continue;
       }
 
       // Unicode character count to skip after \u: \ucN
-      // We handle this implicitly above
+      if (w == QStringLiteral("uc") && tok.hasParam) {
+        currentState.unicodeSkip = qMax(0, tok.parameter);
+        continue;
+      }
 
       // Ignore other control words we don't handle
       break;
@@ -561,7 +1054,7 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
 
     case TokenType::Text: {
       if (mode == ParseMode::FontTable) {
-        fontNameAccum += tok.text;
+        fontNameBytes += tok.text.toLatin1();
         continue;
       }
 
@@ -570,9 +1063,7 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
         const QString &txt = tok.text;
         for (int ci = 0; ci < txt.size(); ++ci) {
           if (txt[ci] == QLatin1Char(';')) {
-            colorTable.append(currentColor);
-            currentColor = ColorEntry();
-            colorHasComponent = false;
+            addColor();
           }
         }
         continue;
@@ -583,6 +1074,15 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
         if (firstParagraph) {
           firstParagraph = false;
         }
+        // ASCII reads the same in every code page, unless it is the trail
+        // byte of a double-byte character
+        if (tok.highBytes || currentDecoder().hasPendingByte()) {
+          const QByteArray bytes = tok.text.toLatin1();
+          insertEncoded(bytes.constData(), bytes.size());
+          continue;
+        }
+        if (!allowCharacters(tok.text.size()))
+          continue;
         QTextCharFormat fmt = applyCharFormat();
         cursor.insertText(tok.text, fmt);
       }
@@ -592,7 +1092,7 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
     case TokenType::HexChar: {
       if (mode == ParseMode::FontTable) {
         // Some font names use hex characters
-        fontNameAccum += QChar::fromLatin1(static_cast<char>(tok.hexValue));
+        fontNameBytes += static_cast<char>(tok.hexValue);
         continue;
       }
       if (mode == ParseMode::ColorTable) {
@@ -602,29 +1102,37 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
         if (firstParagraph) {
           firstParagraph = false;
         }
-        QTextCharFormat fmt = applyCharFormat();
-        // Convert from Windows-1252 by default
-        QChar ch = QChar::fromLatin1(static_cast<char>(tok.hexValue));
-        cursor.insertText(QString(ch), fmt);
+        // Escapes in a row decode and insert together, as one character may
+        // span several. A run ends before the token where the loop above
+        // checks its limits.
+        QByteArray bytes(1, static_cast<char>(tok.hexValue));
+        while (const Token *next = tokenizer.peek()) {
+          if (next->type != TokenType::HexChar ||
+              ((tokenizer.taken() + 1) & 0x3ff) == 0 ||
+              (limits.maxTokens > 0 && tokenizer.taken() >= limits.maxTokens))
+            break;
+          bytes += static_cast<char>(next->hexValue);
+          tokenizer.next(tok);
+        }
+        insertEncoded(bytes.constData(), bytes.size());
       }
       break;
     }
     }
   }
 
-  // Apply formatting to the last paragraph if it was a list item
-  if (pendingListItem) {
-    QTextBlockFormat bfmt;
-    bfmt.setIndent(1);
-    cursor.setBlockFormat(bfmt);
-
-    QTextListFormat listFmt;
-    listFmt.setStyle(QTextListFormat::ListDisc);
-    listFmt.setIndent(1);
-    cursor.createList(listFmt);
+  // The last paragraph has no \par; an empty one is what the final \par
+  // left behind
+  if (!cursor.block().text().isEmpty()) {
+    attachList();
   }
 
-  return seenRtfHeader;
+  if (error) {
+    *error = failure != Error::None ? failure
+             : seenRtfHeader        ? Error::None
+                                    : Error::NotRtf;
+  }
+  return failure == Error::None && seenRtfHeader;
 }
 
 // ============================================================================
@@ -632,6 +1140,7 @@ bool RtfHandler::readRtf(const QByteArray &rtfData, QTextDocument *doc) {
 // ============================================================================
 
 QByteArray RtfHandler::writeRtf(const QTextDocument *doc) {
+  KNOTEPAD_TRACE_SCOPE("RtfHandler::writeRtf");
   if (!doc)
     return QByteArray();
 
@@ -642,9 +1151,19 @@ QByteArray RtfHandler::writeRtf(const QTextDocument *doc) {
   // Always have a default font
   fontNames.append(QStringLiteral("Sans Serif"));
 
-  // First pass: collect fonts and colors
+  // Lists in order of appearance, numbered from 1 for \ls
+  QVector<QTextList *> lists;
+  QHash<QTextList *, int> listNumbers;
+
+  // First pass: collect fonts, colors and lists
   QTextBlock block = doc->begin();
   while (block.isValid()) {
+    if (QTextList *list = block.textList()) {
+      if (!listNumbers.contains(list)) {
+        lists.append(list);
+        listNumbers.insert(list, int(lists.size()));
+      }
+    }
     for (auto it = block.begin(); !it.atEnd(); ++it) {
       QTextFragment fragment = it.fragment();
       if (!fragment.isValid())
@@ -703,6 +1222,33 @@ QByteArray RtfHandler::writeRtf(const QTextDocument *doc) {
   }
   rtf.append("}\n");
 
+  // List table with one list per QTextList, defining the levels down to its
+  // own, and an override for each that its items refer to
+  if (!lists.isEmpty()) {
+    rtf.append("{\\*\\listtable");
+    for (int i = 0; i < lists.size(); ++i) {
+      const QTextListFormat listFmt = lists[i]->format();
+      const int levels = qBound(1, listFmt.indent(), kMaxListLevels);
+      rtf.append("\n{\\list\\listtemplateid");
+      rtf.append(QByteArray::number(i + 1));
+      for (int level = 0; level < levels; ++level) {
+        rtf.append(listLevelRtf(listFmt.style(), level));
+      }
+      rtf.append("\\listid");
+      rtf.append(QByteArray::number(i + 1));
+      rtf.append("}");
+    }
+    rtf.append("}\n{\\*\\listoverridetable");
+    for (int i = 0; i < lists.size(); ++i) {
+      rtf.append("{\\listoverride\\listid");
+      rtf.append(QByteArray::number(i + 1));
+      rtf.append("\\listoverridecount0\\ls");
+      rtf.append(QByteArray::number(i + 1));
+      rtf.append("}");
+    }
+    rtf.append("}\n");
+  }
+
   // Helper: find font index
   auto fontIndex = [&](const QTextCharFormat &fmt) -> int {
     QStringList families = fmt.fontFamilies().toStringList();
@@ -758,14 +1304,16 @@ QByteArray RtfHandler::writeRtf(const QTextDocument *doc) {
 
     rtf.append("\\pard");
 
-    // Check if this block is in a list
+    // List items refer to their list in the table
     QTextList *list = block.textList();
     if (list) {
-      QTextListFormat listFmt = list->format();
-      // Write bullet list markers
-      rtf.append("\\fi-360\\li720 ");
-      rtf.append("{\\pntext\\f0 \\'B7\\tab}");
-      rtf.append("{\\*\\pn\\pnlvlblt{\\pntxtb\\'B7}}");
+      const int level = qBound(1, list->format().indent(), kMaxListLevels) - 1;
+      rtf.append("\\fi-360\\li");
+      rtf.append(QByteArray::number(720 * (level + 1)));
+      rtf.append("\\ls");
+      rtf.append(QByteArray::number(listNumbers.value(list)));
+      rtf.append("\\ilvl");
+      rtf.append(QByteArray::number(level));
     }
 
     rtf.append(" ");
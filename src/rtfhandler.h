@@ -5,27 +5,61 @@
 #include <QString>
 #include <QStringList>
 #include <QTextDocument>
+#include <QTextListFormat>
 #include <QVector>
 
 /**
  * RTF reader/writer for QTextDocument.
  *
  * Supports: bold, italic, underline, strikethrough, font family, font size,
- * text color, bullet lists, and paragraph breaks.
+ * text color, bullet and numbered lists with up to nine levels, and paragraph
+ * breaks. Text is decoded in the code page of its font (\fcharset) or of
+ * the document (\ansicpg).
  */
 class RtfHandler {
 public:
+  // Bounds on what one document may cost the reader. The defaults only stop
+  // input that no word processor writes; zero means no limit.
+  struct Limits {
+    int maxDepth = 1024;        // nested groups
+    qint64 maxTokens = 0;       // tokens read
+    int maxTableIndex = 32767;  // font and color table entries
+    qint64 maxCharacters = 0;   // characters inserted into the document
+    int maxMilliseconds = 0;    // wall time
+  };
+
+  enum class Error {
+    None,
+    NotRtf,
+    TooDeep,
+    TooManyTokens,
+    TableIndexOutOfRange,
+    TooManyCharacters,
+    TimedOut,
+  };
+
   // Read RTF data and populate the given QTextDocument
   static bool readRtf(const QByteArray &rtfData, QTextDocument *doc);
 
+  // Same with explicit limits; reading stops at the first one exceeded,
+  // leaving what was read so far in the document
+  static bool readRtf(const QByteArray &rtfData, QTextDocument *doc,
+                      const Limits &limits, Error *error = nullptr);
+
+  static QString errorString(Error error);
+
   // Write the QTextDocument content as RTF
   static QByteArray writeRtf(const QTextDocument *doc);
 
+  // Number of tokens the reader sees in the data, for benchmarks
+  static int countTokens(const QByteArray &rtfData);
+
 private:
   // Internal structures for the RTF parser
   struct FontEntry {
     int id = 0;
     QString name;
+    int codePage = 0; // from \fcharset or \cpg, 0 for the document's
   };
 
   struct ColorEntry {
@@ -34,6 +68,33 @@ private:
     int blue = 0;
   };
 
+  // One level of a \listtable entry
+  struct ListLevel {
+    int numberFormat = 0; // \levelnfc: 0 decimal, 23 bullet, ...
+    uint bullet = 0;      // \u character of a bullet level's text
+  };
+
+  struct ListEntry {
+    int id = 0;
+    QVector<ListLevel> levels;
+  };
+
+  // \listoverridetable entry; paragraphs refer to lists by its number
+  struct ListOverride {
+    int listId = 0;
+    int number = 0;
+  };
+
+  // List of the current paragraph, kept until \pard
+  struct ParaList {
+    int number = 0;      // \ls, 0 without one
+    int level = 0;       // \ilvl or \pnlvl, from 0
+    bool legacy = false; // \pn numbering, for writers without list tables
+    QTextListFormat::Style legacyStyle = QTextListFormat::ListDisc;
+
+    bool isList() const { return number > 0 || legacy; }
+  };
+
   struct CharState {
     bool bold = false;
     bool italic = false;
@@ -54,21 +115,23 @@ private:
     CharState charState;
     ParaState paraState;
     bool skipDestination = false;
+    int unicodeSkip = 1; // \uc: characters that stand in for each \u
   };
 
   // RTF tokenizer
   enum class TokenType { GroupStart, GroupEnd, ControlWord, Text, HexChar };
 
   struct Token {
-    TokenType type;
-    QString word;      // control word name (without backslash)
-    int parameter = 0; // numeric parameter (-1 if absent)
+    TokenType type = TokenType::Text;
+    QString word;           // control word name (without backslash)
+    int parameter = 0;      // numeric parameter (-1 if absent)
     bool hasParam = false;
-    QString text;      // for Text tokens
-    int hexValue = 0;  // for HexChar tokens
+    QString text;           // for Text tokens, one character per byte
+    bool highBytes = false; // text has bytes to decode by code page
+    int hexValue = 0;       // for HexChar tokens
   };
 
-  static QVector<Token> tokenize(const QByteArray &data);
+  class Tokenizer;
 };
 
 #endif // RTFHANDLER_H
@@ -0,0 +1,53 @@
+#include "rtfmimedata.h"
+#include "rtfhandler.h"
+
+#include <QTextCursor>
+#include <QTextDocument>
+
+RtfMimeData::RtfMimeData(const QTextDocumentFragment &fragment)
+    : m_fragment(fragment) {}
+
+QString RtfMimeData::rtfMimeType() { return QStringLiteral("text/rtf"); }
+
+QString RtfMimeData::qtRichTextMimeType() {
+  return QStringLiteral("application/x-qrichtext");
+}
+
+QStringList RtfMimeData::formats() const {
+  return QStringList() << QStringLiteral("text/plain")
+                       << QStringLiteral("text/html") << qtRichTextMimeType()
+                       << rtfMimeType();
+}
+
+bool RtfMimeData::hasFormat(const QString &mimeType) const {
+  return formats().contains(mimeType);
+}
+
+QVariant RtfMimeData::retrieveData(const QString &mimeType,
+                                   QMetaType type) const {
+  if (mimeType == rtfMimeType()) {
+    if (m_rtf.isEmpty()) {
+      // The writer works on whole documents
+      QTextDocument doc;
+      QTextCursor(&doc).insertFragment(m_fragment);
+      m_rtf = RtfHandler::writeRtf(&doc);
+    }
+    return m_rtf;
+  }
+  if (mimeType == QLatin1String("text/html") ||
+      mimeType == qtRichTextMimeType()) {
+    if (m_html.isEmpty()) {
+      m_html = m_fragment.toHtml();
+    }
+    if (mimeType == qtRichTextMimeType())
+      return m_html.toUtf8();
+    return m_html;
+  }
+  if (mimeType == QLatin1String("text/plain")) {
+    if (m_text.isEmpty()) {
+      m_text = m_fragment.toPlainText();
+    }
+    return m_text;
+  }
+  return QMimeData::retrieveData(mimeType, type);
+}
@@ -0,0 +1,39 @@
+#ifndef RTFMIMEDATA_H
+#define RTFMIMEDATA_H
+
+#include <QMimeData>
+#include <QTextDocumentFragment>
+
+/**
+ * Clipboard data for a copied selection.
+ *
+ * Offers plain text, HTML, Qt's rich text and RTF, but only renders a
+ * format when another application asks for it, so copying costs no more
+ * than taking the fragment. Each rendering is cached for repeated
+ * requests.
+ */
+class RtfMimeData : public QMimeData {
+  Q_OBJECT
+
+public:
+  explicit RtfMimeData(const QTextDocumentFragment &fragment);
+
+  static QString rtfMimeType();
+  // Qt's HTML, which QTextEdit reads back without loss
+  static QString qtRichTextMimeType();
+
+  QStringList formats() const override;
+  bool hasFormat(const QString &mimeType) const override;
+
+protected:
+  QVariant retrieveData(const QString &mimeType,
+                        QMetaType type) const override;
+
+private:
+  QTextDocumentFragment m_fragment;
+  mutable QByteArray m_rtf;
+  mutable QString m_html;
+  mutable QString m_text;
+};
+
+#endif // RTFMIMEDATA_H
@@ -0,0 +1,356 @@
+#include "searchindex.h"
+#include "blockdelta.h"
+#include "wordtokenizer.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QIODevice>
+#include <QPair>
+#include <QSet>
+#include <QTextBlock>
+#include <QTextDocument>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Longer runs are usually encoded data rather than words
+const int kMaxTokenLength = 64;
+
+const quint32 kIndexMagic = 0x4B4E5349; // "KNSI"
+const quint32 kIndexVersion = 2;
+
+// SHA-1 of the document's text, block by block, without building the
+// whole plain text
+QByteArray contentHash(const QTextDocument *doc) {
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  const QChar separator = QChar::ParagraphSeparator;
+  for (QTextBlock block = doc->begin(); block.isValid();
+       block = block.next()) {
+    const QString text = block.text();
+    hash.addData(QByteArrayView(reinterpret_cast<const char *>(text.utf16()),
+                                text.size() * qsizetype(sizeof(QChar))));
+    hash.addData(QByteArrayView(reinterpret_cast<const char *>(&separator),
+                                sizeof(QChar)));
+  }
+  return hash.result();
+}
+
+} // namespace
+
+SearchIndex::SearchIndex() = default;
+
+QStringList SearchIndex::tokenize(const QString &text) {
+  QStringList tokens;
+  WordTokenizer::forEachWord(text, [&](int start, int length) {
+    if (length <= kMaxTokenLength) {
+      tokens.append(text.mid(start, length).toCaseFolded());
+    }
+  });
+  return tokens;
+}
+
+SearchIndex::Document *SearchIndex::document(const QString &docId) {
+  auto it = m_docIndex.constFind(docId);
+  return it == m_docIndex.constEnd() ? nullptr : &m_docs[it.value()];
+}
+
+int SearchIndex::allocateSlot(const QString &docId) {
+  int slot;
+  if (!m_freeSlots.isEmpty()) {
+    slot = m_freeSlots.takeLast();
+  } else {
+    slot = m_docs.size();
+    m_docs.append(Document());
+  }
+  m_docIndex.insert(docId, slot);
+  m_docs[slot].id = docId;
+  return slot;
+}
+
+void SearchIndex::indexBlock(int slot, quint32 blockId, const QString &text,
+                             QStringList &tokens) {
+  QHash<QString, quint32> counts;
+  WordTokenizer::forEachWord(text, [&](int start, int length) {
+    if (length <= kMaxTokenLength) {
+      ++counts[text.mid(start, length).toCaseFolded()];
+    }
+  });
+
+  tokens.clear();
+  tokens.reserve(counts.size());
+  const quint64 key = postingKey(slot, blockId);
+  for (auto it = counts.cbegin(); it != counts.cend(); ++it) {
+    auto posting = m_postings.find(it.key());
+    if (posting == m_postings.end()) {
+      posting = m_postings.insert(it.key(), QHash<quint64, quint32>());
+    }
+    posting->insert(key, it.value());
+    // Share the string data with the dictionary entry
+    tokens.append(posting.key());
+  }
+}
+
+void SearchIndex::unindexBlock(int slot, quint32 blockId,
+                               const QStringList &tokens) {
+  const quint64 key = postingKey(slot, blockId);
+  for (const QString &token : tokens) {
+    auto posting = m_postings.find(token);
+    if (posting == m_postings.end())
+      continue;
+    posting->remove(key);
+    if (posting->isEmpty()) {
+      m_postings.erase(posting);
+    }
+  }
+}
+
+void SearchIndex::addDocument(const QString &docId, const QTextDocument *doc) {
+  removeDocument(docId);
+  if (!doc)
+    return;
+
+  const int slot = allocateSlot(docId);
+  Document &d = m_docs[slot];
+  d.characterCount = doc->characterCount();
+  d.blockIds.reserve(doc->blockCount());
+  d.blockTokens.reserve(doc->blockCount());
+
+  for (QTextBlock block = doc->begin(); block.isValid(); block = block.next()) {
+    const quint32 id = m_nextBlockId++;
+    QStringList tokens;
+    indexBlock(slot, id, block.text(), tokens);
+    d.blockIds.append(id);
+    d.blockTokens.append(tokens);
+  }
+  m_blockTotal += d.blockIds.size();
+}
+
+void SearchIndex::removeDocument(const QString &docId) {
+  auto it = m_docIndex.find(docId);
+  if (it == m_docIndex.end())
+    return;
+
+  const int slot = it.value();
+  Document &d = m_docs[slot];
+  for (int i = 0; i < d.blockIds.size(); ++i) {
+    unindexBlock(slot, d.blockIds[i], d.blockTokens[i]);
+  }
+  m_blockTotal -= d.blockIds.size();
+
+  d = Document();
+  m_freeSlots.append(slot);
+  m_docIndex.erase(it);
+}
+
+void SearchIndex::updateBlocks(const QString &docId, const QTextDocument *doc,
+                               int firstBlock, int removedBlocks,
+                               int addedBlocks) {
+  Document *d = document(docId);
+  const BlockDelta delta{firstBlock, removedBlocks, addedBlocks};
+  if (!d || !delta.fits(d->blockIds.size())) {
+    addDocument(docId, doc);
+    return;
+  }
+
+  const int slot = m_docIndex.value(docId);
+  for (int i = firstBlock; i < firstBlock + removedBlocks; ++i) {
+    unindexBlock(slot, d->blockIds[i], d->blockTokens[i]);
+  }
+
+  // Both vectors move together, even if the delta does not add up
+  m_blockTotal += delta.blockCountChange();
+  const bool idsSpliced = delta.splice(d->blockIds, doc->blockCount());
+  const bool tokensSpliced = delta.splice(d->blockTokens, doc->blockCount());
+  if (!idsSpliced || !tokensSpliced) {
+    addDocument(docId, doc);
+    return;
+  }
+
+  QTextBlock block = doc->findBlockByNumber(firstBlock);
+  for (int i = firstBlock; i < firstBlock + addedBlocks && block.isValid();
+       ++i, block = block.next()) {
+    const quint32 id = m_nextBlockId++;
+    d->blockIds[i] = id;
+    indexBlock(slot, id, block.text(), d->blockTokens[i]);
+  }
+  d->characterCount = doc->characterCount();
+}
+
+QVector<SearchIndex::Hit> SearchIndex::search(const QString &query,
+                                              int maxResults) const {
+  QVector<Hit> hits;
+
+  const QStringList tokens = tokenize(query);
+  QVector<const QHash<quint64, quint32> *> lists;
+  QSet<QString> seen;
+  for (const QString &token : tokens) {
+    if (seen.contains(token))
+      continue;
+    seen.insert(token);
+    auto posting = m_postings.constFind(token);
+    if (posting == m_postings.constEnd())
+      return hits;
+    lists.append(&posting.value());
+  }
+  if (lists.isEmpty())
+    return hits;
+
+  // Walk the rarest token's postings and probe the others
+  std::sort(lists.begin(), lists.end(),
+            [](const QHash<quint64, quint32> *a,
+               const QHash<quint64, quint32> *b) {
+              return a->size() < b->size();
+            });
+
+  QVector<double> idf;
+  idf.reserve(lists.size());
+  for (const QHash<quint64, quint32> *list : std::as_const(lists)) {
+    idf.append(std::log(1.0 + double(m_blockTotal) / double(list->size())));
+  }
+
+  QVector<QPair<quint64, double>> scored;
+  const QHash<quint64, quint32> &rarest = *lists.first();
+  for (auto it = rarest.cbegin(); it != rarest.cend(); ++it) {
+    double score = idf[0] * (1.0 + std::log(double(it.value())));
+    bool all = true;
+    for (int t = 1; t < lists.size(); ++t) {
+      auto other = lists[t]->constFind(it.key());
+      if (other == lists[t]->constEnd()) {
+        all = false;
+        break;
+      }
+      score += idf[t] * (1.0 + std::log(double(other.value())));
+    }
+    if (all) {
+      scored.append(qMakePair(it.key(), score));
+    }
+  }
+
+  auto better = [](const QPair<quint64, double> &a,
+                   const QPair<quint64, double> &b) {
+    return a.second > b.second || (a.second == b.second && a.first < b.first);
+  };
+  const int count = qMin(maxResults, int(scored.size()));
+  std::partial_sort(scored.begin(), scored.begin() + count, scored.end(),
+                    better);
+  scored.resize(count);
+
+  // Resolve block ids to block numbers, one pass per document with hits
+  QHash<int, QHash<quint32, int>> wanted;
+  for (const auto &entry : std::as_const(scored)) {
+    wanted[int(entry.first >> 32)].insert(quint32(entry.first), -1);
+  }
+  for (auto it = wanted.begin(); it != wanted.end(); ++it) {
+    const QVector<quint32> &ids = m_docs[it.key()].blockIds;
+    for (int i = 0; i < ids.size(); ++i) {
+      auto found = it->find(ids[i]);
+      if (found != it->end()) {
+        found.value() = i;
+      }
+    }
+  }
+
+  hits.reserve(count);
+  for (const auto &entry : std::as_const(scored)) {
+    const int slot = int(entry.first >> 32);
+    Hit hit;
+    hit.docId = m_docs[slot].id;
+    hit.blockNumber = wanted[slot].value(quint32(entry.first));
+    hit.score = entry.second;
+    hits.append(hit);
+  }
+  return hits;
+}
+
+QByteArray SearchIndex::saveDocument(const QString &docId,
+                                     const QTextDocument *doc) const {
+  auto it = m_docIndex.constFind(docId);
+  if (!doc || it == m_docIndex.constEnd())
+    return QByteArray();
+
+  const int slot = it.value();
+  const Document &d = m_docs[slot];
+  if (d.characterCount != doc->characterCount() ||
+      d.blockIds.size() != doc->blockCount()) {
+    return QByteArray();
+  }
+
+  QByteArray data;
+  QDataStream out(&data, QIODevice::WriteOnly);
+  out << kIndexMagic << kIndexVersion << qint32(d.characterCount)
+      << qint32(d.blockIds.size()) << contentHash(doc);
+  for (int i = 0; i < d.blockIds.size(); ++i) {
+    const quint64 key = postingKey(slot, d.blockIds[i]);
+    const QStringList &tokens = d.blockTokens[i];
+    out << qint32(tokens.size());
+    for (const QString &token : tokens) {
+      out << token << m_postings.value(token).value(key);
+    }
+  }
+  return data;
+}
+
+bool SearchIndex::restoreDocument(const QString &docId,
+                                  const QTextDocument *doc,
+                                  const QByteArray &data) {
+  if (!doc || data.isEmpty())
+    return false;
+
+  QDataStream in(data);
+  quint32 magic = 0;
+  quint32 version = 0;
+  qint32 characterCount = 0;
+  qint32 blockCount = 0;
+  QByteArray hash;
+  in >> magic >> version >> characterCount >> blockCount >> hash;
+  // The counts rule out most other texts before the text is hashed
+  if (magic != kIndexMagic || version != kIndexVersion ||
+      characterCount != doc->characterCount() ||
+      blockCount != doc->blockCount() || hash != contentHash(doc)) {
+    return false;
+  }
+
+  // Parse everything before touching the index
+  QVector<QVector<QPair<QString, quint32>>> blocks(blockCount);
+  for (int i = 0; i < blockCount; ++i) {
+    qint32 tokenCount = 0;
+    in >> tokenCount;
+    if (tokenCount < 0 || in.status() != QDataStream::Ok)
+      return false;
+    blocks[i].reserve(tokenCount);
+    for (int t = 0; t < tokenCount; ++t) {
+      QString token;
+      quint32 occurrences = 0;
+      in >> token >> occurrences;
+      blocks[i].append(qMakePair(token, occurrences));
+    }
+  }
+  if (in.status() != QDataStream::Ok)
+    return false;
+
+  removeDocument(docId);
+  const int slot = allocateSlot(docId);
+  Document &d = m_docs[slot];
+  d.characterCount = characterCount;
+  d.blockIds.resize(blockCount);
+  d.blockTokens.resize(blockCount);
+  for (int i = 0; i < blockCount; ++i) {
+    const quint32 id = m_nextBlockId++;
+    const quint64 key = postingKey(slot, id);
+    d.blockIds[i] = id;
+    QStringList &tokens = d.blockTokens[i];
+    tokens.reserve(blocks[i].size());
+    for (const auto &entry : std::as_const(blocks[i])) {
+      auto posting = m_postings.find(entry.first);
+      if (posting == m_postings.end()) {
+        posting = m_postings.insert(entry.first, QHash<quint64, quint32>());
+      }
+      posting->insert(key, entry.second);
+      tokens.append(posting.key());
+    }
+  }
+  m_blockTotal += blockCount;
+  return true;
+}
@@ -0,0 +1,86 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QTextDocument;
+
+/**
+ * In-memory inverted index over the blocks of all open documents.
+ *
+ * Maps case-folded tokens to the blocks containing them. Documents are
+ * indexed block by block and kept current from block-level edit deltas, so
+ * an edit only re-tokenizes the blocks it touched. Blocks get ids that
+ * survive insertions before them; a posting names a (document, block id)
+ * pair and the block number is resolved when results are built.
+ */
+class SearchIndex {
+public:
+  struct Hit {
+    QString docId;
+    int blockNumber = 0;
+    double score = 0.0;
+  };
+
+  SearchIndex();
+
+  // (Re)index a whole document
+  void addDocument(const QString &docId, const QTextDocument *doc);
+  void removeDocument(const QString &docId);
+  bool contains(const QString &docId) const {
+    return m_docIndex.contains(docId);
+  }
+
+  // Blocks [firstBlock, firstBlock + addedBlocks) of doc replace
+  // removedBlocks blocks of the indexed version
+  void updateBlocks(const QString &docId, const QTextDocument *doc,
+                    int firstBlock, int removedBlocks, int addedBlocks);
+
+  // Blocks containing every token of the query, best first
+  QVector<Hit> search(const QString &query, int maxResults) const;
+
+  // Query tokens, as matched by search()
+  static QStringList tokenize(const QString &text);
+
+  // Persisted postings of one document, with a hash of the text they were
+  // built from. restoreDocument() only accepts data whose hash matches the
+  // document's current text.
+  QByteArray saveDocument(const QString &docId,
+                          const QTextDocument *doc) const;
+  bool restoreDocument(const QString &docId, const QTextDocument *doc,
+                       const QByteArray &data);
+
+private:
+  struct Document {
+    QString id;
+    int characterCount = 0;
+    QVector<quint32> blockIds;      // in block order
+    QVector<QStringList> blockTokens; // distinct tokens, per block
+  };
+
+  static quint64 postingKey(int slot, quint32 blockId) {
+    return (quint64(slot) << 32) | blockId;
+  }
+
+  Document *document(const QString &docId);
+  int allocateSlot(const QString &docId);
+  void indexBlock(int slot, quint32 blockId, const QString &text,
+                  QStringList &tokens);
+  void unindexBlock(int slot, quint32 blockId, const QStringList &tokens);
+
+  // Documents live in stable slots so postings can refer to them by number
+  QVector<Document> m_docs;
+  QVector<int> m_freeSlots;
+  QHash<QString, int> m_docIndex;
+
+  // token -> (slot, block id) -> occurrences in the block
+  QHash<QString, QHash<quint64, quint32>> m_postings;
+  qint64 m_blockTotal = 0;
+  quint32 m_nextBlockId = 1;
+};
+
+#endif // SEARCHINDEX_H
@@ -0,0 +1,115 @@
+#include "searchpanel.h"
+#include "documenttab.h"
+#include "searchindex.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLineEdit>
+#include <QTabWidget>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+#include <KLocalizedString>
+
+// Results shown per query
+static const int kMaxResults = 500;
+
+// Characters of block text shown as a snippet
+static const int kSnippetLength = 120;
+
+SearchPanel::SearchPanel(const SearchIndex &index, QTabWidget *tabs,
+                         QWidget *parent)
+    : QWidget(parent), m_index(index), m_tabs(tabs) {
+  QVBoxLayout *layout = new QVBoxLayout(this);
+  layout->setContentsMargins(0, 0, 0, 0);
+
+  m_queryEdit = new QLineEdit(this);
+  m_queryEdit->setPlaceholderText(i18n("Search all tabs..."));
+  m_queryEdit->setClearButtonEnabled(true);
+  layout->addWidget(m_queryEdit);
+
+  m_results = new QTreeWidget(this);
+  m_results->setColumnCount(2);
+  m_results->setHeaderLabels(QStringList() << i18n("Tab") << i18n("Text"));
+  m_results->setRootIsDecorated(false);
+  m_results->setUniformRowHeights(true);
+  m_results->header()->setStretchLastSection(true);
+  layout->addWidget(m_results);
+
+  m_statusLabel = new QLabel(this);
+  layout->addWidget(m_statusLabel);
+
+  // The index answers in milliseconds, so every keystroke runs the query
+  connect(m_queryEdit, &QLineEdit::textChanged, this, &SearchPanel::runQuery);
+  connect(m_results, &QTreeWidget::itemActivated, this,
+          &SearchPanel::onItemActivated);
+}
+
+void SearchPanel::focusQuery() {
+  m_queryEdit->setFocus();
+  m_queryEdit->selectAll();
+}
+
+void SearchPanel::runQuery() {
+  m_results->clear();
+
+  const QString query = m_queryEdit->text();
+  if (query.trimmed().isEmpty()) {
+    m_statusLabel->clear();
+    return;
+  }
+
+  QElapsedTimer timer;
+  timer.start();
+  const QVector<SearchIndex::Hit> hits = m_index.search(query, kMaxResults);
+  const qint64 elapsed = timer.elapsed();
+
+  QHash<QString, DocumentTab *> tabs;
+  for (int i = 0; i < m_tabs->count(); ++i) {
+    DocumentTab *tab = qobject_cast<DocumentTab *>(m_tabs->widget(i));
+    if (tab)
+      tabs.insert(tab->sessionId(), tab);
+  }
+
+  QList<QTreeWidgetItem *> items;
+  items.reserve(hits.size());
+  for (const SearchIndex::Hit &hit : hits) {
+    DocumentTab *tab = tabs.value(hit.docId);
+    if (!tab)
+      continue;
+
+    // Hibernated tabs have no document to take a snippet from
+    QString snippet;
+    if (QTextDocument *doc = tab->document()) {
+      snippet = doc->findBlockByNumber(hit.blockNumber).text().simplified();
+      if (snippet.size() > kSnippetLength) {
+        snippet = snippet.left(kSnippetLength) + QStringLiteral("…");
+      }
+    } else {
+      snippet = i18n("Line %1", hit.blockNumber + 1);
+    }
+
+    QTreeWidgetItem *item = new QTreeWidgetItem(
+        QStringList() << tab->tabTitle() << snippet);
+    item->setData(0, Qt::UserRole, hit.docId);
+    item->setData(0, Qt::UserRole + 1, hit.blockNumber);
+    items.append(item);
+  }
+  m_results->addTopLevelItems(items);
+
+  m_statusLabel->setText(
+      i18np("1 result in %2 ms", "%1 results in %2 ms", items.size(), elapsed));
+}
+
+void SearchPanel::onItemActivated(QTreeWidgetItem *item) {
+  if (!item)
+    return;
+
+  Q_EMIT hitActivated(item->data(0, Qt::UserRole).toString(),
+                      item->data(0, Qt::UserRole + 1).toInt(),
+                      m_queryEdit->text());
+}
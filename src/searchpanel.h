@@ -0,0 +1,40 @@
+#ifndef SEARCHPANEL_H
+#define SEARCHPANEL_H
+
+#include <QWidget>
+
+class QLabel;
+class QLineEdit;
+class QTabWidget;
+class QTreeWidget;
+class QTreeWidgetItem;
+class SearchIndex;
+
+// Query field and ranked results for searching across all open tabs
+class SearchPanel : public QWidget {
+  Q_OBJECT
+
+public:
+  SearchPanel(const SearchIndex &index, QTabWidget *tabs,
+              QWidget *parent = nullptr);
+
+  void focusQuery();
+
+Q_SIGNALS:
+  void hitActivated(const QString &docId, int blockNumber,
+                    const QString &query);
+
+private Q_SLOTS:
+  void runQuery();
+  void onItemActivated(QTreeWidgetItem *item);
+
+private:
+  const SearchIndex &m_index;
+  QTabWidget *m_tabs;
+
+  QLineEdit *m_queryEdit;
+  QTreeWidget *m_results;
+  QLabel *m_statusLabel;
+};
+
+#endif // SEARCHPANEL_H
@@ -1,179 +1,256 @@
 #include "sessionmanager.h"
 #include "documenttab.h"
+#include "stallwatchdog.h"
+#include "trace.h"
 
-#include <QDir>
+#include <QCryptographicHash>
 #include <QFile>
-#include <QJsonArray>
-#include <QJsonDocument>
-#include <QJsonObject>
+#include <QFileInfo>
+#include <QMutexLocker>
 #include <QStandardPaths>
-#include <QTextStream>
+#include <QTextDocument>
 
-SessionManager::SessionManager(QObject *parent) : QObject(parent) {
-  m_sessionDir =
-      QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation) +
-      QStringLiteral("/sessions");
-  ensureSessionDir();
-}
+// Snapshots kept per document before the oldest are pruned
+static const int kMaxSnapshots = 500;
 
-void SessionManager::ensureSessionDir() {
-  QDir dir(m_sessionDir);
-  if (!dir.exists()) {
-    dir.mkpath(QStringLiteral("."));
-  }
-}
+SessionManager::SessionManager(QObject *parent)
+    : QObject(parent),
+      m_store(
+          QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation) +
+          QStringLiteral("/sessions")),
+      m_history(m_store.dir() + QStringLiteral("/history")) {
+  // A single writer thread keeps writes for the same tab in order
+  m_writer.setMaxThreadCount(1);
 
-QString SessionManager::tabBackupPath(const QString &sessionId) const {
-  return m_sessionDir + QStringLiteral("/") + sessionId +
-         QStringLiteral(".html");
+  // Chunks left over from the last session's prunes and closed tabs
+  m_writer.start([this]() { m_history.collectGarbage(); });
 }
 
-QString SessionManager::tabMetaPath(const QString &sessionId) const {
-  return m_sessionDir + QStringLiteral("/") + sessionId +
-         QStringLiteral(".json");
-}
+SessionManager::~SessionManager() { flush(); }
 
-void SessionManager::backupTab(DocumentTab *tab) {
-  ensureSessionDir();
+void SessionManager::flush() { m_writer.waitForDone(); }
 
-  // Save content as HTML
-  QFile contentFile(tabBackupPath(tab->sessionId()));
-  if (contentFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-    QTextStream stream(&contentFile);
-    stream << tab->toHtml();
-    contentFile.close();
-  }
+bool SessionManager::backupTab(DocumentTab *tab) {
+  KNOTEPAD_TRACE_SCOPE("SessionManager::backupTab");
+  // A hibernated tab cannot change, so its backup on disk is current
+  if (tab->isHibernated())
+    return true;
+
+  const StallWatchdog::Operation operation(
+      "Back up tab", tab->document() ? tab->document()->characterCount() : 0);
+  const QString sessionId = tab->sessionId();
+  const QString html = tab->toHtml();
 
-  // Save metadata (file path, title, modified state)
-  QJsonObject meta;
-  meta[QStringLiteral("filePath")] = tab->filePath();
-  meta[QStringLiteral("tabTitle")] = tab->tabTitle();
-  meta[QStringLiteral("modified")] = tab->isModified();
+  SessionStore::TabMeta meta;
+  meta.filePath = tab->filePath();
+  meta.tabTitle = tab->tabTitle();
+  meta.modified = tab->isModified();
+  const QByteArray metaData = SessionStore::encodeMeta(meta);
 
-  QFile metaFile(tabMetaPath(tab->sessionId()));
-  if (metaFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-    metaFile.write(QJsonDocument(meta).toJson(QJsonDocument::Compact));
-    metaFile.close();
+  quint64 generation = 0;
+  {
+    QMutexLocker locker(&m_pendingMutex);
+    generation = ++m_generation;
+    m_pending.insert(sessionId, PendingBackup{html, generation});
   }
+
+  // Encoding and compression run on the writer thread
+  m_writer.start([this, sessionId, html, metaData, generation]() {
+    if (!m_store.writeTab(sessionId, html, metaData)) {
+      // Keep the pending copy so the content is not lost
+      return;
+    }
+    updateBackupSize(sessionId);
+
+    QMutexLocker locker(&m_pendingMutex);
+    auto it = m_pending.find(sessionId);
+    if (it != m_pending.end() && it->generation == generation) {
+      m_pending.erase(it);
+    }
+  });
+
+  return true;
 }
 
-bool SessionManager::restoreTab(DocumentTab *tab, const QString &sessionId) {
-  QString contentPath = tabBackupPath(sessionId);
-  QString metaPath = tabMetaPath(sessionId);
+void SessionManager::snapshotTab(DocumentTab *tab, const QString &reason) {
+  if (tab->isHibernated())
+    return;
 
-  if (!QFile::exists(contentPath) || !QFile::exists(metaPath)) {
-    return false;
+  const QString key = historyKey(tab);
+  const QString html = tab->toHtml();
+  const QString title =
+      tab->filePath().isEmpty() ? tab->tabTitle() : tab->filePath();
+  tab->clearNeedsSnapshot();
+
+  m_writer.start([this, key, html, reason, title]() {
+    if (m_history.addSnapshot(key, html.toUtf8(), reason)) {
+      m_history.setTitle(key, title);
+      m_history.prune(key, kMaxSnapshots);
+    }
+  });
+}
+
+QString SessionManager::historyKey(const DocumentTab *tab) const {
+  // Files keep their history across tabs and sessions, whatever path they
+  // were opened by; untitled documents are identified by their tab
+  if (tab->filePath().isEmpty()) {
+    return tab->sessionId();
+  }
+  const QFileInfo info(tab->filePath());
+  QString canonical = info.canonicalFilePath();
+  if (canonical.isEmpty()) {
+    canonical = info.absoluteFilePath(); // not on disk yet
   }
+  const QByteArray path = canonical.toUtf8();
+  return QString::fromLatin1(
+      QCryptographicHash::hash(path, QCryptographicHash::Sha1).toHex());
+}
 
-  // Load metadata
-  QFile metaFile(metaPath);
-  if (!metaFile.open(QIODevice::ReadOnly)) {
+bool SessionManager::restoreTab(DocumentTab *tab, const QString &sessionId) {
+  KNOTEPAD_TRACE_SCOPE("SessionManager::restoreTab");
+  StallWatchdog::Operation operation("Restore tab");
+  SessionStore::TabMeta meta;
+  if (!m_store.readTabMeta(sessionId, meta)) {
     return false;
   }
-  QJsonObject meta = QJsonDocument::fromJson(metaFile.readAll()).object();
-  metaFile.close();
 
   // Load content
-  QFile contentFile(contentPath);
-  if (!contentFile.open(QIODevice::ReadOnly)) {
+  QString html;
+  if (!readTabContent(sessionId, html)) {
     return false;
   }
-  QString html = QString::fromUtf8(contentFile.readAll());
-  contentFile.close();
+  operation.setDocumentSize(html.size());
 
   // Restore the tab
   tab->setSessionId(sessionId);
   tab->setFromHtml(html);
 
-  QString filePath = meta[QStringLiteral("filePath")].toString();
-  QString tabTitle = meta[QStringLiteral("tabTitle")].toString();
-  bool modified = meta[QStringLiteral("modified")].toBool();
-
-  if (!filePath.isEmpty()) {
+  if (!meta.filePath.isEmpty()) {
     // This tab was associated with a file on disk
     // Reload from file if it still exists, otherwise use backup
-    if (QFile::exists(filePath)) {
-      tab->loadFile(filePath);
-      // If it was modified (had unsaved changes), overlay the backup content
-      if (modified) {
+    if (QFile::exists(meta.filePath)) {
+      const bool loaded = tab->loadFile(meta.filePath);
+      // If it was modified (had unsaved changes), or the file can no longer
+      // be read in full, overlay the backup content
+      if (meta.modified || !loaded) {
         tab->setFromHtml(html);
         tab->setModified(true);
       }
+      if (!loaded) {
+        tab->setTabTitle(meta.tabTitle);
+      }
     } else {
       // File no longer exists, keep backup content
-      tab->setTabTitle(tabTitle);
+      tab->setTabTitle(meta.tabTitle);
       tab->setModified(true);
     }
   } else {
     // Untitled document
-    tab->setTabTitle(tabTitle);
-    tab->setModified(modified);
+    tab->setTabTitle(meta.tabTitle);
+    tab->setModified(meta.modified);
   }
 
   return true;
 }
 
-void SessionManager::removeTabBackup(const QString &sessionId) {
-  QFile::remove(tabBackupPath(sessionId));
-  QFile::remove(tabMetaPath(sessionId));
+bool SessionManager::hibernateTab(DocumentTab *tab) {
+  if (tab->isHibernated())
+    return true;
+  if (!tab->canHibernate())
+    return false;
+
+  if (!backupTab(tab))
+    return false;
+
+  tab->hibernate();
+  return true;
 }
 
-void SessionManager::saveSessionIndex(const QStringList &tabIds,
-                                      int activeIndex) {
-  ensureSessionDir();
+bool SessionManager::rehydrateTab(DocumentTab *tab) {
+  if (!tab->isHibernated())
+    return true;
 
-  QJsonObject index;
-  index[QStringLiteral("activeIndex")] = activeIndex;
+  QString html;
+  if (!readTabContent(tab->sessionId(), html))
+    return false;
 
-  QJsonArray tabs;
-  for (const QString &id : tabIds) {
-    tabs.append(id);
+  tab->rehydrate(html);
+  return true;
+}
+
+bool SessionManager::readTabContent(const QString &sessionId,
+                                    QString &html) const {
+  {
+    // Content that has not reached the disk yet is the most recent
+    QMutexLocker locker(&m_pendingMutex);
+    auto it = m_pending.constFind(sessionId);
+    if (it != m_pending.constEnd()) {
+      html = it->html;
+      return true;
+    }
   }
-  index[QStringLiteral("tabs")] = tabs;
 
-  QFile file(m_sessionDir + QStringLiteral("/session.json"));
-  if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-    file.write(QJsonDocument(index).toJson(QJsonDocument::Compact));
-    file.close();
+  return m_store.readTabContent(sessionId, html);
+}
+
+void SessionManager::removeTabBackup(const QString &sessionId) {
+  {
+    QMutexLocker locker(&m_pendingMutex);
+    m_pending.remove(sessionId);
   }
 
-  // Clean up orphaned backup files (tabs that are no longer in the session)
-  QDir dir(m_sessionDir);
-  QStringList allFiles = dir.entryList(
-      QStringList() << QStringLiteral("*.html") << QStringLiteral("*.json"),
-      QDir::Files);
-  for (const QString &fileName : allFiles) {
-    if (fileName == QStringLiteral("session.json"))
-      continue;
-
-    // Extract session ID from filename
-    QString id = fileName;
-    id = id.remove(QStringLiteral(".html")).remove(QStringLiteral(".json"));
-
-    if (!tabIds.contains(id)) {
-      QFile::remove(m_sessionDir + QStringLiteral("/") + fileName);
+  // Queued behind any pending write for the same tab. History kept under
+  // the tab's id, that of an untitled document, stays; the history dialog
+  // lists it with the other closed documents.
+  m_writer.start([this, sessionId]() {
+    m_store.removeTab(sessionId);
+    QMutexLocker locker(&m_sizesMutex);
+    m_backupSizes.remove(sessionId);
+  });
+}
+
+void SessionManager::writeTabData(const QString &sessionId,
+                                  const QString &suffix,
+                                  const QByteArray &data) {
+  Q_ASSERT(SessionStore::tabDataSuffixes().contains(suffix));
+  m_writer.start([this, sessionId, suffix, data]() {
+    if (m_store.writeTabData(sessionId, suffix, data)) {
+      updateBackupSize(sessionId);
     }
-  }
+  });
 }
 
-QStringList SessionManager::loadSessionIndex(int &activeIndex) {
-  QStringList result;
-  activeIndex = 0;
+void SessionManager::updateBackupSize(const QString &sessionId) {
+  const qint64 bytes = m_store.tabDiskUsage(sessionId);
+  QMutexLocker locker(&m_sizesMutex);
+  m_backupSizes.insert(sessionId, bytes);
+}
 
-  QFile file(m_sessionDir + QStringLiteral("/session.json"));
-  if (!file.open(QIODevice::ReadOnly)) {
-    return result;
-  }
+qint64 SessionManager::backupSize(const QString &sessionId) const {
+  QMutexLocker locker(&m_sizesMutex);
+  auto it = m_backupSizes.constFind(sessionId);
+  if (it != m_backupSizes.constEnd())
+    return *it;
 
-  QJsonObject index = QJsonDocument::fromJson(file.readAll()).object();
-  file.close();
+  // Restored tabs have not been written by this process yet
+  const qint64 bytes = m_store.tabDiskUsage(sessionId);
+  m_backupSizes.insert(sessionId, bytes);
+  return bytes;
+}
 
-  activeIndex = index[QStringLiteral("activeIndex")].toInt(0);
+QByteArray SessionManager::readTabData(const QString &sessionId,
+                                       const QString &suffix) const {
+  return m_store.readTabData(sessionId, suffix);
+}
 
-  QJsonArray tabs = index[QStringLiteral("tabs")].toArray();
-  for (const QJsonValue &val : tabs) {
-    result.append(val.toString());
-  }
+void SessionManager::saveSessionIndex(const QStringList &tabIds,
+                                      int activeIndex) {
+  KNOTEPAD_TRACE_SCOPE("SessionManager::saveSessionIndex");
+  const QByteArray index = SessionStore::encodeIndex(tabIds, activeIndex);
+  m_writer.start(
+      [this, tabIds, index]() { m_store.writeIndex(index, tabIds); });
+}
 
-  return result;
+QStringList SessionManager::loadSessionIndex(int &activeIndex) {
+  return m_store.readIndex(activeIndex);
 }
@@ -1,9 +1,15 @@
 #ifndef SESSIONMANAGER_H
 #define SESSIONMANAGER_H
 
+#include "historystore.h"
+#include "sessionstore.h"
+
+#include <QHash>
+#include <QMutex>
 #include <QObject>
 #include <QString>
 #include <QStringList>
+#include <QThreadPool>
 
 class DocumentTab;
 
@@ -12,13 +18,19 @@ class SessionManager : public QObject {
 
 public:
   explicit SessionManager(QObject *parent = nullptr);
+  ~SessionManager() override;
 
-  // Backup a single tab's content to disk
-  void backupTab(DocumentTab *tab);
+  // Backup a single tab's content to disk. The content is captured
+  // immediately; compression and writing happen on the writer thread.
+  bool backupTab(DocumentTab *tab);
 
   // Restore a tab from a session backup
   bool restoreTab(DocumentTab *tab, const QString &sessionId);
 
+  // Back up a tab and release its editor, or bring a hibernated tab back
+  bool hibernateTab(DocumentTab *tab);
+  bool rehydrateTab(DocumentTab *tab);
+
   // Remove a tab's backup (when tab is closed)
   void removeTabBackup(const QString &sessionId);
 
@@ -26,15 +38,47 @@ public:
   void saveSessionIndex(const QStringList &tabIds, int activeIndex);
   QStringList loadSessionIndex(int &activeIndex);
 
+  // Auxiliary per-tab data (e.g. the search index), removed with the tab
+  void writeTabData(const QString &sessionId, const QString &suffix,
+                    const QByteArray &data);
+  QByteArray readTabData(const QString &sessionId,
+                         const QString &suffix) const;
+
+  // Version history: snapshots are stored by the writer thread
+  void snapshotTab(DocumentTab *tab, const QString &reason);
+  QString historyKey(const DocumentTab *tab) const;
+  const HistoryStore &history() const { return m_history; }
+
   // Get the session directory path
-  QString sessionDir() const { return m_sessionDir; }
+  QString sessionDir() const { return m_store.dir(); }
+
+  // Bytes a tab's backup and data files take on disk; remembered from the
+  // last write, so polling it does not touch the disk
+  qint64 backupSize(const QString &sessionId) const;
+
+  // Block until all queued writes have reached the disk
+  void flush();
 
 private:
-  void ensureSessionDir();
-  QString tabBackupPath(const QString &sessionId) const;
-  QString tabMetaPath(const QString &sessionId) const;
+  bool readTabContent(const QString &sessionId, QString &html) const;
+  // On the writer thread, after the tab's files changed
+  void updateBackupSize(const QString &sessionId);
+
+  // Content queued for writing, served to readers until it is on disk
+  struct PendingBackup {
+    QString html;
+    quint64 generation = 0;
+  };
+
+  SessionStore m_store;
+  HistoryStore m_history;
+  QThreadPool m_writer;
+  mutable QMutex m_pendingMutex;
+  QHash<QString, PendingBackup> m_pending;
+  quint64 m_generation = 0;
 
-  QString m_sessionDir;
+  mutable QMutex m_sizesMutex;
+  mutable QHash<QString, qint64> m_backupSizes;
 };
 
 #endif // SESSIONMANAGER_H
@@ -0,0 +1,217 @@
+#include "sessionstore.h"
+#include "trace.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+// zlib level 1: several-fold smaller than the raw HTML, at a speed close to
+// that of the disk write itself
+static const int kBackupCompressionLevel = 1;
+
+SessionStore::SessionStore(const QString &dir) : m_dir(dir) { ensureDir(); }
+
+QStringList SessionStore::tabDataSuffixes() {
+  return QStringList() << QStringLiteral("idx") << QStringLiteral("undo");
+}
+
+void SessionStore::ensureDir() const {
+  QDir dir(m_dir);
+  if (!dir.exists()) {
+    dir.mkpath(QStringLiteral("."));
+  }
+}
+
+QString SessionStore::tabBackupPath(const QString &sessionId) const {
+  return m_dir + QStringLiteral("/") + sessionId + QStringLiteral(".htmlz");
+}
+
+QString SessionStore::legacyBackupPath(const QString &sessionId) const {
+  return m_dir + QStringLiteral("/") + sessionId + QStringLiteral(".html");
+}
+
+QString SessionStore::tabMetaPath(const QString &sessionId) const {
+  return m_dir + QStringLiteral("/") + sessionId + QStringLiteral(".json");
+}
+
+QString SessionStore::tabDataPath(const QString &sessionId,
+                                  const QString &suffix) const {
+  return m_dir + QStringLiteral("/") + sessionId + QStringLiteral(".") +
+         suffix;
+}
+
+QByteArray SessionStore::encodeMeta(const TabMeta &meta) {
+  QJsonObject object;
+  object[QStringLiteral("filePath")] = meta.filePath;
+  object[QStringLiteral("tabTitle")] = meta.tabTitle;
+  object[QStringLiteral("modified")] = meta.modified;
+  return QJsonDocument(object).toJson(QJsonDocument::Compact);
+}
+
+QByteArray SessionStore::encodeIndex(const QStringList &tabIds,
+                                     int activeIndex) {
+  QJsonObject index;
+  index[QStringLiteral("activeIndex")] = activeIndex;
+
+  QJsonArray tabs;
+  for (const QString &id : tabIds) {
+    tabs.append(id);
+  }
+  index[QStringLiteral("tabs")] = tabs;
+  return QJsonDocument(index).toJson(QJsonDocument::Compact);
+}
+
+bool SessionStore::writeFileAtomic(const QString &path,
+                                   const QByteArray &data) {
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly)) {
+    return false;
+  }
+  file.write(data);
+  return file.commit();
+}
+
+bool SessionStore::writeTab(const QString &sessionId, const QString &html,
+                            const QByteArray &meta) {
+  KNOTEPAD_TRACE_SCOPE("SessionStore::writeTab");
+  ensureDir();
+
+  const QByteArray content =
+      qCompress(html.toUtf8(), kBackupCompressionLevel);
+  if (!writeFileAtomic(tabBackupPath(sessionId), content) ||
+      !writeFileAtomic(tabMetaPath(sessionId), meta)) {
+    return false;
+  }
+  QFile::remove(legacyBackupPath(sessionId));
+  return true;
+}
+
+bool SessionStore::readTabContent(const QString &sessionId,
+                                  QString &html) const {
+  QFile contentFile(tabBackupPath(sessionId));
+  if (contentFile.open(QIODevice::ReadOnly)) {
+    QByteArray data = qUncompress(contentFile.readAll());
+    contentFile.close();
+    if (data.isEmpty()) {
+      return false;
+    }
+    html = QString::fromUtf8(data);
+    return true;
+  }
+
+  // Uncompressed backup written by older versions
+  QFile legacyFile(legacyBackupPath(sessionId));
+  if (!legacyFile.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+  html = QString::fromUtf8(legacyFile.readAll());
+  legacyFile.close();
+  return true;
+}
+
+bool SessionStore::readTabMeta(const QString &sessionId,
+                               TabMeta &meta) const {
+  QFile metaFile(tabMetaPath(sessionId));
+  if (!metaFile.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+  const QJsonObject object =
+      QJsonDocument::fromJson(metaFile.readAll()).object();
+  metaFile.close();
+
+  meta.filePath = object[QStringLiteral("filePath")].toString();
+  meta.tabTitle = object[QStringLiteral("tabTitle")].toString();
+  meta.modified = object[QStringLiteral("modified")].toBool();
+  return true;
+}
+
+void SessionStore::removeTab(const QString &sessionId) {
+  QFile::remove(tabBackupPath(sessionId));
+  QFile::remove(legacyBackupPath(sessionId));
+  QFile::remove(tabMetaPath(sessionId));
+  for (const QString &suffix : tabDataSuffixes()) {
+    QFile::remove(tabDataPath(sessionId, suffix));
+  }
+}
+
+qint64 SessionStore::tabDiskUsage(const QString &sessionId) const {
+  qint64 bytes = QFileInfo(tabBackupPath(sessionId)).size() +
+                 QFileInfo(legacyBackupPath(sessionId)).size() +
+                 QFileInfo(tabMetaPath(sessionId)).size();
+  for (const QString &suffix : tabDataSuffixes()) {
+    bytes += QFileInfo(tabDataPath(sessionId, suffix)).size();
+  }
+  return bytes;
+}
+
+bool SessionStore::writeTabData(const QString &sessionId,
+                                const QString &suffix,
+                                const QByteArray &data) {
+  Q_ASSERT(tabDataSuffixes().contains(suffix));
+  ensureDir();
+  return writeFileAtomic(tabDataPath(sessionId, suffix), data);
+}
+
+QByteArray SessionStore::readTabData(const QString &sessionId,
+                                     const QString &suffix) const {
+  QFile file(tabDataPath(sessionId, suffix));
+  if (!file.open(QIODevice::ReadOnly)) {
+    return QByteArray();
+  }
+  return file.readAll();
+}
+
+bool SessionStore::writeIndex(const QByteArray &index,
+                              const QStringList &tabIds) {
+  ensureDir();
+  if (!writeFileAtomic(m_dir + QStringLiteral("/session.json"), index))
+    return false;
+
+  // Clean up orphaned backup files (tabs that are no longer in the session)
+  QDir dir(m_dir);
+  QStringList patterns = QStringList() << QStringLiteral("*.html")
+                                       << QStringLiteral("*.htmlz")
+                                       << QStringLiteral("*.json");
+  for (const QString &suffix : tabDataSuffixes()) {
+    patterns << QString(QStringLiteral("*.") + suffix);
+  }
+  const QStringList allFiles = dir.entryList(patterns, QDir::Files);
+  for (const QString &fileName : allFiles) {
+    if (fileName == QStringLiteral("session.json"))
+      continue;
+
+    // Extract session ID from filename
+    QString id = fileName.section(QLatin1Char('.'), 0, 0);
+
+    if (!tabIds.contains(id)) {
+      QFile::remove(m_dir + QStringLiteral("/") + fileName);
+    }
+  }
+  return true;
+}
+
+QStringList SessionStore::readIndex(int &activeIndex) const {
+  QStringList result;
+  activeIndex = 0;
+
+  QFile file(m_dir + QStringLiteral("/session.json"));
+  if (!file.open(QIODevice::ReadOnly)) {
+    return result;
+  }
+
+  QJsonObject index = QJsonDocument::fromJson(file.readAll()).object();
+  file.close();
+
+  activeIndex = index[QStringLiteral("activeIndex")].toInt(0);
+
+  QJsonArray tabs = index[QStringLiteral("tabs")].toArray();
+  for (const QJsonValue &val : tabs) {
+    result.append(val.toString());
+  }
+
+  return result;
+}
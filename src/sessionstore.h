@@ -0,0 +1,66 @@
+#ifndef SESSIONSTORE_H
+#define SESSIONSTORE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+/**
+ * On-disk layout of a session.
+ *
+ * Every tab has a compressed HTML backup, a JSON metadata file and any
+ * number of auxiliary data files; session.json lists the tabs in order.
+ * All calls are synchronous and touch only the files of the tab they are
+ * given, so SessionManager can run them on its writer thread.
+ */
+class SessionStore {
+public:
+  struct TabMeta {
+    QString filePath;
+    QString tabTitle;
+    bool modified = false;
+  };
+
+  explicit SessionStore(const QString &dir);
+
+  QString dir() const { return m_dir; }
+
+  // Extensions of the auxiliary per-tab files
+  static QStringList tabDataSuffixes();
+
+  // Serialized forms, produced on the caller's thread
+  static QByteArray encodeMeta(const TabMeta &meta);
+  static QByteArray encodeIndex(const QStringList &tabIds, int activeIndex);
+
+  // Compress and write a tab's content and metadata
+  bool writeTab(const QString &sessionId, const QString &html,
+                const QByteArray &meta);
+  bool readTabContent(const QString &sessionId, QString &html) const;
+  bool readTabMeta(const QString &sessionId, TabMeta &meta) const;
+  void removeTab(const QString &sessionId);
+
+  // Bytes of all files kept for a tab
+  qint64 tabDiskUsage(const QString &sessionId) const;
+
+  bool writeTabData(const QString &sessionId, const QString &suffix,
+                    const QByteArray &data);
+  QByteArray readTabData(const QString &sessionId,
+                         const QString &suffix) const;
+
+  // Write the index and delete the files of tabs that are not in it
+  bool writeIndex(const QByteArray &index, const QStringList &tabIds);
+  QStringList readIndex(int &activeIndex) const;
+
+  static bool writeFileAtomic(const QString &path, const QByteArray &data);
+
+private:
+  void ensureDir() const;
+  QString tabBackupPath(const QString &sessionId) const;
+  QString legacyBackupPath(const QString &sessionId) const;
+  QString tabMetaPath(const QString &sessionId) const;
+  QString tabDataPath(const QString &sessionId, const QString &suffix) const;
+
+  QString m_dir;
+};
+
+#endif // SESSIONSTORE_H
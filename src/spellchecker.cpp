@@ -0,0 +1,292 @@
+#include "spellchecker.h"
+#include "blockdelta.h"
+#include "documenttab.h"
+
+#include <QEvent>
+#include <QScrollBar>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextEdit>
+#include <QTimer>
+
+namespace {
+
+// Characters of text handed to the worker per batch; keeps both the copy
+// on the GUI thread and the latency of a visible-range request small
+const int kBatchCharacters = 16 * 1024;
+const int kBatchBlocks = 256;
+
+// Pause after an edit before its blocks are checked, so half-typed words
+// are not flagged
+const int kEditDelayMillis = 400;
+
+// Quiet time before, and between, batches of blocks outside the viewport
+const int kIdleDelayMillis = 100;
+
+} // namespace
+
+SpellChecker::SpellChecker(DocumentTab *tab, SpellCheckService &service)
+    : QObject(tab), m_tab(tab), m_service(service) {
+  m_checkTimer = new QTimer(this);
+  m_checkTimer->setSingleShot(true);
+  connect(m_checkTimer, &QTimer::timeout, this, &SpellChecker::checkNextBatch);
+
+  m_idleTimer = new QTimer(this);
+  m_idleTimer->setSingleShot(true);
+  m_idleTimer->setInterval(kIdleDelayMillis);
+  connect(m_idleTimer, &QTimer::timeout, this,
+          &SpellChecker::checkInBackground);
+
+  m_selectionTimer = new QTimer(this);
+  m_selectionTimer->setSingleShot(true);
+  m_selectionTimer->setInterval(0);
+  connect(m_selectionTimer, &QTimer::timeout, this,
+          &SpellChecker::updateSelections);
+
+  connect(m_tab, &DocumentTab::blocksChanged, this,
+          &SpellChecker::onBlocksChanged);
+  connect(m_tab, &DocumentTab::contentsReset, this, [this]() {
+    attachEditor();
+    resetBlocks();
+  });
+  // Results are kept while hibernated; the same content comes back
+  connect(m_tab, &DocumentTab::rehydrated, this, [this]() {
+    attachEditor();
+    QTextDocument *doc = m_tab->document();
+    if (doc && m_blocks.size() != doc->blockCount()) {
+      resetBlocks();
+    } else {
+      scheduleCheck();
+    }
+  });
+  connect(m_tab, &DocumentTab::hibernated, this, [this]() {
+    m_checkTimer->stop();
+    m_idleTimer->stop();
+  });
+
+  attachEditor();
+  resetBlocks();
+}
+
+void SpellChecker::setEnabled(bool enabled) {
+  if (m_enabled == enabled)
+    return;
+
+  m_enabled = enabled;
+  if (enabled) {
+    resetBlocks();
+  } else {
+    m_checkTimer->stop();
+    m_idleTimer->stop();
+    m_blocks.clear();
+    m_tab->setExtraSelections(DocumentTab::SpellLayer,
+                              QList<QTextEdit::ExtraSelection>());
+  }
+}
+
+void SpellChecker::attachEditor() {
+  QTextEdit *editor = m_tab->editor();
+  if (!editor || editor == m_editor)
+    return;
+
+  m_editor = editor;
+  connect(editor->verticalScrollBar(), &QScrollBar::valueChanged, this,
+          [this]() {
+            scheduleSelections();
+            // Newly visible blocks go before the idle pass
+            if (!m_checkTimer->isActive())
+              scheduleCheck();
+          });
+  editor->viewport()->installEventFilter(this);
+}
+
+bool SpellChecker::eventFilter(QObject *watched, QEvent *event) {
+  // Showing the tab again resumes the checks it skipped while hidden
+  if ((event->type() == QEvent::Resize || event->type() == QEvent::Show) &&
+      m_editor && watched == m_editor->viewport()) {
+    scheduleSelections();
+    scheduleCheck();
+  }
+  return QObject::eventFilter(watched, event);
+}
+
+void SpellChecker::resetBlocks() {
+  m_blocks.clear();
+  m_scanFrom = 0;
+  QTextDocument *doc = m_tab->document();
+  if (!m_enabled || !doc || !m_service.isAvailable())
+    return;
+
+  m_blocks.resize(doc->blockCount());
+  for (BlockState &state : m_blocks) {
+    state.epoch = m_nextEpoch++;
+  }
+  scheduleCheck();
+}
+
+void SpellChecker::onBlocksChanged(int firstBlock, int removedBlocks,
+                                   int addedBlocks) {
+  QTextDocument *doc = m_tab->document();
+  if (!m_enabled || !doc || !m_service.isAvailable())
+    return;
+  // Edited blocks get a new epoch and lose their stale results; the rest
+  // keep theirs and are not checked again
+  const BlockDelta delta{firstBlock, removedBlocks, addedBlocks};
+  if (!delta.splice(m_blocks, doc->blockCount())) {
+    resetBlocks();
+    return;
+  }
+  for (int i = firstBlock; i < firstBlock + addedBlocks; ++i) {
+    m_blocks[i] = BlockState();
+    m_blocks[i].epoch = m_nextEpoch++;
+  }
+
+  m_scanFrom = qMin(m_scanFrom, firstBlock);
+  scheduleSelections();
+  m_idleTimer->stop();
+  m_checkTimer->start(kEditDelayMillis);
+}
+
+void SpellChecker::scheduleCheck() {
+  if (m_enabled && !m_inFlight) {
+    m_idleTimer->stop();
+    m_checkTimer->start(0);
+  }
+}
+
+bool SpellChecker::visibleRange(int &first, int &last) const {
+  if (!m_editor)
+    return false;
+
+  const QRect rect = m_editor->viewport()->rect();
+  first = m_editor->cursorForPosition(rect.topLeft()).blockNumber();
+  last = m_editor->cursorForPosition(rect.bottomRight()).blockNumber();
+  return true;
+}
+
+void SpellChecker::checkNextBatch() {
+  // Once the visible blocks are done, the rest waits for the user to pause
+  if (!sendBatch(false) && !m_inFlight) {
+    m_idleTimer->start();
+  }
+}
+
+void SpellChecker::checkInBackground() {
+  // Only the tab on screen checks ahead; the others wait until shown
+  if (m_editor && m_editor->isVisible()) {
+    sendBatch(true);
+  }
+}
+
+bool SpellChecker::sendBatch(bool background) {
+  QTextDocument *doc = m_tab->document();
+  if (m_inFlight || !m_enabled || !doc || m_blocks.size() != doc->blockCount())
+    return false;
+
+  QVector<SpellCheckService::BlockText> batch;
+  int characters = 0;
+  auto collect = [&](int from, int to) {
+    QTextBlock block = doc->findBlockByNumber(from);
+    for (int i = from; i <= to && block.isValid(); ++i, block = block.next()) {
+      const BlockState &state = m_blocks[i];
+      if (state.checkedEpoch == state.epoch)
+        continue;
+      SpellCheckService::BlockText text;
+      text.blockNumber = i;
+      text.epoch = state.epoch;
+      text.text = block.text();
+      characters += text.text.size();
+      batch.append(text);
+      if (characters >= kBatchCharacters || batch.size() >= kBatchBlocks)
+        return false;
+    }
+    return true;
+  };
+
+  // Visible blocks first, then onwards from where the idle pass stopped
+  int first = 0;
+  int last = -1;
+  if (visibleRange(first, last)) {
+    collect(first, last);
+  }
+  if (background && characters < kBatchCharacters &&
+      batch.size() < kBatchBlocks) {
+    // Skip over checked blocks without touching the document
+    while (m_scanFrom < m_blocks.size() &&
+           m_blocks[m_scanFrom].checkedEpoch == m_blocks[m_scanFrom].epoch) {
+      ++m_scanFrom;
+    }
+    if (m_scanFrom < m_blocks.size()) {
+      collect(m_scanFrom, m_blocks.size() - 1);
+    }
+  }
+  if (batch.isEmpty())
+    return false;
+
+  m_inFlight = true;
+  m_service.check(
+      this, batch,
+      [this](const QVector<SpellCheckService::BlockResult> &results) {
+        applyResults(results);
+      },
+      background ? SpellCheckService::Priority::Background
+                 : SpellCheckService::Priority::Visible);
+  return true;
+}
+
+void SpellChecker::applyResults(
+    const QVector<SpellCheckService::BlockResult> &results) {
+  m_inFlight = false;
+
+  // Results for blocks edited or moved meanwhile no longer match their
+  // epoch; those blocks are still unchecked and come round again
+  for (const SpellCheckService::BlockResult &result : results) {
+    if (result.blockNumber >= m_blocks.size())
+      continue;
+    BlockState &state = m_blocks[result.blockNumber];
+    if (state.epoch != result.epoch)
+      continue;
+    state.checkedEpoch = result.epoch;
+    state.misspellings = result.misspellings;
+  }
+  scheduleSelections();
+
+  // Visible blocks left over, or edited meanwhile, go next; then the idle
+  // pass continues
+  if (!m_checkTimer->isActive())
+    m_checkTimer->start(0);
+}
+
+void SpellChecker::scheduleSelections() { m_selectionTimer->start(); }
+
+void SpellChecker::updateSelections() {
+  QList<QTextEdit::ExtraSelection> selections;
+  QTextDocument *doc = m_tab->document();
+  int first = 0;
+  int last = -1;
+  if (!m_enabled || !doc || m_blocks.size() != doc->blockCount() ||
+      !visibleRange(first, last)) {
+    m_tab->setExtraSelections(DocumentTab::SpellLayer, selections);
+    return;
+  }
+
+  QTextCharFormat format;
+  format.setUnderlineStyle(QTextCharFormat::SpellCheckUnderline);
+  format.setUnderlineColor(Qt::red);
+
+  QTextBlock block = doc->findBlockByNumber(first);
+  for (int i = first; i <= last && block.isValid(); ++i, block = block.next()) {
+    for (const SpellCheckService::Misspelling &m :
+         std::as_const(m_blocks[i].misspellings)) {
+      QTextEdit::ExtraSelection selection;
+      selection.cursor = QTextCursor(doc);
+      selection.cursor.setPosition(block.position() + m.start);
+      selection.cursor.setPosition(block.position() + m.start + m.length,
+                                   QTextCursor::KeepAnchor);
+      selection.format = format;
+      selections.append(selection);
+    }
+  }
+  m_tab->setExtraSelections(DocumentTab::SpellLayer, selections);
+}
@@ -0,0 +1,74 @@
+#ifndef SPELLCHECKER_H
+#define SPELLCHECKER_H
+
+#include "spellcheckservice.h"
+
+#include <QObject>
+#include <QPointer>
+#include <QVector>
+
+class DocumentTab;
+class QTextEdit;
+class QTimer;
+
+/**
+ * Background spell checking of one DocumentTab.
+ *
+ * Every block carries an epoch that changes whenever the block is edited,
+ * and the epoch it was last checked at. Only blocks whose two epochs
+ * differ are sent to the SpellCheckService: visible ones first, at the
+ * service's priority, then the rest of the document in small batches,
+ * one batch in flight at a time. The rest is only checked while the tab
+ * is shown and the user has paused, so background tabs and typing do not
+ * hold up the visible text. Misspellings are underlined through extra
+ * selections built for the visible blocks only.
+ */
+class SpellChecker : public QObject {
+  Q_OBJECT
+
+public:
+  SpellChecker(DocumentTab *tab, SpellCheckService &service);
+
+  void setEnabled(bool enabled);
+  bool isEnabled() const { return m_enabled; }
+
+private Q_SLOTS:
+  void attachEditor();
+  void onBlocksChanged(int firstBlock, int removedBlocks, int addedBlocks);
+  void resetBlocks();
+  void scheduleCheck();
+  void checkNextBatch();
+  void checkInBackground();
+  void scheduleSelections();
+  void updateSelections();
+
+protected:
+  bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+  struct BlockState {
+    quint32 epoch = 0;
+    quint32 checkedEpoch = 0; // 0 while unchecked
+    QVector<SpellCheckService::Misspelling> misspellings;
+  };
+
+  bool sendBatch(bool background);
+  void applyResults(const QVector<SpellCheckService::BlockResult> &results);
+  bool visibleRange(int &first, int &last) const;
+
+  DocumentTab *m_tab;
+  SpellCheckService &m_service;
+  QPointer<QTextEdit> m_editor;
+  bool m_enabled = true;
+
+  QVector<BlockState> m_blocks;
+  quint32 m_nextEpoch = 1;
+  int m_scanFrom = 0; // where the idle pass looks for unchecked blocks
+  bool m_inFlight = false;
+
+  QTimer *m_checkTimer; // visible blocks
+  QTimer *m_idleTimer; // the rest, once nothing happened for a while
+  QTimer *m_selectionTimer;
+};
+
+#endif // SPELLCHECKER_H
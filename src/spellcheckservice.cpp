@@ -0,0 +1,77 @@
+#include "spellcheckservice.h"
+#include "wordtokenizer.h"
+
+namespace {
+
+// The cache is dropped when it grows past this many words
+const int kMaxCachedWords = 200000;
+
+bool shouldSkip(const QString &word, bool checkUppercase) {
+  // Identifiers, numbers and codes are not prose
+  bool hasLower = false;
+  for (QChar ch : word) {
+    if (ch.isDigit() || ch == QLatin1Char('_'))
+      return true;
+    if (ch.isLower())
+      hasLower = true;
+  }
+  return !hasLower && !checkUppercase;
+}
+
+} // namespace
+
+SpellCheckService::SpellCheckService(QObject *parent) : QObject(parent) {
+  m_pool.setMaxThreadCount(1);
+  m_available = m_speller.isValid();
+  m_checkUppercase = m_speller.testAttribute(Sonnet::Speller::CheckUppercase);
+}
+
+SpellCheckService::~SpellCheckService() {
+  m_pool.clear();
+  m_pool.waitForDone();
+}
+
+bool SpellCheckService::isMisspelled(const QString &word) {
+  auto it = m_cache.constFind(word);
+  if (it != m_cache.constEnd())
+    return it.value();
+
+  if (m_cache.size() >= kMaxCachedWords)
+    m_cache.clear();
+  const bool misspelled = m_speller.isMisspelled(word);
+  m_cache.insert(word, misspelled);
+  return misspelled;
+}
+
+void SpellCheckService::check(QObject *receiver,
+                              const QVector<BlockText> &blocks,
+                              const ResultCallback &done, Priority priority) {
+  if (!m_available)
+    return;
+
+  QPointer<QObject> guard(receiver);
+  m_pool.start([this, blocks, done, guard]() {
+    QVector<BlockResult> results;
+    results.reserve(blocks.size());
+    for (const BlockText &block : blocks) {
+      BlockResult result;
+      result.blockNumber = block.blockNumber;
+      result.epoch = block.epoch;
+      WordTokenizer::forEachWord(block.text, [&](int start, int length) {
+        const QString word = block.text.mid(start, length);
+        if (!shouldSkip(word, m_checkUppercase) && isMisspelled(word)) {
+          result.misspellings.append(Misspelling{start, length});
+        }
+      });
+      results.append(result);
+    }
+
+    // Delivered through this object, which outlives the pool's tasks
+    QMetaObject::invokeMethod(
+        this, [results, done, guard]() {
+          if (guard)
+            done(results);
+        },
+        Qt::QueuedConnection);
+  }, int(priority));
+}
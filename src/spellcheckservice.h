@@ -0,0 +1,69 @@
+#ifndef SPELLCHECKSERVICE_H
+#define SPELLCHECKSERVICE_H
+
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+#include <Sonnet/Speller>
+
+#include <functional>
+
+/**
+ * Spell checking on a single worker thread, shared by all tabs.
+ *
+ * The speller and the cache of words already looked up are only touched by
+ * the worker, one batch at a time, so the dictionary backend never sees
+ * concurrent calls and the GUI thread never waits for it. Batches for
+ * visible text are queued ahead of background batches.
+ */
+class SpellCheckService : public QObject {
+  Q_OBJECT
+
+public:
+  struct Misspelling {
+    int start = 0;
+    int length = 0;
+  };
+
+  struct BlockText {
+    int blockNumber = 0;
+    quint32 epoch = 0;
+    QString text;
+  };
+
+  struct BlockResult {
+    int blockNumber = 0;
+    quint32 epoch = 0;
+    QVector<Misspelling> misspellings;
+  };
+
+  using ResultCallback = std::function<void(const QVector<BlockResult> &)>;
+
+  enum class Priority { Background, Visible };
+
+  explicit SpellCheckService(QObject *parent = nullptr);
+  ~SpellCheckService() override;
+
+  bool isAvailable() const { return m_available; }
+
+  // Checks blocks on the worker; done is called on the GUI thread unless
+  // receiver has been destroyed by then
+  void check(QObject *receiver, const QVector<BlockText> &blocks,
+             const ResultCallback &done,
+             Priority priority = Priority::Background);
+
+private:
+  bool isMisspelled(const QString &word);
+
+  QThreadPool m_pool;
+  Sonnet::Speller m_speller; // worker thread only
+  QHash<QString, bool> m_cache; // worker thread only
+  bool m_available = false;
+  bool m_checkUppercase = false;
+};
+
+#endif // SPELLCHECKSERVICE_H
@@ -0,0 +1,135 @@
+#include "stallwatchdog.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+
+std::atomic<const char *> StallWatchdog::s_operation{nullptr};
+std::atomic<qint64> StallWatchdog::s_documentSize{0};
+
+StallWatchdog::Operation::Operation(const char *name, qint64 documentSize)
+    : m_previousName(s_operation.load(std::memory_order_relaxed)),
+      m_previousSize(s_documentSize.load(std::memory_order_relaxed)) {
+  s_documentSize.store(documentSize, std::memory_order_relaxed);
+  s_operation.store(name, std::memory_order_release);
+}
+
+StallWatchdog::Operation::~Operation() {
+  s_documentSize.store(m_previousSize, std::memory_order_relaxed);
+  s_operation.store(m_previousName, std::memory_order_release);
+}
+
+void StallWatchdog::Operation::setDocumentSize(qint64 documentSize) {
+  s_documentSize.store(documentSize, std::memory_order_relaxed);
+}
+
+StallWatchdog::StallWatchdog(QObject *parent) : QObject(parent) {}
+
+StallWatchdog::~StallWatchdog() { stop(); }
+
+void StallWatchdog::setThreshold(int milliseconds) {
+  m_threshold = qMax(10, milliseconds);
+}
+
+void StallWatchdog::setLogPath(const QString &path) { m_logPath = path; }
+
+void StallWatchdog::start() {
+  if (m_thread)
+    return;
+  m_stopping = false;
+  m_thread = QThread::create(
+      [this, threshold = m_threshold, logPath = m_logPath]() {
+        watch(threshold, logPath);
+      });
+  m_thread->setObjectName(QStringLiteral("StallWatchdog"));
+  m_thread->start(QThread::HighPriority);
+}
+
+void StallWatchdog::stop() {
+  if (!m_thread)
+    return;
+  {
+    QMutexLocker locker(&m_mutex);
+    m_stopping = true;
+    m_wake.wakeAll();
+  }
+  m_thread->wait();
+  delete m_thread;
+  m_thread = nullptr;
+}
+
+bool StallWatchdog::pause(int milliseconds) {
+  QMutexLocker locker(&m_mutex);
+  if (!m_stopping) {
+    m_wake.wait(&m_mutex, milliseconds);
+  }
+  return !m_stopping;
+}
+
+void StallWatchdog::watch(int threshold, const QString &logPath) {
+  const int interval = threshold / 2;
+  // Often enough to catch the operation while the stall lasts
+  const int poll = qBound(1, threshold / 5, 10);
+
+  quint64 ping = 0;
+  while (pause(interval)) {
+    ++ping;
+    QElapsedTimer sent;
+    sent.start();
+    QMetaObject::invokeMethod(
+        this,
+        [this, ping]() { m_answered.store(ping, std::memory_order_release); },
+        Qt::QueuedConnection);
+
+    Stall stall;
+    while (m_answered.load(std::memory_order_acquire) != ping) {
+      if (!pause(poll))
+        return;
+      if (sent.elapsed() < threshold)
+        continue;
+      // The innermost operation seen first is the one that stalled
+      const char *operation = s_operation.load(std::memory_order_acquire);
+      if (operation && stall.operation.isEmpty()) {
+        stall.operation = QString::fromLatin1(operation);
+        stall.documentSize = s_documentSize.load(std::memory_order_relaxed);
+      }
+    }
+
+    stall.milliseconds = sent.elapsed();
+    if (stall.milliseconds >= threshold) {
+      stall.when = QDateTime::currentDateTime().addMSecs(-stall.milliseconds);
+      report(stall, logPath);
+    }
+  }
+}
+
+QString StallWatchdog::formatLogLine(const Stall &stall) {
+  return QStringLiteral("%1\t%2 ms\t%3\t%4\n")
+      .arg(stall.when.toString(Qt::ISODateWithMs))
+      .arg(stall.milliseconds)
+      .arg(stall.operation.isEmpty() ? QStringLiteral("-") : stall.operation)
+      .arg(stall.documentSize);
+}
+
+void StallWatchdog::report(const Stall &stall, const QString &logPath) {
+  // Written here rather than on the GUI thread that just stalled
+  if (!logPath.isEmpty()) {
+    const QFileInfo info(logPath);
+    if (info.size() > kMaxLogBytes) {
+      const QString previous = logPath + QStringLiteral(".1");
+      QFile::remove(previous);
+      QFile::rename(logPath, previous);
+    }
+    QDir().mkpath(info.absolutePath());
+    QFile log(logPath);
+    if (log.open(QIODevice::WriteOnly | QIODevice::Append)) {
+      log.write(formatLogLine(stall).toUtf8());
+    }
+  }
+
+  QMetaObject::invokeMethod(
+      this, [this, stall]() { Q_EMIT stallDetected(stall); },
+      Qt::QueuedConnection);
+}
@@ -0,0 +1,100 @@
+#ifndef STALLWATCHDOG_H
+#define STALLWATCHDOG_H
+
+#include <QDateTime>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QWaitCondition>
+
+#include <atomic>
+
+class QThread;
+
+/**
+ * Detects stalls of the GUI event loop.
+ *
+ * A watchdog thread posts a ping to the thread this object lives in and
+ * waits for it to be answered; a ping that takes longer than the threshold
+ * is a stall. While a stall is in progress the watchdog samples the
+ * Operation marked on the GUI thread, so that the report names what was
+ * running, e.g. a tab restore or an RTF save, and how large its document
+ * was. Pings go out every half threshold, so a reported duration can fall
+ * short of the real one by up to that much.
+ *
+ * Stalls are appended to a log that is rotated once it grows too large,
+ * and announced through stallDetected().
+ */
+class StallWatchdog : public QObject {
+  Q_OBJECT
+
+public:
+  struct Stall {
+    QDateTime when; // start of the stall
+    qint64 milliseconds = 0;
+    QString operation; // empty if nothing was marked
+    qint64 documentSize = 0;
+  };
+
+  // Marks what the GUI thread is doing for the rest of the scope. The name
+  // must be a string literal; the size is in whatever unit the operation
+  // has at hand, bytes of input for loads and characters otherwise
+  class Operation {
+  public:
+    explicit Operation(const char *name, qint64 documentSize = 0);
+    ~Operation();
+
+    // Once the operation has found out how large its document is
+    void setDocumentSize(qint64 documentSize);
+
+    Operation(const Operation &) = delete;
+    Operation &operator=(const Operation &) = delete;
+
+  private:
+    const char *m_previousName;
+    qint64 m_previousSize;
+  };
+
+  // Logs beyond this size are moved to <log>.1, replacing the previous one
+  static constexpr qint64 kMaxLogBytes = 256 * 1024;
+
+  explicit StallWatchdog(QObject *parent = nullptr);
+  ~StallWatchdog() override;
+
+  // Both only take effect on the next start()
+  void setThreshold(int milliseconds);
+  int threshold() const { return m_threshold; }
+  void setLogPath(const QString &path);
+  QString logPath() const { return m_logPath; }
+
+  void start();
+  void stop();
+  bool isRunning() const { return m_thread != nullptr; }
+
+  static QString formatLogLine(const Stall &stall);
+
+Q_SIGNALS:
+  void stallDetected(const StallWatchdog::Stall &stall);
+
+private:
+  void watch(int threshold, const QString &logPath);
+  void report(const Stall &stall, const QString &logPath);
+  // Sleep unless stop() is called meanwhile; false once stopping
+  bool pause(int milliseconds);
+
+  int m_threshold = 50;
+  QString m_logPath;
+
+  QThread *m_thread = nullptr;
+  QMutex m_mutex;
+  QWaitCondition m_wake;
+  bool m_stopping = false;
+  std::atomic<quint64> m_answered{0};
+
+  static std::atomic<const char *> s_operation;
+  static std::atomic<qint64> s_documentSize;
+};
+
+Q_DECLARE_METATYPE(StallWatchdog::Stall)
+
+#endif // STALLWATCHDOG_H
@@ -0,0 +1,266 @@
+#include "syntaxhighlighter.h"
+
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QPalette>
+#include <QScrollBar>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTextLayout>
+#include <QTimer>
+
+namespace {
+
+// Blocks re-highlighted synchronously after an edit; the rest of a state
+// change is carried forward in idle time slices
+const int kSyncBlocks = 64;
+const int kSliceMillis = 4;
+
+// Blocks above the viewport highlighted to settle the state of the first
+// visible block when nothing before it has been highlighted yet
+const int kLookbackBlocks = 200;
+
+const int kUnhighlighted = -1;
+
+} // namespace
+
+SyntaxHighlighter::SyntaxHighlighter(QObject *parent) : QObject(parent) {
+  m_visibleTimer = new QTimer(this);
+  m_visibleTimer->setSingleShot(true);
+  m_visibleTimer->setInterval(0);
+  connect(m_visibleTimer, &QTimer::timeout, this,
+          &SyntaxHighlighter::highlightVisible);
+
+  m_propagateTimer = new QTimer(this);
+  m_propagateTimer->setSingleShot(true);
+  m_propagateTimer->setInterval(0);
+  connect(m_propagateTimer, &QTimer::timeout, this,
+          &SyntaxHighlighter::propagate);
+}
+
+SyntaxHighlighter::~SyntaxHighlighter() = default;
+
+void SyntaxHighlighter::attach(QTextEdit *editor,
+                               std::unique_ptr<HighlightRules> rules) {
+  detach();
+  if (!editor || !rules)
+    return;
+
+  m_editor = editor;
+  m_rules = std::move(rules);
+  setupFormats();
+
+  connect(editor->document(), &QTextDocument::contentsChange, this,
+          &SyntaxHighlighter::onContentsChange);
+  connect(editor->verticalScrollBar(), &QScrollBar::valueChanged, this,
+          &SyntaxHighlighter::scheduleVisible);
+  editor->viewport()->installEventFilter(this);
+
+  scheduleVisible();
+}
+
+void SyntaxHighlighter::detach() {
+  m_visibleTimer->stop();
+  m_propagateTimer->stop();
+  m_propagateFrom = -1;
+
+  if (m_editor) {
+    disconnect(m_editor->document(), nullptr, this, nullptr);
+    disconnect(m_editor->verticalScrollBar(), nullptr, this, nullptr);
+    m_editor->viewport()->removeEventFilter(this);
+  }
+
+  m_editor = nullptr;
+  m_rules.reset();
+}
+
+bool SyntaxHighlighter::eventFilter(QObject *watched, QEvent *event) {
+  if (event->type() == QEvent::Resize && m_editor &&
+      watched == m_editor->viewport()) {
+    scheduleVisible();
+  }
+  return QObject::eventFilter(watched, event);
+}
+
+void SyntaxHighlighter::setupFormats() {
+  // Softer colours on dark backgrounds
+  const bool dark = m_editor->palette().color(QPalette::Base).lightness() < 128;
+  auto color = [dark](const char *light, const char *darkColor) {
+    return QColor(QLatin1String(dark ? darkColor : light));
+  };
+
+  m_formats.fill(QTextCharFormat(), HighlightRules::StyleCount);
+  m_formats[HighlightRules::Keyword].setForeground(color("#1f3fa8", "#8fb4ff"));
+  m_formats[HighlightRules::Keyword].setFontWeight(QFont::Bold);
+  m_formats[HighlightRules::Type].setForeground(color("#7a2ba3", "#d7a6ff"));
+  m_formats[HighlightRules::String].setForeground(color("#b3261e", "#ff9e8f"));
+  m_formats[HighlightRules::Number].setForeground(color("#b05a00", "#ffc27a"));
+  m_formats[HighlightRules::Comment].setForeground(color("#6a737d", "#9aa5b1"));
+  m_formats[HighlightRules::Comment].setFontItalic(true);
+  m_formats[HighlightRules::Preprocessor].setForeground(
+      color("#006b6b", "#6fd6d6"));
+  m_formats[HighlightRules::Heading].setForeground(color("#1f3fa8", "#8fb4ff"));
+  m_formats[HighlightRules::Heading].setFontWeight(QFont::Bold);
+  m_formats[HighlightRules::Strong].setFontWeight(QFont::Bold);
+  m_formats[HighlightRules::Emphasis].setFontItalic(true);
+  m_formats[HighlightRules::Code].setFontFamilies(
+      QStringList() << QStringLiteral("monospace"));
+  m_formats[HighlightRules::Code].setForeground(color("#4a5a00", "#c3d88a"));
+  m_formats[HighlightRules::Link].setForeground(color("#0057ae", "#7fb8ff"));
+  m_formats[HighlightRules::Link].setFontUnderline(true);
+  m_formats[HighlightRules::Quote].setForeground(color("#6a737d", "#9aa5b1"));
+  m_formats[HighlightRules::ListMarker].setForeground(
+      color("#b05a00", "#ffc27a"));
+  m_formats[HighlightRules::ListMarker].setFontWeight(QFont::Bold);
+  m_formats[HighlightRules::Timestamp].setForeground(
+      color("#6a737d", "#9aa5b1"));
+  m_formats[HighlightRules::LogError].setForeground(color("#c0120c", "#ff7a70"));
+  m_formats[HighlightRules::LogWarning].setForeground(
+      color("#9a6700", "#f2c94c"));
+  m_formats[HighlightRules::LogInfo].setForeground(color("#1f6f2b", "#8fd694"));
+  m_formats[HighlightRules::LogDebug].setForeground(color("#6a737d", "#9aa5b1"));
+}
+
+bool SyntaxHighlighter::highlightBlock(QTextBlock &block) {
+  const QTextBlock previous = block.previous();
+  // An unknown state before the block is approximated by the initial one
+  const int state = previous.isValid() ? qMax(0, previous.userState()) : 0;
+
+  QVector<HighlightRules::Span> spans;
+  const int endState = m_rules->highlightLine(block.text(), state, spans);
+
+  QList<QTextLayout::FormatRange> ranges;
+  ranges.reserve(spans.size());
+  for (const HighlightRules::Span &span : std::as_const(spans)) {
+    QTextLayout::FormatRange range;
+    range.start = span.start;
+    range.length = span.length;
+    range.format = m_formats[span.style];
+    ranges.append(range);
+  }
+
+  const int oldState = block.userState();
+  block.setUserState(endState);
+
+  // Blocks without old or new formats need no relayout
+  QTextLayout *layout = block.layout();
+  if (!ranges.isEmpty() || !layout->formats().isEmpty()) {
+    layout->setFormats(ranges);
+    // Does not emit contentsChange; outside an edit it only relayouts
+    block.document()->markContentsDirty(block.position(), block.length());
+  }
+  return oldState != endState;
+}
+
+void SyntaxHighlighter::onContentsChange(int position, int charsRemoved,
+                                         int charsAdded) {
+  Q_UNUSED(charsRemoved);
+  if (!m_editor)
+    return;
+
+  QTextDocument *doc = m_editor->document();
+  QTextBlock block = doc->findBlock(position);
+  QTextBlock last = doc->findBlock(position + charsAdded);
+  if (!block.isValid())
+    block = doc->lastBlock();
+  if (!last.isValid())
+    last = doc->lastBlock();
+
+  // The touched blocks, up to a limit: a large paste is left to the
+  // viewport pass rather than highlighted in full here
+  int budget = kSyncBlocks;
+  bool changed = false;
+  while (block.isValid() && budget > 0) {
+    changed = highlightBlock(block);
+    --budget;
+    if (block == last)
+      break;
+    block = block.next();
+  }
+  if (block != last) {
+    scheduleVisible();
+    return;
+  }
+
+  // Carry a changed end state into the blocks already highlighted
+  block = block.next();
+  while (changed && block.isValid() && block.userState() != kUnhighlighted) {
+    if (budget-- <= 0) {
+      m_propagateFrom = block.blockNumber();
+      m_propagateTimer->start();
+      return;
+    }
+    changed = highlightBlock(block);
+    block = block.next();
+  }
+}
+
+void SyntaxHighlighter::propagate() {
+  if (!m_editor || m_propagateFrom < 0)
+    return;
+
+  QElapsedTimer slice;
+  slice.start();
+  QTextBlock block = m_editor->document()->findBlockByNumber(m_propagateFrom);
+  m_propagateFrom = -1;
+  while (block.isValid() && block.userState() != kUnhighlighted) {
+    if (!highlightBlock(block))
+      return;
+    block = block.next();
+    if (slice.elapsed() >= kSliceMillis && block.isValid()) {
+      m_propagateFrom = block.blockNumber();
+      m_propagateTimer->start();
+      return;
+    }
+  }
+}
+
+void SyntaxHighlighter::scheduleVisible() {
+  if (m_editor) {
+    m_visibleTimer->start();
+  }
+}
+
+void SyntaxHighlighter::highlightVisible() {
+  if (!m_editor || !m_rules)
+    return;
+
+  QTextDocument *doc = m_editor->document();
+  const QRect rect = m_editor->viewport()->rect();
+  QTextBlock block = m_editor->cursorForPosition(rect.topLeft()).block();
+  const QTextBlock last = m_editor->cursorForPosition(rect.bottomRight()).block();
+  if (!block.isValid())
+    return;
+
+  // Settle the state of the first visible block from a bounded stretch
+  // above it
+  if (block.userState() == kUnhighlighted) {
+    QTextBlock start = block;
+    for (int i = 0; i < kLookbackBlocks; ++i) {
+      const QTextBlock previous = start.previous();
+      if (!previous.isValid() || previous.userState() != kUnhighlighted)
+        break;
+      start = previous;
+    }
+    for (; start != block; start = start.next()) {
+      highlightBlock(start);
+    }
+  }
+
+  const int lastNumber = last.isValid() ? last.blockNumber()
+                                        : doc->blockCount() - 1;
+  bool changed = false;
+  for (; block.isValid() && block.blockNumber() <= lastNumber;
+       block = block.next()) {
+    // Visible blocks already highlighted are current unless a state change
+    // reaches them from above
+    if (block.userState() == kUnhighlighted || changed) {
+      changed = highlightBlock(block);
+    }
+  }
+
+  if (changed && block.isValid() && block.userState() != kUnhighlighted) {
+    m_propagateFrom = block.blockNumber();
+    m_propagateTimer->start();
+  }
+}
@@ -0,0 +1,67 @@
+#ifndef SYNTAXHIGHLIGHTER_H
+#define SYNTAXHIGHLIGHTER_H
+
+#include "highlightrules.h"
+
+#include <QObject>
+#include <QPointer>
+#include <QTextCharFormat>
+#include <QTextEdit>
+#include <QVector>
+
+#include <memory>
+
+class QTextBlock;
+class QTimer;
+
+/**
+ * Applies HighlightRules to the blocks of an editor's document.
+ *
+ * Unlike QSyntaxHighlighter, nothing is highlighted up front: blocks are
+ * highlighted when they scroll into view, and an edit re-highlights the
+ * touched blocks plus the following ones until their end state matches
+ * what it was before. Each block's end state is kept in its userState(),
+ * with -1 meaning "not highlighted yet". Formats go into the block layouts
+ * only, so they never touch the document, its undo stack or the modified
+ * flag.
+ */
+class SyntaxHighlighter : public QObject {
+  Q_OBJECT
+
+public:
+  explicit SyntaxHighlighter(QObject *parent = nullptr);
+  ~SyntaxHighlighter() override;
+
+  // Start highlighting editor with rules; null rules turn highlighting off.
+  // Meant for freshly loaded content, whose blocks are all unhighlighted.
+  void attach(QTextEdit *editor, std::unique_ptr<HighlightRules> rules);
+  // Stop following the editor, e.g. before its content is replaced
+  void detach();
+
+  const HighlightRules *rules() const { return m_rules.get(); }
+
+protected:
+  bool eventFilter(QObject *watched, QEvent *event) override;
+
+private Q_SLOTS:
+  void onContentsChange(int position, int charsRemoved, int charsAdded);
+  void scheduleVisible();
+  void highlightVisible();
+  void propagate();
+
+private:
+  // Highlights block from the state of the block before it; returns true
+  // if its end state changed
+  bool highlightBlock(QTextBlock &block);
+  void setupFormats();
+
+  QPointer<QTextEdit> m_editor;
+  std::unique_ptr<HighlightRules> m_rules;
+  QVector<QTextCharFormat> m_formats;
+
+  QTimer *m_visibleTimer;
+  QTimer *m_propagateTimer;
+  int m_propagateFrom = -1; // block number, -1 when nothing is pending
+};
+
+#endif // SYNTAXHIGHLIGHTER_H
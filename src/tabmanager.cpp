@@ -0,0 +1,92 @@
+#include "tabmanager.h"
+#include "documenttab.h"
+#include "sessionmanager.h"
+
+#include <QTimer>
+#include <QVector>
+
+#include <KConfigGroup>
+#include <KSharedConfig>
+
+#include <algorithm>
+
+TabManager::TabManager(SessionManager *sessionManager, QObject *parent)
+    : QObject(parent), m_sessionManager(sessionManager),
+      m_checkTimer(new QTimer(this)) {
+  m_clock.start();
+
+  KConfigGroup group(KSharedConfig::openConfig(), QStringLiteral("Memory"));
+  setBudget(group.readEntry("TabMemoryBudgetMB", 1024) * qint64(1024 * 1024));
+
+  // Tabs grow while being edited, so re-check the budget periodically
+  m_checkTimer->setInterval(60 * 1000);
+  connect(m_checkTimer, &QTimer::timeout, this, &TabManager::enforceBudget);
+  m_checkTimer->start();
+}
+
+void TabManager::addTab(DocumentTab *tab) {
+  m_lastAccess.insert(tab, m_clock.elapsed());
+}
+
+void TabManager::removeTab(DocumentTab *tab) { m_lastAccess.remove(tab); }
+
+void TabManager::activate(DocumentTab *tab) {
+  if (!tab)
+    return;
+
+  m_activeTab = tab;
+  m_lastAccess.insert(tab, m_clock.elapsed());
+
+  if (tab->isHibernated()) {
+    m_sessionManager->rehydrateTab(tab);
+    enforceBudget();
+  }
+}
+
+void TabManager::setBudget(qint64 bytes) {
+  m_budget = qMax<qint64>(0, bytes);
+}
+
+qint64 TabManager::totalMemory() const {
+  qint64 total = 0;
+  for (auto it = m_lastAccess.cbegin(); it != m_lastAccess.cend(); ++it) {
+    total += it.key()->estimatedMemory();
+  }
+  return total;
+}
+
+void TabManager::enforceBudget() {
+  if (m_budget <= 0)
+    return;
+
+  qint64 total = 0;
+  QVector<DocumentTab *> candidates;
+  for (auto it = m_lastAccess.cbegin(); it != m_lastAccess.cend(); ++it) {
+    DocumentTab *tab = it.key();
+    // Hibernated tabs still hold their compressed undo history
+    total += tab->estimatedMemory();
+    if (tab->isHibernated())
+      continue;
+    // A paste still inserting slices would lose the rest
+    if (tab != m_activeTab && tab->canHibernate())
+      candidates.append(tab);
+  }
+
+  if (total <= m_budget)
+    return;
+
+  // Least recently used first
+  std::sort(candidates.begin(), candidates.end(),
+            [this](DocumentTab *a, DocumentTab *b) {
+              return m_lastAccess.value(a) < m_lastAccess.value(b);
+            });
+
+  for (DocumentTab *tab : std::as_const(candidates)) {
+    if (total <= m_budget)
+      break;
+    qint64 size = tab->estimatedMemory();
+    if (m_sessionManager->hibernateTab(tab)) {
+      total -= size - tab->estimatedMemory();
+    }
+  }
+}
@@ -0,0 +1,51 @@
+#ifndef TABMANAGER_H
+#define TABMANAGER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+
+class DocumentTab;
+class SessionManager;
+class QTimer;
+
+/**
+ * Keeps the memory used by open tabs under a global budget.
+ *
+ * Tracks when each tab was last activated. Once the estimated memory of all
+ * live tabs exceeds the budget, the least recently used ones are backed up
+ * through SessionManager and hibernated; they are rehydrated on activation.
+ */
+class TabManager : public QObject {
+  Q_OBJECT
+
+public:
+  explicit TabManager(SessionManager *sessionManager,
+                      QObject *parent = nullptr);
+
+  void addTab(DocumentTab *tab);
+  void removeTab(DocumentTab *tab);
+
+  // Mark a tab as used now, rehydrating it if it was hibernated
+  void activate(DocumentTab *tab);
+
+  // Memory budget in bytes (0 disables hibernation)
+  qint64 budget() const { return m_budget; }
+  void setBudget(qint64 bytes);
+
+  qint64 totalMemory() const;
+
+public Q_SLOTS:
+  void enforceBudget();
+
+private:
+  SessionManager *m_sessionManager;
+  QHash<DocumentTab *, qint64> m_lastAccess;
+  QPointer<DocumentTab> m_activeTab;
+  QElapsedTimer m_clock;
+  QTimer *m_checkTimer;
+  qint64 m_budget = 0;
+};
+
+#endif // TABMANAGER_H
@@ -0,0 +1,315 @@
+#include "texteditor.h"
+#include "rtfhandler.h"
+#include "rtfmimedata.h"
+
+#include <QApplication>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMimeData>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTextDocumentFragment>
+#include <QTextFrame>
+#include <QTextList>
+#include <QThread>
+#include <QTimer>
+
+namespace {
+
+// Payloads below this many characters are left to QTextEdit
+const int kLargePaste = 256 * 1024;
+
+// Time spent inserting per event-loop turn
+const int kSliceMillis = 8;
+
+// Plain text is inserted in pieces of about this size, cut at line ends
+const int kPlainChunk = 64 * 1024;
+
+} // namespace
+
+TextEditor::TextEditor(QWidget *parent)
+    : QTextEdit(parent),
+      m_cancelled(std::make_shared<std::atomic<bool>>(false)) {
+  m_pool.setMaxThreadCount(1);
+
+  m_sliceTimer = new QTimer(this);
+  m_sliceTimer->setSingleShot(true);
+  m_sliceTimer->setInterval(0);
+  connect(m_sliceTimer, &QTimer::timeout, this, &TextEditor::insertSlice);
+}
+
+TextEditor::~TextEditor() {
+  m_cancelled->store(true);
+  m_pool.clear();
+  m_pool.waitForDone();
+  if (m_pasting) {
+    QApplication::restoreOverrideCursor();
+  }
+}
+
+QMimeData *TextEditor::createMimeDataFromSelection() const {
+  const QTextCursor cursor = textCursor();
+  if (!acceptRichText() || !cursor.hasSelection())
+    return QTextEdit::createMimeDataFromSelection();
+  return new RtfMimeData(cursor.selection());
+}
+
+void TextEditor::insertFromMimeData(const QMimeData *source) {
+  if (!source || m_pasting) {
+    QTextEdit::insertFromMimeData(source);
+    return;
+  }
+
+  // Qt's rich text, from our own copies or another Qt application, pastes
+  // losslessly and goes first; RTF from other applications goes straight
+  // through the RTF reader
+  const bool qtRichText =
+      acceptRichText() && source->hasFormat(RtfMimeData::qtRichTextMimeType());
+  if (acceptRichText() && !qtRichText &&
+      source->hasFormat(RtfMimeData::rtfMimeType())) {
+    const QByteArray rtf = source->data(RtfMimeData::rtfMimeType());
+    if (rtf.size() >= kLargePaste) {
+      convertInBackground(
+          [rtf](QTextDocument *doc) { RtfHandler::readRtf(rtf, doc); });
+      return;
+    }
+    QTextDocument doc;
+    if (RtfHandler::readRtf(rtf, &doc)) {
+      QTextCursor cursor = textCursor();
+      cursor.insertFragment(QTextDocumentFragment(&doc));
+      setTextCursor(cursor);
+      ensureCursorVisible();
+      return;
+    }
+  }
+
+  if (qtRichText || (acceptRichText() && source->hasHtml())) {
+    const QString html =
+        qtRichText ? QString::fromUtf8(
+                         source->data(RtfMimeData::qtRichTextMimeType()))
+                   : source->html();
+    if (html.size() < kLargePaste) {
+      QTextEdit::insertFromMimeData(source);
+      return;
+    }
+    convertInBackground([html](QTextDocument *doc) { doc->setHtml(html); });
+    return;
+  }
+
+  if (source->hasText()) {
+    QString text = source->text();
+    if (text.size() >= kLargePaste) {
+      // Inserted as is with the format at the cursor; only line ends are
+      // normalized, since QTextCursor starts a block at every '\r'
+      text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+      text.replace(QLatin1Char('\r'), QLatin1Char('\n'));
+      beginPaste();
+      m_plainText = text;
+      m_plainOffset = 0;
+      insertSlice();
+      return;
+    }
+  }
+
+  QTextEdit::insertFromMimeData(source);
+}
+
+void TextEditor::convertInBackground(
+    const std::function<void(QTextDocument *)> &load) {
+  beginPaste();
+  const quint64 generation = ++m_generation;
+  std::shared_ptr<std::atomic<bool>> cancelled = m_cancelled;
+  m_pool.start([this, load, cancelled, generation]() {
+    // A document private to this thread, until it may be handed over; the
+    // last owner can be either thread, so it is deleted in its own
+    std::shared_ptr<QTextDocument> doc(
+        new QTextDocument, [](QTextDocument *document) {
+          if (document->thread() == QThread::currentThread()) {
+            delete document;
+          } else {
+            document->deleteLater();
+          }
+        });
+    load(doc.get());
+    if (cancelled->load())
+      return;
+
+    // Blocks cannot carry tables and frames; such a document is handed
+    // over whole and inserted as one fragment
+    if (!doc->rootFrame()->childFrames().isEmpty()) {
+      doc->moveToThread(QCoreApplication::instance()->thread());
+      QMetaObject::invokeMethod(
+          this,
+          [this, doc, generation]() {
+            if (generation != m_generation || !m_pasting)
+              return;
+            m_pasteCursor.insertFragment(QTextDocumentFragment(doc.get()));
+            endPaste();
+          },
+          Qt::QueuedConnection);
+      return;
+    }
+
+    const QVector<PasteBlock> blocks = documentBlocks(*doc, *cancelled);
+    if (cancelled->load())
+      return;
+    QMetaObject::invokeMethod(
+        this,
+        [this, blocks, generation]() {
+          if (generation != m_generation || !m_pasting)
+            return;
+          m_blocks = blocks;
+          m_nextBlock = 0;
+          insertSlice();
+        },
+        Qt::QueuedConnection);
+  });
+}
+
+QVector<TextEditor::PasteBlock>
+TextEditor::documentBlocks(const QTextDocument &doc,
+                           const std::atomic<bool> &cancelled) {
+  QVector<PasteBlock> blocks;
+  blocks.reserve(doc.blockCount());
+  for (QTextBlock block = doc.begin(); block.isValid() && !cancelled.load();
+       block = block.next()) {
+    PasteBlock paste;
+    paste.text = block.text();
+    // Object indices refer to lists and frames of the source document
+    paste.blockFormat = block.blockFormat();
+    paste.blockFormat.setObjectIndex(-1);
+    paste.charFormat = block.charFormat();
+    paste.charFormat.setObjectIndex(-1);
+    if (QTextList *list = block.textList()) {
+      paste.listFormat = list->format();
+    }
+
+    for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+      const QTextFragment fragment = it.fragment();
+      if (!fragment.isValid())
+        continue;
+      QTextCharFormat format = fragment.charFormat();
+      format.setObjectIndex(-1);
+      if (!paste.runs.isEmpty() && paste.runs.last().format == format) {
+        paste.runs.last().length += fragment.length();
+      } else {
+        paste.runs.append(Run{fragment.length(), format});
+      }
+    }
+    blocks.append(paste);
+  }
+  return blocks;
+}
+
+void TextEditor::beginPaste() {
+  m_pasting = true;
+  Q_EMIT pasteStarted();
+
+  m_pasteCursor = textCursor();
+  if (m_pasteCursor.hasSelection()) {
+    m_pasteCursor.removeSelectedText();
+  }
+
+  // Typing into a half-inserted paste would interleave with it
+  setReadOnly(true);
+  QApplication::setOverrideCursor(Qt::BusyCursor);
+}
+
+void TextEditor::endPaste() {
+  m_sliceTimer->stop();
+  m_blocks.clear();
+  m_nextBlock = 0;
+  m_plainText.clear();
+  m_plainOffset = 0;
+
+  setReadOnly(false);
+  setTextCursor(m_pasteCursor);
+  ensureCursorVisible();
+  QApplication::restoreOverrideCursor();
+
+  m_pasting = false;
+  Q_EMIT pasteFinished();
+}
+
+void TextEditor::cancelPaste() {
+  if (!m_pasting)
+    return;
+
+  m_cancelled->store(true);
+  m_cancelled = std::make_shared<std::atomic<bool>>(false);
+  ++m_generation;
+  endPaste();
+}
+
+void TextEditor::insertBlock(const PasteBlock &block, bool first) {
+  // The first paragraph continues the block at the cursor, as with
+  // QTextCursor::insertFragment()
+  if (!first) {
+    m_pasteCursor.insertBlock(block.blockFormat, block.charFormat);
+  }
+
+  int offset = 0;
+  for (const Run &run : block.runs) {
+    if (run.format.isImageFormat()) {
+      for (int i = 0; i < run.length; ++i) {
+        m_pasteCursor.insertImage(run.format.toImageFormat());
+      }
+    } else {
+      m_pasteCursor.insertText(block.text.mid(offset, run.length), run.format);
+    }
+    offset += run.length;
+  }
+
+  // Consecutive list items with the same format join one list
+  if (!first && block.listFormat.isListFormat()) {
+    const QTextBlock previous = m_pasteCursor.block().previous();
+    QTextList *list = previous.isValid() ? previous.textList() : nullptr;
+    if (list && list->format() == block.listFormat) {
+      list->add(m_pasteCursor.block());
+    } else {
+      m_pasteCursor.createList(block.listFormat.toListFormat());
+    }
+  }
+}
+
+void TextEditor::insertSlice() {
+  if (!m_pasting)
+    return;
+
+  // One edit block per slice, so listeners see one change per slice
+  QElapsedTimer clock;
+  clock.start();
+  m_pasteCursor.beginEditBlock();
+  if (!m_plainText.isEmpty()) {
+    const int size = m_plainText.size();
+    while (m_plainOffset < size && clock.elapsed() < kSliceMillis) {
+      int end = qMin(m_plainOffset + kPlainChunk, size);
+      if (end < size) {
+        const int lineEnd =
+            m_plainText.lastIndexOf(QLatin1Char('\n'), end - 1);
+        if (lineEnd > m_plainOffset) {
+          end = lineEnd + 1;
+        } else if (m_plainText.at(end - 1).isHighSurrogate()) {
+          --end;
+        }
+      }
+      m_pasteCursor.insertText(
+          m_plainText.mid(m_plainOffset, end - m_plainOffset));
+      m_plainOffset = end;
+    }
+  } else {
+    while (m_nextBlock < m_blocks.size() && clock.elapsed() < kSliceMillis) {
+      insertBlock(m_blocks[m_nextBlock], m_nextBlock == 0);
+      ++m_nextBlock;
+    }
+  }
+  m_pasteCursor.endEditBlock();
+
+  const bool done = m_plainText.isEmpty() ? m_nextBlock >= m_blocks.size()
+                                          : m_plainOffset >= m_plainText.size();
+  if (done) {
+    endPaste();
+  } else {
+    m_sliceTimer->start();
+  }
+}
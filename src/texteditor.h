@@ -0,0 +1,94 @@
+#ifndef TEXTEDITOR_H
+#define TEXTEDITOR_H
+
+#include <QTextBlockFormat>
+#include <QTextCharFormat>
+#include <QTextCursor>
+#include <QTextEdit>
+#include <QThreadPool>
+#include <QVector>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class QTimer;
+
+/**
+ * The editor widget of a DocumentTab.
+ *
+ * Small pastes go through QTextEdit as usual. Large ones would block the
+ * event loop while Qt converts and inserts them, so HTML is converted on a
+ * worker into a list of blocks and plain text skips rich-text processing
+ * altogether; either is then inserted in short slices. Converted content
+ * with tables or frames is inserted in one piece instead, so that they
+ * keep their structure. The editor is read only until the paste is
+ * complete.
+ *
+ * Qt's rich text is pasted in preference to RTF, which is read through
+ * RtfHandler; copies offer both, rendered on request.
+ */
+class TextEditor : public QTextEdit {
+  Q_OBJECT
+
+public:
+  explicit TextEditor(QWidget *parent = nullptr);
+  ~TextEditor() override;
+
+  bool isPasting() const { return m_pasting; }
+
+  // Stop a paste in progress, keeping what has been inserted so far
+  void cancelPaste();
+
+Q_SIGNALS:
+  // Everything inserted in between belongs to one paste
+  void pasteStarted();
+  void pasteFinished();
+
+protected:
+  QMimeData *createMimeDataFromSelection() const override;
+  void insertFromMimeData(const QMimeData *source) override;
+
+private Q_SLOTS:
+  void insertSlice();
+
+private:
+  struct Run {
+    int length = 0;
+    QTextCharFormat format;
+  };
+
+  // A converted paragraph; the first one continues the block at the cursor
+  struct PasteBlock {
+    QString text;
+    QTextBlockFormat blockFormat;
+    QTextCharFormat charFormat;
+    QTextFormat listFormat; // invalid outside lists
+    QVector<Run> runs;
+  };
+
+  static QVector<PasteBlock>
+  documentBlocks(const QTextDocument &doc, const std::atomic<bool> &cancelled);
+
+  // Fill a document on the worker and insert its blocks in slices
+  void convertInBackground(const std::function<void(QTextDocument *)> &load);
+  void beginPaste();
+  void endPaste();
+  void insertBlock(const PasteBlock &block, bool first);
+
+  QThreadPool m_pool;
+  std::shared_ptr<std::atomic<bool>> m_cancelled;
+  quint64 m_generation = 0;
+
+  bool m_pasting = false;
+  QTextCursor m_pasteCursor;
+  QTimer *m_sliceTimer;
+
+  // What is left to insert: either converted blocks or plain text
+  QVector<PasteBlock> m_blocks;
+  int m_nextBlock = 0;
+  QString m_plainText;
+  int m_plainOffset = 0;
+};
+
+#endif // TEXTEDITOR_H
@@ -0,0 +1,111 @@
+#include "textsearch.h"
+
+#include <QElapsedTimer>
+
+namespace {
+
+// Matches are handed over when a batch is full or has waited this long, so
+// the first results show up quickly without flooding the GUI thread
+const int kBatchSize = 4096;
+const int kBatchMillis = 30;
+
+} // namespace
+
+QRegularExpression TextSearch::regularExpression(const Options &options) {
+  QRegularExpression::PatternOptions patternOptions =
+      QRegularExpression::MultilineOption |
+      QRegularExpression::UseUnicodePropertiesOption;
+  if (!options.caseSensitive) {
+    patternOptions |= QRegularExpression::CaseInsensitiveOption;
+  }
+  return QRegularExpression(options.pattern, patternOptions);
+}
+
+bool TextSearch::run(const QString &text, const Options &options,
+                     const std::atomic<bool> &cancelled,
+                     const BatchCallback &onBatch) {
+  if (options.pattern.isEmpty())
+    return false;
+
+  QVector<Match> batch;
+  QElapsedTimer sinceFlush;
+  sinceFlush.start();
+  auto add = [&](int position, int length) {
+    batch.append(Match{position, length});
+    if (batch.size() >= kBatchSize || sinceFlush.elapsed() >= kBatchMillis) {
+      onBatch(batch);
+      batch.clear();
+      sinceFlush.restart();
+    }
+  };
+
+  if (options.regex) {
+    const QRegularExpression re = regularExpression(options);
+    if (!re.isValid())
+      return false;
+
+    QRegularExpressionMatchIterator it = re.globalMatch(text);
+    while (it.hasNext()) {
+      if (cancelled.load(std::memory_order_relaxed))
+        return false;
+      const QRegularExpressionMatch match = it.next();
+      // Empty matches cannot be highlighted or replaced meaningfully
+      if (match.capturedLength() > 0) {
+        add(int(match.capturedStart()), int(match.capturedLength()));
+      }
+    }
+  } else {
+    const Qt::CaseSensitivity cs =
+        options.caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    const int length = options.pattern.size();
+    qsizetype from = 0;
+    while (true) {
+      if (cancelled.load(std::memory_order_relaxed))
+        return false;
+      const qsizetype found = text.indexOf(options.pattern, from, cs);
+      if (found < 0)
+        break;
+      add(int(found), length);
+      from = found + length;
+    }
+  }
+
+  if (!batch.isEmpty()) {
+    onBatch(batch);
+  }
+  return true;
+}
+
+QString TextSearch::replacementFor(const QString &text, const Match &match,
+                                   const QRegularExpression *re,
+                                   const QString &replacement) {
+  if (!re)
+    return replacement;
+
+  const QRegularExpressionMatch m = re->match(
+      text, match.position, QRegularExpression::NormalMatch,
+      QRegularExpression::AnchorAtOffsetMatchOption);
+  if (!m.hasMatch())
+    return replacement;
+
+  QString result;
+  result.reserve(replacement.size());
+  for (int i = 0; i < replacement.size(); ++i) {
+    const QChar ch = replacement[i];
+    if (ch == QLatin1Char('\\') && i + 1 < replacement.size()) {
+      const QChar next = replacement[i + 1];
+      if (next.isDigit()) {
+        result += m.captured(next.digitValue());
+        ++i;
+        continue;
+      }
+      if (next == QLatin1Char('\\')) {
+        result += next;
+        ++i;
+        continue;
+      }
+    }
+    result += ch;
+  }
+  return result;
+}
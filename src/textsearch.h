@@ -0,0 +1,46 @@
+#ifndef TEXTSEARCH_H
+#define TEXTSEARCH_H
+
+#include <QRegularExpression>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+#include <functional>
+
+/**
+ * Find/replace matching over a plain-text snapshot of a document.
+ *
+ * Runs on any thread: it only reads the snapshot it is given and reports
+ * matches in batches, checking the cancel flag between matches.
+ */
+class TextSearch {
+public:
+  struct Options {
+    QString pattern;
+    bool regex = false;
+    bool caseSensitive = false;
+  };
+
+  struct Match {
+    int position = 0;
+    int length = 0;
+  };
+
+  using BatchCallback = std::function<void(const QVector<Match> &)>;
+
+  // Returns false if the search was cancelled or the pattern is invalid
+  static bool run(const QString &text, const Options &options,
+                  const std::atomic<bool> &cancelled,
+                  const BatchCallback &onBatch);
+
+  static QRegularExpression regularExpression(const Options &options);
+
+  // Replacement text for a match. With a regular expression (re not null),
+  // \0..\9 in the replacement refer to its capture groups.
+  static QString replacementFor(const QString &text, const Match &match,
+                                const QRegularExpression *re,
+                                const QString &replacement);
+};
+
+#endif // TEXTSEARCH_H
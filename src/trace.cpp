@@ -0,0 +1,215 @@
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QSaveFile>
+#include <QThread>
+#include <QVector>
+
+namespace {
+
+struct Event {
+  std::atomic<const char *> name{nullptr};
+  std::atomic<qint64> start{0};
+  std::atomic<qint64> end{0};
+};
+
+// Written only by its own thread; the exporter reads it concurrently and
+// drops whatever may have been overwritten meanwhile
+struct Ring {
+  int tid = 0;
+  QString threadName;
+  std::atomic<quint64> written{0};
+  std::atomic<quint64> clearedAt{0};
+  std::atomic<bool> finished{false}; // free for the next new thread
+  Event events[Trace::kRingSize];
+};
+
+// Rings outlive their threads, so that spans of finished workers can still
+// be exported until a new thread takes the ring over. Pools replace idle
+// threads all the time, so there are only as many rings as threads ever
+// ran at once.
+QMutex s_ringsMutex;
+QVector<Ring *> s_rings;
+int s_lastTid = 0;
+
+thread_local Ring *t_ring = nullptr;
+
+// Hands the ring back when its thread exits
+struct RingRelease {
+  Ring *ring = nullptr;
+  ~RingRelease() {
+    t_ring = nullptr;
+    if (ring)
+      ring->finished.store(true, std::memory_order_release);
+  }
+};
+
+Ring *registerThread() {
+  QString threadName;
+  QThread *thread = QThread::currentThread();
+  QCoreApplication *app = QCoreApplication::instance();
+  if (app && thread == app->thread()) {
+    threadName = QStringLiteral("main");
+  } else {
+    threadName = thread->objectName();
+  }
+
+  QMutexLocker locker(&s_ringsMutex);
+  Ring *ring = nullptr;
+  for (Ring *candidate : std::as_const(s_rings)) {
+    if (candidate->finished.load(std::memory_order_acquire)) {
+      ring = candidate;
+      break;
+    }
+  }
+  if (ring) {
+    // The spans of the finished thread go with it
+    ring->clearedAt.store(ring->written.load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+    ring->finished.store(false, std::memory_order_relaxed);
+  } else {
+    ring = new Ring;
+    s_rings.append(ring);
+  }
+  ring->tid = ++s_lastTid;
+  ring->threadName = threadName.isEmpty()
+                         ? QStringLiteral("thread %1").arg(ring->tid)
+                         : threadName;
+  locker.unlock();
+
+  static thread_local RingRelease release;
+  release.ring = ring;
+  return ring;
+}
+
+} // namespace
+
+std::atomic<bool> Trace::s_enabled{false};
+
+void Trace::setEnabled(bool enabled) {
+  if (enabled) {
+    now(); // start the clock
+  }
+  s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+qint64 Trace::now() {
+  static const QElapsedTimer clock = [] {
+    QElapsedTimer timer;
+    timer.start();
+    return timer;
+  }();
+  return clock.nsecsElapsed();
+}
+
+void Trace::record(const char *name, qint64 start, qint64 end) {
+  Ring *ring = t_ring;
+  if (!ring) {
+    ring = t_ring = registerThread();
+  }
+  const quint64 index = ring->written.load(std::memory_order_relaxed);
+  Event &event = ring->events[index % kRingSize];
+  event.name.store(name, std::memory_order_relaxed);
+  event.start.store(start, std::memory_order_relaxed);
+  event.end.store(end, std::memory_order_relaxed);
+  ring->written.store(index + 1, std::memory_order_release);
+}
+
+void Trace::clear() {
+  QMutexLocker locker(&s_ringsMutex);
+  for (Ring *ring : std::as_const(s_rings)) {
+    ring->clearedAt.store(ring->written.load(std::memory_order_acquire),
+                          std::memory_order_relaxed);
+  }
+}
+
+int Trace::eventCount() {
+  QMutexLocker locker(&s_ringsMutex);
+  quint64 count = 0;
+  for (Ring *ring : std::as_const(s_rings)) {
+    const quint64 written = ring->written.load(std::memory_order_acquire);
+    const quint64 cleared = ring->clearedAt.load(std::memory_order_relaxed);
+    count += qMin<quint64>(written - cleared, kRingSize);
+  }
+  return int(count);
+}
+
+QByteArray Trace::toChromeJson() {
+  const qint64 pid = QCoreApplication::applicationPid();
+  QJsonArray events;
+
+  QMutexLocker locker(&s_ringsMutex);
+  for (Ring *ring : std::as_const(s_rings)) {
+    QJsonObject threadName;
+    threadName.insert(QStringLiteral("name"), QStringLiteral("thread_name"));
+    threadName.insert(QStringLiteral("ph"), QStringLiteral("M"));
+    threadName.insert(QStringLiteral("pid"), pid);
+    threadName.insert(QStringLiteral("tid"), ring->tid);
+    threadName.insert(QStringLiteral("args"),
+                      QJsonObject{{QStringLiteral("name"), ring->threadName}});
+    events.append(threadName);
+
+    const quint64 end = ring->written.load(std::memory_order_acquire);
+    quint64 begin = ring->clearedAt.load(std::memory_order_relaxed);
+    if (end - begin > quint64(kRingSize)) {
+      begin = end - kRingSize;
+    }
+
+    struct Copy {
+      quint64 index;
+      const char *name;
+      qint64 start;
+      qint64 end;
+    };
+    QVector<Copy> copies;
+    copies.reserve(int(end - begin));
+    for (quint64 i = begin; i < end; ++i) {
+      const Event &event = ring->events[i % kRingSize];
+      copies.append({i, event.name.load(std::memory_order_relaxed),
+                     event.start.load(std::memory_order_relaxed),
+                     event.end.load(std::memory_order_relaxed)});
+    }
+
+    // Slots the thread reached again while they were copied, including the
+    // one it may be writing right now
+    const quint64 after = ring->written.load(std::memory_order_acquire);
+    quint64 firstIntact = begin;
+    if (after != end && after + 1 > quint64(kRingSize)) {
+      firstIntact = after + 1 - kRingSize;
+    }
+
+    for (const Copy &copy : std::as_const(copies)) {
+      if (copy.index < firstIntact || !copy.name)
+        continue;
+      QJsonObject event;
+      event.insert(QStringLiteral("name"), QLatin1String(copy.name));
+      event.insert(QStringLiteral("cat"), QStringLiteral("knotepad"));
+      event.insert(QStringLiteral("ph"), QStringLiteral("X"));
+      event.insert(QStringLiteral("ts"), double(copy.start) / 1000.0);
+      event.insert(QStringLiteral("dur"),
+                   double(copy.end - copy.start) / 1000.0);
+      event.insert(QStringLiteral("pid"), pid);
+      event.insert(QStringLiteral("tid"), ring->tid);
+      events.append(event);
+    }
+  }
+  locker.unlock();
+
+  QJsonObject root;
+  root.insert(QStringLiteral("traceEvents"), events);
+  root.insert(QStringLiteral("displayTimeUnit"), QStringLiteral("ms"));
+  return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+bool Trace::writeChromeJson(const QString &path) {
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+  file.write(toChromeJson());
+  return file.commit();
+}
@@ -0,0 +1,73 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QByteArray>
+#include <QString>
+
+#include <atomic>
+
+/**
+ * Scoped timing spans for finding out where a slow startup, load or save
+ * spent its time.
+ *
+ * Each thread records into its own fixed-size ring, so recording takes no
+ * lock and keeps only the most recent spans. While tracing is off a span
+ * costs a single relaxed load. The rings are exported as Chrome trace
+ * event JSON, which chrome://tracing and ui.perfetto.dev open directly.
+ *
+ * Span names must be string literals; only the pointer is stored.
+ */
+class Trace {
+public:
+  // Spans kept per thread before the oldest are overwritten
+  static constexpr int kRingSize = 16384;
+
+  static bool isEnabled() {
+    return s_enabled.load(std::memory_order_relaxed);
+  }
+  static void setEnabled(bool enabled);
+
+  // Forget everything recorded so far, e.g. before a measurement
+  static void clear();
+
+  // Spans recorded so far on all threads
+  static int eventCount();
+
+  // Everything recorded, as a Chrome trace event document
+  static QByteArray toChromeJson();
+  static bool writeChromeJson(const QString &path);
+
+  class Span {
+  public:
+    explicit Span(const char *name)
+        : m_name(isEnabled() ? name : nullptr),
+          m_start(m_name ? now() : 0) {}
+    ~Span() {
+      if (m_name)
+        record(m_name, m_start, now());
+    }
+
+    Span(const Span &) = delete;
+    Span &operator=(const Span &) = delete;
+
+  private:
+    const char *m_name;
+    qint64 m_start;
+  };
+
+private:
+  // Nanoseconds since the first call
+  static qint64 now();
+  static void record(const char *name, qint64 start, qint64 end);
+
+  static std::atomic<bool> s_enabled;
+};
+
+#define KNOTEPAD_TRACE_CONCAT2(a, b) a##b
+#define KNOTEPAD_TRACE_CONCAT(a, b) KNOTEPAD_TRACE_CONCAT2(a, b)
+
+// Time the rest of the enclosing scope as one span
+#define KNOTEPAD_TRACE_SCOPE(name)                                             \
+  const Trace::Span KNOTEPAD_TRACE_CONCAT(traceSpan, __LINE__)(name)
+
+#endif // TRACE_H
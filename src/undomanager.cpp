@@ -0,0 +1,864 @@
+#include "undomanager.h"
+#include "blockdelta.h"
+
+#include <QDataStream>
+#include <QIODevice>
+#include <QStringList>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextFrame>
+#include <QTextList>
+#include <QTextTable>
+
+namespace {
+
+const qint64 kDefaultBudget = 4 * 1024 * 1024;
+
+// Typing within this interval of the previous keystroke merges into the
+// same command
+const int kCoalesceMillis = 1000;
+const int kMaxCoalescedBlocks = 16;
+
+// Most recent commands kept ready to apply; older ones are compressed
+const int kHotCommands = 32;
+
+// Bookkeeping per command and block beyond the text itself
+const qint64 kCommandOverhead = 96;
+const qint64 kBlockOverhead = 160;
+
+const quint32 kUndoMagic = 0x4B4E554E; // "KNUN"
+const quint32 kUndoVersion = 2;
+
+} // namespace
+
+UndoManager::UndoManager() : m_budget(kDefaultBudget) {}
+
+void UndoManager::setBudget(qint64 bytes) {
+  m_budget = qMax(qint64(0), bytes);
+  enforceBudget();
+}
+
+UndoManager::BlockContent UndoManager::capture(const QTextBlock &block) {
+  BlockContent content;
+  content.text = block.text();
+  content.blockFormat = block.blockFormat();
+  content.blockFormat.setObjectIndex(-1);
+  content.charFormat = block.charFormat();
+  if (QTextList *list = block.textList()) {
+    content.listFormat = list->format();
+  }
+
+  locate(block, content.frame, content.cell);
+  content.nested = content.frame != nullptr;
+
+  for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+    const QTextFragment fragment = it.fragment();
+    if (!fragment.isValid())
+      continue;
+    const QTextCharFormat format = fragment.charFormat();
+    if (!content.runs.isEmpty() && content.runs.last().format == format) {
+      content.runs.last().length += fragment.length();
+    } else {
+      content.runs.append(Run{fragment.length(), format});
+    }
+  }
+  return content;
+}
+
+void UndoManager::locate(const QTextBlock &block, const QTextFrame *&frame,
+                         int &cell) {
+  const QTextDocument *doc = block.document();
+  QTextFrame *innermost = doc->frameAt(block.position());
+  frame = innermost != doc->rootFrame() ? innermost : nullptr;
+  cell = -1;
+  if (QTextTable *table = qobject_cast<QTextTable *>(innermost)) {
+    const QTextTableCell tableCell = table->cellAt(block.position());
+    cell = tableCell.row() * table->columns() + tableCell.column();
+  }
+}
+
+bool UndoManager::isLocal(const Command &command) {
+  // Replacing blocks cannot rebuild tables and frames, so every block has
+  // to stay in the one cell or frame it was in
+  const BlockContent *reference = nullptr;
+  for (const QVector<BlockContent> *blocks :
+       {&command.before, &command.after}) {
+    for (const BlockContent &content : *blocks) {
+      if (!reference) {
+        reference = &content;
+      } else if (content.nested != reference->nested ||
+                 content.frame != reference->frame ||
+                 content.cell != reference->cell) {
+        return false;
+      }
+    }
+  }
+  // Compressed window blocks no longer know their cell
+  return !reference || !reference->nested || reference->frame;
+}
+
+qint64 UndoManager::blockBytes(const BlockContent &content) {
+  // Formats are shared with the document's format collection
+  return kBlockOverhead + qint64(content.text.size()) * 2 +
+         qint64(content.runs.size()) * qint64(sizeof(Run));
+}
+
+qint64 UndoManager::commandBytes(const Command &command) {
+  if (!command.packed.isEmpty())
+    return kCommandOverhead + command.packed.size();
+
+  qint64 bytes = kCommandOverhead;
+  for (const BlockContent &content : command.before) {
+    bytes += blockBytes(content);
+  }
+  for (const BlockContent &content : command.after) {
+    bytes += blockBytes(content);
+  }
+  return bytes;
+}
+
+int UndoManager::textLength(const QVector<BlockContent> &blocks) {
+  // Block separators count as one character each
+  int length = qMax(0, int(blocks.size()) - 1);
+  for (const BlockContent &content : blocks) {
+    length += content.text.size();
+  }
+  return length;
+}
+
+int UndoManager::changeEnd(const QVector<BlockContent> &result,
+                           const QVector<BlockContent> &replaced) {
+  QStringList resultTexts;
+  for (const BlockContent &content : result) {
+    resultTexts.append(content.text);
+  }
+  QStringList replacedTexts;
+  for (const BlockContent &content : replaced) {
+    replacedTexts.append(content.text);
+  }
+  const QString a = resultTexts.join(QLatin1Char('\n'));
+  const QString b = replacedTexts.join(QLatin1Char('\n'));
+
+  // The unchanged tail of both sides does not move the cursor
+  const int shorter = int(qMin(a.size(), b.size()));
+  int prefix = 0;
+  while (prefix < shorter && a[prefix] == b[prefix]) {
+    ++prefix;
+  }
+  int suffix = 0;
+  while (suffix < shorter - prefix &&
+         a[a.size() - 1 - suffix] == b[b.size() - 1 - suffix]) {
+    ++suffix;
+  }
+  return int(a.size()) - suffix;
+}
+
+void UndoManager::appendRuns(QVector<Run> &runs, const QVector<Run> &from,
+                             int start, int end) {
+  int position = 0;
+  for (const Run &run : from) {
+    const int begin = qMax(position, start);
+    const int stop = qMin(position + run.length, end);
+    if (begin < stop) {
+      if (!runs.isEmpty() && runs.last().format == run.format) {
+        runs.last().length += stop - begin;
+      } else {
+        runs.append(Run{stop - begin, run.format});
+      }
+    }
+    position += run.length;
+  }
+}
+
+bool UndoManager::removeInsertion(const QVector<BlockContent> &after,
+                                  int offset, int length,
+                                  QVector<BlockContent> &before) {
+  if (after.isEmpty())
+    return false;
+
+  // The inserted text has to cover every block separator it added, so that
+  // one block remains
+  const BlockContent &first = after.first();
+  const BlockContent &last = after.last();
+  const int lastStart = textLength(after) - int(last.text.size());
+  const int end = offset + length;
+  if (offset < 0 || length < 0 || offset > first.text.size() ||
+      end < lastStart || end > lastStart + last.text.size()) {
+    return false;
+  }
+
+  BlockContent content = first;
+  content.text = first.text.left(offset) + last.text.mid(end - lastStart);
+  content.runs.clear();
+  appendRuns(content.runs, first.runs, 0, offset);
+  appendRuns(content.runs, last.runs, end - lastStart, int(last.text.size()));
+  before = {content};
+  return true;
+}
+
+void UndoManager::writeBlocks(QDataStream &out,
+                              const QVector<BlockContent> &blocks) {
+  out << qint32(blocks.size());
+  for (const BlockContent &content : blocks) {
+    out << content.text << QTextFormat(content.blockFormat)
+        << QTextFormat(content.charFormat) << content.listFormat
+        << content.nested << qint32(content.runs.size());
+    for (const Run &run : content.runs) {
+      out << qint32(run.length) << QTextFormat(run.format);
+    }
+  }
+}
+
+bool UndoManager::readBlocks(QDataStream &in, QVector<BlockContent> &blocks) {
+  qint32 count = 0;
+  in >> count;
+  if (count < 0 || in.status() != QDataStream::Ok)
+    return false;
+  blocks.clear();
+  blocks.reserve(count);
+  for (qint32 i = 0; i < count; ++i) {
+    BlockContent content;
+    QTextFormat blockFormat;
+    QTextFormat charFormat;
+    qint32 runCount = 0;
+    in >> content.text >> blockFormat >> charFormat >> content.listFormat >>
+        content.nested >> runCount;
+    if (runCount < 0 || in.status() != QDataStream::Ok)
+      return false;
+    content.blockFormat = blockFormat.toBlockFormat();
+    content.charFormat = charFormat.toCharFormat();
+    content.runs.reserve(runCount);
+    for (qint32 r = 0; r < runCount; ++r) {
+      qint32 length = 0;
+      QTextFormat format;
+      in >> length >> format;
+      content.runs.append(Run{length, format.toCharFormat()});
+    }
+    blocks.append(content);
+  }
+  return in.status() == QDataStream::Ok;
+}
+
+QByteArray UndoManager::pack(const Command &command) {
+  if (!command.packed.isEmpty())
+    return command.packed;
+
+  QByteArray raw;
+  QDataStream out(&raw, QIODevice::WriteOnly);
+  writeBlocks(out, command.before);
+  writeBlocks(out, command.after);
+  return qCompress(raw, 1);
+}
+
+bool UndoManager::unpack(Command &command) {
+  if (command.packed.isEmpty())
+    return true;
+
+  const QByteArray raw = qUncompress(command.packed);
+  QDataStream in(raw);
+  QVector<BlockContent> before;
+  QVector<BlockContent> after;
+  if (!readBlocks(in, before) || !readBlocks(in, after) ||
+      before.size() != command.beforeBlocks ||
+      after.size() != command.afterBlocks) {
+    return false;
+  }
+
+  command.before = before;
+  command.after = after;
+  command.packed.clear();
+  return true;
+}
+
+void UndoManager::clearWindow() {
+  m_window = QVector<BlockContent>();
+  m_windowPacked.clear();
+  m_windowFirst = 0;
+  m_windowCount = 0;
+  m_windowBytes = 0;
+}
+
+bool UndoManager::windowCovers(int firstBlock, int count) const {
+  return firstBlock >= m_windowFirst &&
+         firstBlock + count <= m_windowFirst + m_windowCount;
+}
+
+bool UndoManager::windowBlock(int number, BlockContent &content) const {
+  if (!m_windowPacked.isEmpty() || !windowCovers(number, 1))
+    return false;
+  content = m_window[number - m_windowFirst];
+  return true;
+}
+
+void UndoManager::packWindow() {
+  QByteArray raw;
+  QDataStream out(&raw, QIODevice::WriteOnly);
+  writeBlocks(out, m_window);
+  m_windowPacked = qCompress(raw, 1);
+  m_window = QVector<BlockContent>();
+  m_windowBytes = m_windowPacked.size();
+}
+
+void UndoManager::unpackWindow() {
+  if (m_windowPacked.isEmpty())
+    return;
+
+  const QByteArray raw = qUncompress(m_windowPacked);
+  QDataStream in(raw);
+  QVector<BlockContent> blocks;
+  if (!readBlocks(in, blocks) || blocks.size() != m_windowCount) {
+    clearWindow();
+    return;
+  }
+  m_window = blocks;
+  m_windowPacked.clear();
+  m_windowBytes = 0;
+  for (const BlockContent &content : std::as_const(m_window)) {
+    m_windowBytes += blockBytes(content);
+  }
+}
+
+void UndoManager::reset(const QTextDocument *doc) {
+  clearHistory();
+  clearWindow();
+  m_blockCount = doc->blockCount();
+  m_characterCount = doc->characterCount();
+}
+
+void UndoManager::reattach(const QTextDocument *doc) {
+  if (doc->blockCount() != m_blockCount ||
+      doc->characterCount() != m_characterCount) {
+    reset(doc);
+    return;
+  }
+  clearWindow();
+}
+
+void UndoManager::prepare(const QTextDocument *doc, int firstBlock,
+                          int lastBlock) {
+  firstBlock = qMax(0, firstBlock);
+  lastBlock = qMin(lastBlock, doc->blockCount() - 1);
+  if (lastBlock < firstBlock)
+    return;
+
+  // A compressed window is kept whole while it covers the range, and not
+  // unpacked just to be cut down
+  if (!m_windowPacked.isEmpty()) {
+    if (windowCovers(firstBlock, lastBlock - firstBlock + 1))
+      return;
+    clearWindow();
+  }
+
+  // Keep what overlaps the range and capture only what is missing
+  const int windowEnd = m_windowFirst + int(m_window.size());
+  if (m_window.isEmpty() || firstBlock > windowEnd ||
+      lastBlock < m_windowFirst - 1) {
+    clearWindow();
+    m_windowFirst = firstBlock;
+  } else {
+    const int front = firstBlock - m_windowFirst;
+    for (int i = 0; i < front; ++i) {
+      m_windowBytes -= blockBytes(m_window[i]);
+    }
+    if (front > 0) {
+      m_window.remove(0, front);
+      m_windowFirst = firstBlock;
+    }
+    const int back = m_windowFirst + int(m_window.size()) - 1 - lastBlock;
+    for (int i = 0; i < back; ++i) {
+      m_windowBytes -= blockBytes(m_window[m_window.size() - 1 - i]);
+    }
+    if (back > 0) {
+      m_window.resize(m_window.size() - back);
+    }
+  }
+
+  if (firstBlock < m_windowFirst) {
+    QVector<BlockContent> front;
+    front.reserve(m_windowFirst - firstBlock);
+    QTextBlock block = doc->findBlockByNumber(firstBlock);
+    for (int i = firstBlock; i < m_windowFirst; ++i, block = block.next()) {
+      front.append(capture(block));
+      m_windowBytes += blockBytes(front.last());
+    }
+    m_window = front + m_window;
+    m_windowFirst = firstBlock;
+  }
+  QTextBlock block =
+      doc->findBlockByNumber(m_windowFirst + int(m_window.size()));
+  while (block.isValid() && block.blockNumber() <= lastBlock) {
+    m_window.append(capture(block));
+    m_windowBytes += blockBytes(m_window.last());
+    block = block.next();
+  }
+  m_windowCount = int(m_window.size());
+
+  // A large selection, or a whole document about to be replaced
+  if (m_windowBytes > m_budget) {
+    packWindow();
+  }
+  enforceBudget();
+}
+
+void UndoManager::followEdit(const QTextDocument *doc, const Command &command,
+                             int removedBlocks) {
+  // The changed blocks and their neighbours, which the next keystroke is
+  // most likely to touch; unchanged neighbours come from the old window
+  const int firstBlock = command.firstBlock;
+  QVector<BlockContent> window;
+  window.reserve(command.after.size() + 2);
+  int windowFirst = firstBlock;
+  BlockContent neighbour;
+  if (firstBlock > 0) {
+    windowFirst = firstBlock - 1;
+    window.append(windowBlock(windowFirst, neighbour)
+                      ? neighbour
+                      : capture(doc->findBlockByNumber(windowFirst)));
+  }
+  window += command.after;
+  const QTextBlock next =
+      doc->findBlockByNumber(firstBlock + int(command.after.size()));
+  if (next.isValid()) {
+    window.append(windowBlock(firstBlock + removedBlocks, neighbour)
+                      ? neighbour
+                      : capture(next));
+  }
+
+  m_window = window;
+  m_windowPacked.clear();
+  m_windowFirst = windowFirst;
+  m_windowCount = int(m_window.size());
+  m_windowBytes = 0;
+  for (const BlockContent &content : std::as_const(m_window)) {
+    m_windowBytes += blockBytes(content);
+  }
+}
+
+void UndoManager::release() {
+  clearWindow();
+  for (Command &command : m_undo) {
+    compact(command);
+  }
+  for (Command &command : m_redo) {
+    compact(command);
+  }
+  m_coalesce = false;
+  m_grouping = false;
+  m_groupStarted = false;
+}
+
+void UndoManager::clearHistory() {
+  m_undo.clear();
+  m_redo.clear();
+  m_historyBytes = 0;
+  m_coalesce = false;
+  m_groupStarted = false;
+}
+
+void UndoManager::record(const QTextDocument *doc, int firstBlock,
+                         int removedBlocks, int addedBlocks, int position,
+                         int charsRemoved, int charsAdded) {
+  const BlockDelta delta{firstBlock, removedBlocks, addedBlocks};
+  if (!delta.fits(m_blockCount) ||
+      m_blockCount + delta.blockCountChange() != doc->blockCount()) {
+    reset(doc);
+    return;
+  }
+
+  Command command;
+  command.firstBlock = firstBlock;
+  command.after.reserve(addedBlocks);
+  QTextBlock block = doc->findBlockByNumber(firstBlock);
+  for (int i = 0; i < addedBlocks && block.isValid();
+       ++i, block = block.next()) {
+    command.after.append(capture(block));
+  }
+  if (command.after.size() != addedBlocks) {
+    reset(doc);
+    return;
+  }
+
+  // The blocks as they were: captured ahead of the edit, or the blocks now
+  // without what was inserted
+  bool known = true;
+  if (windowCovers(firstBlock, removedBlocks)) {
+    unpackWindow();
+    command.before =
+        m_window.mid(firstBlock - m_windowFirst, removedBlocks);
+    known = command.before.size() == removedBlocks;
+  } else if (charsRemoved == 0 && removedBlocks == 1) {
+    known = removeInsertion(command.after,
+                            position - doc->findBlockByNumber(firstBlock)
+                                           .position(),
+                            charsAdded, command.before);
+  } else {
+    known = removedBlocks == 0;
+  }
+
+  followEdit(doc, command, removedBlocks);
+  m_blockCount = doc->blockCount();
+  m_characterCount = doc->characterCount();
+  if (m_applying)
+    return;
+  if (!known || !isLocal(command)) {
+    skipEdit(firstBlock, removedBlocks, addedBlocks);
+    return;
+  }
+  command.beforeBlocks = removedBlocks;
+  command.afterBlocks = addedBlocks;
+
+  for (const Command &redo : std::as_const(m_redo)) {
+    m_historyBytes -= redo.bytes;
+  }
+  m_redo.clear();
+
+  // Inside a group every edit extends the group's command
+  if (m_grouping) {
+    if (!m_groupStarted || !mergeIntoLast(command, removedBlocks, -1)) {
+      command.bytes = commandBytes(command);
+      m_historyBytes += command.bytes;
+      m_undo.append(command);
+      m_groupStarted = true;
+    }
+    enforceBudget();
+    return;
+  }
+
+  // Typing and deleting one character at a time extends the last command
+  // as long as the edits stay within the blocks it covers
+  const int delta = textLength(command.after) - textLength(command.before);
+  if (m_coalesce && qAbs(delta) == 1 && delta == m_lastDelta &&
+      m_lastEdit.elapsed() < kCoalesceMillis &&
+      mergeIntoLast(command, removedBlocks, kMaxCoalescedBlocks)) {
+    m_lastEdit.restart();
+    enforceBudget();
+    return;
+  }
+
+  command.bytes = commandBytes(command);
+  m_historyBytes += command.bytes;
+  m_undo.append(command);
+
+  m_coalesce = qAbs(delta) == 1;
+  m_lastDelta = delta;
+  m_lastEdit.restart();
+  enforceBudget();
+}
+
+bool UndoManager::mergeIntoLast(const Command &command, int removedBlocks,
+                                int maxBlocks) {
+  if (m_undo.isEmpty())
+    return false;
+
+  Command &last = m_undo.last();
+  const int offset = command.firstBlock - last.firstBlock;
+  const int addedBlocks = command.after.size();
+  if (!last.packed.isEmpty() || offset < 0 ||
+      offset + removedBlocks > last.after.size()) {
+    return false;
+  }
+  if (maxBlocks >= 0 &&
+      last.after.size() - removedBlocks + addedBlocks > maxBlocks) {
+    return false;
+  }
+
+  m_historyBytes -= last.bytes;
+  if (removedBlocks != addedBlocks) {
+    last.after.remove(offset, removedBlocks);
+    last.after.insert(offset, addedBlocks, BlockContent());
+  }
+  for (int i = 0; i < addedBlocks; ++i) {
+    last.after[offset + i] = command.after[i];
+  }
+  last.afterBlocks = int(last.after.size());
+  last.bytes = commandBytes(last);
+  m_historyBytes += last.bytes;
+  return true;
+}
+
+void UndoManager::skipEdit(int firstBlock, int removedBlocks,
+                           int addedBlocks) {
+  for (const Command &redo : std::as_const(m_redo)) {
+    m_historyBytes -= redo.bytes;
+  }
+  m_redo.clear();
+  m_coalesce = false;
+  m_groupStarted = false;
+
+  // Walk back through the history with the edit's range as it was before
+  // each command. Commands clear of it stay undoable, moved if they lie
+  // past it; from the first one it overlaps on, the history ends.
+  int editFirst = firstBlock;
+  int editEnd = firstBlock + removedBlocks;
+  for (int i = int(m_undo.size()) - 1; i >= 0; --i) {
+    Command &command = m_undo[i];
+    if (command.firstBlock + command.afterBlocks <= editFirst) {
+      editFirst += command.beforeBlocks - command.afterBlocks;
+      editEnd += command.beforeBlocks - command.afterBlocks;
+    } else if (command.firstBlock >= editEnd) {
+      command.firstBlock += addedBlocks - removedBlocks;
+    } else {
+      for (int j = 0; j <= i; ++j) {
+        m_historyBytes -= m_undo[j].bytes;
+      }
+      m_undo.remove(0, i + 1);
+      break;
+    }
+  }
+}
+
+void UndoManager::beginGroup() {
+  m_grouping = true;
+  m_groupStarted = false;
+  m_coalesce = false;
+}
+
+void UndoManager::endGroup() {
+  m_grouping = false;
+  m_groupStarted = false;
+}
+
+bool UndoManager::apply(QTextDocument *doc, int firstBlock,
+                        const QVector<BlockContent> &contents,
+                        const QVector<BlockContent> &replaced,
+                        int &cursorPosition) {
+  const int count = replaced.size();
+  if (!doc || count < 1 || contents.isEmpty() ||
+      firstBlock + count > doc->blockCount()) {
+    return false;
+  }
+
+  // The history only applies to the text it was recorded against, within
+  // one cell or frame
+  const QTextBlock first = doc->findBlockByNumber(firstBlock);
+  QTextBlock last = first;
+  const QTextFrame *firstFrame = nullptr;
+  int firstCell = -1;
+  for (int i = 0; i < count; ++i) {
+    if (i > 0) {
+      last = last.next();
+    }
+    if (!last.isValid() || last.text() != replaced[i].text)
+      return false;
+    const QTextFrame *frame = nullptr;
+    int cell = -1;
+    locate(last, frame, cell);
+    if (i == 0) {
+      firstFrame = frame;
+      firstCell = cell;
+    } else if (frame != firstFrame || cell != firstCell) {
+      return false;
+    }
+  }
+
+  m_applying = true;
+  QTextCursor cursor(doc);
+  cursor.beginEditBlock();
+  cursor.setPosition(first.position());
+  cursor.setPosition(last.position() + last.length() - 1,
+                     QTextCursor::KeepAnchor);
+  cursor.removeSelectedText();
+  if (QTextList *list = cursor.currentList()) {
+    list->remove(cursor.block());
+  }
+
+  for (int i = 0; i < contents.size(); ++i) {
+    const BlockContent &content = contents[i];
+    if (i == 0) {
+      cursor.setBlockFormat(content.blockFormat);
+      cursor.setBlockCharFormat(content.charFormat);
+    } else {
+      cursor.insertBlock(content.blockFormat, content.charFormat);
+    }
+
+    int offset = 0;
+    for (const Run &run : content.runs) {
+      cursor.insertText(content.text.mid(offset, run.length), run.format);
+      offset += run.length;
+    }
+    if (offset < content.text.size()) {
+      cursor.insertText(content.text.mid(offset), content.charFormat);
+    }
+
+    // Consecutive list items with the same format rejoin one list
+    if (content.listFormat.isListFormat()) {
+      const QTextBlock previous = cursor.block().previous();
+      QTextList *list = previous.isValid() ? previous.textList() : nullptr;
+      if (list && list->format() == content.listFormat) {
+        list->add(cursor.block());
+      } else {
+        cursor.createList(content.listFormat.toListFormat());
+      }
+    }
+  }
+  cursor.endEditBlock();
+  m_applying = false;
+
+  cursorPosition = doc->findBlockByNumber(firstBlock).position() +
+                   changeEnd(contents, replaced);
+  return true;
+}
+
+bool UndoManager::undo(QTextDocument *doc, int &cursorPosition) {
+  if (m_undo.isEmpty())
+    return false;
+
+  Command command = m_undo.takeLast();
+  m_historyBytes -= command.bytes;
+  if (!unpack(command) || !apply(doc, command.firstBlock, command.before,
+                                 command.after, cursorPosition)) {
+    clearHistory();
+    return false;
+  }
+
+  command.bytes = commandBytes(command);
+  m_historyBytes += command.bytes;
+  m_redo.append(command);
+  m_coalesce = false;
+  enforceBudget();
+  return true;
+}
+
+bool UndoManager::redo(QTextDocument *doc, int &cursorPosition) {
+  if (m_redo.isEmpty())
+    return false;
+
+  Command command = m_redo.takeLast();
+  m_historyBytes -= command.bytes;
+  if (!unpack(command) || !apply(doc, command.firstBlock, command.after,
+                                 command.before, cursorPosition)) {
+    clearHistory();
+    return false;
+  }
+
+  command.bytes = commandBytes(command);
+  m_historyBytes += command.bytes;
+  m_undo.append(command);
+  m_coalesce = false;
+  enforceBudget();
+  return true;
+}
+
+void UndoManager::compact(Command &command) {
+  if (!command.packed.isEmpty())
+    return;
+
+  m_historyBytes -= command.bytes;
+  command.packed = pack(command);
+  command.before = QVector<BlockContent>();
+  command.after = QVector<BlockContent>();
+  command.bytes = commandBytes(command);
+  m_historyBytes += command.bytes;
+}
+
+void UndoManager::enforceBudget() {
+  // Everything older than the hot commands is already compressed, so only
+  // the one that just dropped out of the window needs work
+  for (int i = int(m_undo.size()) - kHotCommands - 1;
+       i >= 0 && m_undo[i].packed.isEmpty(); --i) {
+    compact(m_undo[i]);
+  }
+  if (m_historyBytes + m_windowBytes <= m_budget)
+    return;
+
+  // Over budget: compress all but the commands next in line, and those too
+  // if that is not enough, e.g. after a large document was replaced; then
+  // drop the oldest
+  for (int i = 0; i < int(m_undo.size()) - 1; ++i) {
+    compact(m_undo[i]);
+  }
+  for (int i = 0; i < int(m_redo.size()) - 1; ++i) {
+    compact(m_redo[i]);
+  }
+  if (m_historyBytes + m_windowBytes > m_budget) {
+    if (!m_undo.isEmpty()) {
+      compact(m_undo.last());
+    }
+    if (!m_redo.isEmpty()) {
+      compact(m_redo.last());
+    }
+  }
+  while (m_historyBytes + m_windowBytes > m_budget && m_undo.size() > 1) {
+    m_historyBytes -= m_undo.first().bytes;
+    m_undo.removeFirst();
+  }
+  while (m_historyBytes + m_windowBytes > m_budget && m_redo.size() > 1) {
+    m_historyBytes -= m_redo.first().bytes;
+    m_redo.removeFirst();
+  }
+}
+
+QByteArray UndoManager::save() const {
+  if (m_undo.isEmpty() && m_redo.isEmpty())
+    return QByteArray();
+
+  QByteArray data;
+  QDataStream out(&data, QIODevice::WriteOnly);
+  out << kUndoMagic << kUndoVersion << qint32(m_blockCount)
+      << qint32(m_characterCount);
+  for (const QVector<Command> *stack : {&m_undo, &m_redo}) {
+    out << qint32(stack->size());
+    for (const Command &command : *stack) {
+      out << qint32(command.firstBlock) << qint32(command.beforeBlocks)
+          << qint32(command.afterBlocks) << pack(command);
+    }
+  }
+  return data;
+}
+
+bool UndoManager::restore(const QTextDocument *doc, const QByteArray &data) {
+  if (!doc || data.isEmpty())
+    return false;
+
+  QDataStream in(data);
+  quint32 magic = 0;
+  quint32 version = 0;
+  qint32 blockCount = 0;
+  qint32 characterCount = 0;
+  in >> magic >> version >> blockCount >> characterCount;
+  if (magic != kUndoMagic || version != kUndoVersion ||
+      blockCount != doc->blockCount() ||
+      characterCount != doc->characterCount()) {
+    return false;
+  }
+
+  // Commands stay compressed until they are applied
+  QVector<Command> stacks[2];
+  for (QVector<Command> &stack : stacks) {
+    qint32 count = 0;
+    in >> count;
+    if (count < 0 || in.status() != QDataStream::Ok)
+      return false;
+    stack.reserve(count);
+    for (qint32 i = 0; i < count; ++i) {
+      Command command;
+      qint32 firstBlock = 0;
+      qint32 beforeBlocks = 0;
+      qint32 afterBlocks = 0;
+      in >> firstBlock >> beforeBlocks >> afterBlocks >> command.packed;
+      if (firstBlock < 0 || beforeBlocks < 0 || afterBlocks < 0 ||
+          command.packed.isEmpty()) {
+        return false;
+      }
+      command.firstBlock = firstBlock;
+      command.beforeBlocks = beforeBlocks;
+      command.afterBlocks = afterBlocks;
+      command.bytes = commandBytes(command);
+      stack.append(command);
+    }
+  }
+  if (in.status() != QDataStream::Ok)
+    return false;
+
+  clearHistory();
+  m_undo = stacks[0];
+  m_redo = stacks[1];
+  for (const QVector<Command> *stack : {&m_undo, &m_redo}) {
+    for (const Command &command : *stack) {
+      m_historyBytes += command.bytes;
+    }
+  }
+  enforceBudget();
+  return true;
+}
@@ -0,0 +1,179 @@
+#ifndef UNDOMANAGER_H
+#define UNDOMANAGER_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <QTextBlockFormat>
+#include <QTextCharFormat>
+#include <QVector>
+
+class QDataStream;
+class QTextBlock;
+class QTextDocument;
+class QTextFrame;
+
+/**
+ * Undo history of one document, kept under a memory budget.
+ *
+ * Replaces the unbounded QTextDocument undo stack. Edits are recorded from
+ * the block-level deltas of DocumentTab::blocksChanged() as the content of
+ * the touched blocks before and after. QTextDocument reports changes only
+ * after they happened, so the "before" side comes either from a window of
+ * blocks captured ahead of the edit, around the cursor and selection, or,
+ * for edits that only insert, from taking the inserted text out of the
+ * blocks again. A window larger than the budget is kept compressed.
+ *
+ * Blocks inside a table or frame are replaced only within their own cell
+ * or frame. Edits that change such structure, or remove text outside the
+ * window, cannot be undone; the commands they do not overlap stay
+ * undoable.
+ *
+ * Runs of typing merge into one command. Older commands are compressed,
+ * and the oldest ones are dropped once the window plus the history exceed
+ * the budget; the most recent command is always kept, compressed if need
+ * be.
+ */
+class UndoManager {
+public:
+  UndoManager();
+
+  // Bytes of history kept before old commands are dropped
+  qint64 budget() const { return m_budget; }
+  void setBudget(qint64 bytes);
+
+  // Start over from the current content, forgetting the history
+  void reset(const QTextDocument *doc);
+
+  // Follow a document recreated with the same content; the history is kept
+  // if the document still matches it
+  void reattach(const QTextDocument *doc);
+
+  // Drop the window and compress the history, for hibernated tabs
+  void release();
+
+  // Capture blocks [firstBlock, lastBlock] so that the next edit of them can
+  // be undone
+  void prepare(const QTextDocument *doc, int firstBlock, int lastBlock);
+
+  // Record an edit as reported by DocumentTab::blocksChanged(), with the
+  // range QTextDocument::contentsChange() reported for it
+  void record(const QTextDocument *doc, int firstBlock, int removedBlocks,
+              int addedBlocks, int position, int charsRemoved,
+              int charsAdded);
+
+  bool canUndo() const { return !m_undo.isEmpty(); }
+  bool canRedo() const { return !m_redo.isEmpty(); }
+
+  // Apply the previous or next command; cursorPosition receives the end of
+  // the restored text
+  bool undo(QTextDocument *doc, int &cursorPosition);
+  bool redo(QTextDocument *doc, int &cursorPosition);
+
+  // Stop merging typing into the last command, e.g. after the cursor moved
+  void breakCoalescing() { m_coalesce = false; }
+
+  // Edits between these calls form one command, e.g. a paste inserted in
+  // slices
+  void beginGroup();
+  void endGroup();
+
+  // Whole history, compressed, for the session store
+  QByteArray save() const;
+  bool restore(const QTextDocument *doc, const QByteArray &data);
+
+  // Window plus history
+  qint64 memoryUsage() const { return m_windowBytes + m_historyBytes; }
+
+private:
+  struct Run {
+    int length = 0;
+    QTextCharFormat format;
+  };
+
+  struct BlockContent {
+    QString text;
+    QTextBlockFormat blockFormat; // without the list object
+    QTextCharFormat charFormat;
+    QTextFormat listFormat; // invalid outside lists
+    QVector<Run> runs;
+    bool nested = false; // inside a table or frame
+    // Frame and table cell of a nested block as captured; not kept in
+    // compressed data
+    const QTextFrame *frame = nullptr;
+    int cell = -1;
+  };
+
+  struct Command {
+    int firstBlock = 0;
+    int beforeBlocks = 0;
+    int afterBlocks = 0;
+    QVector<BlockContent> before;
+    QVector<BlockContent> after;
+    QByteArray packed; // before/after compressed; both empty then
+    qint64 bytes = 0;
+  };
+
+  static BlockContent capture(const QTextBlock &block);
+  static void locate(const QTextBlock &block, const QTextFrame *&frame,
+                     int &cell);
+  static bool isLocal(const Command &command);
+  static qint64 blockBytes(const BlockContent &content);
+  static qint64 commandBytes(const Command &command);
+  static int textLength(const QVector<BlockContent> &blocks);
+  static int changeEnd(const QVector<BlockContent> &result,
+                       const QVector<BlockContent> &replaced);
+  static void appendRuns(QVector<Run> &runs, const QVector<Run> &from,
+                         int start, int end);
+  static bool removeInsertion(const QVector<BlockContent> &after, int offset,
+                              int length, QVector<BlockContent> &before);
+
+  static void writeBlocks(QDataStream &out,
+                          const QVector<BlockContent> &blocks);
+  static bool readBlocks(QDataStream &in, QVector<BlockContent> &blocks);
+  static QByteArray pack(const Command &command);
+  static bool unpack(Command &command);
+
+  bool apply(QTextDocument *doc, int firstBlock,
+             const QVector<BlockContent> &contents,
+             const QVector<BlockContent> &replaced, int &cursorPosition);
+  bool mergeIntoLast(const Command &command, int removedBlocks,
+                     int maxBlocks);
+  bool windowCovers(int firstBlock, int count) const;
+  bool windowBlock(int number, BlockContent &content) const;
+  void followEdit(const QTextDocument *doc, const Command &command,
+                  int removedBlocks);
+  void packWindow();
+  void unpackWindow();
+  void clearWindow();
+  void skipEdit(int firstBlock, int removedBlocks, int addedBlocks);
+  void compact(Command &command);
+  void enforceBudget();
+  void clearHistory();
+
+  // Blocks [m_windowFirst, m_windowFirst + m_windowCount) as they are now;
+  // in m_windowPacked instead while they take more than the budget
+  QVector<BlockContent> m_window;
+  QByteArray m_windowPacked;
+  int m_windowFirst = 0;
+  int m_windowCount = 0;
+  qint64 m_windowBytes = 0;
+  QVector<Command> m_undo; // oldest first
+  QVector<Command> m_redo; // next redo last
+  qint64 m_historyBytes = 0;
+  qint64 m_budget;
+
+  // Shape of the document the history applies to, kept while released and
+  // used to check that deltas add up
+  int m_blockCount = 0;
+  int m_characterCount = 0;
+
+  bool m_applying = false;
+  bool m_coalesce = false;
+  bool m_grouping = false;
+  bool m_groupStarted = false;
+  int m_lastDelta = 0;
+  QElapsedTimer m_lastEdit;
+};
+
+#endif // UNDOMANAGER_H
@@ -0,0 +1,152 @@
+#include "wordcompleter.h"
+#include "completionindex.h"
+#include "documenttab.h"
+#include "wordtokenizer.h"
+
+#include <QAbstractItemView>
+#include <QCompleter>
+#include <QKeyEvent>
+#include <QScrollBar>
+#include <QStringListModel>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextEdit>
+#include <QTimer>
+
+namespace {
+
+const int kMinPrefixLength = 3;
+const int kMaxSuggestions = 8;
+
+} // namespace
+
+WordCompleter::WordCompleter(DocumentTab *tab, const CompletionIndex &index)
+    : QObject(tab), m_tab(tab), m_index(index) {
+  m_model = new QStringListModel(this);
+  m_completer = new QCompleter(m_model, this);
+  // The index already ranks by frequency; show its order as is
+  m_completer->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
+  m_completer->setMaxVisibleItems(kMaxSuggestions);
+  connect(m_completer, qOverload<const QString &>(&QCompleter::activated),
+          this, &WordCompleter::insertCompletion);
+  // While the popup is open it receives the keys and QCompleter forwards
+  // most of them straight to the editor. Filtering the popup (after
+  // QCompleter did) keeps Enter and Tab from reaching the editor as well.
+  m_completer->popup()->installEventFilter(this);
+
+  // Look up once the keystroke has been applied to the document
+  m_updateTimer = new QTimer(this);
+  m_updateTimer->setSingleShot(true);
+  m_updateTimer->setInterval(0);
+  connect(m_updateTimer, &QTimer::timeout, this, &WordCompleter::updatePopup);
+
+  connect(m_tab, &DocumentTab::rehydrated, this, &WordCompleter::attachEditor);
+  connect(m_tab, &DocumentTab::contentsReset, this,
+          &WordCompleter::attachEditor);
+  attachEditor();
+}
+
+void WordCompleter::attachEditor() {
+  QTextEdit *editor = m_tab->editor();
+  if (!editor || editor == m_editor)
+    return;
+
+  m_editor = editor;
+  m_completer->setWidget(editor);
+  editor->installEventFilter(this);
+
+  // Keys forwarded by the open popup bypass the editor's event filters
+  auto followEdits = [this]() {
+    if (m_completer->popup()->isVisible())
+      m_updateTimer->start();
+  };
+  connect(editor, &QTextEdit::textChanged, this, followEdits);
+  connect(editor, &QTextEdit::cursorPositionChanged, this, followEdits);
+}
+
+bool WordCompleter::eventFilter(QObject *watched, QEvent *event) {
+  if (event->type() != QEvent::KeyPress)
+    return QObject::eventFilter(watched, event);
+  QKeyEvent *key = static_cast<QKeyEvent *>(event);
+
+  QAbstractItemView *popup = m_completer->popup();
+  if (watched == popup) {
+    switch (key->key()) {
+    case Qt::Key_Enter:
+    case Qt::Key_Return:
+    case Qt::Key_Tab: {
+      const QModelIndex current = popup->currentIndex();
+      popup->hide();
+      if (current.isValid())
+        insertCompletion(current.data().toString());
+      return true;
+    }
+    case Qt::Key_Escape:
+    case Qt::Key_Backtab:
+      popup->hide();
+      return true;
+    default:
+      break;
+    }
+  } else if (watched == m_editor) {
+    const QString text = key->text();
+    if ((!text.isEmpty() && text.at(0).isPrint()) ||
+        key->key() == Qt::Key_Backspace) {
+      m_updateTimer->start();
+    }
+  }
+  return QObject::eventFilter(watched, event);
+}
+
+QString WordCompleter::currentPrefix() const {
+  const QTextCursor cursor = m_editor->textCursor();
+  if (cursor.hasSelection())
+    return QString();
+
+  const QString text = cursor.block().text();
+  const int end = cursor.positionInBlock();
+  if (end < text.size() && WordTokenizer::isWordChar(text.at(end)))
+    return QString();
+
+  int start = end;
+  while (start > 0 && WordTokenizer::isWordChar(text.at(start - 1)))
+    --start;
+  return text.mid(start, end - start);
+}
+
+void WordCompleter::updatePopup() {
+  if (!m_editor)
+    return;
+
+  const QString prefix = currentPrefix();
+  const QStringList words = prefix.size() >= kMinPrefixLength
+                                ? m_index.complete(prefix, kMaxSuggestions)
+                                : QStringList();
+  if (words.isEmpty()) {
+    m_completer->popup()->hide();
+    return;
+  }
+
+  m_model->setStringList(words);
+  m_completer->setCompletionPrefix(prefix);
+  QAbstractItemView *popup = m_completer->popup();
+  popup->setCurrentIndex(m_completer->completionModel()->index(0, 0));
+
+  QRect rect = m_editor->cursorRect();
+  rect.setWidth(popup->sizeHintForColumn(0) +
+                popup->verticalScrollBar()->sizeHint().width());
+  m_completer->complete(rect);
+}
+
+void WordCompleter::insertCompletion(const QString &completion) {
+  if (!m_editor)
+    return;
+
+  // Replace the typed prefix so the word keeps the suggested spelling
+  const QString prefix = currentPrefix();
+  QTextCursor cursor = m_editor->textCursor();
+  cursor.movePosition(QTextCursor::Left, QTextCursor::KeepAnchor,
+                      prefix.size());
+  cursor.insertText(completion);
+  m_editor->setTextCursor(cursor);
+}
@@ -0,0 +1,42 @@
+#ifndef WORDCOMPLETER_H
+#define WORDCOMPLETER_H
+
+#include <QObject>
+#include <QPointer>
+
+class CompletionIndex;
+class DocumentTab;
+class QCompleter;
+class QStringListModel;
+class QTextEdit;
+class QTimer;
+
+// Completion popup for the word being typed in a DocumentTab, offering the
+// most frequent matching words of all open tabs
+class WordCompleter : public QObject {
+  Q_OBJECT
+
+public:
+  WordCompleter(DocumentTab *tab, const CompletionIndex &index);
+
+protected:
+  bool eventFilter(QObject *watched, QEvent *event) override;
+
+private Q_SLOTS:
+  void attachEditor();
+  void updatePopup();
+  void insertCompletion(const QString &completion);
+
+private:
+  // The word characters left of the cursor, if the cursor ends a word
+  QString currentPrefix() const;
+
+  DocumentTab *m_tab;
+  const CompletionIndex &m_index;
+  QPointer<QTextEdit> m_editor;
+  QCompleter *m_completer;
+  QStringListModel *m_model;
+  QTimer *m_updateTimer;
+};
+
+#endif // WORDCOMPLETER_H
@@ -0,0 +1,56 @@
+#ifndef WORDTOKENIZER_H
+#define WORDTOKENIZER_H
+
+#include <QChar>
+#include <QString>
+
+/**
+ * Word splitting shared by search, statistics, completion and spell
+ * checking, so they all agree on what a word is.
+ *
+ * A word is a run of letters, digits, marks and underscores; an apostrophe
+ * between two letters ("don't") does not end it.
+ */
+class WordTokenizer {
+public:
+  static bool isWordChar(QChar ch) {
+    return ch.isLetterOrNumber() || ch.isMark() || ch == QLatin1Char('_');
+  }
+
+  // Calls f(start, length) for every word in text, in order
+  template <typename F> static void forEachWord(const QString &text, F f) {
+    const QChar *data = text.constData();
+    const int n = text.size();
+    int i = 0;
+    while (i < n) {
+      while (i < n && !isWordChar(data[i]))
+        ++i;
+      const int start = i;
+      while (i < n) {
+        if (isWordChar(data[i])) {
+          ++i;
+        } else if (isApostrophe(data[i]) && i > start && i + 1 < n &&
+                   data[i + 1].isLetter()) {
+          ++i;
+        } else {
+          break;
+        }
+      }
+      if (i > start)
+        f(start, i - start);
+    }
+  }
+
+  static int countWords(const QString &text) {
+    int count = 0;
+    forEachWord(text, [&count](int, int) { ++count; });
+    return count;
+  }
+
+private:
+  static bool isApostrophe(QChar ch) {
+    return ch == QLatin1Char('\'') || ch.unicode() == 0x2019;
+  }
+};
+
+#endif // WORDTOKENIZER_H